@@ -0,0 +1,23 @@
+// Per-instance attributes written by InstanceRenderer, for
+// InstanceRenderer::init(format, 4, ...). Define
+// INSTANCE_AFFINE for InstanceFormatAffine.
+
+#ifdef INSTANCE_AFFINE
+layout(location = 4) in vec4 aInstanceRow0;
+layout(location = 5) in vec4 aInstanceRow1;
+layout(location = 6) in vec4 aInstanceRow2;
+layout(location = 7) in uint aInstanceMaterial;
+
+mat4 instanceTransform()
+{
+    return transpose(mat4(aInstanceRow0, aInstanceRow1, aInstanceRow2, vec4(0.0, 0.0, 0.0, 1.0)));
+}
+#else
+layout(location = 4) in mat4 aInstanceTransform;
+layout(location = 8) in uint aInstanceMaterial;
+
+mat4 instanceTransform()
+{
+    return aInstanceTransform;
+}
+#endif
@@ -0,0 +1,73 @@
+// Direct lighting specialised by ShaderPermutations instead
+// of uniform switches:
+//   LIGHT_COUNT  lights shaded, a bucket at least as large as
+//                the scene's; the entries past the real count
+//                are uploaded with zero color
+//   NORMAL_MAP   perturb the normal with a tangent space map
+//   SHADOWS      multiply each light by lightShadow(i, position),
+//                which the including shader defines
+// Every loop has a constant trip count and light types are
+// blended rather than branched on, so a permutation contains
+// no run-time branches.
+
+#ifndef LIGHT_COUNT
+#define LIGHT_COUNT 1
+#endif
+#define MAX_LIGHTS LIGHT_COUNT
+#include "uniform_blocks.glsl"
+
+#ifdef NORMAL_MAP
+uniform sampler2D uNormalMap;
+
+vec3 surfaceNormal(vec3 normal, vec4 tangent, vec2 uv)
+{
+    vec3 bitangent = cross(normal, tangent.xyz) * tangent.w;
+    vec3 texel = texture(uNormalMap, uv).xyz * 2.0 - 1.0;
+    return normalize(mat3(tangent.xyz, bitangent, normal) * texel);
+}
+#else
+vec3 surfaceNormal(vec3 normal, vec4 tangent, vec2 uv)
+{
+    return normalize(normal);
+}
+#endif
+
+#ifdef SHADOWS
+float lightShadow(int light, vec3 position);
+#endif
+
+// Diffuse light reaching position from one light; color.w is
+// 0 for directional, 1 for point and 2 for spot lights
+vec3 lightContribution(Light light, vec3 position, vec3 normal)
+{
+    float positional = min(light.color.w, 1.0);
+    float spot = step(1.5, light.color.w);
+
+    vec3 toLight = mix(-light.direction.xyz, light.position.xyz - position, positional);
+    float distance = length(toLight);
+    vec3 l = toLight / max(distance, 1e-4);
+
+    float range = max(light.position.w, 1e-4);
+    float falloff = clamp(1.0 - distance / range, 0.0, 1.0);
+    falloff = mix(1.0, falloff * falloff, positional * step(1e-4, light.position.w));
+
+    float cosAngle = dot(-l, light.direction.xyz);
+    float cone = smoothstep(light.direction.w, mix(light.direction.w, 1.0, 0.1), cosAngle);
+    falloff *= mix(1.0, cone, spot);
+
+    return light.color.rgb * max(dot(normal, l), 0.0) * falloff;
+}
+
+vec3 directLighting(vec3 position, vec3 normal)
+{
+    vec3 result = vec3(0.0);
+    for(int i = 0; i < LIGHT_COUNT; ++i)
+    {
+        vec3 light = lightContribution(uLights[i], position, normal);
+#ifdef SHADOWS
+        light *= lightShadow(i, position);
+#endif
+        result += light;
+    }
+    return result;
+}
@@ -0,0 +1,59 @@
+// Decode for vertices packed by quantizeMesh(), bound with
+// setQuantizedAttributes(state, buffer, encoding, 0). Define
+// QUANTIZED_OCTAHEDRAL, QUANTIZED_1010102 or QUANTIZED_QTANGENT
+// to match the encoding. uPositionScale and uPositionBias are
+// QuantizedMesh::positionScale and positionBias.
+
+layout(location = 0) in vec3 aQuantizedPosition;
+layout(location = 2) in vec2 aQuantizedUV;
+
+uniform vec3 uPositionScale;
+uniform vec3 uPositionBias;
+
+vec3 quantizedPosition()
+{
+    return aQuantizedPosition * uPositionScale + uPositionBias;
+}
+
+vec2 quantizedUV()
+{
+    return aQuantizedUV;
+}
+
+#if defined(QUANTIZED_OCTAHEDRAL)
+layout(location = 1) in vec2 aQuantizedNormal;
+
+vec3 quantizedNormal()
+{
+    vec3 n = vec3(aQuantizedNormal, 1.0 - abs(aQuantizedNormal.x) - abs(aQuantizedNormal.y));
+    if(n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+#elif defined(QUANTIZED_QTANGENT)
+layout(location = 1) in vec4 aQuantizedFrame;
+
+vec3 quatRotate(vec4 q, vec3 v)
+{
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+vec3 quantizedNormal()
+{
+    return quatRotate(normalize(aQuantizedFrame), vec3(0.0, 0.0, 1.0));
+}
+
+// w is the bitangent sign: bitangent = cross(normal, tangent.xyz) * tangent.w
+vec4 quantizedTangent()
+{
+    return vec4(quatRotate(normalize(aQuantizedFrame), vec3(1.0, 0.0, 0.0)),
+                aQuantizedFrame.w < 0.0 ? -1.0 : 1.0);
+}
+#else
+layout(location = 1) in vec4 aQuantizedNormal;
+
+vec3 quantizedNormal()
+{
+    return normalize(aQuantizedNormal.xyz);
+}
+#endif
@@ -0,0 +1,25 @@
+// L2 spherical harmonic irradiance probes (see SHProbeGrid).
+// Nine RGB 3D textures, one per coefficient, with the cosine
+// convolution and basis constants already folded in, so the
+// lookup is one MAD per coefficient and channel.
+
+uniform sampler3D uSHProbes[9];
+uniform vec3 uSHProbeScale;
+uniform vec3 uSHProbeBias;
+
+// Irradiance / pi at a world position for a unit normal;
+// multiply by the albedo for diffuse light.
+vec3 shProbeIrradiance(vec3 worldPosition, vec3 n)
+{
+    vec3 uvw = worldPosition * uSHProbeScale + uSHProbeBias;
+    vec3 result = texture(uSHProbes[0], uvw).rgb;
+    result += texture(uSHProbes[1], uvw).rgb * n.y;
+    result += texture(uSHProbes[2], uvw).rgb * n.z;
+    result += texture(uSHProbes[3], uvw).rgb * n.x;
+    result += texture(uSHProbes[4], uvw).rgb * (n.x * n.y);
+    result += texture(uSHProbes[5], uvw).rgb * (n.y * n.z);
+    result += texture(uSHProbes[6], uvw).rgb * (3.0 * n.z * n.z - 1.0);
+    result += texture(uSHProbes[7], uvw).rgb * (n.x * n.z);
+    result += texture(uSHProbes[8], uvw).rgb * (n.x * n.x - n.y * n.y);
+    return max(result, vec3(0.0));
+}
@@ -0,0 +1,47 @@
+// Per-frame blocks written by UniformRing; layouts and
+// binding points match render/uniform_ring.h. Binding
+// qualifiers need GL 4.2 or ARB_shading_language_420pack;
+// on plain 3.3 use glUniformBlockBinding with the same
+// numbers. Define LIGHTS_STORAGE_BUFFER to read the lights
+// from a storage block of any length instead of a uniform
+// block of at most MAX_LIGHTS.
+
+#ifndef UNIFORM_BLOCKS_GLSL
+#define UNIFORM_BLOCKS_GLSL
+
+layout(std140, binding = 0) uniform CameraBlock
+{
+    mat4 uView;
+    mat4 uProjection;
+    mat4 uViewProjection;
+    vec4 uCameraPosition;
+    vec4 uViewport;         // width, height, 1 / width, 1 / height
+};
+
+// Matches SceneLight: position.w range (0 unbounded),
+// direction.w cosine of the spot angle, color.w type
+// (0 directional, 1 point, 2 spot)
+struct Light
+{
+    vec4 position;
+    vec4 direction;
+    vec4 color;
+};
+
+#ifdef LIGHTS_STORAGE_BUFFER
+layout(std430, binding = 2) readonly buffer LightBlock
+{
+    uvec4 uLightCount;
+    Light uLights[];
+};
+#else
+#ifndef MAX_LIGHTS
+#define MAX_LIGHTS 64
+#endif
+layout(std140, binding = 2) uniform LightBlock
+{
+    uvec4 uLightCount;
+    Light uLights[MAX_LIGHTS];
+};
+#endif
+#endif
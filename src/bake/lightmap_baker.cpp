@@ -0,0 +1,427 @@
+#include "bake/lightmap_baker.h"
+#include "core/parallel.h"
+
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+    const float Pi = glm::pi<float>();
+
+// Small per-path generator; gtc/random draws from the shared
+// std::rand() state, which is neither thread safe nor
+// reproducible across thread counts.
+    struct Random
+    {
+        uint32_t state;
+
+        explicit Random(uint32_t seed) : state(seed * 747796405u + 2891336453u) {}
+
+        float next()
+        {
+            state = state * 747796405u + 2891336453u;
+            uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+            return float((word >> 22u) ^ word) * (1.0f / 4294967296.0f);
+        }
+    };
+
+    struct TexelSample
+    {
+        uint32_t texel;
+        uint32_t triangle;
+        glm::vec3 position;
+        glm::vec3 normal;
+    };
+
+    void orthonormalBasis(const glm::vec3& n, glm::vec3& t, glm::vec3& b)
+    {
+        float sign = n.z >= 0.0f ? 1.0f : -1.0f;
+        float a = -1.0f / (sign + n.z);
+        float c = n.x * n.y * a;
+        t = glm::vec3(1.0f + sign * n.x * n.x * a, sign * c, -sign * n.x);
+        b = glm::vec3(c, sign + n.y * n.y * a, -n.y);
+    }
+
+    glm::vec3 cosineHemisphere(const glm::vec3& n, float u1, float u2)
+    {
+        glm::vec3 t, b;
+        orthonormalBasis(n, t, b);
+        float r = std::sqrt(u1);
+        float phi = 2.0f * Pi * u2;
+        return t * (r * std::cos(phi)) + b * (r * std::sin(phi)) + n * std::sqrt(glm::max(0.0f, 1.0f - u1));
+    }
+
+// Barycentrics of the point on a 2D triangle closest to p
+    glm::vec3 closestBarycentric(const glm::vec2& p, const glm::vec2& a, const glm::vec2& b, const glm::vec2& c)
+    {
+        glm::vec2 v0 = b - a, v1 = c - a, v2 = p - a;
+        float d00 = glm::dot(v0, v0), d01 = glm::dot(v0, v1), d11 = glm::dot(v1, v1);
+        float denom = d00 * d11 - d01 * d01;
+        if(std::fabs(denom) > 1e-12f)
+        {
+            float d20 = glm::dot(v2, v0), d21 = glm::dot(v2, v1);
+            float v = (d11 * d20 - d01 * d21) / denom;
+            float w = (d00 * d21 - d01 * d20) / denom;
+            if(v >= 0.0f && w >= 0.0f && v + w <= 1.0f)
+                return glm::vec3(1.0f - v - w, v, w);
+        }
+
+    // Outside: clamp onto the nearest edge
+        const glm::vec2* corners[3] = { &a, &b, &c };
+        glm::vec3 best(1.0f, 0.0f, 0.0f);
+        float bestDistance = FLT_MAX;
+        for(int e = 0; e < 3; ++e)
+        {
+            const glm::vec2& from = *corners[e];
+            const glm::vec2& to = *corners[(e + 1) % 3];
+            glm::vec2 edge = to - from;
+            float length2 = glm::dot(edge, edge);
+            float s = length2 > 0.0f ? glm::clamp(glm::dot(p - from, edge) / length2, 0.0f, 1.0f) : 0.0f;
+            glm::vec2 q = from + edge * s;
+            float distance = glm::dot(p - q, p - q);
+            if(distance < bestDistance)
+            {
+                bestDistance = distance;
+                best = glm::vec3(0.0f);
+                best[e] = 1.0f - s;
+                best[(e + 1) % 3] = s;
+            }
+        }
+        return best;
+    }
+
+    class PathTracer
+    {
+    public:
+        PathTracer(const BakeScene& scene, const TriangleBVH& bvh, const BakeSettings& settings, float epsilon)
+            : rays(0), m_scene(scene), m_bvh(bvh), m_settings(settings), m_epsilon(epsilon) {}
+
+        glm::vec3 shadeTexel(const TexelSample& sample, Random& random);
+
+        uint64_t rays;
+
+    private:
+        glm::vec3 directLight(const glm::vec3& position, const glm::vec3& normal);
+        glm::vec3 tracePath(Ray ray, Random& random);
+        glm::vec3 surfaceNormal(const RayHit& hit) const;
+
+        const BakeScene& m_scene;
+        const TriangleBVH& m_bvh;
+        const BakeSettings& m_settings;
+        float m_epsilon;
+    };
+
+    glm::vec3 PathTracer::surfaceNormal(const RayHit& hit) const
+    {
+        const uint32_t* tri = &m_scene.indices[hit.triangle * 3];
+        if(!m_scene.normals.empty())
+        {
+            glm::vec3 n = m_scene.normals[tri[0]] * (1.0f - hit.u - hit.v)
+                        + m_scene.normals[tri[1]] * hit.u
+                        + m_scene.normals[tri[2]] * hit.v;
+            if(glm::dot(n, n) > 0.0f)
+                return glm::normalize(n);
+        }
+        const std::vector<glm::vec3>& p = m_scene.positions;
+        return glm::normalize(glm::cross(p[tri[1]] - p[tri[0]], p[tri[2]] - p[tri[0]]));
+    }
+
+// Irradiance / pi from the point and directional lights
+    glm::vec3 PathTracer::directLight(const glm::vec3& position, const glm::vec3& normal)
+    {
+        glm::vec3 result(0.0f);
+        for(size_t i = 0; i < m_scene.lights.size(); ++i)
+        {
+            const BakeLight& light = m_scene.lights[i];
+            glm::vec3 toLight;
+            float distance, falloff;
+            if(light.directional)
+            {
+                toLight = -glm::normalize(light.direction);
+                distance = FLT_MAX;
+                falloff = 1.0f;
+            }
+            else
+            {
+                toLight = light.position - position;
+                float distance2 = glm::dot(toLight, toLight);
+                distance = std::sqrt(distance2);
+                toLight /= distance;
+                falloff = 1.0f / glm::max(distance2, 1e-8f);
+            }
+
+            float cosine = glm::dot(normal, toLight);
+            if(cosine <= 0.0f)
+                continue;
+
+            Ray shadow = { position + normal * m_epsilon, toLight, 0.0f, distance - m_epsilon * 2.0f };
+            ++rays;
+            if(m_bvh.occluded(shadow))
+                continue;
+            result += light.color * (cosine * falloff / Pi);
+        }
+        return result;
+    }
+
+// Radiance arriving along ray, estimated with next event
+// estimation towards the lights at every bounce
+    glm::vec3 PathTracer::tracePath(Ray ray, Random& random)
+    {
+        glm::vec3 radiance(0.0f);
+        glm::vec3 throughput(1.0f);
+        for(int bounce = 0; bounce < m_settings.maxBounces; ++bounce)
+        {
+            RayHit hit;
+            ++rays;
+            if(!m_bvh.intersect(ray, hit))
+            {
+                radiance += throughput * m_scene.skyColor;
+                break;
+            }
+
+            const BakeMaterial& material = m_scene.materials[m_scene.triangleMaterials[hit.triangle]];
+            if(bounce > 0 || !m_settings.indirectOnly)
+                radiance += throughput * material.emission;
+
+            glm::vec3 position = ray.origin + ray.direction * hit.t;
+            glm::vec3 normal = surfaceNormal(hit);
+            if(glm::dot(normal, ray.direction) > 0.0f)
+                normal = -normal;
+
+            throughput *= material.albedo;
+            radiance += throughput * directLight(position, normal);
+
+        // Russian roulette keeps the estimate unbiased while
+        // terminating dim paths early
+            if(bounce + 1 >= m_settings.rouletteDepth)
+            {
+                float survive = glm::min(glm::max(throughput.r, glm::max(throughput.g, throughput.b)), 0.95f);
+                if(random.next() >= survive)
+                    break;
+                throughput /= survive;
+            }
+
+            float u1 = random.next();
+            float u2 = random.next();
+            ray.origin = position + normal * m_epsilon;
+            ray.direction = cosineHemisphere(normal, u1, u2);
+            ray.tMin = 0.0f;
+            ray.tMax = FLT_MAX;
+        }
+        return radiance;
+    }
+
+// Stratified cosine-weighted hemisphere integration at a texel
+    glm::vec3 PathTracer::shadeTexel(const TexelSample& sample, Random& random)
+    {
+        int strata = glm::max(1, (int)std::sqrt((float)m_settings.samplesPerTexel));
+        float invStrata = 1.0f / strata;
+
+        glm::vec3 indirect(0.0f);
+        for(int sy = 0; sy < strata; ++sy)
+        {
+            for(int sx = 0; sx < strata; ++sx)
+            {
+                float u1 = (sx + random.next()) * invStrata;
+                float u2 = (sy + random.next()) * invStrata;
+                Ray ray = { sample.position + sample.normal * m_epsilon,
+                            cosineHemisphere(sample.normal, u1, u2), 0.0f, FLT_MAX };
+                indirect += tracePath(ray, random);
+            }
+        }
+        indirect /= float(strata * strata);
+
+        if(m_settings.indirectOnly)
+            return indirect;
+        return indirect + directLight(sample.position, sample.normal);
+    }
+
+// Copies covered texels into empty neighbours so bilinear
+// filtering at chart borders never picks up black
+    void dilate(Lightmap& lightmap, std::vector<uint8_t>& coverage, int passes)
+    {
+        for(int pass = 0; pass < passes; ++pass)
+        {
+            std::vector<uint8_t> next = coverage;
+            for(int y = 0; y < lightmap.height; ++y)
+            {
+                for(int x = 0; x < lightmap.width; ++x)
+                {
+                    int index = y * lightmap.width + x;
+                    if(coverage[index])
+                        continue;
+
+                    glm::vec3 sum(0.0f);
+                    int count = 0;
+                    for(int dy = -1; dy <= 1; ++dy)
+                    {
+                        for(int dx = -1; dx <= 1; ++dx)
+                        {
+                            int nx = x + dx, ny = y + dy;
+                            if(nx < 0 || ny < 0 || nx >= lightmap.width || ny >= lightmap.height)
+                                continue;
+                            int neighbour = ny * lightmap.width + nx;
+                            if(!coverage[neighbour])
+                                continue;
+                            sum += lightmap.texels[neighbour];
+                            ++count;
+                        }
+                    }
+                    if(count)
+                    {
+                        lightmap.texels[index] = sum / float(count);
+                        next[index] = 1;
+                    }
+                }
+            }
+            coverage.swap(next);
+        }
+    }
+}
+
+/**************************************************************
+ * defaultBakeSettings()
+ * --------------------
+ * Settings that give a clean preview bake in seconds.
+ *************************************************************/
+BakeSettings defaultBakeSettings()
+{
+    BakeSettings settings;
+    settings.samplesPerTexel = 64;
+    settings.maxBounces = 8;
+    settings.rouletteDepth = 3;
+    settings.indirectOnly = false;
+    settings.threadCount = hardwareThreadCount();
+    settings.seed = 1;
+    return settings;
+}
+
+/**************************************************************
+ * bakeLightmap()
+ * -------------
+ * Path traces every lightmap texel covered by the layout.
+ * Texels are first rasterised into world-space samples, then
+ * traced in parallel. Each texel seeds its own generator, so
+ * the result does not depend on the thread count.
+ *************************************************************/
+bool bakeLightmap(const BakeScene& scene, const LightmapLayout& layout,
+                  const BakeSettings& settings, Lightmap& lightmap, BakeStats* stats)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    size_t triangleCount = scene.indices.size() / 3;
+    if(layout.uvs.size() != triangleCount * 3 || scene.triangleMaterials.size() != triangleCount)
+        return false;
+    for(size_t i = 0; i < triangleCount; ++i)
+        if(scene.triangleMaterials[i] >= scene.materials.size())
+            return false;
+
+    TriangleBVH bvh;
+    bvh.build(scene.positions, scene.indices);
+
+// Offset rays relative to the scene size to avoid self hits
+    glm::vec3 sceneMin(FLT_MAX), sceneMax(-FLT_MAX);
+    for(size_t i = 0; i < scene.positions.size(); ++i)
+    {
+        sceneMin = glm::min(sceneMin, scene.positions[i]);
+        sceneMax = glm::max(sceneMax, scene.positions[i]);
+    }
+    float epsilon = glm::max(glm::length(sceneMax - sceneMin) * 1e-4f, 1e-5f);
+
+// Rasterise charts; a texel belongs to the nearest triangle
+// within half a texel diagonal of its centre
+    lightmap.width = layout.width;
+    lightmap.height = layout.height;
+    lightmap.texels.assign((size_t)layout.width * layout.height, glm::vec3(0.0f));
+
+    std::vector<float> texelDistance(lightmap.texels.size(), FLT_MAX);
+    std::vector<TexelSample> texelSamples(lightmap.texels.size());
+    glm::vec2 size((float)layout.width, (float)layout.height);
+    const float MaxDistance2 = 0.5f;
+
+    for(size_t t = 0; t < triangleCount; ++t)
+    {
+        glm::vec2 uv[3];
+        glm::vec3 p[3], n[3];
+        for(int c = 0; c < 3; ++c)
+        {
+            uv[c] = layout.uvs[t * 3 + c] * size;
+            uint32_t vertex = scene.indices[t * 3 + c];
+            p[c] = scene.positions[vertex];
+            n[c] = scene.normals.empty() ? glm::vec3(0.0f) : scene.normals[vertex];
+        }
+        glm::vec3 faceNormal = glm::cross(p[1] - p[0], p[2] - p[0]);
+        if(glm::dot(faceNormal, faceNormal) <= 0.0f)
+            continue;
+        faceNormal = glm::normalize(faceNormal);
+
+        glm::vec2 uvMin = glm::min(uv[0], glm::min(uv[1], uv[2]));
+        glm::vec2 uvMax = glm::max(uv[0], glm::max(uv[1], uv[2]));
+        int x0 = glm::max(0, (int)std::floor(uvMin.x) - 1);
+        int y0 = glm::max(0, (int)std::floor(uvMin.y) - 1);
+        int x1 = glm::min(layout.width - 1, (int)std::ceil(uvMax.x) + 1);
+        int y1 = glm::min(layout.height - 1, (int)std::ceil(uvMax.y) + 1);
+
+        for(int y = y0; y <= y1; ++y)
+        {
+            for(int x = x0; x <= x1; ++x)
+            {
+                glm::vec2 centre(x + 0.5f, y + 0.5f);
+                glm::vec3 bary = closestBarycentric(centre, uv[0], uv[1], uv[2]);
+                glm::vec2 q = uv[0] * bary.x + uv[1] * bary.y + uv[2] * bary.z;
+                float distance2 = glm::dot(centre - q, centre - q);
+                size_t texel = (size_t)y * layout.width + x;
+                if(distance2 > MaxDistance2 || distance2 >= texelDistance[texel])
+                    continue;
+
+                glm::vec3 normal = n[0] * bary.x + n[1] * bary.y + n[2] * bary.z;
+                if(glm::dot(normal, normal) <= 0.0f)
+                    normal = faceNormal;
+
+                texelDistance[texel] = distance2;
+                TexelSample& sample = texelSamples[texel];
+                sample.texel = (uint32_t)texel;
+                sample.triangle = (uint32_t)t;
+                sample.position = p[0] * bary.x + p[1] * bary.y + p[2] * bary.z;
+                sample.normal = glm::normalize(normal);
+            }
+        }
+    }
+
+    std::vector<TexelSample> samples;
+    std::vector<uint8_t> coverage(lightmap.texels.size(), 0);
+    for(size_t i = 0; i < texelSamples.size(); ++i)
+    {
+        if(texelDistance[i] == FLT_MAX)
+            continue;
+        samples.push_back(texelSamples[i]);
+        coverage[i] = 1;
+    }
+
+// Trace; chunks are small because texel cost varies a lot
+    std::atomic<uint64_t> rays(0);
+    parallelFor(0, samples.size(), 64, settings.threadCount, [&](size_t begin, size_t end)
+    {
+        PathTracer tracer(scene, bvh, settings, epsilon);
+        for(size_t i = begin; i < end; ++i)
+        {
+            Random random(samples[i].texel * 9781u + settings.seed * 6271u);
+            lightmap.texels[samples[i].texel] = tracer.shadeTexel(samples[i], random);
+        }
+        rays += tracer.rays;
+    });
+
+    dilate(lightmap, coverage, 2);
+
+    if(stats)
+    {
+        stats->texels = samples.size();
+        stats->rays = rays;
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return true;
+}
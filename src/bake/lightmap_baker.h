@@ -0,0 +1,87 @@
+#pragma once
+
+#include "bake/lightmap_unwrap.h"
+#include "bake/triangle_bvh.h"
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+/*************************************************************
+ * Bake Scene
+ * ----------
+ * Static geometry and lights handed to the baker. Normals are
+ * optional per-vertex normals; face normals are used when the
+ * array is empty. Lights with directional set shine along
+ * direction from infinitely far away, otherwise they are
+ * point lights with inverse square falloff.
+ ************************************************************/
+struct BakeMaterial
+{
+    glm::vec3 albedo;
+    glm::vec3 emission;
+};
+
+struct BakeLight
+{
+    glm::vec3 position;
+    glm::vec3 direction;
+    glm::vec3 color;
+    bool directional;
+};
+
+struct BakeScene
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> triangleMaterials;
+    std::vector<BakeMaterial> materials;
+    std::vector<BakeLight> lights;
+    glm::vec3 skyColor;
+};
+
+/*************************************************************
+ * Bake Settings
+ * -------------
+ * samplesPerTexel is rounded down to a square so the
+ * hemisphere can be stratified. Paths are cut by Russian
+ * roulette from rouletteDepth onwards and hard-capped at
+ * maxBounces. With indirectOnly the texel's own direct light
+ * is left out so it can stay dynamic at runtime.
+ ************************************************************/
+struct BakeSettings
+{
+    int samplesPerTexel;
+    int maxBounces;
+    int rouletteDepth;
+    bool indirectOnly;
+    unsigned threadCount;
+    uint32_t seed;
+};
+
+BakeSettings defaultBakeSettings();
+
+/*************************************************************
+ * Lightmap
+ * --------
+ * Linear HDR irradiance / pi per texel, i.e. what the shader
+ * multiplies with the surface albedo. Texels not covered by
+ * any chart are black.
+ ************************************************************/
+struct Lightmap
+{
+    int width;
+    int height;
+    std::vector<glm::vec3> texels;
+};
+
+struct BakeStats
+{
+    uint64_t texels;
+    uint64_t rays;
+    double seconds;
+};
+
+bool bakeLightmap(const BakeScene& scene, const LightmapLayout& layout,
+                  const BakeSettings& settings, Lightmap& lightmap, BakeStats* stats);
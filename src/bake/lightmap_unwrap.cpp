@@ -0,0 +1,128 @@
+#include "bake/lightmap_unwrap.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    struct Chart
+    {
+        glm::vec2 corners[3];   // in world units, min corner at the origin
+        glm::vec2 size;
+        uint32_t triangle;
+        int x, y, w, h;         // placement in texels, including padding
+    };
+
+// Flattens a triangle into 2D with its longest edge on the x axis
+    void flattenTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, Chart& chart)
+    {
+        const glm::vec3* v[3] = { &a, &b, &c };
+        float lengths[3] = { glm::length(b - a), glm::length(c - b), glm::length(a - c) };
+        int start = 0;
+        if(lengths[1] > lengths[start]) start = 1;
+        if(lengths[2] > lengths[start]) start = 2;
+
+        const glm::vec3& origin = *v[start];
+        glm::vec3 edge = *v[(start + 1) % 3] - origin;
+        glm::vec3 normal = glm::cross(edge, *v[(start + 2) % 3] - origin);
+        glm::vec3 xAxis = lengths[start] > 0.0f ? edge / lengths[start] : glm::vec3(1.0f, 0.0f, 0.0f);
+        glm::vec3 yAxis = glm::length(normal) > 0.0f ? glm::normalize(glm::cross(normal, xAxis)) : glm::vec3(0.0f);
+
+        glm::vec2 minCorner(0.0f), maxCorner(0.0f);
+        for(int i = 0; i < 3; ++i)
+        {
+            glm::vec3 d = *v[(start + i) % 3] - origin;
+            glm::vec2 p(glm::dot(d, xAxis), glm::dot(d, yAxis));
+            chart.corners[(start + i) % 3] = p;
+            minCorner = glm::min(minCorner, p);
+            maxCorner = glm::max(maxCorner, p);
+        }
+        for(int i = 0; i < 3; ++i)
+            chart.corners[i] -= minCorner;
+        chart.size = maxCorner - minCorner;
+    }
+
+// Shelf packs charts into a square of the given size, tallest first
+    bool packCharts(std::vector<Chart>& charts, float texelsPerUnit, int padding, int resolution)
+    {
+        int x = 0, y = 0, shelfHeight = 0;
+        for(size_t i = 0; i < charts.size(); ++i)
+        {
+            Chart& chart = charts[i];
+            chart.w = (int)std::ceil(chart.size.x * texelsPerUnit) + 1 + padding * 2;
+            chart.h = (int)std::ceil(chart.size.y * texelsPerUnit) + 1 + padding * 2;
+            if(chart.w > resolution)
+                return false;
+            if(x + chart.w > resolution)
+            {
+                x = 0;
+                y += shelfHeight;
+                shelfHeight = 0;
+            }
+            if(y + chart.h > resolution)
+                return false;
+            chart.x = x;
+            chart.y = y;
+            x += chart.w;
+            shelfHeight = std::max(shelfHeight, chart.h);
+        }
+        return true;
+    }
+}
+
+/**************************************************************
+ * unwrapLightmap()
+ * ---------------
+ * Gives every triangle its own chart in a square lightmap of
+ * the given resolution. Charts keep world-space proportions
+ * at a uniform texel density, which is lowered step by step
+ * until everything fits. Returns false if even the smallest
+ * density does not fit.
+ *************************************************************/
+bool unwrapLightmap(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+                    int resolution, int padding, LightmapLayout& layout)
+{
+    size_t triangleCount = indices.size() / 3;
+    std::vector<Chart> charts(triangleCount);
+    float totalArea = 0.0f;
+    for(size_t i = 0; i < triangleCount; ++i)
+    {
+        flattenTriangle(positions[indices[i * 3 + 0]], positions[indices[i * 3 + 1]],
+                        positions[indices[i * 3 + 2]], charts[i]);
+        charts[i].triangle = (uint32_t)i;
+        totalArea += charts[i].size.x * charts[i].size.y;
+    }
+
+    std::sort(charts.begin(), charts.end(), [](const Chart& a, const Chart& b)
+    {
+        return a.size.y > b.size.y;
+    });
+
+// Start from the density that would fill the map exactly and back off
+    float texelsPerUnit = totalArea > 0.0f ? std::sqrt(float(resolution) * resolution / totalArea) : 1.0f;
+    bool packed = false;
+    for(int attempt = 0; attempt < 64 && !packed; ++attempt)
+    {
+        packed = packCharts(charts, texelsPerUnit, padding, resolution);
+        if(!packed)
+            texelsPerUnit *= 0.9f;
+    }
+    if(!packed)
+        return false;
+
+    layout.width = resolution;
+    layout.height = resolution;
+    layout.texelsPerUnit = texelsPerUnit;
+    layout.uvs.resize(triangleCount * 3);
+
+// Corners sit on texel centres inside the padding border
+    glm::vec2 invSize(1.0f / resolution);
+    for(size_t i = 0; i < charts.size(); ++i)
+    {
+        const Chart& chart = charts[i];
+        glm::vec2 offset(chart.x + padding + 0.5f, chart.y + padding + 0.5f);
+        for(int c = 0; c < 3; ++c)
+            layout.uvs[chart.triangle * 3 + c] = (offset + chart.corners[c] * texelsPerUnit) * invSize;
+    }
+    return true;
+}
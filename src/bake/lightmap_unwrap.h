@@ -0,0 +1,24 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+/*************************************************************
+ * LightmapLayout
+ * --------------
+ * Lightmap UVs for an indexed triangle list. Every triangle
+ * gets its own chart, so uvs holds three entries per
+ * triangle (in the same order as the index buffer) and the
+ * mesh has to be drawn unindexed or re-welded on them.
+ ************************************************************/
+struct LightmapLayout
+{
+    int width;
+    int height;
+    float texelsPerUnit;
+    std::vector<glm::vec2> uvs;
+};
+
+bool unwrapLightmap(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+                    int resolution, int padding, LightmapLayout& layout);
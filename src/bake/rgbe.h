@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cmath>
+#include <cstdint>
+
+/*************************************************************
+ * RGBE
+ * ----
+ * Shared-exponent HDR encoding (Radiance .hdr) packed into an
+ * ordinary RGBA8 texel, so HDR lightmaps can go through
+ * SOIL_save_image and decode in the shader with one fetch:
+ *     rgb * 255.0 * exp2(a * 255.0 - 136.0)
+ ************************************************************/
+inline void encodeRGBE(const glm::vec3& color, uint8_t rgbe[4])
+{
+    float maxComponent = glm::max(color.r, glm::max(color.g, color.b));
+    if(maxComponent < 1e-32f)
+    {
+        rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+        return;
+    }
+
+    int exponent;
+    float scale = std::frexp(maxComponent, &exponent) * 256.0f / maxComponent;
+    rgbe[0] = (uint8_t)glm::max(color.r * scale, 0.0f);
+    rgbe[1] = (uint8_t)glm::max(color.g * scale, 0.0f);
+    rgbe[2] = (uint8_t)glm::max(color.b * scale, 0.0f);
+    rgbe[3] = (uint8_t)(exponent + 128);
+}
+
+inline glm::vec3 decodeRGBE(const uint8_t rgbe[4])
+{
+    if(rgbe[3] == 0)
+        return glm::vec3(0.0f);
+    float scale = std::ldexp(1.0f, (int)rgbe[3] - (128 + 8));
+    return glm::vec3(rgbe[0], rgbe[1], rgbe[2]) * scale;
+}
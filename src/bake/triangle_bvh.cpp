@@ -0,0 +1,335 @@
+#include "bake/triangle_bvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <limits>
+
+namespace
+{
+    const int BinCount = 12;
+    const uint32_t MaxLeafSize = 4;
+    const uint32_t MaxDepth = 63;   // traversal stacks hold MaxDepth + 1 entries
+
+    struct BuildTriangle
+    {
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+        glm::vec3 centroid;
+        uint32_t index;
+    };
+
+    struct BuildTask
+    {
+        uint32_t node;
+        uint32_t first;
+        uint32_t count;
+        uint32_t depth;
+    };
+
+    float surfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+    {
+        glm::vec3 d = glm::max(boundsMax - boundsMin, glm::vec3(0.0f));
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    bool intersectBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+                         const glm::vec3& origin, const glm::vec3& invDir, float tMin, float tMax, float& tEnter)
+    {
+        glm::vec3 t0 = (boundsMin - origin) * invDir;
+        glm::vec3 t1 = (boundsMax - origin) * invDir;
+        glm::vec3 tNear = glm::min(t0, t1);
+        glm::vec3 tFar = glm::max(t0, t1);
+        float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, tMin));
+        float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, tMax));
+        tEnter = enter;
+        return enter <= exit;
+    }
+}
+
+/**************************************************************
+ * TriangleBVH::build()
+ * -------------------
+ * Builds the hierarchy top-down. Each split picks the
+ * cheapest of BinCount centroid bins along every axis by
+ * the surface area heuristic, and a node becomes a leaf
+ * once no split beats intersecting its triangles directly,
+ * or at MaxDepth, which degenerate input such as many
+ * coincident triangles would otherwise exceed.
+ *************************************************************/
+void TriangleBVH::build(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices)
+{
+    m_nodes.clear();
+    m_triangles.clear();
+
+    uint32_t triangleCount = (uint32_t)(indices.size() / 3);
+    if(triangleCount == 0)
+        return;
+
+    std::vector<BuildTriangle> build(triangleCount);
+    for(uint32_t i = 0; i < triangleCount; ++i)
+    {
+        const glm::vec3& a = positions[indices[i * 3 + 0]];
+        const glm::vec3& b = positions[indices[i * 3 + 1]];
+        const glm::vec3& c = positions[indices[i * 3 + 2]];
+        build[i].boundsMin = glm::min(a, glm::min(b, c));
+        build[i].boundsMax = glm::max(a, glm::max(b, c));
+        build[i].centroid = (a + b + c) / 3.0f;
+        build[i].index = i;
+    }
+
+    m_nodes.reserve(triangleCount * 2);
+    m_nodes.push_back(Node());
+
+    std::vector<BuildTask> stack;
+    BuildTask root = { 0, 0, triangleCount, 0 };
+    stack.push_back(root);
+
+    while(!stack.empty())
+    {
+        BuildTask task = stack.back();
+        stack.pop_back();
+
+    // Bounds of the triangles and of their centroids
+        glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+        glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+        for(uint32_t i = task.first; i < task.first + task.count; ++i)
+        {
+            boundsMin = glm::min(boundsMin, build[i].boundsMin);
+            boundsMax = glm::max(boundsMax, build[i].boundsMax);
+            centroidMin = glm::min(centroidMin, build[i].centroid);
+            centroidMax = glm::max(centroidMax, build[i].centroid);
+        }
+
+        Node& node = m_nodes[task.node];
+        node.boundsMin = boundsMin;
+        node.boundsMax = boundsMax;
+        node.firstOrChild = task.first;
+        node.count = task.count;
+
+        if(task.count <= MaxLeafSize || task.depth >= MaxDepth)
+            continue;
+
+    // Evaluate the SAH at every bin boundary along every axis
+        float bestCost = FLT_MAX;
+        int bestAxis = -1;
+        int bestSplit = 0;
+        glm::vec3 extent = centroidMax - centroidMin;
+        for(int axis = 0; axis < 3; ++axis)
+        {
+            if(extent[axis] <= 0.0f)
+                continue;
+
+            glm::vec3 binMin[BinCount], binMax[BinCount];
+            uint32_t binCount[BinCount] = { 0 };
+            for(int b = 0; b < BinCount; ++b)
+            {
+                binMin[b] = glm::vec3(FLT_MAX);
+                binMax[b] = glm::vec3(-FLT_MAX);
+            }
+
+            float scale = BinCount / extent[axis];
+            for(uint32_t i = task.first; i < task.first + task.count; ++i)
+            {
+                int b = std::min(BinCount - 1, (int)((build[i].centroid[axis] - centroidMin[axis]) * scale));
+                binMin[b] = glm::min(binMin[b], build[i].boundsMin);
+                binMax[b] = glm::max(binMax[b], build[i].boundsMax);
+                ++binCount[b];
+            }
+
+            float leftArea[BinCount - 1];
+            uint32_t leftCount[BinCount - 1];
+            glm::vec3 accMin(FLT_MAX), accMax(-FLT_MAX);
+            uint32_t accCount = 0;
+            for(int b = 0; b < BinCount - 1; ++b)
+            {
+                accMin = glm::min(accMin, binMin[b]);
+                accMax = glm::max(accMax, binMax[b]);
+                accCount += binCount[b];
+                leftArea[b] = surfaceArea(accMin, accMax);
+                leftCount[b] = accCount;
+            }
+
+            accMin = glm::vec3(FLT_MAX);
+            accMax = glm::vec3(-FLT_MAX);
+            accCount = 0;
+            for(int b = BinCount - 1; b > 0; --b)
+            {
+                accMin = glm::min(accMin, binMin[b]);
+                accMax = glm::max(accMax, binMax[b]);
+                accCount += binCount[b];
+                if(accCount == 0 || leftCount[b - 1] == 0)
+                    continue;
+                float cost = leftArea[b - 1] * leftCount[b - 1] + surfaceArea(accMin, accMax) * accCount;
+                if(cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = b;
+                }
+            }
+        }
+
+        float leafCost = surfaceArea(boundsMin, boundsMax) * task.count;
+        if(bestAxis < 0 || bestCost >= leafCost)
+            continue;
+
+    // Partition triangles around the chosen bin boundary
+        float scale = BinCount / extent[bestAxis];
+        float axisMin = centroidMin[bestAxis];
+        BuildTriangle* middle = std::partition(&build[task.first], &build[task.first] + task.count,
+            [&](const BuildTriangle& t)
+            {
+                return std::min(BinCount - 1, (int)((t.centroid[bestAxis] - axisMin) * scale)) < bestSplit;
+            });
+        uint32_t leftCount = (uint32_t)(middle - &build[task.first]);
+
+        uint32_t left = (uint32_t)m_nodes.size();
+        m_nodes.push_back(Node());
+        m_nodes.push_back(Node());
+        m_nodes[task.node].firstOrChild = left;
+        m_nodes[task.node].count = 0;
+
+        BuildTask leftTask = { left, task.first, leftCount, task.depth + 1 };
+        BuildTask rightTask = { left + 1, task.first + leftCount, task.count - leftCount, task.depth + 1 };
+        stack.push_back(leftTask);
+        stack.push_back(rightTask);
+    }
+
+// Store triangles in leaf order so traversal reads them linearly
+    m_triangles.resize(triangleCount);
+    for(uint32_t i = 0; i < triangleCount; ++i)
+    {
+        uint32_t t = build[i].index;
+        const glm::vec3& a = positions[indices[t * 3 + 0]];
+        m_triangles[i].v0 = a;
+        m_triangles[i].e1 = positions[indices[t * 3 + 1]] - a;
+        m_triangles[i].e2 = positions[indices[t * 3 + 2]] - a;
+        m_triangles[i].index = t;
+    }
+}
+
+/**************************************************************
+ * TriangleBVH::intersect()
+ * -----------------------
+ * Finds the closest hit along the ray segment.
+ *************************************************************/
+bool TriangleBVH::intersect(const Ray& ray, RayHit& hit) const
+{
+    return traverse<false>(ray, &hit);
+}
+
+/**************************************************************
+ * TriangleBVH::occluded()
+ * ----------------------
+ * Returns true as soon as any triangle blocks the segment.
+ *************************************************************/
+bool TriangleBVH::occluded(const Ray& ray) const
+{
+    return traverse<true>(ray, NULL);
+}
+
+/**************************************************************
+ * TriangleBVH::traverse()
+ * ----------------------
+ * Stack based traversal shared by the closest and any hit
+ * queries, visiting the nearer child first.
+ *************************************************************/
+template <bool AnyHit>
+bool TriangleBVH::traverse(const Ray& ray, RayHit* hit) const
+{
+    if(m_nodes.empty())
+        return false;
+
+    const float Epsilon = std::numeric_limits<float>::epsilon();
+    glm::vec3 invDir = 1.0f / ray.direction;
+    float tMax = ray.tMax;
+    bool found = false;
+
+    float tEnter;
+    if(!intersectBounds(m_nodes[0].boundsMin, m_nodes[0].boundsMax, ray.origin, invDir, ray.tMin, tMax, tEnter))
+        return false;
+
+// Entries carry the distance at which the ray enters the node.
+// Each level leaves at most one sibling behind, and interior
+// nodes are shallower than MaxDepth, so the stack cannot overflow
+    struct Entry
+    {
+        uint32_t node;
+        float t;
+    };
+    Entry stack[MaxDepth + 1];
+    int top = 0;
+    stack[top].node = 0;
+    stack[top++].t = tEnter;
+
+    while(top > 0)
+    {
+        Entry entry = stack[--top];
+        if(entry.t > tMax)
+            continue;
+
+        const Node& node = m_nodes[entry.node];
+        if(node.count == 0)
+        {
+            uint32_t left = node.firstOrChild;
+            float tLeft, tRight;
+            bool hitLeft = intersectBounds(m_nodes[left].boundsMin, m_nodes[left].boundsMax,
+                                           ray.origin, invDir, ray.tMin, tMax, tLeft);
+            bool hitRight = intersectBounds(m_nodes[left + 1].boundsMin, m_nodes[left + 1].boundsMax,
+                                            ray.origin, invDir, ray.tMin, tMax, tRight);
+
+        // Push the farther child first so the nearer one is visited next
+            if(hitLeft && hitRight)
+            {
+                bool leftNear = tLeft <= tRight;
+                stack[top].node = leftNear ? left + 1 : left;
+                stack[top++].t = leftNear ? tRight : tLeft;
+                stack[top].node = leftNear ? left : left + 1;
+                stack[top++].t = leftNear ? tLeft : tRight;
+            }
+            else if(hitLeft || hitRight)
+            {
+                stack[top].node = hitLeft ? left : left + 1;
+                stack[top++].t = hitLeft ? tLeft : tRight;
+            }
+            continue;
+        }
+
+        for(uint32_t i = node.firstOrChild; i < node.firstOrChild + node.count; ++i)
+        {
+            const Triangle& tri = m_triangles[i];
+
+        // Same steps as glm::intersectRayTriangle, accepting either winding
+            glm::vec3 p = glm::cross(ray.direction, tri.e2);
+            float a = glm::dot(tri.e1, p);
+            if(glm::abs(a) < Epsilon)
+                continue;
+
+            float f = 1.0f / a;
+            glm::vec3 s = ray.origin - tri.v0;
+            float u = f * glm::dot(s, p);
+            if(u < 0.0f || u > 1.0f)
+                continue;
+
+            glm::vec3 q = glm::cross(s, tri.e1);
+            float v = f * glm::dot(ray.direction, q);
+            if(v < 0.0f || u + v > 1.0f)
+                continue;
+
+            float t = f * glm::dot(tri.e2, q);
+            if(t < ray.tMin || t > tMax)
+                continue;
+
+            if(AnyHit)
+                return true;
+
+            found = true;
+            tMax = t;
+            hit->triangle = tri.index;
+            hit->t = t;
+            hit->u = u;
+            hit->v = v;
+        }
+    }
+    return found;
+}
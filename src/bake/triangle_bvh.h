@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+/*************************************************************
+ * Ray / RayHit
+ * ------------
+ * A ray segment [tMin, tMax] and the closest triangle it hit.
+ * u and v are the barycentric weights of vertices 1 and 2.
+ ************************************************************/
+struct Ray
+{
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float tMin;
+    float tMax;
+};
+
+struct RayHit
+{
+    uint32_t triangle;
+    float t;
+    float u;
+    float v;
+};
+
+/*************************************************************
+ * TriangleBVH
+ * -----------
+ * Static bounding volume hierarchy over an indexed triangle
+ * list, built with binned SAH. The triangle test is the
+ * gtx/intersect intersectRayTriangle formulation made
+ * two-sided, since light bounces off both faces of a wall.
+ ************************************************************/
+class TriangleBVH
+{
+public:
+    void build(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices);
+
+    bool intersect(const Ray& ray, RayHit& hit) const;
+    bool occluded(const Ray& ray) const;
+
+    size_t nodeCount() const { return m_nodes.size(); }
+    size_t triangleCount() const { return m_triangles.size(); }
+
+private:
+    struct Node
+    {
+        glm::vec3 boundsMin;
+        uint32_t firstOrChild;  // first triangle for leaves, left child otherwise
+        glm::vec3 boundsMax;
+        uint32_t count;         // triangles in a leaf, 0 for interior nodes
+    };
+
+// Triangles are stored in leaf order with precomputed edges
+    struct Triangle
+    {
+        glm::vec3 v0;
+        glm::vec3 e1;
+        glm::vec3 e2;
+        uint32_t index;
+    };
+
+    template <bool AnyHit>
+    bool traverse(const Ray& ray, RayHit* hit) const;
+
+    std::vector<Node> m_nodes;
+    std::vector<Triangle> m_triangles;
+};
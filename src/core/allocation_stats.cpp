@@ -0,0 +1,177 @@
+#include "core/allocation_stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    std::atomic<uint64_t> g_allocations(0);
+    std::atomic<uint64_t> g_frees(0);
+    std::atomic<uint64_t> g_bytes(0);
+
+    void* countedAllocate(size_t size)
+    {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        g_bytes.fetch_add(size, std::memory_order_relaxed);
+        return std::malloc(size ? size : 1);
+    }
+
+    void countedFree(void* pointer)
+    {
+        if(!pointer)
+            return;
+        g_frees.fetch_add(1, std::memory_order_relaxed);
+        std::free(pointer);
+    }
+
+#ifdef __cpp_aligned_new
+// Over-aligned blocks keep the pointer malloc returned just
+// before the aligned address, so this works without
+// aligned_alloc or posix_memalign
+    void* countedAllocateAligned(size_t size, std::align_val_t alignment)
+    {
+        size_t align = std::max(static_cast<size_t>(alignment), sizeof(void*));
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        g_bytes.fetch_add(size, std::memory_order_relaxed);
+        void* block = std::malloc(size + align + sizeof(void*));
+        if(!block)
+            return NULL;
+        uintptr_t aligned = ((uintptr_t)block + sizeof(void*) + align - 1) & ~(uintptr_t)(align - 1);
+        ((void**)aligned)[-1] = block;
+        return (void*)aligned;
+    }
+
+    void countedFreeAligned(void* pointer)
+    {
+        if(pointer)
+            countedFree(((void**)pointer)[-1]);
+    }
+#endif
+}
+
+HeapStats heapStats()
+{
+    HeapStats stats;
+    stats.allocations = g_allocations.load(std::memory_order_relaxed);
+    stats.frees = g_frees.load(std::memory_order_relaxed);
+    stats.bytes = g_bytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void* operator new(size_t size)
+{
+    void* pointer = countedAllocate(size);
+    if(!pointer)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new[](size_t size)
+{
+    void* pointer = countedAllocate(size);
+    if(!pointer)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return countedAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return countedAllocate(size);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    countedFree(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    countedFree(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+    countedFree(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+    countedFree(pointer);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void* pointer, size_t) noexcept
+{
+    countedFree(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+    countedFree(pointer);
+}
+#endif
+
+#ifdef __cpp_aligned_new
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    void* pointer = countedAllocateAligned(size, alignment);
+    if(!pointer)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    void* pointer = countedAllocateAligned(size, alignment);
+    if(!pointer)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return countedAllocateAligned(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return countedAllocateAligned(size, alignment);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+    countedFreeAligned(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept
+{
+    countedFreeAligned(pointer);
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept
+{
+    countedFreeAligned(pointer);
+}
+
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept
+{
+    countedFreeAligned(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    countedFreeAligned(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    countedFreeAligned(pointer);
+}
+#endif
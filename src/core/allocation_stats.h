@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+/*************************************************************
+ * Heap Allocation Stats
+ * ---------------------
+ * Counts of calls to the global operator new and delete
+ * (every form, including the sized and, from C++17, the
+ * aligned ones), which core/allocation_stats.cpp replaces with
+ * counting wrappers around malloc and free. Allocations made
+ * directly with malloc, such as inside the GL driver, are not
+ * seen. Taking the difference across a frame tells whether
+ * the frame allocated at all:
+ *
+ *     HeapStats before = heapStats();
+ *     ... frame ...
+ *     uint64_t allocations = heapStats().allocations - before.allocations;
+ *
+ * Counters are relaxed atomics, so the totals are exact but a
+ * read while other threads allocate is only a snapshot.
+ ************************************************************/
+struct HeapStats
+{
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t bytes;             // requested by allocations, never decreases
+};
+
+HeapStats heapStats();
@@ -0,0 +1,163 @@
+#include "core/file_watcher.h"
+
+#include <algorithm>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    bool isDirectory(const std::string& path)
+    {
+        struct stat info;
+        return stat(path.c_str(), &info) == 0 && (info.st_mode & S_IFMT) == S_IFDIR;
+    }
+
+    std::string parentDirectory(const std::string& path)
+    {
+        size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? "." : path.substr(0, slash);
+    }
+
+#ifndef __linux__
+    long long modificationTime(const std::string& path)
+    {
+        struct stat info;
+        return stat(path.c_str(), &info) == 0 ? (long long)info.st_mtime : -1;
+    }
+#endif
+}
+
+/**************************************************************
+ * watchPath()
+ * ----------
+ * The one spelling of a path the watcher uses, so a file
+ * given without a directory matches the path poll() builds
+ * from its directory, ".".
+ *************************************************************/
+std::string watchPath(const std::string& path)
+{
+    std::string normalised = path;
+    while(normalised.size() > 1 && normalised[normalised.size() - 1] == '/')
+        normalised.erase(normalised.size() - 1);
+    if(!normalised.empty() && normalised.find_first_of("/\\") == std::string::npos && normalised != "."
+        && normalised != ".." && !isDirectory(normalised))
+        normalised = "./" + normalised;
+    return normalised;
+}
+
+#ifdef __linux__
+
+FileWatcher::FileWatcher()
+    : m_fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+{
+}
+
+FileWatcher::~FileWatcher()
+{
+    if(m_fd >= 0)
+        close(m_fd);
+}
+
+/**************************************************************
+ * FileWatcher::watch()
+ * -------------------
+ * Watches a file, through its directory, or a directory.
+ * Writes finishing and files renamed into place count as
+ * changes; files being written do not.
+ *************************************************************/
+bool FileWatcher::watch(const std::string& watched)
+{
+    if(m_fd < 0)
+        return false;
+    std::string path = watchPath(watched);
+    bool directory = isDirectory(path);
+    std::string target = directory ? path : parentDirectory(path);
+
+    int wd = inotify_add_watch(m_fd, target.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if(wd < 0)
+        return false;
+    m_directories[wd] = target;
+    if(directory)
+        m_wholeDirectories.insert(target);
+    else
+        m_files.insert(path);
+    return true;
+}
+
+/**************************************************************
+ * FileWatcher::poll()
+ * ------------------
+ * Drains the pending events and appends every watched file
+ * they name, once, to changed. Returns how many were added.
+ *************************************************************/
+size_t FileWatcher::poll(std::vector<std::string>& changed)
+{
+    size_t first = changed.size();
+    if(m_fd < 0)
+        return 0;
+
+    alignas(inotify_event) char buffer[4096];
+    while(true)
+    {
+        ssize_t length = read(m_fd, buffer, sizeof(buffer));
+        if(length <= 0)
+            break;
+        for(ssize_t at = 0; at < length;)
+        {
+            const inotify_event* event = (const inotify_event*)(buffer + at);
+            at += sizeof(inotify_event) + event->len;
+            if(event->len == 0)
+                continue;
+
+            std::unordered_map<int, std::string>::const_iterator directory = m_directories.find(event->wd);
+            if(directory == m_directories.end())
+                continue;
+            std::string path = directory->second + "/" + event->name;
+            bool watched = m_wholeDirectories.count(directory->second) || m_files.count(path);
+            if(watched && std::find(changed.begin() + first, changed.end(), path) == changed.end())
+                changed.push_back(path);
+        }
+    }
+    return changed.size() - first;
+}
+
+#else
+
+FileWatcher::FileWatcher()
+{
+}
+
+FileWatcher::~FileWatcher()
+{
+}
+
+bool FileWatcher::watch(const std::string& watched)
+{
+    std::string path = watchPath(watched);
+    if(isDirectory(path))
+        return false;
+    m_files.insert(path);
+    m_times[path] = modificationTime(path);
+    return true;
+}
+
+size_t FileWatcher::poll(std::vector<std::string>& changed)
+{
+    size_t first = changed.size();
+    for(std::unordered_map<std::string, long long>::iterator it = m_times.begin(); it != m_times.end(); ++it)
+    {
+        long long time = modificationTime(it->first);
+        if(time != it->second && time != -1)
+        {
+            it->second = time;
+            changed.push_back(it->first);
+        }
+    }
+    return changed.size() - first;
+}
+
+#endif
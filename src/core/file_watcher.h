@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/*************************************************************
+ * FileWatcher
+ * -----------
+ * Reports files that changed on disk since the last poll().
+ * On Linux it uses inotify on the containing directories, so
+ * poll() is one non-blocking read and also catches editors
+ * that save by writing a new file and renaming it over the
+ * old one. Elsewhere it compares modification times of the
+ * watched files on every poll(), and directories cannot be
+ * watched.
+ *
+ * A watched directory reports any file written in it, not in
+ * its subdirectories. Paths come back in the form
+ * watchPath() gives them: as passed to watch(), with trailing
+ * slashes dropped and "./" put before a bare file name, and
+ * joined with the file name for directories.
+ ************************************************************/
+std::string watchPath(const std::string& path);
+
+class FileWatcher
+{
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    bool watch(const std::string& path);
+    size_t poll(std::vector<std::string>& changed);
+
+private:
+    FileWatcher(const FileWatcher&);
+    FileWatcher& operator=(const FileWatcher&);
+
+    std::unordered_set<std::string> m_files;
+#ifdef __linux__
+    int m_fd;
+    std::unordered_map<int, std::string> m_directories;     // by watch descriptor
+    std::unordered_set<std::string> m_wholeDirectories;
+#else
+    std::unordered_map<std::string, long long> m_times;
+#endif
+};
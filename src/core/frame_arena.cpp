@@ -0,0 +1,135 @@
+#include "core/frame_arena.h"
+#include "core/job_system.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+LinearArena::LinearArena(size_t blockSize)
+    : m_blockSize(std::max<size_t>(blockSize, 256)), m_current(0), m_offset(0)
+{
+    m_stats.used = 0;
+    m_stats.peak = 0;
+    m_stats.capacity = 0;
+    m_stats.allocations = 0;
+    m_stats.blockAllocations = 0;
+}
+
+LinearArena::~LinearArena()
+{
+    for(size_t i = 0; i < m_blocks.size(); ++i)
+        std::free(m_blocks[i].memory);
+}
+
+/**************************************************************
+ * LinearArena::allocate()
+ * ----------------------
+ * Returns size bytes aligned to alignment (a power of two),
+ * moving on to the next block, or a new one big enough, when
+ * the current block cannot hold them.
+ *************************************************************/
+void* LinearArena::allocate(size_t size, size_t alignment)
+{
+    ++m_stats.allocations;
+    while(true)
+    {
+        if(m_current < m_blocks.size())
+        {
+            Block& block = m_blocks[m_current];
+            uintptr_t base = (uintptr_t)block.memory;
+            size_t start = (size_t)(((base + m_offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base);
+            if(start + size <= block.size)
+            {
+                m_stats.used += start + size - m_offset;
+                m_offset = start + size;
+                return block.memory + start;
+            }
+            if(m_current + 1 < m_blocks.size())
+            {
+                m_stats.used += block.size - m_offset;
+                ++m_current;
+                m_offset = 0;
+                continue;
+            }
+            m_stats.used += block.size - m_offset;
+        }
+        addBlock(size + alignment);
+        m_current = m_blocks.size() - 1;
+        m_offset = 0;
+    }
+}
+
+/**************************************************************
+ * LinearArena::reset()
+ * -------------------
+ * Releases everything allocated. If the frame needed more
+ * than one block they are replaced by one holding them all,
+ * so the next frame of the same size fits without the heap.
+ *************************************************************/
+void LinearArena::reset()
+{
+    m_stats.peak = std::max(m_stats.peak, m_stats.used);
+    if(m_blocks.size() > 1)
+    {
+        size_t total = m_stats.capacity;
+        for(size_t i = 0; i < m_blocks.size(); ++i)
+            std::free(m_blocks[i].memory);
+        m_blocks.clear();
+        m_stats.capacity = 0;
+        addBlock(total);
+    }
+    m_current = 0;
+    m_offset = 0;
+    m_stats.used = 0;
+}
+
+void LinearArena::addBlock(size_t minimumSize)
+{
+    Block block;
+    block.size = std::max(m_blockSize, minimumSize);
+    block.memory = (uint8_t*)std::malloc(block.size);
+    if(!block.memory)
+        throw std::bad_alloc();
+    m_blocks.push_back(block);
+    m_stats.capacity += block.size;
+    ++m_stats.blockAllocations;
+}
+
+FrameArena::FrameArena(const JobSystem& jobs, size_t blockSize)
+    : m_jobs(jobs)
+{
+    for(unsigned i = 0; i < jobs.threadCount(); ++i)
+        m_arenas.push_back(std::unique_ptr<LinearArena>(new LinearArena(blockSize)));
+}
+
+LinearArena& FrameArena::local()
+{
+    return *m_arenas[m_jobs.currentWorker()];
+}
+
+void FrameArena::reset()
+{
+    for(size_t i = 0; i < m_arenas.size(); ++i)
+        m_arenas[i]->reset();
+}
+
+/**************************************************************
+ * FrameArena::stats()
+ * ------------------
+ * Sum over the per-thread arenas; peak is the sum of their
+ * peaks, an upper bound on the combined peak.
+ *************************************************************/
+ArenaStats FrameArena::stats() const
+{
+    ArenaStats total = { 0, 0, 0, 0, 0 };
+    for(size_t i = 0; i < m_arenas.size(); ++i)
+    {
+        const ArenaStats& stats = m_arenas[i]->stats();
+        total.used += stats.used;
+        total.peak += stats.peak;
+        total.capacity += stats.capacity;
+        total.allocations += stats.allocations;
+        total.blockAllocations += stats.blockAllocations;
+    }
+    return total;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class JobSystem;
+
+/*************************************************************
+ * LinearArena
+ * -----------
+ * Bump allocator for data that lives until the next reset(),
+ * typically one frame: visible lists, uniform staging, scratch
+ * arrays. Allocation is an aligned pointer bump in the current
+ * block; when it is full a new block is taken from the heap.
+ * Nothing is freed individually and no destructors run, so it
+ * suits trivially destructible data.
+ *
+ * reset() keeps a single block as large as everything the
+ * arena held, so after the first frames of a steady workload
+ * the arena never touches the heap again.
+ ************************************************************/
+struct ArenaStats
+{
+    size_t used;                // bytes handed out since the last reset, with padding
+    size_t peak;                // largest used seen at any reset
+    size_t capacity;            // bytes held in blocks
+    uint64_t allocations;       // calls to allocate() since construction
+    uint64_t blockAllocations;  // times a block was taken from the heap
+};
+
+class LinearArena
+{
+public:
+    explicit LinearArena(size_t blockSize = 64 * 1024);
+    ~LinearArena();
+
+    void* allocate(size_t size, size_t alignment = 16);
+    template<typename T> T* allocateArray(size_t count) { return (T*)allocate(count * sizeof(T), alignof(T)); }
+    void reset();
+
+    const ArenaStats& stats() const { return m_stats; }
+
+private:
+    struct Block
+    {
+        uint8_t* memory;
+        size_t size;
+    };
+
+    LinearArena(const LinearArena&);
+    LinearArena& operator=(const LinearArena&);
+
+    void addBlock(size_t minimumSize);
+
+    std::vector<Block> m_blocks;
+    size_t m_blockSize;
+    size_t m_current;           // block being bumped
+    size_t m_offset;            // within it
+    ArenaStats m_stats;
+};
+
+/*************************************************************
+ * ArenaAllocator
+ * --------------
+ * Standard allocator over a LinearArena, so containers built
+ * during a frame can use it:
+ *
+ *     FrameVector<uint32_t> visible(ArenaAllocator<uint32_t>(arena));
+ *
+ * deallocate() does nothing; growth leaves the old storage in
+ * the arena until reset(), so reserve() up front where the
+ * size is known. The container must not outlive the reset.
+ ************************************************************/
+template<typename T>
+struct ArenaAllocator
+{
+    typedef T value_type;
+
+    explicit ArenaAllocator(LinearArena& target) : arena(&target) {}
+    template<typename U> ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t count) { return arena->allocateArray<T>(count); }
+    void deallocate(T*, size_t) {}
+
+    LinearArena* arena;
+};
+
+template<typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena == b.arena; }
+template<typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena != b.arena; }
+
+template<typename T>
+using FrameVector = std::vector<T, ArenaAllocator<T> >;
+
+/*************************************************************
+ * FrameArena
+ * ----------
+ * One LinearArena per thread of a JobSystem, so jobs allocate
+ * frame data without locking: local() is the calling thread's
+ * arena (the system's creating thread, and any thread that is
+ * not a worker, get arena 0, which only one of them may use
+ * at a time). reset() at frame end, once no job is running,
+ * resets them all.
+ ************************************************************/
+class FrameArena
+{
+public:
+    FrameArena(const JobSystem& jobs, size_t blockSize = 64 * 1024);
+
+    LinearArena& local();
+    LinearArena& arena(unsigned worker) { return *m_arenas[worker]; }
+    unsigned arenaCount() const { return (unsigned)m_arenas.size(); }
+    void reset();
+    ArenaStats stats() const;
+
+private:
+    FrameArena(const FrameArena&);
+    FrameArena& operator=(const FrameArena&);
+
+    const JobSystem& m_jobs;
+    std::vector<std::unique_ptr<LinearArena> > m_arenas;
+};
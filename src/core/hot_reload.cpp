@@ -0,0 +1,133 @@
+#include "core/hot_reload.h"
+
+#include <chrono>
+
+namespace
+{
+    uint64_t ticks()
+    {
+        return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+    }
+
+    double ticksToMilliseconds(uint64_t elapsed)
+    {
+        typedef std::chrono::steady_clock::duration Duration;
+        return std::chrono::duration<double, std::milli>(Duration((Duration::rep)elapsed)).count();
+    }
+}
+
+HotReloader::HotReloader(JobSystem& jobs)
+    : m_jobs(jobs)
+{
+    m_stats.changes = 0;
+    m_stats.reloads = 0;
+    m_stats.lastLatency = 0.0;
+}
+
+HotReloader::~HotReloader()
+{
+    m_jobs.wait(m_loading);
+}
+
+/**************************************************************
+ * HotReloader::watch()
+ * -------------------
+ * Calls load for path whenever it changes or, for a
+ * directory, with the path of any file changed in it.
+ *************************************************************/
+bool HotReloader::watch(const std::string& watched, const ReloadFunction& load)
+{
+// Stored as the watcher reports it, for findWatch()
+    std::string path = watchPath(watched);
+    for(size_t i = 0; i < m_watches.size(); ++i)
+    {
+        if(m_watches[i].path == path)
+        {
+            m_watches[i].load = load;
+            return true;
+        }
+    }
+    if(!m_watcher.watch(path))
+        return false;
+    Watch watch;
+    watch.path = path;
+    watch.load = load;
+    m_watches.push_back(watch);
+    return true;
+}
+
+/**************************************************************
+ * HotReloader::update()
+ * --------------------
+ * Frame boundary work: starts a load for every changed file,
+ * then applies finished loads that are still the latest for
+ * their file.
+ *************************************************************/
+void HotReloader::update()
+{
+    m_changed.clear();
+    m_stats.changes += m_watcher.poll(m_changed);
+    for(size_t i = 0; i < m_changed.size(); ++i)
+    {
+        int watch = findWatch(m_changed[i]);
+        if(watch >= 0)
+            startLoad((size_t)watch, m_changed[i]);
+    }
+    if(m_jobs.threadCount() == 1 && !m_loading.done())
+        m_jobs.wait(m_loading);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_applying.swap(m_loaded);
+    }
+    for(size_t i = 0; i < m_applying.size(); ++i)
+    {
+        Loaded& loaded = m_applying[i];
+        if(loaded.generation != m_generations[loaded.path] || !loaded.apply)
+            continue;
+        loaded.apply();
+        ++m_stats.reloads;
+        m_stats.lastLatency = ticksToMilliseconds(ticks() - loaded.started);
+    }
+    m_applying.clear();
+}
+
+// The watch for a changed file: its own, else its directory's
+int HotReloader::findWatch(const std::string& changed) const
+{
+    int directory = -1;
+    for(size_t i = 0; i < m_watches.size(); ++i)
+    {
+        const std::string& path = m_watches[i].path;
+        if(path == changed)
+            return (int)i;
+        if(changed.size() > path.size() && changed.compare(0, path.size(), path) == 0
+            && changed[path.size()] == '/' && changed.find('/', path.size() + 1) == std::string::npos)
+            directory = (int)i;
+    }
+    return directory;
+}
+
+/**************************************************************
+ * HotReloader::startLoad()
+ * -----------------------
+ * Runs the watch's load function as a job with its own copy
+ * of everything it needs, so later watch() calls cannot race
+ * with it.
+ *************************************************************/
+void HotReloader::startLoad(size_t watch, const std::string& path)
+{
+    uint64_t generation = ++m_generations[path];
+    uint64_t started = ticks();
+    ReloadFunction load = m_watches[watch].load;
+    m_jobs.run([this, load, path, generation, started]()
+    {
+        Loaded loaded;
+        loaded.path = path;
+        loaded.generation = generation;
+        loaded.started = started;
+        loaded.apply = load(path);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_loaded.push_back(loaded);
+    }, &m_loading);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "core/file_watcher.h"
+#include "core/job_system.h"
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*************************************************************
+ * HotReloader
+ * -----------
+ * Reloads assets while the application runs. Each watched
+ * file or directory has a load function, run as a job when a
+ * watched file changes: it reads and decodes on a worker and
+ * returns the function that swaps the result in. update(),
+ * called once per frame on the render thread, polls the
+ * watcher, starts loads and runs the swaps whose loads have
+ * finished, so GL objects are only replaced between frames:
+ *
+ *     reloader.watch("assets/statue.mesh", [&](const std::string& path) -> JobFunction {
+ *         std::shared_ptr<MeshCacheFile> file(new MeshCacheFile());
+ *         if(!file->open(path, true))
+ *             return JobFunction();
+ *         return [&, file]() { ... uploadMeshCache(), destroy the old mesh ... };
+ *     });
+ *
+ * An empty function means there is nothing to swap in, such
+ * as a file that failed to load; the old asset stays. When a
+ * file changes again before its previous load was swapped in,
+ * only the newest load is applied. Without worker threads
+ * loads run inside update().
+ ************************************************************/
+typedef std::function<JobFunction(const std::string& path)> ReloadFunction;
+
+struct HotReloadStats
+{
+    uint64_t changes;           // watched files reported changed
+    uint64_t reloads;           // swaps applied
+    double lastLatency;         // ms from noticing the change to the swap
+};
+
+class HotReloader
+{
+public:
+    explicit HotReloader(JobSystem& jobs);
+    ~HotReloader();
+
+    bool watch(const std::string& path, const ReloadFunction& load);
+    void update();
+
+    const HotReloadStats& stats() const { return m_stats; }
+
+private:
+    struct Watch
+    {
+        std::string path;
+        ReloadFunction load;
+    };
+
+    struct Loaded
+    {
+        std::string path;
+        uint64_t generation;
+        uint64_t started;       // ticks
+        JobFunction apply;
+    };
+
+    HotReloader(const HotReloader&);
+    HotReloader& operator=(const HotReloader&);
+
+    int findWatch(const std::string& changed) const;
+    void startLoad(size_t watch, const std::string& path);
+
+    JobSystem& m_jobs;
+    FileWatcher m_watcher;
+    std::vector<Watch> m_watches;
+    std::vector<std::string> m_changed;
+    std::unordered_map<std::string, uint64_t> m_generations;   // of each file's latest load
+    JobCounter m_loading;
+    std::mutex m_mutex;
+    std::vector<Loaded> m_loaded;   // guarded by m_mutex
+    std::vector<Loaded> m_applying;
+    HotReloadStats m_stats;
+};
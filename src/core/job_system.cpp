@@ -0,0 +1,327 @@
+#include "core/job_system.h"
+
+#include <algorithm>
+
+namespace
+{
+// The system and worker index of the calling thread, set on
+// worker threads only
+    thread_local const JobSystem* t_system = 0;
+    thread_local unsigned t_worker = 0;
+
+// Failed attempts to find a job before a worker goes to sleep
+    const int IdleSpins = 64;
+
+// Initial ring buffer size of each deque
+    const size_t InitialDequeSize = 256;
+
+// Jobs released by a counter, reused so releasing allocates
+// nothing once it has grown
+    thread_local std::vector<Job> t_released;
+
+// Shared by the jobs of one JobSystem::parallelFor(); they
+// capture only a pointer to it, which std::function stores
+// without allocating
+    struct ParallelForState
+    {
+        std::atomic<size_t> next;
+        size_t begin;
+        size_t end;
+        size_t grain;
+        size_t chunks;
+        const RangeFunction* body;
+
+        void run()
+        {
+            for(size_t chunk = next++; chunk < chunks; chunk = next++)
+            {
+                size_t first = begin + chunk * grain;
+                (*body)(first, std::min(first + grain, end));
+            }
+        }
+    };
+}
+
+/**************************************************************
+ * JobSystem::JobSystem()
+ * ---------------------
+ * Starts threadCount - 1 workers; the creating thread is the
+ * remaining one.
+ *************************************************************/
+JobSystem::JobSystem(unsigned threadCount)
+    : m_queued(0), m_sleeping(0), m_stop(false)
+{
+    threadCount = std::max(threadCount, 1u);
+    for(unsigned i = 0; i < threadCount; ++i)
+    {
+        m_workers.push_back(std::unique_ptr<Worker>(new Worker()));
+        m_workers.back()->jobs.resize(InitialDequeSize);
+        m_workers.back()->head = 0;
+        m_workers.back()->count = 0;
+        m_workers.back()->executed = 0;
+        m_workers.back()->stolen = 0;
+    }
+    for(unsigned i = 1; i < threadCount; ++i)
+        m_threads.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for(size_t i = 0; i < m_threads.size(); ++i)
+        m_threads[i].join();
+}
+
+/**************************************************************
+ * JobSystem::run()
+ * ---------------
+ * Queues function on the calling thread's deque. counter, if
+ * given, counts it until it returns; dependency, if given and
+ * not yet zero, holds the job back until it is.
+ *************************************************************/
+void JobSystem::run(const JobFunction& function, JobCounter* counter, JobCounter* dependency)
+{
+    if(counter)
+        ++counter->m_pending;
+    Job job = { function, counter };
+    if(dependency)
+    {
+        std::lock_guard<std::mutex> lock(dependency->m_mutex);
+        if(dependency->m_pending > 0)
+        {
+            dependency->m_waiting.push_back(job);
+            return;
+        }
+    }
+    push(currentWorker(), job);
+}
+
+/**************************************************************
+ * JobSystem::wait()
+ * ----------------
+ * Runs queued jobs until counter reaches zero. The final lock
+ * makes sure the job that released it has finished touching
+ * the counter, so it can be destroyed on return.
+ *************************************************************/
+void JobSystem::wait(JobCounter& counter)
+{
+    unsigned worker = currentWorker();
+    while(counter.m_pending > 0)
+    {
+        if(!runOne(worker))
+            std::this_thread::yield();
+    }
+    std::lock_guard<std::mutex> lock(counter.m_mutex);
+}
+
+/**************************************************************
+ * JobSystem::parallelFor()
+ * -----------------------
+ * Runs body over [begin, end) in chunks of grain items on up
+ * to threadCount threads: that many jobs (the caller being
+ * one) pull chunk indices from a shared counter, so uneven
+ * chunks balance. One job runs everything inline.
+ *************************************************************/
+void JobSystem::parallelFor(size_t begin, size_t end, size_t grain, unsigned threadCount, const RangeFunction& body)
+{
+    if(end <= begin)
+        return;
+    if(grain == 0)
+        grain = 1;
+
+    size_t chunks = (end - begin + grain - 1) / grain;
+    unsigned jobs = (unsigned)std::min<size_t>(std::min(std::max(threadCount, 1u), this->threadCount()), chunks);
+    if(jobs == 1)
+    {
+        body(begin, end);
+        return;
+    }
+
+    ParallelForState state;
+    state.next = 0;
+    state.begin = begin;
+    state.end = end;
+    state.grain = grain;
+    state.chunks = chunks;
+    state.body = &body;
+    ParallelForState* shared = &state;
+
+    JobCounter counter;
+    for(unsigned i = 1; i < jobs; ++i)
+        run([shared]() { shared->run(); }, &counter);
+    state.run();
+    wait(counter);
+}
+
+JobSystemStats JobSystem::stats() const
+{
+    JobSystemStats stats = { 0, 0 };
+    for(size_t i = 0; i < m_workers.size(); ++i)
+    {
+        stats.executed += m_workers[i]->executed;
+        stats.stolen += m_workers[i]->stolen;
+    }
+    return stats;
+}
+
+void JobSystem::resetStats()
+{
+    for(size_t i = 0; i < m_workers.size(); ++i)
+    {
+        m_workers[i]->executed = 0;
+        m_workers[i]->stolen = 0;
+    }
+}
+
+unsigned JobSystem::currentWorker() const
+{
+    return t_system == this ? t_worker : 0;
+}
+
+/**************************************************************
+ * JobSystem::push()
+ * ----------------
+ * Appends a job to a deque, doubling its ring buffer when
+ * full, and wakes a sleeping worker. The queued count is
+ * raised before sleepers are checked and sleepers register
+ * before checking it, so either the pusher sees the sleeper
+ * or the sleeper sees the job.
+ *************************************************************/
+void JobSystem::push(unsigned worker, const Job& job)
+{
+    {
+        Worker& target = *m_workers[worker];
+        std::lock_guard<std::mutex> lock(target.mutex);
+        size_t capacity = target.jobs.size();
+        if(target.count == capacity)
+        {
+            std::vector<Job> grown(capacity * 2);
+            for(size_t i = 0; i < target.count; ++i)
+                grown[i] = std::move(target.jobs[(target.head + i) & (capacity - 1)]);
+            target.jobs.swap(grown);
+            target.head = 0;
+            capacity *= 2;
+        }
+        target.jobs[(target.head + target.count++) & (capacity - 1)] = job;
+    }
+    ++m_queued;
+    if(m_sleeping > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+        }
+        m_wake.notify_one();
+    }
+}
+
+/**************************************************************
+ * JobSystem::runOne()
+ * ------------------
+ * Runs the newest job of the worker's own deque or, failing
+ * that, the oldest job of the next deque that has one.
+ * Returns false when every deque was empty.
+ *************************************************************/
+bool JobSystem::runOne(unsigned worker)
+{
+    Job job;
+    bool found = false;
+    {
+        Worker& own = *m_workers[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if(own.count > 0)
+        {
+            --own.count;
+            job = std::move(own.jobs[(own.head + own.count) & (own.jobs.size() - 1)]);
+            found = true;
+        }
+    }
+    for(size_t i = 1; i < m_workers.size() && !found; ++i)
+    {
+        Worker& victim = *m_workers[(worker + i) % m_workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if(victim.count > 0)
+        {
+            job = std::move(victim.jobs[victim.head]);
+            victim.head = (victim.head + 1) & (victim.jobs.size() - 1);
+            --victim.count;
+            found = true;
+            ++m_workers[worker]->stolen;
+        }
+    }
+    if(!found)
+        return false;
+
+    --m_queued;
+    job.function();
+    ++m_workers[worker]->executed;
+    if(job.counter)
+        finish(job.counter);
+    return true;
+}
+
+/**************************************************************
+ * JobSystem::finish()
+ * ------------------
+ * Signals a job's counter, queuing the jobs that depended on
+ * it when it drops to zero. The decrement happens under the
+ * counter's lock; see wait().
+ *************************************************************/
+void JobSystem::finish(JobCounter* counter)
+{
+    std::vector<Job>& released = t_released;
+    released.clear();
+    {
+        std::lock_guard<std::mutex> lock(counter->m_mutex);
+        if(--counter->m_pending == 0)
+        {
+            released.insert(released.end(), counter->m_waiting.begin(), counter->m_waiting.end());
+            counter->m_waiting.clear();
+        }
+    }
+    unsigned worker = currentWorker();
+    for(size_t i = 0; i < released.size(); ++i)
+        push(worker, released[i]);
+    released.clear();
+}
+
+void JobSystem::workerLoop(unsigned worker)
+{
+    t_system = this;
+    t_worker = worker;
+    int idle = 0;
+    while(!m_stop)
+    {
+        if(runOne(worker))
+        {
+            idle = 0;
+            continue;
+        }
+        if(++idle < IdleSpins)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        ++m_sleeping;
+        m_wake.wait(lock, [this]() { return m_stop || m_queued > 0; });
+        --m_sleeping;
+        idle = 0;
+    }
+}
+
+/**************************************************************
+ * defaultJobSystem()
+ * -----------------
+ * The shared system behind parallelFor(), with one thread per
+ * hardware thread, created on first use.
+ *************************************************************/
+JobSystem& defaultJobSystem()
+{
+    static JobSystem system(hardwareThreadCount());
+    return system;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "core/parallel.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::function<void()> JobFunction;
+
+class JobCounter;
+
+struct Job
+{
+    JobFunction function;
+    JobCounter* counter;
+};
+
+/*************************************************************
+ * JobCounter
+ * ----------
+ * Counts the unfinished jobs started with it. Jobs can be
+ * made to depend on a counter: they are held by it and only
+ * queued once it drops to zero. A counter may be reused once
+ * JobSystem::wait() has returned for it, and must outlive
+ * every job that signals or depends on it.
+ ************************************************************/
+class JobCounter
+{
+public:
+    JobCounter() : m_pending(0) {}
+
+    bool done() const { return m_pending.load() == 0; }
+
+private:
+    friend class JobSystem;
+
+    JobCounter(const JobCounter&);
+    JobCounter& operator=(const JobCounter&);
+
+    std::atomic<int> m_pending;
+    std::mutex m_mutex;
+    std::vector<Job> m_waiting;
+};
+
+struct JobSystemStats
+{
+    uint64_t executed;
+    uint64_t stolen;
+};
+
+/*************************************************************
+ * JobSystem
+ * ---------
+ * Thread pool with one job deque per thread. A thread pushes
+ * and pops its own jobs at the back (most recent first, so
+ * recursive splitting stays cache friendly) and, when empty,
+ * steals from the front of the others' deques, oldest and
+ * usually largest first. Idle workers sleep until a job is
+ * queued.
+ *
+ * The thread count includes the thread that created the
+ * system: it owns deque 0, as does any other thread that is
+ * not a worker. Nothing runs on it except inside wait(),
+ * which runs queued jobs until the counter drops to zero
+ * instead of blocking, so jobs may start and wait for jobs
+ * of their own.
+ *
+ *     JobCounter counter;
+ *     jobs.run(decodeTexture, &counter);
+ *     jobs.run(buildCommands, 0, &counter);   // after decode
+ *     jobs.wait(counter);
+ *
+ * parallelFor() splits a range as core/parallel.h's does,
+ * which runs on defaultJobSystem(). currentWorker() is the
+ * calling thread's index, for per-thread data such as
+ * FrameArena's sub-arenas.
+ *
+ * Deques are ring buffers that only grow, so once they have
+ * reached their working size queuing jobs whose functions fit
+ * std::function's inline storage (a couple of pointers)
+ * allocates nothing. The same holds for dependencies when the
+ * counter is kept across frames rather than recreated.
+ ************************************************************/
+class JobSystem
+{
+public:
+    explicit JobSystem(unsigned threadCount);
+    ~JobSystem();
+
+    void run(const JobFunction& function, JobCounter* counter = 0, JobCounter* dependency = 0);
+    void wait(JobCounter& counter);
+    void parallelFor(size_t begin, size_t end, size_t grain, unsigned threadCount, const RangeFunction& body);
+
+    unsigned threadCount() const { return (unsigned)m_workers.size(); }
+    unsigned currentWorker() const;
+    JobSystemStats stats() const;
+    void resetStats();
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::vector<Job> jobs;      // ring buffer, power of two sized
+        size_t head;                // oldest job
+        size_t count;
+        std::atomic<uint64_t> executed;
+        std::atomic<uint64_t> stolen;
+        char padding[64];           // keeps neighbouring workers' hot fields apart
+    };
+
+    JobSystem(const JobSystem&);
+    JobSystem& operator=(const JobSystem&);
+
+    void push(unsigned worker, const Job& job);
+    bool runOne(unsigned worker);
+    void finish(JobCounter* counter);
+    void workerLoop(unsigned worker);
+
+    std::vector<std::unique_ptr<Worker> > m_workers;
+    std::vector<std::thread> m_threads;
+    std::atomic<int> m_queued;
+    std::atomic<int> m_sleeping;
+    std::atomic<bool> m_stop;
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+};
+
+JobSystem& defaultJobSystem();
@@ -0,0 +1,38 @@
+#include "core/parallel.h"
+#include "core/job_system.h"
+
+#include <thread>
+
+/**************************************************************
+ * hardwareThreadCount()
+ * --------------------
+ * Number of hardware threads, never less than one.
+ *************************************************************/
+unsigned hardwareThreadCount()
+{
+    unsigned count = std::thread::hardware_concurrency();
+    return count ? count : 1;
+}
+
+/**************************************************************
+ * parallelFor()
+ * ------------
+ * Runs body over [begin, end) on every hardware thread.
+ *************************************************************/
+void parallelFor(size_t begin, size_t end, size_t grain, const RangeFunction& body)
+{
+    parallelFor(begin, end, grain, hardwareThreadCount(), body);
+}
+
+/**************************************************************
+ * parallelFor()
+ * ------------
+ * Runs body over [begin, end) in chunks of grain items on up
+ * to threadCount threads of the default job system. The
+ * calling thread takes part, so a thread count of one runs
+ * everything inline.
+ *************************************************************/
+void parallelFor(size_t begin, size_t end, size_t grain, unsigned threadCount, const RangeFunction& body)
+{
+    defaultJobSystem().parallelFor(begin, end, grain, threadCount, body);
+}
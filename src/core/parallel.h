@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+/*************************************************************
+ * Parallel Helpers
+ * ----------------
+ * Minimal data-parallel primitives shared by the offline
+ * tools and the runtime. Work is split into chunks of
+ * `grain` items which are handed out dynamically, so uneven
+ * per-item cost (e.g. path tracing texels) still balances.
+ * They run on the shared job system (core/job_system.h), so
+ * threadCount is capped at its size and a parallelFor inside
+ * a job or another parallelFor does not oversubscribe.
+ ************************************************************/
+typedef std::function<void(size_t begin, size_t end)> RangeFunction;
+
+unsigned hardwareThreadCount();
+void parallelFor(size_t begin, size_t end, size_t grain, const RangeFunction& body);
+void parallelFor(size_t begin, size_t end, size_t grain, unsigned threadCount, const RangeFunction& body);
@@ -0,0 +1,66 @@
+#include "core/pool_allocator.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+PoolAllocator::PoolAllocator(size_t elementSize, size_t elementsPerChunk, size_t alignment)
+    : m_free(0), m_elementsPerChunk(std::max<size_t>(elementsPerChunk, 1)),
+      m_alignment(std::max(alignment, sizeof(void*)))
+{
+    elementSize = std::max(elementSize, sizeof(void*));
+    m_elementSize = (elementSize + m_alignment - 1) / m_alignment * m_alignment;
+    m_stats.live = 0;
+    m_stats.peak = 0;
+    m_stats.capacity = 0;
+    m_stats.chunkAllocations = 0;
+}
+
+PoolAllocator::~PoolAllocator()
+{
+    for(size_t i = 0; i < m_chunks.size(); ++i)
+        std::free(m_chunks[i]);
+}
+
+void* PoolAllocator::allocate()
+{
+    if(!m_free)
+        addChunk();
+    void* element = m_free;
+    m_free = *(void**)element;
+    m_stats.peak = std::max(m_stats.peak, ++m_stats.live);
+    return element;
+}
+
+void PoolAllocator::free(void* element)
+{
+    if(!element)
+        return;
+    *(void**)element = m_free;
+    m_free = element;
+    --m_stats.live;
+}
+
+/**************************************************************
+ * PoolAllocator::addChunk()
+ * ------------------------
+ * Takes a chunk from the heap, over-allocated so its first
+ * block can be aligned, and threads its blocks onto the free
+ * list in address order.
+ *************************************************************/
+void PoolAllocator::addChunk()
+{
+    uint8_t* chunk = (uint8_t*)std::malloc(m_elementSize * m_elementsPerChunk + m_alignment - 1);
+    if(!chunk)
+        throw std::bad_alloc();
+    m_chunks.push_back(chunk);
+
+    uint8_t* first = (uint8_t*)(((uintptr_t)chunk + m_alignment - 1) & ~(uintptr_t)(m_alignment - 1));
+    for(size_t i = m_elementsPerChunk; i-- > 0;)
+    {
+        void* element = first + i * m_elementSize;
+        *(void**)element = m_free;
+        m_free = element;
+    }
+    m_stats.capacity += m_elementsPerChunk;
+    ++m_stats.chunkAllocations;
+}
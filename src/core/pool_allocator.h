@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+/*************************************************************
+ * PoolAllocator
+ * -------------
+ * Fixed-size blocks carved from chunks of elementsPerChunk,
+ * with freed blocks kept on an intrusive free list, so both
+ * allocate() and free() are a pointer swap. Chunks are only
+ * returned when the pool is destroyed: a pool that has grown
+ * to its working size no longer touches the heap. Not thread
+ * safe; give each thread its own pool or lock around it.
+ ************************************************************/
+struct PoolStats
+{
+    size_t live;                // blocks allocated and not yet freed
+    size_t peak;                // largest live seen
+    size_t capacity;            // blocks in all chunks
+    uint64_t chunkAllocations;  // times a chunk was taken from the heap
+};
+
+class PoolAllocator
+{
+public:
+    PoolAllocator(size_t elementSize, size_t elementsPerChunk = 256, size_t alignment = 16);
+    ~PoolAllocator();
+
+    void* allocate();
+    void free(void* element);
+
+    size_t elementSize() const { return m_elementSize; }
+    const PoolStats& stats() const { return m_stats; }
+
+private:
+    PoolAllocator(const PoolAllocator&);
+    PoolAllocator& operator=(const PoolAllocator&);
+
+    void addChunk();
+
+    std::vector<uint8_t*> m_chunks;
+    void* m_free;               // first free block, each holds the next
+    size_t m_elementSize;       // rounded up to the alignment
+    size_t m_elementsPerChunk;
+    size_t m_alignment;
+    PoolStats m_stats;
+};
+
+/*************************************************************
+ * ObjectPool
+ * ----------
+ * Typed PoolAllocator that constructs and destroys in place,
+ * for components and other objects created and destroyed at
+ * run time:
+ *
+ *     ObjectPool<Particle> particles;
+ *     Particle* p = particles.create(position, velocity);
+ *     particles.destroy(p);
+ ************************************************************/
+template<typename T>
+class ObjectPool
+{
+public:
+    explicit ObjectPool(size_t elementsPerChunk = 256)
+        : m_pool(sizeof(T), elementsPerChunk, alignof(T) > sizeof(void*) ? alignof(T) : sizeof(void*)) {}
+
+    template<typename... Args>
+    T* create(Args&&... args) { return new(m_pool.allocate()) T(std::forward<Args>(args)...); }
+
+    void destroy(T* object)
+    {
+        if(!object)
+            return;
+        object->~T();
+        m_pool.free(object);
+    }
+
+    const PoolStats& stats() const { return m_pool.stats(); }
+
+private:
+    PoolAllocator m_pool;
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_SSE
+#endif
+
+/*************************************************************
+ * SIMD Lanes
+ * ----------
+ * The few float operations the culling kernels need, over 8
+ * lanes with AVX, 4 with SSE2 (always present on x86-64) or
+ * a single float elsewhere, so a kernel is written once in
+ * terms of SimdFloat and SimdWidth. AVX is chosen at compile
+ * time (-mavx / /arch:AVX); there is no runtime dispatch.
+ *
+ * Comparisons return lane masks (all bits set or clear) for
+ * simdAnd, simdSelect and simdMask.
+ ************************************************************/
+#if defined(SIMD_AVX)
+typedef __m256 SimdFloat;
+const size_t SimdWidth = 8;
+
+inline SimdFloat simdSplat(float v) { return _mm256_set1_ps(v); }
+inline SimdFloat simdLoad(const float* p) { return _mm256_loadu_ps(p); }
+inline void simdStore(float* p, SimdFloat a) { _mm256_storeu_ps(p, a); }
+inline SimdFloat simdRamp() { return _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f); }
+inline SimdFloat simdAdd(SimdFloat a, SimdFloat b) { return _mm256_add_ps(a, b); }
+inline SimdFloat simdSub(SimdFloat a, SimdFloat b) { return _mm256_sub_ps(a, b); }
+inline SimdFloat simdMul(SimdFloat a, SimdFloat b) { return _mm256_mul_ps(a, b); }
+inline SimdFloat simdDiv(SimdFloat a, SimdFloat b) { return _mm256_div_ps(a, b); }
+inline SimdFloat simdMin(SimdFloat a, SimdFloat b) { return _mm256_min_ps(a, b); }
+inline SimdFloat simdMax(SimdFloat a, SimdFloat b) { return _mm256_max_ps(a, b); }
+inline SimdFloat simdGreaterEqual(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+inline SimdFloat simdAnd(SimdFloat a, SimdFloat b) { return _mm256_and_ps(a, b); }
+inline SimdFloat simdSelect(SimdFloat mask, SimdFloat a, SimdFloat b) { return _mm256_blendv_ps(b, a, mask); }
+inline unsigned simdMask(SimdFloat mask) { return (unsigned)_mm256_movemask_ps(mask); }
+#elif defined(SIMD_SSE)
+typedef __m128 SimdFloat;
+const size_t SimdWidth = 4;
+
+inline SimdFloat simdSplat(float v) { return _mm_set1_ps(v); }
+inline SimdFloat simdLoad(const float* p) { return _mm_loadu_ps(p); }
+inline void simdStore(float* p, SimdFloat a) { _mm_storeu_ps(p, a); }
+inline SimdFloat simdRamp() { return _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f); }
+inline SimdFloat simdAdd(SimdFloat a, SimdFloat b) { return _mm_add_ps(a, b); }
+inline SimdFloat simdSub(SimdFloat a, SimdFloat b) { return _mm_sub_ps(a, b); }
+inline SimdFloat simdMul(SimdFloat a, SimdFloat b) { return _mm_mul_ps(a, b); }
+inline SimdFloat simdDiv(SimdFloat a, SimdFloat b) { return _mm_div_ps(a, b); }
+inline SimdFloat simdMin(SimdFloat a, SimdFloat b) { return _mm_min_ps(a, b); }
+inline SimdFloat simdMax(SimdFloat a, SimdFloat b) { return _mm_max_ps(a, b); }
+inline SimdFloat simdGreaterEqual(SimdFloat a, SimdFloat b) { return _mm_cmpge_ps(a, b); }
+inline SimdFloat simdAnd(SimdFloat a, SimdFloat b) { return _mm_and_ps(a, b); }
+inline SimdFloat simdSelect(SimdFloat mask, SimdFloat a, SimdFloat b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+inline unsigned simdMask(SimdFloat mask) { return (unsigned)_mm_movemask_ps(mask); }
+#else
+typedef float SimdFloat;
+const size_t SimdWidth = 1;
+
+// Masks are 1.0f or 0.0f in the scalar build
+inline SimdFloat simdSplat(float v) { return v; }
+inline SimdFloat simdLoad(const float* p) { return *p; }
+inline void simdStore(float* p, SimdFloat a) { *p = a; }
+inline SimdFloat simdRamp() { return 0.0f; }
+inline SimdFloat simdAdd(SimdFloat a, SimdFloat b) { return a + b; }
+inline SimdFloat simdSub(SimdFloat a, SimdFloat b) { return a - b; }
+inline SimdFloat simdMul(SimdFloat a, SimdFloat b) { return a * b; }
+inline SimdFloat simdDiv(SimdFloat a, SimdFloat b) { return a / b; }
+inline SimdFloat simdMin(SimdFloat a, SimdFloat b) { return a < b ? a : b; }
+inline SimdFloat simdMax(SimdFloat a, SimdFloat b) { return a > b ? a : b; }
+inline SimdFloat simdGreaterEqual(SimdFloat a, SimdFloat b) { return a >= b ? 1.0f : 0.0f; }
+inline SimdFloat simdAnd(SimdFloat a, SimdFloat b) { return a * b; }
+inline SimdFloat simdSelect(SimdFloat mask, SimdFloat a, SimdFloat b) { return mask != 0.0f ? a : b; }
+inline unsigned simdMask(SimdFloat mask) { return mask != 0.0f ? 1u : 0u; }
+#endif
+
+/*************************************************************
+ * 4x4 Matrix Product
+ * ------------------
+ * out = a * b for column-major 4x4 float matrices (glm's
+ * layout), each output column a sum of a's columns scaled by
+ * one column of b, four floats per instruction. out may not
+ * alias a or b.
+ ************************************************************/
+#if defined(SIMD_AVX) || defined(SIMD_SSE)
+inline void simdMultiplyMat4(const float* a, const float* b, float* out)
+{
+    __m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + 4), a2 = _mm_loadu_ps(a + 8), a3 = _mm_loadu_ps(a + 12);
+    for(int c = 0; c < 4; ++c)
+    {
+        const float* column = b + 4 * c;
+        __m128 xy = _mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(column[0])), _mm_mul_ps(a1, _mm_set1_ps(column[1])));
+        __m128 zw = _mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(column[2])), _mm_mul_ps(a3, _mm_set1_ps(column[3])));
+        _mm_storeu_ps(out + 4 * c, _mm_add_ps(xy, zw));
+    }
+}
+#else
+inline void simdMultiplyMat4(const float* a, const float* b, float* out)
+{
+    for(int c = 0; c < 4; ++c)
+    {
+        for(int r = 0; r < 4; ++r)
+        {
+            out[4 * c + r] = a[r] * b[4 * c] + a[4 + r] * b[4 * c + 1]
+                           + a[8 + r] * b[4 * c + 2] + a[12 + r] * b[4 * c + 3];
+        }
+    }
+}
+#endif
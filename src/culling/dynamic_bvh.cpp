@@ -0,0 +1,557 @@
+#include "culling/dynamic_bvh.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    struct StackEntry
+    {
+        uint32_t node;
+        float cost;                 // inherited SAH cost, or ray entry distance
+    };
+
+    struct FrustumEntry
+    {
+        uint32_t node;
+        unsigned planes;            // planes the node is not yet known to be inside of
+    };
+
+    float surfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+    {
+        glm::vec3 d = boundsMax - boundsMin;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    float unionArea(const glm::vec3& minA, const glm::vec3& maxA, const glm::vec3& minB, const glm::vec3& maxB)
+    {
+        return surfaceArea(glm::min(minA, minB), glm::max(maxA, maxB));
+    }
+
+    bool contains(const glm::vec3& outerMin, const glm::vec3& outerMax,
+                  const glm::vec3& innerMin, const glm::vec3& innerMax)
+    {
+        return glm::all(glm::lessThanEqual(outerMin, innerMin)) && glm::all(glm::lessThanEqual(innerMax, outerMax));
+    }
+
+    bool intersectBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+                         const glm::vec3& origin, const glm::vec3& invDir, float tMax, float& tEnter)
+    {
+        glm::vec3 t0 = (boundsMin - origin) * invDir;
+        glm::vec3 t1 = (boundsMax - origin) * invDir;
+        glm::vec3 tNear = glm::min(t0, t1);
+        glm::vec3 tFar = glm::max(t0, t1);
+        float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+        float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, tMax));
+        tEnter = enter;
+        return enter <= exit;
+    }
+}
+
+DynamicBVH::DynamicBVH(float margin)
+    : m_root(NullNode), m_freeList(NullNode), m_leafCount(0), m_margin(margin)
+{
+}
+
+/**************************************************************
+ * DynamicBVH::insert()
+ * -------------------
+ * Adds an object and returns its proxy, which stays valid
+ * until remove().
+ *************************************************************/
+uint32_t DynamicBVH::insert(const glm::vec3& boundsMin, const glm::vec3& boundsMax, uint32_t userData)
+{
+    uint32_t leaf = allocateNode();
+    Node& node = m_nodes[leaf];
+    node.boundsMin = boundsMin - glm::vec3(m_margin);
+    node.boundsMax = boundsMax + glm::vec3(m_margin);
+    node.userData = userData;
+    node.height = 0;
+
+    insertLeaf(leaf);
+    ++m_leafCount;
+    return leaf;
+}
+
+void DynamicBVH::remove(uint32_t proxy)
+{
+    removeLeaf(proxy);
+    freeNode(proxy);
+    --m_leafCount;
+}
+
+/**************************************************************
+ * DynamicBVH::move()
+ * -----------------
+ * Gives a proxy new bounds. Returns false, and does nothing,
+ * while the bounds still fit inside the leaf's fat box;
+ * otherwise the leaf is re-fattened around them and queued
+ * for the next commit().
+ *************************************************************/
+bool DynamicBVH::move(uint32_t proxy, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    Node& node = m_nodes[proxy];
+    if(contains(node.boundsMin, node.boundsMax, boundsMin, boundsMax))
+        return false;
+
+    node.boundsMin = boundsMin - glm::vec3(m_margin);
+    node.boundsMax = boundsMax + glm::vec3(m_margin);
+    if(!node.moved)
+    {
+        node.moved = true;
+        m_moved.push_back(proxy);
+    }
+    return true;
+}
+
+/**************************************************************
+ * DynamicBVH::commit()
+ * -------------------
+ * Refits the ancestors of every moved leaf. Each ancestor is
+ * flagged once however many of its leaves moved, and the
+ * flagged nodes are refitted in order of height so children
+ * are always done before their parents; each one also gets
+ * a rotation, which is what keeps the tree tight as objects
+ * drift away from where they were inserted.
+ *************************************************************/
+void DynamicBVH::commit()
+{
+    std::vector<uint32_t> dirty;
+    for(size_t i = 0; i < m_moved.size(); ++i)
+    {
+        Node& leaf = m_nodes[m_moved[i]];
+        if(!leaf.moved || leaf.height != 0)
+            continue;
+        leaf.moved = false;
+        for(uint32_t p = leaf.parent; p != NullNode && !m_nodes[p].moved; p = m_nodes[p].parent)
+        {
+            m_nodes[p].moved = true;
+            dirty.push_back(p);
+        }
+    }
+    m_moved.clear();
+
+    std::sort(dirty.begin(), dirty.end(), [this](uint32_t a, uint32_t b)
+    {
+        return m_nodes[a].height < m_nodes[b].height;
+    });
+    for(size_t i = 0; i < dirty.size(); ++i)
+    {
+        refit(dirty[i]);
+        rotate(dirty[i]);
+        m_nodes[dirty[i]].moved = false;
+    }
+}
+
+void DynamicBVH::clear()
+{
+    m_nodes.clear();
+    m_moved.clear();
+    m_root = NullNode;
+    m_freeList = NullNode;
+    m_leafCount = 0;
+}
+
+/**************************************************************
+ * DynamicBVH::queryFrustum()
+ * -------------------------
+ * Tests boxes against the planes still in play: a plane that
+ * a node lies entirely inside of is dropped for the whole
+ * subtree, so once no planes are left every leaf below is
+ * reported without further tests.
+ *************************************************************/
+void DynamicBVH::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& results) const
+{
+    if(m_root == NullNode)
+        return;
+
+    std::vector<FrustumEntry> stack;
+    stack.reserve(64);
+    FrustumEntry root = { m_root, 0x3f };
+    stack.push_back(root);
+    while(!stack.empty())
+    {
+        FrustumEntry entry = stack.back();
+        stack.pop_back();
+        const Node& node = m_nodes[entry.node];
+
+        glm::vec3 center = (node.boundsMin + node.boundsMax) * 0.5f;
+        glm::vec3 extent = (node.boundsMax - node.boundsMin) * 0.5f;
+        unsigned mask = entry.planes;
+        bool outside = false;
+        for(int p = 0; p < 6 && !outside; ++p)
+        {
+            if(!(mask & (1u << p)))
+                continue;
+            const glm::vec4& plane = frustum.planes[p];
+            float d = glm::dot(glm::vec3(plane), center) + plane.w;
+            float r = glm::dot(glm::abs(glm::vec3(plane)), extent);
+            if(d + r < 0.0f)
+                outside = true;
+            else if(d - r >= 0.0f)
+                mask &= ~(1u << p);
+        }
+
+        if(outside)
+            continue;
+        if(node.isLeaf())
+            results.push_back(node.userData);
+        else
+        {
+            for(int c = 0; c < 2; ++c)
+            {
+                FrustumEntry child = { node.children[c], mask };
+                stack.push_back(child);
+            }
+        }
+    }
+}
+
+void DynamicBVH::querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& results) const
+{
+    if(m_root == NullNode)
+        return;
+
+    std::vector<uint32_t> stack(1, m_root);
+    while(!stack.empty())
+    {
+        const Node& node = m_nodes[stack.back()];
+        stack.pop_back();
+
+        glm::vec3 offset = center - glm::clamp(center, node.boundsMin, node.boundsMax);
+        if(glm::dot(offset, offset) > radius * radius)
+            continue;
+        if(node.isLeaf())
+            results.push_back(node.userData);
+        else
+        {
+            stack.push_back(node.children[0]);
+            stack.push_back(node.children[1]);
+        }
+    }
+}
+
+void DynamicBVH::queryBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<uint32_t>& results) const
+{
+    if(m_root == NullNode)
+        return;
+
+    std::vector<uint32_t> stack(1, m_root);
+    while(!stack.empty())
+    {
+        const Node& node = m_nodes[stack.back()];
+        stack.pop_back();
+
+        if(glm::any(glm::lessThan(node.boundsMax, boundsMin)) || glm::any(glm::lessThan(boundsMax, node.boundsMin)))
+            continue;
+        if(node.isLeaf())
+            results.push_back(node.userData);
+        else
+        {
+            stack.push_back(node.children[0]);
+            stack.push_back(node.children[1]);
+        }
+    }
+}
+
+/**************************************************************
+ * DynamicBVH::raycast()
+ * --------------------
+ * Visits the leaf boxes along origin + t * direction for t in
+ * [0, tMax], nearer child first, so a closest-hit callback
+ * can shorten the ray early. The callback does the exact
+ * test, e.g. glm::intersectRaySphere() on the object.
+ *************************************************************/
+void DynamicBVH::raycast(const glm::vec3& origin, const glm::vec3& direction, float tMax,
+                         const RayCallback& callback) const
+{
+    if(m_root == NullNode)
+        return;
+
+    glm::vec3 invDir = 1.0f / direction;
+    std::vector<StackEntry> stack;
+    stack.reserve(64);
+    StackEntry root = { m_root, 0.0f };
+    stack.push_back(root);
+    while(!stack.empty())
+    {
+        StackEntry entry = stack.back();
+        stack.pop_back();
+        if(entry.cost > tMax)
+            continue;
+
+        const Node& node = m_nodes[entry.node];
+        if(node.isLeaf())
+        {
+            tMax = callback(node.userData, tMax);
+            if(tMax <= 0.0f)
+                return;
+            continue;
+        }
+
+        StackEntry children[2];
+        bool hit[2];
+        for(int c = 0; c < 2; ++c)
+        {
+            const Node& child = m_nodes[node.children[c]];
+            children[c].node = node.children[c];
+            hit[c] = intersectBounds(child.boundsMin, child.boundsMax, origin, invDir, tMax, children[c].cost);
+        }
+        int nearer = hit[1] && (!hit[0] || children[1].cost < children[0].cost) ? 1 : 0;
+        if(hit[1 - nearer])
+            stack.push_back(children[1 - nearer]);
+        if(hit[nearer])
+            stack.push_back(children[nearer]);
+    }
+}
+
+/**************************************************************
+ * DynamicBVH::areaRatio()
+ * ----------------------
+ * Summed surface area of the internal nodes relative to the
+ * root: the SAH traversal cost the tree's shape implies,
+ * lower is better.
+ *************************************************************/
+float DynamicBVH::areaRatio() const
+{
+    if(m_root == NullNode)
+        return 0.0f;
+
+    float total = 0.0f;
+    for(size_t i = 0; i < m_nodes.size(); ++i)
+    {
+        if(m_nodes[i].height > 0)
+            total += surfaceArea(m_nodes[i].boundsMin, m_nodes[i].boundsMax);
+    }
+    const Node& root = m_nodes[m_root];
+    return total / std::max(surfaceArea(root.boundsMin, root.boundsMax), 1e-20f);
+}
+
+uint32_t DynamicBVH::allocateNode()
+{
+    uint32_t index = m_freeList;
+    if(index == NullNode)
+    {
+        index = (uint32_t)m_nodes.size();
+        m_nodes.push_back(Node());
+    }
+    else
+        m_freeList = m_nodes[index].parent;
+
+    Node& node = m_nodes[index];
+    node.parent = NullNode;
+    node.userData = NullNode;
+    node.children[0] = node.children[1] = NullNode;
+    node.height = 0;
+    node.moved = false;
+    return index;
+}
+
+void DynamicBVH::freeNode(uint32_t node)
+{
+    m_nodes[node].parent = m_freeList;
+    m_nodes[node].height = -1;
+    m_nodes[node].moved = false;
+    m_freeList = node;
+}
+
+/**************************************************************
+ * DynamicBVH::findBestSibling()
+ * ----------------------------
+ * The node whose pairing with the new box adds the least
+ * area to the tree: the new parent's area plus the growth of
+ * every ancestor above it. The search descends from the root
+ * into the child with the lower bound on that cost and stops
+ * once neither child can beat the best node seen, so it
+ * costs one root to leaf walk at most.
+ *************************************************************/
+uint32_t DynamicBVH::findBestSibling(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+{
+    float leafArea = surfaceArea(boundsMin, boundsMax);
+    const Node& root = m_nodes[m_root];
+
+    uint32_t best = m_root;
+    float nodeArea = surfaceArea(root.boundsMin, root.boundsMax);
+    float direct = unionArea(root.boundsMin, root.boundsMax, boundsMin, boundsMax);
+    float inherited = 0.0f;
+    float bestCost = direct;
+
+    uint32_t index = m_root;
+    while(!m_nodes[index].isLeaf())
+    {
+        const Node& node = m_nodes[index];
+        float cost = direct + inherited;
+        if(cost < bestCost)
+        {
+            best = index;
+            bestCost = cost;
+        }
+        inherited += direct - nodeArea;
+
+    // A leaf child can only become the sibling; an internal one
+    // can be descended into, at a cost of at least lowerBound
+        float lowerBound[2], childDirect[2], childArea[2];
+        for(int c = 0; c < 2; ++c)
+        {
+            const Node& child = m_nodes[node.children[c]];
+            childArea[c] = surfaceArea(child.boundsMin, child.boundsMax);
+            childDirect[c] = unionArea(child.boundsMin, child.boundsMax, boundsMin, boundsMax);
+            if(child.isLeaf())
+            {
+                if(childDirect[c] + inherited < bestCost)
+                {
+                    best = node.children[c];
+                    bestCost = childDirect[c] + inherited;
+                }
+                lowerBound[c] = 1e30f;
+            }
+            else
+                lowerBound[c] = inherited + childDirect[c] + std::min(leafArea - childArea[c], 0.0f);
+        }
+
+        int next = lowerBound[1] < lowerBound[0] ? 1 : 0;
+        if(lowerBound[next] >= bestCost)
+            break;
+        index = node.children[next];
+        nodeArea = childArea[next];
+        direct = childDirect[next];
+    }
+    return best;
+}
+
+/**************************************************************
+ * DynamicBVH::insertLeaf()
+ * -----------------------
+ * Pairs the leaf with its best sibling under a new parent
+ * and refits and rotates the path up to the root.
+ *************************************************************/
+void DynamicBVH::insertLeaf(uint32_t leaf)
+{
+    if(m_root == NullNode)
+    {
+        m_root = leaf;
+        m_nodes[leaf].parent = NullNode;
+        return;
+    }
+
+    uint32_t sibling = findBestSibling(m_nodes[leaf].boundsMin, m_nodes[leaf].boundsMax);
+    uint32_t oldParent = m_nodes[sibling].parent;
+    uint32_t newParent = allocateNode();
+
+    Node& parent = m_nodes[newParent];
+    parent.parent = oldParent;
+    parent.children[0] = sibling;
+    parent.children[1] = leaf;
+    m_nodes[sibling].parent = newParent;
+    m_nodes[leaf].parent = newParent;
+
+    if(oldParent == NullNode)
+        m_root = newParent;
+    else
+    {
+        Node& grandparent = m_nodes[oldParent];
+        grandparent.children[grandparent.children[0] == sibling ? 0 : 1] = newParent;
+    }
+    refitAncestors(newParent);
+}
+
+/**************************************************************
+ * DynamicBVH::removeLeaf()
+ * -----------------------
+ * Replaces the leaf's parent with its sibling and refits
+ * from there up. The leaf itself is left for the caller.
+ *************************************************************/
+void DynamicBVH::removeLeaf(uint32_t leaf)
+{
+    if(leaf == m_root)
+    {
+        m_root = NullNode;
+        return;
+    }
+
+    uint32_t parent = m_nodes[leaf].parent;
+    uint32_t grandparent = m_nodes[parent].parent;
+    uint32_t sibling = m_nodes[parent].children[m_nodes[parent].children[0] == leaf ? 1 : 0];
+
+    m_nodes[sibling].parent = grandparent;
+    freeNode(parent);
+    if(grandparent == NullNode)
+        m_root = sibling;
+    else
+    {
+        Node& node = m_nodes[grandparent];
+        node.children[node.children[0] == parent ? 0 : 1] = sibling;
+        refitAncestors(grandparent);
+    }
+}
+
+void DynamicBVH::refit(uint32_t node)
+{
+    Node& n = m_nodes[node];
+    const Node& a = m_nodes[n.children[0]];
+    const Node& b = m_nodes[n.children[1]];
+    n.boundsMin = glm::min(a.boundsMin, b.boundsMin);
+    n.boundsMax = glm::max(a.boundsMax, b.boundsMax);
+    n.height = 1 + std::max(a.height, b.height);
+}
+
+/**************************************************************
+ * DynamicBVH::rotate()
+ * -------------------
+ * Tries swapping each child of node with a grandchild on the
+ * other side (four candidates) and applies the swap that
+ * shrinks the affected child's surface area the most, if
+ * any does. The node's own bounds never change.
+ *************************************************************/
+void DynamicBVH::rotate(uint32_t node)
+{
+    Node& a = m_nodes[node];
+    if(a.height < 2)
+        return;
+
+    int bestChild = -1, bestCousin = -1;
+    float bestDelta = 0.0f;
+    for(int side = 0; side < 2; ++side)
+    {
+    // Swap child 'side' with a child of the other child
+        const Node& moving = m_nodes[a.children[side]];
+        const Node& other = m_nodes[a.children[1 - side]];
+        if(other.isLeaf())
+            continue;
+
+        float otherArea = surfaceArea(other.boundsMin, other.boundsMax);
+        for(int cousin = 0; cousin < 2; ++cousin)
+        {
+            const Node& kept = m_nodes[other.children[1 - cousin]];
+            float delta = unionArea(moving.boundsMin, moving.boundsMax, kept.boundsMin, kept.boundsMax) - otherArea;
+            if(delta < bestDelta)
+            {
+                bestDelta = delta;
+                bestChild = side;
+                bestCousin = cousin;
+            }
+        }
+    }
+    if(bestChild < 0)
+        return;
+
+    uint32_t moving = a.children[bestChild];
+    uint32_t other = a.children[1 - bestChild];
+    uint32_t cousin = m_nodes[other].children[bestCousin];
+
+    a.children[bestChild] = cousin;
+    m_nodes[cousin].parent = node;
+    m_nodes[other].children[bestCousin] = moving;
+    m_nodes[moving].parent = other;
+    refit(other);
+    refit(node);
+}
+
+void DynamicBVH::refitAncestors(uint32_t node)
+{
+    for(uint32_t p = node; p != NullNode; p = m_nodes[p].parent)
+    {
+        refit(p);
+        rotate(p);
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "culling/frustum.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/*************************************************************
+ * DynamicBVH
+ * ----------
+ * Incrementally maintained AABB tree for scenes whose objects
+ * move, appear and disappear. Each object is a leaf (a proxy)
+ * holding a "fat" box: its bounds grown by a margin, so small
+ * movements stay inside and cost nothing.
+ *
+ * Leaves are inserted next to the sibling that adds the least
+ * surface area to the tree (a bounded descent over the SAH
+ * cost, as in Box2D v3), and every node whose children change
+ * tries a tree rotation that lowers its children's surface
+ * area. Moved objects are batched: move() only updates the
+ * leaf, and commit() refits every affected ancestor once,
+ * bottom up, rotating along the way so quality holds up
+ * without reinserting anything. Queries made between move()
+ * and commit() may miss moved objects.
+ *
+ * Frustum, sphere, box and ray queries all walk the same
+ * tree and report the userData given to insert().
+ ************************************************************/
+class DynamicBVH
+{
+public:
+    enum { NullNode = 0xffffffffu };
+
+// Receives the userData of each leaf box the ray enters and
+// the current ray end; returns the new end, so a closest-hit
+// query returns the hit distance and an any-hit query 0
+    typedef std::function<float(uint32_t userData, float tMax)> RayCallback;
+
+    explicit DynamicBVH(float margin = 0.1f);
+
+    uint32_t insert(const glm::vec3& boundsMin, const glm::vec3& boundsMax, uint32_t userData);
+    void remove(uint32_t proxy);
+    bool move(uint32_t proxy, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+    void commit();
+    void clear();
+
+    void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& results) const;
+    void querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& results) const;
+    void queryBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<uint32_t>& results) const;
+    void raycast(const glm::vec3& origin, const glm::vec3& direction, float tMax, const RayCallback& callback) const;
+
+    uint32_t userData(uint32_t proxy) const { return m_nodes[proxy].userData; }
+    size_t leafCount() const { return m_leafCount; }
+    int height() const { return m_root == NullNode ? 0 : m_nodes[m_root].height; }
+    float areaRatio() const;
+
+private:
+    struct Node
+    {
+        glm::vec3 boundsMin;
+        uint32_t parent;            // next free node while on the free list
+        glm::vec3 boundsMax;
+        uint32_t userData;
+        uint32_t children[2];       // NullNode for leaves
+        int height;                 // 0 for leaves, -1 when free
+        bool moved;                 // leaf queued for commit(), or internal node awaiting refit
+
+        bool isLeaf() const { return children[0] == NullNode; }
+    };
+
+    uint32_t allocateNode();
+    void freeNode(uint32_t node);
+    uint32_t findBestSibling(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+    void insertLeaf(uint32_t leaf);
+    void removeLeaf(uint32_t leaf);
+    void refit(uint32_t node);
+    void rotate(uint32_t node);
+    void refitAncestors(uint32_t node);
+
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_moved;
+    uint32_t m_root;
+    uint32_t m_freeList;
+    size_t m_leafCount;
+    float m_margin;
+};
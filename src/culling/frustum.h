@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+/*************************************************************
+ * Frustum
+ * -------
+ * The six clip planes of a view-projection matrix (Gribb and
+ * Hartmann), normalised so that dot(plane, vec4(p, 1)) is the
+ * signed distance of p, positive inside. Planes are ordered
+ * left, right, bottom, top, near, far.
+ ************************************************************/
+struct Frustum
+{
+    glm::vec4 planes[6];
+};
+
+inline Frustum makeFrustum(const glm::mat4& viewProjection)
+{
+    glm::vec4 row[4];
+    for(int r = 0; r < 4; ++r)
+        row[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+
+    Frustum frustum;
+    frustum.planes[0] = row[3] + row[0];
+    frustum.planes[1] = row[3] - row[0];
+    frustum.planes[2] = row[3] + row[1];
+    frustum.planes[3] = row[3] - row[1];
+    frustum.planes[4] = row[3] + row[2];
+    frustum.planes[5] = row[3] - row[2];
+    for(int i = 0; i < 6; ++i)
+        frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+    return frustum;
+}
+
+inline bool frustumIntersectsSphere(const Frustum& frustum, const glm::vec3& center, float radius)
+{
+    for(int i = 0; i < 6; ++i)
+    {
+        if(glm::dot(glm::vec3(frustum.planes[i]), center) + frustum.planes[i].w < -radius)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,243 @@
+#include "culling/frustum_culling.h"
+#include "core/parallel.h"
+#include "core/simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+// Padding volumes sit at the origin with a hugely negative
+// radius and extent, so every plane rejects them
+    const float Rejected = -1e30f;
+
+// Objects per parallel block; a multiple of every SIMD width
+    const size_t BlockSize = 16384;
+
+    struct PlaneLanes
+    {
+        SimdFloat x, y, z, w;
+        SimdFloat absX, absY, absZ;
+    };
+
+/*************************************************************
+ * cullRange()
+ * ----------
+ * The kernel. For each plane the signed distance of every
+ * lane is computed and the smallest distance plus radius (or
+ * projected box extent) across planes is kept; an object is
+ * visible when that minimum is not negative. Visible indices
+ * are written without branches: every lane is stored and the
+ * output cursor only advances for the visible ones.
+ * begin must be a multiple of SimdWidth; end may run into the
+ * padding.
+ ************************************************************/
+    size_t cullRange(const PlaneLanes* planes, const CullingVolumes& volumes, FrustumCullMode mode,
+                     size_t begin, size_t end, uint32_t* out)
+    {
+        bool spheres = mode != CullBox;
+        bool boxes = mode != CullSphere;
+        size_t count = 0;
+
+        for(size_t i = begin; i < end; i += SimdWidth)
+        {
+            unsigned mask = ~0u;
+            if(spheres)
+            {
+                SimdFloat x = simdLoad(&volumes.sphereX[i]);
+                SimdFloat y = simdLoad(&volumes.sphereY[i]);
+                SimdFloat z = simdLoad(&volumes.sphereZ[i]);
+                SimdFloat r = simdLoad(&volumes.radius[i]);
+                SimdFloat nearest = simdSplat(1e30f);
+                for(int p = 0; p < 6; ++p)
+                {
+                    const PlaneLanes& plane = planes[p];
+                    SimdFloat d = simdAdd(simdAdd(simdMul(plane.x, x), simdMul(plane.y, y)),
+                                          simdAdd(simdMul(plane.z, z), plane.w));
+                    nearest = simdMin(nearest, simdAdd(d, r));
+                }
+                mask &= simdMask(simdGreaterEqual(nearest, simdSplat(0.0f)));
+            }
+            if(boxes)
+            {
+                SimdFloat x = simdLoad(&volumes.boxX[i]);
+                SimdFloat y = simdLoad(&volumes.boxY[i]);
+                SimdFloat z = simdLoad(&volumes.boxZ[i]);
+                SimdFloat ex = simdLoad(&volumes.extentX[i]);
+                SimdFloat ey = simdLoad(&volumes.extentY[i]);
+                SimdFloat ez = simdLoad(&volumes.extentZ[i]);
+                SimdFloat nearest = simdSplat(1e30f);
+                for(int p = 0; p < 6; ++p)
+                {
+                    const PlaneLanes& plane = planes[p];
+                    SimdFloat d = simdAdd(simdAdd(simdMul(plane.x, x), simdMul(plane.y, y)),
+                                          simdAdd(simdMul(plane.z, z), plane.w));
+                    SimdFloat r = simdAdd(simdAdd(simdMul(plane.absX, ex), simdMul(plane.absY, ey)),
+                                          simdMul(plane.absZ, ez));
+                    nearest = simdMin(nearest, simdAdd(d, r));
+                }
+                mask &= simdMask(simdGreaterEqual(nearest, simdSplat(0.0f)));
+            }
+
+            for(size_t k = 0; k < SimdWidth; ++k)
+            {
+                out[count] = (uint32_t)(i + k);
+                count += (mask >> k) & 1;
+            }
+        }
+        return count;
+    }
+
+    void splatPlanes(const Frustum& frustum, PlaneLanes* planes)
+    {
+        for(int p = 0; p < 6; ++p)
+        {
+            const glm::vec4& plane = frustum.planes[p];
+            planes[p].x = simdSplat(plane.x);
+            planes[p].y = simdSplat(plane.y);
+            planes[p].z = simdSplat(plane.z);
+            planes[p].w = simdSplat(plane.w);
+            planes[p].absX = simdSplat(std::abs(plane.x));
+            planes[p].absY = simdSplat(std::abs(plane.y));
+            planes[p].absZ = simdSplat(std::abs(plane.z));
+        }
+    }
+}
+
+CullingVolumes::CullingVolumes()
+    : count(0)
+{
+}
+
+void CullingVolumes::reserve(size_t capacity)
+{
+    capacity = (capacity + Padding - 1) / Padding * Padding;
+    std::vector<float>* arrays[] = { &sphereX, &sphereY, &sphereZ, &radius, &boxX, &boxY, &boxZ,
+                                     &extentX, &extentY, &extentZ };
+    for(size_t a = 0; a < sizeof(arrays) / sizeof(arrays[0]); ++a)
+        arrays[a]->reserve(capacity);
+}
+
+void CullingVolumes::clear()
+{
+    std::vector<float>* arrays[] = { &sphereX, &sphereY, &sphereZ, &radius, &boxX, &boxY, &boxZ,
+                                     &extentX, &extentY, &extentZ };
+    for(size_t a = 0; a < sizeof(arrays) / sizeof(arrays[0]); ++a)
+        arrays[a]->clear();
+    count = 0;
+}
+
+/**************************************************************
+ * CullingVolumes::add()
+ * --------------------
+ * Appends an object, growing the arrays by a whole padding
+ * block of rejected volumes when the last block is full.
+ *************************************************************/
+uint32_t CullingVolumes::add(const glm::vec3& center, float sphereRadius, const glm::vec3& boundsMin,
+                             const glm::vec3& boundsMax)
+{
+    if(count == sphereX.size())
+    {
+        size_t padded = count + Padding;
+        sphereX.resize(padded, 0.0f);
+        sphereY.resize(padded, 0.0f);
+        sphereZ.resize(padded, 0.0f);
+        radius.resize(padded, Rejected);
+        boxX.resize(padded, 0.0f);
+        boxY.resize(padded, 0.0f);
+        boxZ.resize(padded, 0.0f);
+        extentX.resize(padded, Rejected);
+        extentY.resize(padded, Rejected);
+        extentZ.resize(padded, Rejected);
+    }
+
+    uint32_t index = (uint32_t)count++;
+    setSphere(index, center, sphereRadius);
+    setBox(index, boundsMin, boundsMax);
+    return index;
+}
+
+void CullingVolumes::setSphere(uint32_t index, const glm::vec3& center, float sphereRadius)
+{
+    sphereX[index] = center.x;
+    sphereY[index] = center.y;
+    sphereZ[index] = center.z;
+    radius[index] = sphereRadius;
+}
+
+void CullingVolumes::setBox(uint32_t index, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+    glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+    boxX[index] = center.x;
+    boxY[index] = center.y;
+    boxZ[index] = center.z;
+    extentX[index] = extent.x;
+    extentY[index] = extent.y;
+    extentZ[index] = extent.z;
+}
+
+unsigned frustumCullWidth()
+{
+    return (unsigned)SimdWidth;
+}
+
+/**************************************************************
+ * cullFrustum()
+ * ------------
+ * Culls every volume on the calling thread. Returns the
+ * number of visible objects, which is also visible.size().
+ *************************************************************/
+size_t cullFrustum(const Frustum& frustum, const CullingVolumes& volumes, FrustumCullMode mode,
+                   std::vector<uint32_t>& visible)
+{
+    PlaneLanes planes[6];
+    splatPlanes(frustum, planes);
+
+    visible.resize(volumes.paddedSize());
+    size_t count = visible.empty() ? 0 : cullRange(planes, volumes, mode, 0, volumes.paddedSize(), &visible[0]);
+    visible.resize(count);
+    return count;
+}
+
+/**************************************************************
+ * cullFrustumParallel()
+ * --------------------
+ * Culls fixed blocks of objects on threadCount threads. Each
+ * block writes its visible indices at its own offset in the
+ * output, then the blocks are moved together in order, so
+ * the result is the same as cullFrustum().
+ *************************************************************/
+size_t cullFrustumParallel(const Frustum& frustum, const CullingVolumes& volumes, FrustumCullMode mode,
+                           unsigned threadCount, std::vector<uint32_t>& visible)
+{
+    size_t total = volumes.paddedSize();
+    size_t blocks = (total + BlockSize - 1) / BlockSize;
+    if(blocks <= 1 || threadCount <= 1)
+        return cullFrustum(frustum, volumes, mode, visible);
+
+    PlaneLanes planes[6];
+    splatPlanes(frustum, planes);
+
+    visible.resize(total);
+    std::vector<size_t> counts(blocks);
+    parallelFor(0, blocks, 1, threadCount, [&](size_t begin, size_t end)
+    {
+        for(size_t b = begin; b < end; ++b)
+        {
+            size_t first = b * BlockSize;
+            counts[b] = cullRange(planes, volumes, mode, first, std::min(first + BlockSize, total), &visible[first]);
+        }
+    });
+
+    size_t count = counts[0];
+    for(size_t b = 1; b < blocks; ++b)
+    {
+        if(counts[b])
+            std::memmove(&visible[count], &visible[b * BlockSize], counts[b] * sizeof(uint32_t));
+        count += counts[b];
+    }
+    visible.resize(count);
+    return count;
+}
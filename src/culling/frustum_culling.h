@@ -0,0 +1,66 @@
+#pragma once
+
+#include "culling/frustum.h"
+
+#include <cstdint>
+#include <vector>
+
+/*************************************************************
+ * CullingVolumes
+ * --------------
+ * Bounding spheres and AABBs of many objects, stored as one
+ * array per component (structure of arrays) so the frustum
+ * test can load 4 or 8 objects per instruction. Boxes are
+ * kept as center and half extent.
+ *
+ * Arrays are padded to a multiple of Padding with volumes
+ * that fail every plane, so the SIMD loop never needs a
+ * scalar tail.
+ ************************************************************/
+struct CullingVolumes
+{
+    enum { Padding = 8 };
+
+    CullingVolumes();
+
+    void reserve(size_t capacity);
+    void clear();
+    uint32_t add(const glm::vec3& center, float sphereRadius, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+    void setSphere(uint32_t index, const glm::vec3& center, float sphereRadius);
+    void setBox(uint32_t index, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+    size_t size() const { return count; }
+    size_t paddedSize() const { return sphereX.size(); }
+
+    std::vector<float> sphereX, sphereY, sphereZ, radius;
+    std::vector<float> boxX, boxY, boxZ;
+    std::vector<float> extentX, extentY, extentZ;
+    size_t count;
+};
+
+/*************************************************************
+ * Frustum Culling
+ * ---------------
+ * Tests every volume against the six planes and writes the
+ * indices of the visible ones, in increasing order, to a
+ * compacted list. CullSphereAndBox keeps an object only if
+ * both its sphere and its box pass, which is tighter than
+ * either alone for long thin objects.
+ *
+ * With AVX enabled at compile time 8 objects are tested per
+ * instruction, otherwise 4 with SSE2 (always present on
+ * x86-64), and a scalar loop elsewhere. frustumCullWidth()
+ * reports which one was built.
+ ************************************************************/
+enum FrustumCullMode
+{
+    CullSphere,
+    CullBox,
+    CullSphereAndBox
+};
+
+unsigned frustumCullWidth();
+size_t cullFrustum(const Frustum& frustum, const CullingVolumes& volumes, FrustumCullMode mode,
+                   std::vector<uint32_t>& visible);
+size_t cullFrustumParallel(const Frustum& frustum, const CullingVolumes& volumes, FrustumCullMode mode,
+                           unsigned threadCount, std::vector<uint32_t>& visible);
@@ -0,0 +1,490 @@
+#include "culling/occlusion_buffer.h"
+#include "core/parallel.h"
+#include "core/simd.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// Objects per parallel block in cullOccluded()
+    const size_t TestBlockSize = 1024;
+
+    inline float nearDistance(const glm::vec4& clip)
+    {
+        return clip.z + clip.w;
+    }
+}
+
+OcclusionBuffer::OcclusionBuffer()
+    : m_viewProjection(1.0f), m_width(0), m_height(0), m_tilesX(0), m_tilesY(0)
+{
+}
+
+/**************************************************************
+ * OcclusionBuffer::init()
+ * ----------------------
+ * Sizes the buffer, rounded up to whole tiles, and allocates
+ * the pyramid down to 1x1.
+ *************************************************************/
+void OcclusionBuffer::init(int width, int height)
+{
+    m_tilesX = std::max((width + TileWidth - 1) / TileWidth, 1);
+    m_tilesY = std::max((height + TileHeight - 1) / TileHeight, 1);
+    m_width = m_tilesX * TileWidth;
+    m_height = m_tilesY * TileHeight;
+    m_bins.assign(m_tilesX * m_tilesY, std::vector<uint32_t>());
+
+    m_levels.clear();
+    m_levelSizes.clear();
+    glm::ivec2 size(m_width, m_height);
+    while(true)
+    {
+        m_levelSizes.push_back(size);
+        m_levels.push_back(std::vector<float>(size.x * size.y, 1.0f));
+        if(size.x == 1 && size.y == 1)
+            break;
+        size = glm::max((size + 1) / 2, glm::ivec2(1));
+    }
+}
+
+void OcclusionBuffer::begin(const glm::mat4& viewProjection)
+{
+    m_viewProjection = viewProjection;
+    m_triangles.clear();
+    for(size_t i = 0; i < m_bins.size(); ++i)
+        m_bins[i].clear();
+}
+
+/**************************************************************
+ * OcclusionBuffer::addOccluder()
+ * -----------------------------
+ * Transforms an indexed triangle list to clip space, clips it
+ * against the near plane and bins the resulting triangles.
+ * Both faces are rasterized, so open meshes such as single
+ * walls work as occluders from either side.
+ *************************************************************/
+void OcclusionBuffer::addOccluder(const glm::vec3* positions, const uint32_t* indices, size_t indexCount,
+                                  const glm::mat4& model)
+{
+    glm::mat4 transform = m_viewProjection * model;
+    for(size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        glm::vec4 clip[3];
+        for(int k = 0; k < 3; ++k)
+            clip[k] = transform * glm::vec4(positions[indices[i + k]], 1.0f);
+
+    // Trivially outside one of the side or far planes
+        bool outside = false;
+        for(int axis = 0; axis < 3 && !outside; ++axis)
+        {
+            outside = (clip[0][axis] > clip[0].w && clip[1][axis] > clip[1].w && clip[2][axis] > clip[2].w)
+                   || (axis < 2 && clip[0][axis] < -clip[0].w && clip[1][axis] < -clip[1].w
+                       && clip[2][axis] < -clip[2].w);
+        }
+        if(outside)
+            continue;
+
+        int behind = (nearDistance(clip[0]) < 0.0f) + (nearDistance(clip[1]) < 0.0f) + (nearDistance(clip[2]) < 0.0f);
+        if(behind == 3)
+            continue;
+        if(behind == 0)
+        {
+            addTriangle(clip);
+            continue;
+        }
+
+    // Sutherland-Hodgman against z = -w leaves 3 or 4 vertices
+        glm::vec4 polygon[4];
+        int count = 0;
+        for(int k = 0; k < 3; ++k)
+        {
+            const glm::vec4& a = clip[k];
+            const glm::vec4& b = clip[(k + 1) % 3];
+            float da = nearDistance(a), db = nearDistance(b);
+            if(da >= 0.0f)
+                polygon[count++] = a;
+            if((da >= 0.0f) != (db >= 0.0f))
+                polygon[count++] = a + (b - a) * (da / (da - db));
+        }
+        for(int k = 1; k + 1 < count; ++k)
+        {
+            glm::vec4 triangle[3] = { polygon[0], polygon[k], polygon[k + 1] };
+            addTriangle(triangle);
+        }
+    }
+}
+
+/**************************************************************
+ * OcclusionBuffer::addTriangle()
+ * -----------------------------
+ * Projects a clipped triangle to pixels and adds it to the
+ * bin of every tile its bounding box touches.
+ *************************************************************/
+void OcclusionBuffer::addTriangle(const glm::vec4* clip)
+{
+    ScreenTriangle triangle;
+    glm::vec2 boundsMin(1e30f), boundsMax(-1e30f);
+    for(int k = 0; k < 3; ++k)
+    {
+        glm::vec3 ndc = glm::vec3(clip[k]) / std::max(clip[k].w, 1e-6f);
+        triangle.v[k] = glm::vec3((ndc.x * 0.5f + 0.5f) * m_width, (ndc.y * 0.5f + 0.5f) * m_height,
+                                  ndc.z * 0.5f + 0.5f);
+        boundsMin = glm::min(boundsMin, glm::vec2(triangle.v[k]));
+        boundsMax = glm::max(boundsMax, glm::vec2(triangle.v[k]));
+    }
+
+// Vertices close to the near plane can project far off screen;
+// keep the bounds in int range
+    boundsMin = glm::clamp(boundsMin, -1.0f, (float)(m_width + m_height));
+    boundsMax = glm::clamp(boundsMax, -1.0f, (float)(m_width + m_height));
+
+    glm::vec2 e1 = glm::vec2(triangle.v[1] - triangle.v[0]);
+    glm::vec2 e2 = glm::vec2(triangle.v[2] - triangle.v[0]);
+    if(e1.x * e2.y - e1.y * e2.x == 0.0f)
+        return;
+
+    if(boundsMax.x < 0.0f || boundsMax.y < 0.0f || boundsMin.x >= m_width || boundsMin.y >= m_height)
+        return;
+    int x0 = std::max((int)std::floor(boundsMin.x), 0) / TileWidth;
+    int y0 = std::max((int)std::floor(boundsMin.y), 0) / TileHeight;
+    int x1 = std::min((int)std::floor(boundsMax.x), m_width - 1) / TileWidth;
+    int y1 = std::min((int)std::floor(boundsMax.y), m_height - 1) / TileHeight;
+
+    uint32_t index = (uint32_t)m_triangles.size();
+    m_triangles.push_back(triangle);
+    for(int ty = y0; ty <= y1; ++ty)
+    {
+        for(int tx = x0; tx <= x1; ++tx)
+            m_bins[ty * m_tilesX + tx].push_back(index);
+    }
+}
+
+/**************************************************************
+ * OcclusionBuffer::rasterize()
+ * ---------------------------
+ * Rasterizes every tile, each on whichever thread picks it
+ * up, then builds the pyramid level by level.
+ *************************************************************/
+void OcclusionBuffer::rasterize(unsigned threadCount)
+{
+    parallelFor(0, m_bins.size(), 1, threadCount, [this](size_t begin, size_t end)
+    {
+        for(size_t tile = begin; tile < end; ++tile)
+            rasterizeTile((int)tile);
+    });
+    for(int level = 1; level < levelCount(); ++level)
+        buildLevel(level, threadCount);
+}
+
+/**************************************************************
+ * OcclusionBuffer::rasterizeTile()
+ * -------------------------------
+ * Clears the tile to the far plane and draws its triangles
+ * with edge functions evaluated at pixel centres, SimdWidth
+ * pixels per step. Depth (z/w) is linear in screen space, so
+ * it is a plane evaluated the same way. Each row only visits
+ * the steps its span overlaps. Tiles are a multiple of
+ * SimdWidth wide, so whole steps never leave the tile.
+ *************************************************************/
+void OcclusionBuffer::rasterizeTile(int tile)
+{
+    int tileX = (tile % m_tilesX) * TileWidth;
+    int tileY = (tile / m_tilesX) * TileHeight;
+    float* depth = &m_levels[0][0];
+    for(int y = tileY; y < tileY + TileHeight; ++y)
+        std::fill(depth + y * m_width + tileX, depth + y * m_width + tileX + TileWidth, 1.0f);
+
+    const SimdFloat ramp = simdAdd(simdRamp(), simdSplat(0.5f));
+    const SimdFloat zero = simdSplat(0.0f);
+    const std::vector<uint32_t>& bin = m_bins[tile];
+    for(size_t t = 0; t < bin.size(); ++t)
+    {
+        const ScreenTriangle& triangle = m_triangles[bin[t]];
+        glm::vec3 v0 = triangle.v[0], v1 = triangle.v[1], v2 = triangle.v[2];
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+        if(area < 0.0f)
+        {
+            std::swap(v1, v2);
+            area = -area;
+        }
+
+    // Edge a->b is A x + B y + C, positive on the inside
+        const glm::vec3* edges[3][2] = { { &v1, &v2 }, { &v2, &v0 }, { &v0, &v1 } };
+        float a[3], b[3], c[3];
+        for(int e = 0; e < 3; ++e)
+        {
+            const glm::vec3& from = *edges[e][0];
+            const glm::vec3& to = *edges[e][1];
+            a[e] = from.y - to.y;
+            b[e] = to.x - from.x;
+            c[e] = -(a[e] * from.x + b[e] * from.y);
+        }
+
+    // Edge e weighs the vertex opposite it, so the depth plane
+    // is the edge functions weighted by z over the area
+        float zA = (a[0] * v0.z + a[1] * v1.z + a[2] * v2.z) / area;
+        float zB = (b[0] * v0.z + b[1] * v1.z + b[2] * v2.z) / area;
+        float zC = (c[0] * v0.z + c[1] * v1.z + c[2] * v2.z) / area;
+
+        float minX = std::min(std::min(v0.x, v1.x), v2.x), maxX = std::max(std::max(v0.x, v1.x), v2.x);
+        float minY = std::min(std::min(v0.y, v1.y), v2.y), maxY = std::max(std::max(v0.y, v1.y), v2.y);
+        int x0 = (int)std::max(std::floor(minX), (float)tileX);
+        int x1 = (int)std::min(std::floor(maxX), (float)(tileX + TileWidth - 1));
+        int y0 = (int)std::max(std::floor(minY), (float)tileY);
+        int y1 = (int)std::min(std::floor(maxY), (float)(tileY + TileHeight - 1));
+
+        SimdFloat stepA0 = simdSplat(a[0]), stepA1 = simdSplat(a[1]), stepA2 = simdSplat(a[2]);
+        SimdFloat stepZ = simdSplat(zA);
+        for(int y = y0; y <= y1; ++y)
+        {
+            float py = y + 0.5f;
+            float* row = depth + y * m_width;
+
+        // Each edge bounds the row's covered span from one side;
+        // the span is widened by a pixel against rounding and the
+        // edge tests below stay exact
+            float spanMin = (float)x0, spanMax = (float)x1;
+            for(int e = 0; e < 3; ++e)
+            {
+                float k = b[e] * py + c[e];
+                if(a[e] > 0.0f)
+                    spanMin = std::max(spanMin, std::floor(-k / a[e] - 0.5f) - 1.0f);
+                else if(a[e] < 0.0f)
+                    spanMax = std::min(spanMax, std::ceil(-k / a[e] - 0.5f) + 1.0f);
+                else if(k < 0.0f)
+                    spanMax = -1.0f;
+            }
+            if(spanMin > spanMax)
+                continue;
+            int rowX0 = (int)spanMin, rowX1 = (int)spanMax;
+            rowX0 = tileX + (rowX0 - tileX) / (int)SimdWidth * (int)SimdWidth;
+
+            for(int x = rowX0; x <= rowX1; x += (int)SimdWidth)
+            {
+                SimdFloat px = simdAdd(simdSplat((float)x), ramp);
+                SimdFloat e0 = simdAdd(simdMul(stepA0, px), simdSplat(b[0] * py + c[0]));
+                SimdFloat e1 = simdAdd(simdMul(stepA1, px), simdSplat(b[1] * py + c[1]));
+                SimdFloat e2 = simdAdd(simdMul(stepA2, px), simdSplat(b[2] * py + c[2]));
+                SimdFloat inside = simdAnd(simdAnd(simdGreaterEqual(e0, zero), simdGreaterEqual(e1, zero)),
+                                           simdGreaterEqual(e2, zero));
+                if(!simdMask(inside))
+                    continue;
+
+                SimdFloat z = simdAdd(simdMul(stepZ, px), simdSplat(zB * py + zC));
+                SimdFloat current = simdLoad(row + x);
+                simdStore(row + x, simdSelect(inside, simdMin(current, z), current));
+            }
+        }
+    }
+}
+
+/**************************************************************
+ * OcclusionBuffer::buildLevel()
+ * ----------------------------
+ * Each texel keeps the farthest of the 2x2 texels below it;
+ * odd edges repeat the last row or column.
+ *************************************************************/
+void OcclusionBuffer::buildLevel(int level, unsigned threadCount)
+{
+    const std::vector<float>& source = m_levels[level - 1];
+    std::vector<float>& target = m_levels[level];
+    glm::ivec2 sourceSize = m_levelSizes[level - 1];
+    glm::ivec2 size = m_levelSizes[level];
+
+    parallelFor(0, size.y, 16, threadCount, [&](size_t begin, size_t end)
+    {
+        for(int y = (int)begin; y < (int)end; ++y)
+        {
+            const float* row0 = &source[2 * y * sourceSize.x];
+            const float* row1 = &source[std::min(2 * y + 1, sourceSize.y - 1) * sourceSize.x];
+            for(int x = 0; x < size.x; ++x)
+            {
+                int xa = 2 * x, xb = std::min(2 * x + 1, sourceSize.x - 1);
+                target[y * size.x + x] = std::max(std::max(row0[xa], row0[xb]), std::max(row1[xa], row1[xb]));
+            }
+        }
+    });
+}
+
+/**************************************************************
+ * OcclusionBuffer::testBox()
+ * -------------------------
+ * Projects the box's corners and tests the rectangle they
+ * cover. The corners are the projected minimum corner plus
+ * the matrix columns scaled by the box size, which is cheaper
+ * than eight full transforms.
+ *************************************************************/
+bool OcclusionBuffer::testBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+{
+    glm::vec3 size = boundsMax - boundsMin;
+    glm::vec4 base = m_viewProjection * glm::vec4(boundsMin, 1.0f);
+    glm::vec4 stepX = m_viewProjection[0] * size.x;
+    glm::vec4 stepY = m_viewProjection[1] * size.y;
+    glm::vec4 stepZ = m_viewProjection[2] * size.z;
+
+    glm::vec3 clipMin(1e30f), clipMax(-1e30f);
+    for(int k = 0; k < 8; ++k)
+    {
+        glm::vec4 clip = base;
+        if(k & 1)
+            clip += stepX;
+        if(k & 2)
+            clip += stepY;
+        if(k & 4)
+            clip += stepZ;
+        if(nearDistance(clip) <= 0.0f || clip.w <= 1e-6f)
+            return true;
+
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        clipMin = glm::min(clipMin, ndc);
+        clipMax = glm::max(clipMax, ndc);
+    }
+    return testRect(clipMin, clipMax);
+}
+
+/**************************************************************
+ * OcclusionBuffer::testRect()
+ * --------------------------
+ * Compares the nearest depth of a projected box, given as its
+ * NDC bounds, against the farthest occluder depth over the
+ * covered rectangle, read from the first pyramid level where
+ * that rectangle spans at most MaxTestTexels texels each way.
+ * Returns false only when the box is certainly hidden or
+ * entirely off screen.
+ *************************************************************/
+bool OcclusionBuffer::testRect(const glm::vec3& ndcMin, const glm::vec3& ndcMax) const
+{
+    float screenMinX = (ndcMin.x * 0.5f + 0.5f) * m_width, screenMaxX = (ndcMax.x * 0.5f + 0.5f) * m_width;
+    float screenMinY = (ndcMin.y * 0.5f + 0.5f) * m_height, screenMaxY = (ndcMax.y * 0.5f + 0.5f) * m_height;
+    if(screenMaxX < 0.0f || screenMaxY < 0.0f || screenMinX >= m_width || screenMinY >= m_height)
+        return false;
+    float nearest = ndcMin.z * 0.5f + 0.5f;
+
+    int x0 = (int)std::max(std::floor(screenMinX) - 1.0f, 0.0f);
+    int y0 = (int)std::max(std::floor(screenMinY) - 1.0f, 0.0f);
+    int x1 = (int)std::min(std::floor(screenMaxX) + 1.0f, (float)(m_width - 1));
+    int y1 = (int)std::min(std::floor(screenMaxY) + 1.0f, (float)(m_height - 1));
+
+    int level = 0;
+    while(level + 1 < levelCount()
+          && ((x1 >> level) - (x0 >> level) >= MaxTestTexels || (y1 >> level) - (y0 >> level) >= MaxTestTexels))
+        ++level;
+
+    const float* depth = &m_levels[level][0];
+    int stride = m_levelSizes[level].x;
+    for(int y = y0 >> level; y <= y1 >> level; ++y)
+    {
+        for(int x = x0 >> level; x <= x1 >> level; ++x)
+        {
+            if(depth[y * stride + x] >= nearest)
+                return true;
+        }
+    }
+    return false;
+}
+
+/**************************************************************
+ * OcclusionBuffer::cullOccluded()
+ * ------------------------------
+ * Removes the hidden objects from a visible list (such as
+ * the output of cullFrustum()), keeping the order. Boxes are
+ * projected SimdWidth at a time, one per lane, in parallel
+ * blocks; only the pyramid lookups are per box.
+ *************************************************************/
+size_t OcclusionBuffer::cullOccluded(const CullingVolumes& volumes, std::vector<uint32_t>& visible,
+                                     unsigned threadCount) const
+{
+    std::vector<char> keep(visible.size());
+    parallelFor(0, visible.size(), TestBlockSize, threadCount, [&](size_t begin, size_t end)
+    {
+        const glm::mat4& m = m_viewProjection;
+        const SimdFloat zero = simdSplat(0.0f), minW = simdSplat(1e-6f);
+        for(size_t i = begin; i < end; i += SimdWidth)
+        {
+            size_t lanes = std::min(end - i, SimdWidth);
+
+        // Gather the boxes; spare lanes repeat the last one
+            float gathered[6][SimdWidth];
+            for(size_t lane = 0; lane < SimdWidth; ++lane)
+            {
+                uint32_t object = visible[i + std::min(lane, lanes - 1)];
+                gathered[0][lane] = volumes.boxX[object];
+                gathered[1][lane] = volumes.boxY[object];
+                gathered[2][lane] = volumes.boxZ[object];
+                gathered[3][lane] = volumes.extentX[object];
+                gathered[4][lane] = volumes.extentY[object];
+                gathered[5][lane] = volumes.extentZ[object];
+            }
+            SimdFloat centerX = simdLoad(gathered[0]), centerY = simdLoad(gathered[1]);
+            SimdFloat centerZ = simdLoad(gathered[2]), extentX = simdLoad(gathered[3]);
+            SimdFloat extentY = simdLoad(gathered[4]), extentZ = simdLoad(gathered[5]);
+
+        // Clip space centre, and the offsets of the corners from it
+        // along each box axis, per component x, y, z, w
+            SimdFloat center[4], offsetX[4], offsetY[4], offsetZ[4];
+            for(int r = 0; r < 4; ++r)
+            {
+                center[r] = simdAdd(simdAdd(simdMul(simdSplat(m[0][r]), centerX), simdMul(simdSplat(m[1][r]), centerY)),
+                                    simdAdd(simdMul(simdSplat(m[2][r]), centerZ), simdSplat(m[3][r])));
+                offsetX[r] = simdMul(simdSplat(m[0][r]), extentX);
+                offsetY[r] = simdMul(simdSplat(m[1][r]), extentY);
+                offsetZ[r] = simdMul(simdSplat(m[2][r]), extentZ);
+            }
+
+            SimdFloat ndcMin[3], ndcMax[3];
+            for(int r = 0; r < 3; ++r)
+            {
+                ndcMin[r] = simdSplat(1e30f);
+                ndcMax[r] = simdSplat(-1e30f);
+            }
+            unsigned crossing = 0;
+            for(int k = 0; k < 8; ++k)
+            {
+                SimdFloat clip[4];
+                for(int r = 0; r < 4; ++r)
+                {
+                    SimdFloat dx = (k & 1) ? offsetX[r] : simdSub(zero, offsetX[r]);
+                    SimdFloat dy = (k & 2) ? offsetY[r] : simdSub(zero, offsetY[r]);
+                    SimdFloat dz = (k & 4) ? offsetZ[r] : simdSub(zero, offsetZ[r]);
+                    clip[r] = simdAdd(center[r], simdAdd(dx, simdAdd(dy, dz)));
+                }
+                crossing |= simdMask(simdGreaterEqual(zero, simdAdd(clip[2], clip[3])))
+                          | simdMask(simdGreaterEqual(minW, clip[3]));
+                for(int r = 0; r < 3; ++r)
+                {
+                    SimdFloat ndc = simdDiv(clip[r], clip[3]);
+                    ndcMin[r] = simdMin(ndcMin[r], ndc);
+                    ndcMax[r] = simdMax(ndcMax[r], ndc);
+                }
+            }
+
+            float bounds[6][SimdWidth];
+            for(int r = 0; r < 3; ++r)
+            {
+                simdStore(bounds[r], ndcMin[r]);
+                simdStore(bounds[3 + r], ndcMax[r]);
+            }
+            for(size_t lane = 0; lane < lanes; ++lane)
+            {
+                if(crossing & (1u << lane))
+                {
+                    keep[i + lane] = true;
+                    continue;
+                }
+                glm::vec3 boundsMin(bounds[0][lane], bounds[1][lane], bounds[2][lane]);
+                glm::vec3 boundsMax(bounds[3][lane], bounds[4][lane], bounds[5][lane]);
+                keep[i + lane] = testRect(boundsMin, boundsMax);
+            }
+        }
+    });
+
+    size_t count = 0;
+    for(size_t i = 0; i < visible.size(); ++i)
+    {
+        visible[count] = visible[i];
+        count += keep[i];
+    }
+    visible.resize(count);
+    return count;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "culling/frustum_culling.h"
+
+#include <cstdint>
+#include <vector>
+
+/*************************************************************
+ * OcclusionBuffer
+ * ---------------
+ * Software occlusion culling. A few designated occluders
+ * (walls, floors, large props, preferably simplified meshes)
+ * are rasterized on the CPU into a small depth buffer, which
+ * is reduced into a hierarchical-Z pyramid holding the
+ * farthest depth of each 2x2 block per level. Objects are
+ * then tested by projecting their bounding boxes: an object
+ * is hidden when its nearest depth lies behind the farthest
+ * occluder depth over the whole screen rectangle it covers.
+ * The test reads one pyramid level picked so the rectangle
+ * spans at most 4x4 texels. Per frame:
+ *
+ *     buffer.begin(viewProjection);
+ *     buffer.addOccluder(positions, indices, indexCount, model);
+ *     buffer.rasterize(threads);
+ *     buffer.cullOccluded(volumes, visible, threads);
+ *
+ * after which only the objects left in visible are submitted
+ * to the render queue. Depth is z/w mapped to [0, 1], 1 far.
+ *
+ * The screen is split into TileWidth x TileHeight tiles;
+ * triangles are binned per tile and tiles are rasterized in
+ * parallel, SimdWidth pixels at a time. Pixels are covered
+ * when their centre is, so tested rectangles are grown by a
+ * pixel on each side to stay conservative along occluder
+ * edges. Boxes crossing the near plane are always visible.
+ ************************************************************/
+class OcclusionBuffer
+{
+public:
+    enum
+    {
+        TileWidth = 32,
+        TileHeight = 16,
+        MaxTestTexels = 4
+    };
+
+    OcclusionBuffer();
+
+    void init(int width, int height);
+    void begin(const glm::mat4& viewProjection);
+    void addOccluder(const glm::vec3* positions, const uint32_t* indices, size_t indexCount, const glm::mat4& model);
+    void rasterize(unsigned threadCount);
+
+    bool testBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+    size_t cullOccluded(const CullingVolumes& volumes, std::vector<uint32_t>& visible, unsigned threadCount) const;
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    int levelCount() const { return (int)m_levels.size(); }
+    int levelWidth(int level) const { return m_levelSizes[level].x; }
+    int levelHeight(int level) const { return m_levelSizes[level].y; }
+    const float* depth(int level) const { return &m_levels[level][0]; }
+    size_t triangleCount() const { return m_triangles.size(); }
+
+private:
+    struct ScreenTriangle
+    {
+        glm::vec3 v[3];             // pixels x and y, depth z
+    };
+
+    void addTriangle(const glm::vec4* clip);
+    void rasterizeTile(int tile);
+    void buildLevel(int level, unsigned threadCount);
+    bool testRect(const glm::vec3& ndcMin, const glm::vec3& ndcMax) const;
+
+    glm::mat4 m_viewProjection;
+    int m_width;
+    int m_height;
+    int m_tilesX;
+    int m_tilesY;
+    std::vector<ScreenTriangle> m_triangles;
+    std::vector<std::vector<uint32_t> > m_bins;
+    std::vector<std::vector<float> > m_levels;
+    std::vector<glm::ivec2> m_levelSizes;
+};
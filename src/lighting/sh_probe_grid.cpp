@@ -0,0 +1,450 @@
+#include "lighting/sh_probe_grid.h"
+#include "core/parallel.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+    const float Pi = glm::pi<float>();
+
+// Windowed inverse square falloff that reaches zero at range
+    float lightFalloff(float distance2, float range)
+    {
+        float falloff = 1.0f / glm::max(distance2, 1e-8f);
+        if(range <= 0.0f)
+            return falloff;
+        float ratio2 = distance2 / (range * range);
+        float window = glm::clamp(1.0f - ratio2 * ratio2, 0.0f, 1.0f);
+        return falloff * window * window;
+    }
+}
+
+SHProbeGrid::SHProbeGrid()
+    : m_boundsMin(0.0f), m_boundsMax(0.0f), m_resolution(0), m_epsilon(1e-4f), m_bvh(NULL),
+      m_dirtyMin(0), m_dirtyMax(-1), m_state(NULL)
+{
+    for(int i = 0; i < 9; ++i)
+        m_textures[i] = 0;
+}
+
+SHProbeGrid::~SHProbeGrid()
+{
+    if(m_textures[0])
+        m_state->deleteTextures(9, m_textures);
+}
+
+/**************************************************************
+ * SHProbeGrid::configure()
+ * -----------------------
+ * Places resolution probes along each axis so the outermost
+ * probes sit on the bounds. Clears any previous bake.
+ *************************************************************/
+void SHProbeGrid::configure(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::ivec3& resolution)
+{
+    m_boundsMin = boundsMin;
+    m_boundsMax = boundsMax;
+    m_resolution = glm::max(resolution, glm::ivec3(2));
+    m_epsilon = glm::max(glm::length(boundsMax - boundsMin) * 1e-4f, 1e-5f);
+
+    m_probes.assign((size_t)m_resolution.x * m_resolution.y * m_resolution.z, Probe());
+    for(int z = 0; z < m_resolution.z; ++z)
+        for(int y = 0; y < m_resolution.y; ++y)
+            for(int x = 0; x < m_resolution.x; ++x)
+            {
+                Probe& probe = m_probes[index(glm::ivec3(x, y, z))];
+                probe.position = probePosition(glm::ivec3(x, y, z));
+                probe.hitCentre = probe.position;
+                probe.hitRadius = -1.0f;
+                probe.firstHit = 0;
+                probe.hitCount = 0;
+                shZero(probe.staticRadiance);
+                shZero(probe.irradiance);
+            }
+
+    m_hits.clear();
+    m_hitValid.clear();
+    m_lightRadiance.assign(m_lights.size() * m_probes.size(), SH9Color());
+    m_dirtyMin = glm::ivec3(0);
+    m_dirtyMax = m_resolution - 1;
+
+    if(m_textures[0])
+    {
+        m_state->deleteTextures(9, m_textures);
+        for(int i = 0; i < 9; ++i)
+            m_textures[i] = 0;
+    }
+}
+
+/**************************************************************
+ * SHProbeGrid::bake()
+ * ------------------
+ * Traces samplesPerProbe directions from every probe in
+ * parallel and caches the first hit of each. Directions are
+ * a Fibonacci spiral, an even stratification of the sphere
+ * shared by all probes so the SH basis is evaluated once.
+ *************************************************************/
+void SHProbeGrid::bake(const BakeScene& scene, const TriangleBVH& bvh, int samplesPerProbe, unsigned threadCount)
+{
+    m_bvh = &bvh;
+    uint32_t sampleCount = (uint32_t)glm::max(samplesPerProbe, 16);
+
+    m_directions.resize(sampleCount);
+    m_basis.resize(sampleCount * 9);
+    const float GoldenAngle = Pi * (3.0f - std::sqrt(5.0f));
+    for(uint32_t i = 0; i < sampleCount; ++i)
+    {
+        float z = 1.0f - (2.0f * i + 1.0f) / sampleCount;
+        float r = std::sqrt(glm::max(0.0f, 1.0f - z * z));
+        float phi = GoldenAngle * i;
+        m_directions[i] = glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+        shBasis(m_directions[i], &m_basis[i * 9]);
+    }
+
+    m_hits.resize(m_probes.size() * sampleCount);
+    m_hitValid.assign(m_hits.size(), 0);
+    float weight = 4.0f * Pi / sampleCount;
+
+    parallelFor(0, m_probes.size(), 16, threadCount, [&](size_t begin, size_t end)
+    {
+        for(size_t p = begin; p < end; ++p)
+        {
+            Probe& probe = m_probes[p];
+            probe.firstHit = (uint32_t)(p * sampleCount);
+            probe.hitCount = sampleCount;
+            shZero(probe.staticRadiance);
+
+            glm::vec3 hitMin(FLT_MAX), hitMax(-FLT_MAX);
+            for(uint32_t s = 0; s < sampleCount; ++s)
+            {
+                Ray ray = { probe.position, m_directions[s], 0.0f, FLT_MAX };
+                RayHit hit;
+                glm::vec3 radiance;
+                if(bvh.intersect(ray, hit))
+                {
+                    const uint32_t* tri = &scene.indices[hit.triangle * 3];
+                    const glm::vec3& a = scene.positions[tri[0]];
+                    glm::vec3 normal = glm::normalize(glm::cross(scene.positions[tri[1]] - a, scene.positions[tri[2]] - a));
+                    if(glm::dot(normal, ray.direction) > 0.0f)
+                        normal = -normal;
+
+                    const BakeMaterial& material = scene.materials[scene.triangleMaterials[hit.triangle]];
+                    CachedHit& cached = m_hits[probe.firstHit + s];
+                    cached.position = ray.origin + ray.direction * hit.t;
+                    cached.normal = normal;
+                    cached.albedo = material.albedo;
+                    m_hitValid[probe.firstHit + s] = 1;
+                    hitMin = glm::min(hitMin, cached.position);
+                    hitMax = glm::max(hitMax, cached.position);
+                    radiance = material.emission;
+                }
+                else
+                    radiance = scene.skyColor;
+
+                const float* basis = &m_basis[s * 9];
+                for(int i = 0; i < 9; ++i)
+                    probe.staticRadiance.c[i] += radiance * (basis[i] * weight);
+            }
+
+            probe.hitCentre = (hitMin + hitMax) * 0.5f;
+            probe.hitRadius = hitMin.x <= hitMax.x ? glm::length(hitMax - hitMin) * 0.5f : -1.0f;
+        }
+    });
+
+// Re-evaluate lights that were added before the bake
+    m_lightRadiance.assign(m_lights.size() * m_probes.size(), SH9Color());
+    std::vector<uint32_t> all(m_probes.size());
+    for(size_t p = 0; p < all.size(); ++p)
+        all[p] = (uint32_t)p;
+    for(size_t l = 0; l < m_lights.size(); ++l)
+        relight(l, all);
+    for(size_t p = 0; p < all.size(); ++p)
+    {
+        resolve((uint32_t)p);
+        markDirty((uint32_t)p);
+    }
+}
+
+/**************************************************************
+ * SHProbeGrid::addLight()
+ * ----------------------
+ * Adds a light and relights the probes it reaches. Returns
+ * the light's index for later updates.
+ *************************************************************/
+size_t SHProbeGrid::addLight(const ProbeLight& light)
+{
+    size_t id = m_lights.size();
+    m_lights.push_back(light);
+
+    std::vector<SH9Color> grown(m_lights.size() * m_probes.size());
+    std::copy(m_lightRadiance.begin(), m_lightRadiance.end(), grown.begin());
+    for(size_t p = 0; p < m_probes.size(); ++p)
+        shZero(grown[id * m_probes.size() + p]);
+    m_lightRadiance.swap(grown);
+
+    std::vector<uint32_t> affected;
+    for(size_t p = 0; p < m_probes.size(); ++p)
+        if(reaches(light, m_probes[p]))
+            affected.push_back((uint32_t)p);
+
+    relight(id, affected);
+    for(size_t i = 0; i < affected.size(); ++i)
+    {
+        resolve(affected[i]);
+        markDirty(affected[i]);
+    }
+    return id;
+}
+
+/**************************************************************
+ * SHProbeGrid::updateLight()
+ * -------------------------
+ * Changes a light and recomputes only the probes it reached
+ * before or reaches now. A pure colour change rescales the
+ * stored coefficients without tracing anything. Returns the
+ * number of probes that changed.
+ *************************************************************/
+size_t SHProbeGrid::updateLight(size_t light, const ProbeLight& value)
+{
+    ProbeLight previous = m_lights[light];
+    m_lights[light] = value;
+
+    std::vector<uint32_t> affected;
+    for(size_t p = 0; p < m_probes.size(); ++p)
+        if(reaches(previous, m_probes[p]) || reaches(value, m_probes[p]))
+            affected.push_back((uint32_t)p);
+
+    bool colourOnly = previous.position == value.position && previous.range == value.range
+                   && previous.color.r > 0.0f && previous.color.g > 0.0f && previous.color.b > 0.0f;
+    if(colourOnly)
+    {
+        glm::vec3 scale = value.color / previous.color;
+        for(size_t i = 0; i < affected.size(); ++i)
+        {
+            SH9Color& sh = m_lightRadiance[light * m_probes.size() + affected[i]];
+            for(int c = 0; c < 9; ++c)
+                sh.c[c] *= scale;
+        }
+    }
+    else
+        relight(light, affected);
+
+    for(size_t i = 0; i < affected.size(); ++i)
+    {
+        resolve(affected[i]);
+        markDirty(affected[i]);
+    }
+    return affected.size();
+}
+
+/**************************************************************
+ * SHProbeGrid::relight()
+ * ---------------------
+ * Projects one light's first bounce, seen through each
+ * probe's cached hits, into SH. Only shadow rays from the
+ * hits towards the light are traced.
+ *************************************************************/
+void SHProbeGrid::relight(size_t light, const std::vector<uint32_t>& probes)
+{
+    const ProbeLight& source = m_lights[light];
+    SH9Color* radiance = &m_lightRadiance[light * m_probes.size()];
+    float weight = m_directions.empty() ? 0.0f : 4.0f * Pi / m_directions.size();
+
+    parallelFor(0, probes.size(), 8, [&](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; ++i)
+        {
+            const Probe& probe = m_probes[probes[i]];
+            SH9Color& sh = radiance[probes[i]];
+            shZero(sh);
+            if(!m_bvh || !reaches(source, probe))
+                continue;
+
+            for(uint32_t s = 0; s < probe.hitCount; ++s)
+            {
+                if(!m_hitValid[probe.firstHit + s])
+                    continue;
+
+                const CachedHit& hit = m_hits[probe.firstHit + s];
+                glm::vec3 toLight = source.position - hit.position;
+                float distance2 = glm::dot(toLight, toLight);
+                float falloff = lightFalloff(distance2, source.range);
+                if(falloff <= 0.0f)
+                    continue;
+
+                float distance = std::sqrt(distance2);
+                toLight /= distance;
+                float cosine = glm::dot(hit.normal, toLight);
+                if(cosine <= 0.0f)
+                    continue;
+
+                Ray shadow = { hit.position + hit.normal * m_epsilon, toLight, 0.0f, distance - m_epsilon * 2.0f };
+                if(m_bvh->occluded(shadow))
+                    continue;
+
+            // Diffuse radiance leaving the hit back towards the probe
+                glm::vec3 exitant = hit.albedo * source.color * (cosine * falloff / Pi);
+                const float* basis = &m_basis[s * 9];
+                for(int c = 0; c < 9; ++c)
+                    sh.c[c] += exitant * (basis[c] * weight);
+            }
+        }
+    });
+}
+
+/**************************************************************
+ * SHProbeGrid::resolve()
+ * ---------------------
+ * Sums static and per-light radiance and folds it into the
+ * irradiance coefficients that get uploaded.
+ *************************************************************/
+void SHProbeGrid::resolve(uint32_t probe)
+{
+    SH9Color total = m_probes[probe].staticRadiance;
+    for(size_t l = 0; l < m_lights.size(); ++l)
+        shAdd(total, m_lightRadiance[l * m_probes.size() + probe]);
+    m_probes[probe].irradiance = shIrradianceCoefficients(total);
+}
+
+/**************************************************************
+ * SHProbeGrid::sampleIrradiance()
+ * ------------------------------
+ * CPU version of the shader lookup: trilinear blend of the
+ * eight surrounding probes, evaluated for normal.
+ *************************************************************/
+glm::vec3 SHProbeGrid::sampleIrradiance(const glm::vec3& position, const glm::vec3& normal) const
+{
+    if(m_probes.empty())
+        return glm::vec3(0.0f);
+
+    glm::vec3 cell = (position - m_boundsMin) / (m_boundsMax - m_boundsMin) * glm::vec3(m_resolution - 1);
+    cell = glm::clamp(cell, glm::vec3(0.0f), glm::vec3(m_resolution - 1));
+    glm::ivec3 base = glm::min(glm::ivec3(cell), m_resolution - 2);
+    glm::vec3 f = cell - glm::vec3(base);
+
+    SH9Color blended;
+    shZero(blended);
+    for(int corner = 0; corner < 8; ++corner)
+    {
+        glm::ivec3 offset(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1);
+        glm::vec3 w = glm::mix(glm::vec3(1.0f) - f, f, glm::vec3(offset));
+        float weight = w.x * w.y * w.z;
+        const SH9Color& sh = m_probes[index(base + offset)].irradiance;
+        for(int c = 0; c < 9; ++c)
+            blended.c[c] += sh.c[c] * weight;
+    }
+    return glm::max(shEvaluate(blended, normal), glm::vec3(0.0f));
+}
+
+/**************************************************************
+ * SHProbeGrid::upload()
+ * --------------------
+ * Creates the nine coefficient textures on first use and
+ * afterwards re-uploads only the box of probes that changed.
+ *************************************************************/
+void SHProbeGrid::upload(GLStateCache& state)
+{
+    if(m_probes.empty())
+        return;
+
+    bool create = m_textures[0] == 0;
+    if(create)
+    {
+        m_state = &state;
+        glGenTextures(9, m_textures);
+        m_dirtyMin = glm::ivec3(0);
+        m_dirtyMax = m_resolution - 1;
+    }
+    if(glm::any(glm::greaterThan(m_dirtyMin, m_dirtyMax)))
+        return;
+
+    glm::ivec3 size = m_dirtyMax - m_dirtyMin + 1;
+    std::vector<glm::vec3> texels((size_t)size.x * size.y * size.z);
+    for(int c = 0; c < 9; ++c)
+    {
+        size_t t = 0;
+        for(int z = m_dirtyMin.z; z <= m_dirtyMax.z; ++z)
+            for(int y = m_dirtyMin.y; y <= m_dirtyMax.y; ++y)
+                for(int x = m_dirtyMin.x; x <= m_dirtyMax.x; ++x)
+                    texels[t++] = m_probes[index(glm::ivec3(x, y, z))].irradiance.c[c];
+
+        state.bindTexture(0, GL_TEXTURE_3D, m_textures[c]);
+        if(create)
+        {
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+            glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB16F, size.x, size.y, size.z, 0, GL_RGB, GL_FLOAT, &texels[0]);
+        }
+        else
+            glTexSubImage3D(GL_TEXTURE_3D, 0, m_dirtyMin.x, m_dirtyMin.y, m_dirtyMin.z,
+                            size.x, size.y, size.z, GL_RGB, GL_FLOAT, &texels[0]);
+    }
+
+    m_dirtyMin = m_resolution;
+    m_dirtyMax = glm::ivec3(-1);
+}
+
+/**************************************************************
+ * SHProbeGrid::textureTransform()
+ * ------------------------------
+ * World position to texture coordinate as uvw = p * scale +
+ * bias, putting each probe on its texel centre.
+ *************************************************************/
+void SHProbeGrid::textureTransform(glm::vec3& scale, glm::vec3& bias) const
+{
+    glm::vec3 resolution(m_resolution);
+    glm::vec3 cellsPerUnit = (resolution - 1.0f) / (m_boundsMax - m_boundsMin);
+    scale = cellsPerUnit / resolution;
+    bias = (0.5f - m_boundsMin * cellsPerUnit) / resolution;
+}
+
+glm::vec3 SHProbeGrid::probePosition(const glm::ivec3& cell) const
+{
+    return m_boundsMin + (m_boundsMax - m_boundsMin) * glm::vec3(cell) / glm::vec3(m_resolution - 1);
+}
+
+const SH9Color& SHProbeGrid::probe(const glm::ivec3& cell) const
+{
+    return m_probes[index(cell)].irradiance;
+}
+
+size_t SHProbeGrid::index(const glm::ivec3& cell) const
+{
+    return ((size_t)cell.z * m_resolution.y + cell.y) * m_resolution.x + cell.x;
+}
+
+// Coarse bounding sphere test first, then the cached hits
+bool SHProbeGrid::reaches(const ProbeLight& light, const Probe& probe) const
+{
+    if(probe.hitRadius < 0.0f)
+        return false;
+    if(light.range <= 0.0f)
+        return true;
+    if(glm::length(light.position - probe.hitCentre) > light.range + probe.hitRadius)
+        return false;
+
+    float range2 = light.range * light.range;
+    for(uint32_t s = 0; s < probe.hitCount; ++s)
+    {
+        if(!m_hitValid[probe.firstHit + s])
+            continue;
+        glm::vec3 d = m_hits[probe.firstHit + s].position - light.position;
+        if(glm::dot(d, d) < range2)
+            return true;
+    }
+    return false;
+}
+
+void SHProbeGrid::markDirty(uint32_t probe)
+{
+    glm::ivec3 cell;
+    cell.x = (int)(probe % m_resolution.x);
+    cell.y = (int)((probe / m_resolution.x) % m_resolution.y);
+    cell.z = (int)(probe / ((size_t)m_resolution.x * m_resolution.y));
+    m_dirtyMin = glm::min(m_dirtyMin, cell);
+    m_dirtyMax = glm::max(m_dirtyMax, cell);
+}
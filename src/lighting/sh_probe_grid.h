@@ -0,0 +1,112 @@
+#pragma once
+
+#include "bake/lightmap_baker.h"
+#include "bake/triangle_bvh.h"
+#include "lighting/spherical_harmonics.h"
+#include "render/gl.h"
+#include "render/gl_state_cache.h"
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+/*************************************************************
+ * ProbeLight
+ * ----------
+ * Point light used for probe relighting. range bounds the
+ * light's influence (falloff is windowed to reach zero
+ * there), which is what lets a change touch only nearby
+ * probes. A range of zero or less means unbounded.
+ ************************************************************/
+struct ProbeLight
+{
+    glm::vec3 position;
+    glm::vec3 color;
+    float range;
+};
+
+/*************************************************************
+ * SHProbeGrid
+ * -----------
+ * Regular 3D grid of L2 SH irradiance probes. Baking traces a
+ * fixed set of directions from every probe and caches what
+ * each ray hit; relighting then only re-evaluates lights at
+ * those cached hits, one bounce deep, for the probes a light
+ * can reach. Coefficients are kept per light so a light can
+ * change without touching the others.
+ *
+ * On the GPU the grid is nine RGB16F 3D textures, one per
+ * coefficient (structure of arrays), sampled trilinearly by
+ * shaders/sh_irradiance.glsl. The BVH passed to bake() is
+ * kept for relighting and has to outlive the grid; so does
+ * the state cache passed to upload(), which binds the
+ * textures and so also has to delete them.
+ ************************************************************/
+class SHProbeGrid
+{
+public:
+    SHProbeGrid();
+    ~SHProbeGrid();
+
+    void configure(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::ivec3& resolution);
+    void bake(const BakeScene& scene, const TriangleBVH& bvh, int samplesPerProbe, unsigned threadCount);
+
+    size_t addLight(const ProbeLight& light);
+    size_t updateLight(size_t light, const ProbeLight& value);
+
+    glm::vec3 probePosition(const glm::ivec3& cell) const;
+    const SH9Color& probe(const glm::ivec3& cell) const;
+    glm::vec3 sampleIrradiance(const glm::vec3& position, const glm::vec3& normal) const;
+
+    void upload(GLStateCache& state);
+    GLuint texture(int coefficient) const { return m_textures[coefficient]; }
+    void textureTransform(glm::vec3& scale, glm::vec3& bias) const;
+
+    size_t probeCount() const { return m_probes.size(); }
+    size_t lightCount() const { return m_lights.size(); }
+
+private:
+    struct CachedHit
+    {
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec3 albedo;
+    };
+
+    struct Probe
+    {
+        glm::vec3 position;
+        glm::vec3 hitCentre;        // bounding sphere of the cached hits,
+        float hitRadius;            // negative if every ray escaped
+        uint32_t firstHit;
+        uint32_t hitCount;
+        SH9Color staticRadiance;    // sky and emissive surfaces
+        SH9Color irradiance;        // folded, ready to upload
+    };
+
+    size_t index(const glm::ivec3& cell) const;
+    bool reaches(const ProbeLight& light, const Probe& probe) const;
+    void relight(size_t light, const std::vector<uint32_t>& probes);
+    void resolve(uint32_t probe);
+    void markDirty(uint32_t probe);
+
+    glm::vec3 m_boundsMin;
+    glm::vec3 m_boundsMax;
+    glm::ivec3 m_resolution;
+    float m_epsilon;
+
+    const TriangleBVH* m_bvh;
+    std::vector<glm::vec3> m_directions;
+    std::vector<float> m_basis;                 // 9 per direction
+    std::vector<Probe> m_probes;
+    std::vector<CachedHit> m_hits;
+    std::vector<uint8_t> m_hitValid;            // 0 where the ray escaped
+
+    std::vector<ProbeLight> m_lights;
+    std::vector<SH9Color> m_lightRadiance;      // lights * probes
+
+    glm::ivec3 m_dirtyMin;
+    glm::ivec3 m_dirtyMax;
+    GLStateCache* m_state;
+    GLuint m_textures[9];
+};
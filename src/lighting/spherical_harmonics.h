@@ -0,0 +1,84 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+/*************************************************************
+ * SH9Color
+ * --------
+ * Order 2 (L2, nine coefficient) spherical harmonics with an
+ * RGB value per coefficient. Coefficients are ordered
+ *     Y00, Y1-1 (y), Y10 (z), Y11 (x),
+ *     Y2-2 (xy), Y2-1 (yz), Y20 (3z^2 - 1), Y21 (xz), Y22 (x^2 - y^2)
+ ************************************************************/
+struct SH9Color
+{
+    glm::vec3 c[9];
+};
+
+inline void shZero(SH9Color& sh)
+{
+    for(int i = 0; i < 9; ++i)
+        sh.c[i] = glm::vec3(0.0f);
+}
+
+inline void shAdd(SH9Color& sh, const SH9Color& other)
+{
+    for(int i = 0; i < 9; ++i)
+        sh.c[i] += other.c[i];
+}
+
+inline void shBasis(const glm::vec3& d, float basis[9])
+{
+    basis[0] = 0.282095f;
+    basis[1] = 0.488603f * d.y;
+    basis[2] = 0.488603f * d.z;
+    basis[3] = 0.488603f * d.x;
+    basis[4] = 1.092548f * d.x * d.y;
+    basis[5] = 1.092548f * d.y * d.z;
+    basis[6] = 0.315392f * (3.0f * d.z * d.z - 1.0f);
+    basis[7] = 1.092548f * d.x * d.z;
+    basis[8] = 0.546274f * (d.x * d.x - d.y * d.y);
+}
+
+/**************************************************************
+ * shIrradianceCoefficients()
+ * -------------------------
+ * Convolves projected radiance with the clamped cosine lobe
+ * (Ramamoorthi & Hanrahan) and divides by pi, then folds the
+ * basis constants in. The result evaluates to irradiance / pi
+ * for normal n as one MAD per coefficient against
+ *     1, y, z, x, xy, yz, 3z^2 - 1, xz, x^2 - y^2
+ * which is what shEvaluate() and sh_irradiance.glsl do.
+ *************************************************************/
+inline SH9Color shIrradianceCoefficients(const SH9Color& radiance)
+{
+    const float band0 = 1.0f;
+    const float band1 = 2.0f / 3.0f;
+    const float band2 = 1.0f / 4.0f;
+
+    SH9Color folded;
+    folded.c[0] = radiance.c[0] * (band0 * 0.282095f);
+    folded.c[1] = radiance.c[1] * (band1 * 0.488603f);
+    folded.c[2] = radiance.c[2] * (band1 * 0.488603f);
+    folded.c[3] = radiance.c[3] * (band1 * 0.488603f);
+    folded.c[4] = radiance.c[4] * (band2 * 1.092548f);
+    folded.c[5] = radiance.c[5] * (band2 * 1.092548f);
+    folded.c[6] = radiance.c[6] * (band2 * 0.315392f);
+    folded.c[7] = radiance.c[7] * (band2 * 1.092548f);
+    folded.c[8] = radiance.c[8] * (band2 * 0.546274f);
+    return folded;
+}
+
+inline glm::vec3 shEvaluate(const SH9Color& folded, const glm::vec3& n)
+{
+    return folded.c[0]
+         + folded.c[1] * n.y
+         + folded.c[2] * n.z
+         + folded.c[3] * n.x
+         + folded.c[4] * (n.x * n.y)
+         + folded.c[5] * (n.y * n.z)
+         + folded.c[6] * (3.0f * n.z * n.z - 1.0f)
+         + folded.c[7] * (n.x * n.z)
+         + folded.c[8] * (n.x * n.x - n.y * n.y);
+}
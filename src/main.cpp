@@ -1,6 +1,12 @@
-#define GLEW_STATIC
-#include <GL/glew.h>
+#include "core/allocation_stats.h"
+#include "core/frame_arena.h"
+#include "core/hot_reload.h"
+#include "core/job_system.h"
+#include "render/gl.h"
+#include "render/gl_state_cache.h"
 #include <GL/glfw3.h>
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 
 /*************************************************************
@@ -9,6 +15,13 @@
  * Set up global variables for this application
  ************************************************************/
 GLFWwindow* window;
+GLStateCache glState;
+unsigned long stateBudget = 0;
+FrameArena frameArena(defaultJobSystem());
+HotReloader hotReloader(defaultJobSystem());
+unsigned long allocationCheckAfter = 0;
+unsigned long frameNumber = 0;
+HeapStats frameHeap;
 /*************************************************************
  * Global GLFW and GL Functions
  * ----------------------------
@@ -20,6 +33,8 @@ void terminateApplication();
 bool initGLFW();
 bool initGLEW();
 void checkForErrors();
+void checkStateBudget();
+void checkFrameAllocations();
 void setWindowHints();
 void error_callback(int error, const char * desc);
 
@@ -43,6 +58,18 @@ int main(int argc, const char * argv[]) {
  *************************************************************/
 void startApplication()
 {
+// GL_STATE_BUDGET caps state calls issued per frame, so CI
+// (e.g. under Mesa llvmpipe) can fail on state thrash
+    const char* budget = std::getenv("GL_STATE_BUDGET");
+    if(budget)
+        stateBudget = std::strtoul(budget, NULL, 10);
+
+// FRAME_ALLOCATION_CHECK=N fails any frame after the first N
+// that allocates from the heap
+    const char* allocationCheck = std::getenv("FRAME_ALLOCATION_CHECK");
+    if(allocationCheck)
+        allocationCheckAfter = std::max(std::strtoul(allocationCheck, NULL, 10), 1ul);
+
     if(!initGLFW())
         exit(-1);
     if(!initGLEW())
@@ -61,6 +88,11 @@ void runApplication()
     {
     // Check for any OpenGL errors
         checkForErrors();
+        glState.beginFrame();
+        frameHeap = heapStats();
+
+    // Swap in assets changed on disk before anything uses them
+        hotReloader.update();
         
     // Poll for and process events
         glfwPollEvents();
@@ -70,6 +102,12 @@ void runApplication()
         
     // Swap front and back buffers
         glfwSwapBuffers(window);
+        checkStateBudget();
+
+    // Per-frame data ends with the frame
+        frameArena.reset();
+        checkFrameAllocations();
+        ++frameNumber;
     }
 }
 
@@ -137,7 +175,7 @@ bool initGLEW()
     glGetError();
 
 // Set our initial color to grey when the window first opens
-    glClearColor((GLclampf)0.8, (GLclampf)0.8, (GLclampf)0.8, (GLclampf)1.0);
+    glState.clearColor((GLclampf)0.8, (GLclampf)0.8, (GLclampf)0.8, (GLclampf)1.0);
     
     return true;
 }
@@ -173,6 +211,49 @@ void checkForErrors()
     }
 }
 
+/**************************************************************
+ * checkStateBudget()
+ * -----------------
+ * Prints the frame's state call counters and terminates the
+ * application if more calls were issued than the budget.
+ *************************************************************/
+void checkStateBudget()
+{
+    const GLStateCounters& counters = glState.counters();
+    if(stateBudget == 0 || counters.totalIssued() <= stateBudget)
+        return;
+
+    std::cerr << "GL state budget exceeded: " << counters.totalIssued() << " issued, "
+              << counters.totalSkipped() << " skipped, budget " << stateBudget << std::endl;
+    for(int i = 0; i < GLStateKindCount; ++i)
+        std::cerr << "  " << glStateKindName((GLStateKind)i) << ": " << counters.issued[i]
+                  << " issued, " << counters.skipped[i] << " skipped" << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+/**************************************************************
+ * checkFrameAllocations()
+ * ----------------------
+ * Once the warm-up frames are over, terminates the
+ * application if the frame just finished called operator new:
+ * steady-state frames are expected to run from arenas, pools
+ * and containers that have already grown.
+ *************************************************************/
+void checkFrameAllocations()
+{
+    if(allocationCheckAfter == 0 || frameNumber < allocationCheckAfter)
+        return;
+
+    HeapStats after = heapStats();
+    if(after.allocations == frameHeap.allocations)
+        return;
+
+    std::cerr << "Frame " << frameNumber << " allocated from the heap: "
+              << after.allocations - frameHeap.allocations << " allocations, "
+              << after.bytes - frameHeap.bytes << " bytes" << std::endl;
+    exit(EXIT_FAILURE);
+}
+
 /**************************************************************
  * error_callback()
  * ---------------
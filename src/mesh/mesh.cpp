@@ -0,0 +1,138 @@
+#include "mesh/mesh.h"
+#include "render/gl.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+/**************************************************************
+ * computeBounds()
+ * --------------
+ * Axis aligned bounds of the vertex positions.
+ *************************************************************/
+void computeBounds(Mesh& mesh)
+{
+    mesh.boundsMin = glm::vec3(FLT_MAX);
+    mesh.boundsMax = glm::vec3(-FLT_MAX);
+    for(size_t i = 0; i < mesh.vertices.size(); ++i)
+    {
+        mesh.boundsMin = glm::min(mesh.boundsMin, mesh.vertices[i].position);
+        mesh.boundsMax = glm::max(mesh.boundsMax, mesh.vertices[i].position);
+    }
+    if(mesh.vertices.empty())
+        mesh.boundsMin = mesh.boundsMax = glm::vec3(0.0f);
+}
+
+/**************************************************************
+ * computeNormals()
+ * ---------------
+ * Replaces the normals with area weighted averages of the
+ * face normals around each vertex.
+ *************************************************************/
+void computeNormals(Mesh& mesh)
+{
+    for(size_t i = 0; i < mesh.vertices.size(); ++i)
+        mesh.vertices[i].normal = glm::vec3(0.0f);
+
+    for(size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        MeshVertex& a = mesh.vertices[mesh.indices[i + 0]];
+        MeshVertex& b = mesh.vertices[mesh.indices[i + 1]];
+        MeshVertex& c = mesh.vertices[mesh.indices[i + 2]];
+    // The cross product's length is twice the area
+        glm::vec3 n = glm::cross(b.position - a.position, c.position - a.position);
+        a.normal += n;
+        b.normal += n;
+        c.normal += n;
+    }
+
+    for(size_t i = 0; i < mesh.vertices.size(); ++i)
+    {
+        glm::vec3& n = mesh.vertices[i].normal;
+        float length = glm::length(n);
+        n = length > 0.0f ? n / length : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+}
+
+/**************************************************************
+ * computeTangents()
+ * ----------------
+ * Per-vertex tangents along increasing u, accumulated from
+ * the uv gradients of the surrounding triangles and made
+ * orthogonal to the normal. w is the handedness of the
+ * bitangent, cross(normal, tangent) * w. Vertices without a
+ * usable uv mapping get an arbitrary tangent.
+ *************************************************************/
+void computeTangents(const Mesh& mesh, std::vector<glm::vec4>& tangents)
+{
+    std::vector<glm::vec3> tangent(mesh.vertices.size(), glm::vec3(0.0f));
+    std::vector<glm::vec3> bitangent(mesh.vertices.size(), glm::vec3(0.0f));
+
+    for(size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        uint32_t v[3] = { mesh.indices[i], mesh.indices[i + 1], mesh.indices[i + 2] };
+        const MeshVertex& a = mesh.vertices[v[0]];
+        const MeshVertex& b = mesh.vertices[v[1]];
+        const MeshVertex& c = mesh.vertices[v[2]];
+
+        glm::vec3 e1 = b.position - a.position, e2 = c.position - a.position;
+        glm::vec2 d1 = b.uv - a.uv, d2 = c.uv - a.uv;
+        float det = d1.x * d2.y - d2.x * d1.y;
+        if(det == 0.0f)
+            continue;
+        float r = 1.0f / det;
+        glm::vec3 t = (e1 * d2.y - e2 * d1.y) * r;
+        glm::vec3 bt = (e2 * d1.x - e1 * d2.x) * r;
+        for(int k = 0; k < 3; ++k)
+        {
+            tangent[v[k]] += t;
+            bitangent[v[k]] += bt;
+        }
+    }
+
+    tangents.resize(mesh.vertices.size());
+    for(size_t i = 0; i < mesh.vertices.size(); ++i)
+    {
+        const glm::vec3& n = mesh.vertices[i].normal;
+        glm::vec3 t = tangent[i] - n * glm::dot(n, tangent[i]);
+        float length = glm::length(t);
+        if(length > 1e-12f)
+            t /= length;
+        else
+        {
+        // Any direction perpendicular to the normal
+            glm::vec3 axis = std::abs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+            t = glm::normalize(axis - n * glm::dot(n, axis));
+        }
+        float w = glm::dot(glm::cross(n, t), bitangent[i]) < 0.0f ? -1.0f : 1.0f;
+        tangents[i] = glm::vec4(t, w);
+    }
+}
+
+/**************************************************************
+ * buildIndexBuffer()
+ * -----------------
+ * Packs indices at the narrowest width that can address
+ * vertexCount vertices.
+ *************************************************************/
+IndexBuffer buildIndexBuffer(const std::vector<uint32_t>& indices, size_t vertexCount)
+{
+    IndexBuffer buffer;
+    buffer.count = (uint32_t)indices.size();
+    if(vertexCount <= 0x10000)
+    {
+        buffer.type = GL_UNSIGNED_SHORT;
+        buffer.data.resize(indices.size() * sizeof(uint16_t));
+        uint16_t* out = (uint16_t*)(buffer.data.empty() ? NULL : &buffer.data[0]);
+        for(size_t i = 0; i < indices.size(); ++i)
+            out[i] = (uint16_t)indices[i];
+    }
+    else
+    {
+        buffer.type = GL_UNSIGNED_INT;
+        buffer.data.resize(indices.size() * sizeof(uint32_t));
+        if(!indices.empty())
+            std::memcpy(&buffer.data[0], &indices[0], buffer.data.size());
+    }
+    return buffer;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+/*************************************************************
+ * MeshVertex
+ * ----------
+ * Interleaved vertex as uploaded to the GPU: position,
+ * normal and texture coordinate, 32 bytes.
+ ************************************************************/
+struct MeshVertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 uv;
+};
+
+inline bool operator==(const MeshVertex& a, const MeshVertex& b)
+{
+    return a.position == b.position && a.normal == b.normal && a.uv == b.uv;
+}
+
+/*************************************************************
+ * Mesh
+ * ----
+ * Indexed triangle list. Indices are always 32-bit in memory;
+ * buildIndexBuffer() narrows them for upload.
+ ************************************************************/
+struct Mesh
+{
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+};
+
+/*************************************************************
+ * IndexBuffer
+ * -----------
+ * GPU-ready index data: 16-bit whenever every index fits,
+ * 32-bit otherwise. type is GL_UNSIGNED_SHORT or
+ * GL_UNSIGNED_INT.
+ ************************************************************/
+struct IndexBuffer
+{
+    unsigned int type;
+    uint32_t count;
+    std::vector<uint8_t> data;
+};
+
+void computeBounds(Mesh& mesh);
+void computeNormals(Mesh& mesh);
+void computeTangents(const Mesh& mesh, std::vector<glm::vec4>& tangents);
+IndexBuffer buildIndexBuffer(const std::vector<uint32_t>& indices, size_t vertexCount);
@@ -0,0 +1,305 @@
+#include "mesh/mesh_cache.h"
+#include "core/parallel.h"
+
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const uint64_t Prime1 = 0x9E3779B185EBCA87ull;
+    const uint64_t Prime2 = 0xC2B2AE3D27D4EB4Full;
+    const uint64_t Prime3 = 0x165667B19E3779F9ull;
+
+    inline uint64_t rotateLeft(uint64_t x, int bits)
+    {
+        return (x << bits) | (x >> (64 - bits));
+    }
+
+    inline uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    bool sectionMatches(const MeshCacheHeader& header, MeshCacheSectionType type, uint64_t expectedSize,
+                        size_t fileSize)
+    {
+        const MeshCacheSection& section = header.sections[type];
+        return section.size == expectedSize && section.offset % MeshCacheAlignment == 0
+            && section.offset <= fileSize && section.size <= fileSize - section.offset;
+    }
+
+// Meshlets and LODs are ranges of the index section; a corrupt
+// one would send draws past the end of the index buffer
+    template<typename Range>
+    bool rangesInside(const uint8_t* data, const MeshCacheSection& section, uint32_t count, uint32_t indexCount)
+    {
+        const Range* ranges = (const Range*)(data + section.offset);
+        for(uint32_t i = 0; i < count; ++i)
+        {
+            if((uint64_t)ranges[i].firstIndex + ranges[i].indexCount > indexCount)
+                return false;
+        }
+        return true;
+    }
+}
+
+/**************************************************************
+ * meshCacheChecksum()
+ * ------------------
+ * Four independent multiply-rotate lanes over 8-byte words,
+ * in the style of xxHash64, so hashing runs at memory speed
+ * and is never what holds loading back from disk speed.
+ *************************************************************/
+uint64_t meshCacheChecksum(const void* data, size_t size)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t lanes[4] = { Prime1 + Prime2, Prime2, 0, 0 - Prime1 };
+
+    size_t blocks = size / 32;
+    for(size_t b = 0; b < blocks; ++b, p += 32)
+    {
+        uint64_t words[4];
+        std::memcpy(words, p, sizeof(words));
+        for(int k = 0; k < 4; ++k)
+            lanes[k] = rotateLeft(lanes[k] + words[k] * Prime2, 31) * Prime1;
+    }
+
+    uint64_t hash = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) + rotateLeft(lanes[2], 12)
+                  + rotateLeft(lanes[3], 18) + (uint64_t)size;
+    for(size_t i = blocks * 32; i < size; ++i, ++p)
+        hash = rotateLeft(hash ^ (*p * Prime3), 11) * Prime1;
+
+    hash ^= hash >> 33;
+    hash *= Prime2;
+    hash ^= hash >> 29;
+    hash *= Prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/**************************************************************
+ * writeMeshCache()
+ * ---------------
+ * Lays the sections out after the header on aligned offsets,
+ * narrowing indices to 16 bits when the vertex count allows.
+ *************************************************************/
+bool writeMeshCache(const std::string& path, const MeshCacheContents& contents)
+{
+    if(contents.vertexStride == 0)
+        return false;
+    uint32_t vertexCount = (uint32_t)(contents.vertices.size() / contents.vertexStride);
+    IndexBuffer indices = buildIndexBuffer(contents.indices, vertexCount);
+
+    MeshCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = MeshCacheMagic;
+    header.version = MeshCacheVersion;
+    header.headerSize = sizeof(MeshCacheHeader);
+    header.meshletSize = sizeof(Meshlet);
+    header.lodSize = sizeof(MeshLod);
+    header.vertexFormat = contents.vertexFormat;
+    header.vertexStride = contents.vertexStride;
+    header.vertexCount = vertexCount;
+    header.indexSize = indices.count ? (uint32_t)(indices.data.size() / indices.count) : 4;
+    header.indexCount = indices.count;
+    header.meshletCount = (uint32_t)contents.meshlets.size();
+    header.lodCount = (uint32_t)contents.lods.size();
+    for(int k = 0; k < 3; ++k)
+    {
+        header.boundsMin[k] = contents.boundsMin[k];
+        header.boundsMax[k] = contents.boundsMax[k];
+        header.positionScale[k] = contents.positionScale[k];
+        header.positionBias[k] = contents.positionBias[k];
+    }
+
+    const void* data[MeshCacheSectionCount] =
+    {
+        contents.vertices.empty() ? NULL : &contents.vertices[0],
+        indices.data.empty() ? NULL : &indices.data[0],
+        contents.meshlets.empty() ? NULL : &contents.meshlets[0],
+        contents.lods.empty() ? NULL : &contents.lods[0]
+    };
+    uint64_t sizes[MeshCacheSectionCount] =
+    {
+        contents.vertices.size(),
+        indices.data.size(),
+        contents.meshlets.size() * sizeof(Meshlet),
+        contents.lods.size() * sizeof(MeshLod)
+    };
+
+    uint64_t offset = alignUp(sizeof(MeshCacheHeader), MeshCacheAlignment);
+    for(int i = 0; i < MeshCacheSectionCount; ++i)
+    {
+        header.sections[i].offset = offset;
+        header.sections[i].size = sizes[i];
+        header.sections[i].checksum = meshCacheChecksum(data[i], (size_t)sizes[i]);
+        offset = alignUp(offset + sizes[i], MeshCacheAlignment);
+    }
+
+    std::ofstream file(path.c_str(), std::ios::binary);
+    if(!file)
+        return false;
+
+    static const char Padding[MeshCacheAlignment] = { 0 };
+    file.write((const char*)&header, sizeof(header));
+    uint64_t written = sizeof(header);
+    for(int i = 0; i < MeshCacheSectionCount; ++i)
+    {
+        file.write(Padding, (std::streamsize)(header.sections[i].offset - written));
+        if(sizes[i])
+            file.write((const char*)data[i], (std::streamsize)sizes[i]);
+        written = header.sections[i].offset + sizes[i];
+    }
+    return file.good();
+}
+
+MeshCacheFile::MeshCacheFile()
+    : m_data(NULL), m_size(0),
+#ifdef _WIN32
+      m_file(INVALID_HANDLE_VALUE), m_mapping(NULL)
+#else
+      m_file(-1)
+#endif
+{
+}
+
+MeshCacheFile::~MeshCacheFile()
+{
+    close();
+}
+
+/**************************************************************
+ * MeshCacheFile::open()
+ * --------------------
+ * Maps the file read-only and validates the header, the
+ * section table against the file size, and the meshlet and
+ * LOD index ranges against the index count. With verify, all
+ * section checksums are checked as well, in parallel.
+ *************************************************************/
+bool MeshCacheFile::open(const std::string& path, bool verify)
+{
+    close();
+
+#ifdef _WIN32
+    m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                         FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(m_file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(m_file, &size) || size.QuadPart < (LONGLONG)sizeof(MeshCacheHeader))
+    {
+        close();
+        return false;
+    }
+    m_size = (size_t)size.QuadPart;
+    m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    m_data = m_mapping ? (const uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+#else
+    m_file = ::open(path.c_str(), O_RDONLY);
+    if(m_file < 0)
+        return false;
+    struct stat status;
+    if(fstat(m_file, &status) != 0 || status.st_size < (off_t)sizeof(MeshCacheHeader))
+    {
+        close();
+        return false;
+    }
+    m_size = (size_t)status.st_size;
+    void* mapped = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+    m_data = mapped == MAP_FAILED ? NULL : (const uint8_t*)mapped;
+    if(m_data)
+    {
+        // Start readahead now; the upload reads front to back
+        madvise(mapped, m_size, MADV_SEQUENTIAL);
+        madvise(mapped, m_size, MADV_WILLNEED);
+    }
+#endif
+    if(!m_data)
+    {
+        close();
+        return false;
+    }
+
+    const MeshCacheHeader& h = header();
+    bool valid = h.magic == MeshCacheMagic && h.version == MeshCacheVersion
+              && h.headerSize == sizeof(MeshCacheHeader) && h.meshletSize == sizeof(Meshlet)
+              && h.lodSize == sizeof(MeshLod) && (h.indexSize == 2 || h.indexSize == 4)
+              && sectionMatches(h, MeshCacheVertices, (uint64_t)h.vertexCount * h.vertexStride, m_size)
+              && sectionMatches(h, MeshCacheIndices, (uint64_t)h.indexCount * h.indexSize, m_size)
+              && sectionMatches(h, MeshCacheMeshlets, (uint64_t)h.meshletCount * sizeof(Meshlet), m_size)
+              && sectionMatches(h, MeshCacheLods, (uint64_t)h.lodCount * sizeof(MeshLod), m_size);
+    valid = valid && rangesInside<Meshlet>(m_data, h.sections[MeshCacheMeshlets], h.meshletCount, h.indexCount)
+                  && rangesInside<MeshLod>(m_data, h.sections[MeshCacheLods], h.lodCount, h.indexCount);
+
+    if(valid && verify)
+    {
+        char matches[MeshCacheSectionCount];
+        parallelFor(0, MeshCacheSectionCount, 1, [&](size_t begin, size_t end)
+        {
+            for(size_t i = begin; i < end; ++i)
+            {
+                const MeshCacheSection& s = h.sections[i];
+                matches[i] = meshCacheChecksum(m_data + s.offset, (size_t)s.size) == s.checksum;
+            }
+        });
+        for(int i = 0; i < MeshCacheSectionCount; ++i)
+            valid = valid && matches[i];
+    }
+
+    if(!valid)
+        close();
+    return valid;
+}
+
+void MeshCacheFile::close()
+{
+#ifdef _WIN32
+    if(m_data)
+        UnmapViewOfFile(m_data);
+    if(m_mapping)
+        CloseHandle(m_mapping);
+    if(m_file != INVALID_HANDLE_VALUE)
+        CloseHandle(m_file);
+    m_mapping = NULL;
+    m_file = INVALID_HANDLE_VALUE;
+#else
+    if(m_data)
+        munmap((void*)m_data, m_size);
+    if(m_file >= 0)
+        ::close(m_file);
+    m_file = -1;
+#endif
+    m_data = NULL;
+    m_size = 0;
+}
+
+bool MeshCacheFile::isOpen() const
+{
+    return m_data != NULL;
+}
+
+const MeshCacheHeader& MeshCacheFile::header() const
+{
+    return *(const MeshCacheHeader*)m_data;
+}
+
+const void* MeshCacheFile::section(MeshCacheSectionType type, size_t& size) const
+{
+    const MeshCacheSection& s = header().sections[type];
+    size = (size_t)s.size;
+    return m_data + s.offset;
+}
+
+size_t MeshCacheFile::fileSize() const
+{
+    return m_size;
+}
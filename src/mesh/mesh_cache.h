@@ -0,0 +1,119 @@
+#pragma once
+
+#include "mesh/meshlet.h"
+#include "mesh/mesh_simplify.h"
+
+#include <string>
+
+/*************************************************************
+ * Mesh Cache
+ * ----------
+ * Binary mesh files that load without parsing. A fixed header
+ * is followed by sections (vertices, indices, meshlets, LODs)
+ * each starting on a MeshCacheAlignment boundary and stored
+ * exactly as the GPU or the culling code consumes them, so a
+ * memory mapped file can be handed to glBufferStorage as is.
+ *
+ * Every section carries a 64-bit checksum over its bytes.
+ * Readers reject files whose magic, version or record sizes
+ * do not match this build, so a format change only needs
+ * MeshCacheVersion bumped for old caches to be rebuilt.
+ *
+ * Index data holds every LOD back to back; LOD 0 is in
+ * meshlet order and the meshlets index into it.
+ ************************************************************/
+const uint32_t MeshCacheMagic = 0x4853454d;    // "MESH"
+const uint32_t MeshCacheVersion = 1;
+const uint32_t MeshCacheAlignment = 64;
+
+enum MeshCacheSectionType
+{
+    MeshCacheVertices,
+    MeshCacheIndices,
+    MeshCacheMeshlets,
+    MeshCacheLods,
+    MeshCacheSectionCount
+};
+
+// 0 is interleaved MeshVertex; otherwise NormalEncoding + 1
+const uint32_t MeshCacheFloatVertices = 0;
+
+struct MeshCacheSection
+{
+    uint64_t offset;
+    uint64_t size;
+    uint64_t checksum;
+};
+
+struct MeshCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t meshletSize;       // sizeof(Meshlet) and sizeof(MeshLod) when written
+    uint32_t lodSize;
+    uint32_t vertexFormat;
+    uint32_t vertexStride;
+    uint32_t vertexCount;
+    uint32_t indexSize;         // 2 or 4
+    uint32_t indexCount;
+    uint32_t meshletCount;
+    uint32_t lodCount;
+    float boundsMin[3];
+    float boundsMax[3];
+    float positionScale[3];     // quantized formats only
+    float positionBias[3];
+    MeshCacheSection sections[MeshCacheSectionCount];
+};
+
+struct MeshCacheContents
+{
+    uint32_t vertexFormat;
+    uint32_t vertexStride;
+    std::vector<uint8_t> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<Meshlet> meshlets;
+    std::vector<MeshLod> lods;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    glm::vec3 positionScale;
+    glm::vec3 positionBias;
+};
+
+uint64_t meshCacheChecksum(const void* data, size_t size);
+bool writeMeshCache(const std::string& path, const MeshCacheContents& contents);
+
+/*************************************************************
+ * MeshCacheFile
+ * -------------
+ * Read-only memory mapping of a mesh cache. Section pointers
+ * stay valid until close(); nothing is copied on open, and
+ * open(path, true) additionally verifies every checksum.
+ ************************************************************/
+class MeshCacheFile
+{
+public:
+    MeshCacheFile();
+    ~MeshCacheFile();
+
+    bool open(const std::string& path, bool verify);
+    void close();
+
+    bool isOpen() const;
+    const MeshCacheHeader& header() const;
+    const void* section(MeshCacheSectionType type, size_t& size) const;
+    size_t fileSize() const;
+
+private:
+    MeshCacheFile(const MeshCacheFile&);
+    MeshCacheFile& operator=(const MeshCacheFile&);
+
+    const uint8_t* m_data;
+    size_t m_size;
+#ifdef _WIN32
+    void* m_file;
+    void* m_mapping;
+#else
+    int m_file;
+#endif
+};
@@ -0,0 +1,858 @@
+#include "mesh/mesh_import.h"
+#include "core/parallel.h"
+
+#include <glm/gtx/hash.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <unordered_map>
+
+namespace
+{
+    const uint32_t NoIndex = ~0u;
+    const uint32_t RelativeFlag = 0x80000000u;
+
+    typedef std::chrono::steady_clock Clock;
+
+    double secondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    struct Corner
+    {
+        uint32_t position;
+        uint32_t uv;
+        uint32_t normal;
+    };
+
+    struct MeshVertexHash
+    {
+        size_t operator()(const MeshVertex& v) const
+        {
+            size_t seed = std::hash<glm::vec3>()(v.position);
+            glm::detail::hash_combine(seed, std::hash<glm::vec3>()(v.normal));
+            glm::detail::hash_combine(seed, std::hash<glm::vec2>()(v.uv));
+            return seed;
+        }
+    };
+
+/**************************************************************
+ * Text Scanning
+ * -------------
+ * Bounded parsers over [p, end); none of them needs the
+ * buffer to be null terminated.
+ *************************************************************/
+    inline const char* skipSpaces(const char* p, const char* end)
+    {
+        while(p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+            ++p;
+        return p;
+    }
+
+    inline const char* nextLine(const char* p, const char* end)
+    {
+        const char* newline = (const char*)std::memchr(p, '\n', end - p);
+        return newline ? newline + 1 : end;
+    }
+
+    const double PowersOfTen[] =
+    {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char* parseFloat(const char* p, const char* end, float& value)
+    {
+        p = skipSpaces(p, end);
+        bool negative = false;
+        if(p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+
+        uint64_t mantissa = 0;
+        int exponent = 0;
+        int digits = 0;
+        for(; p < end && *p >= '0' && *p <= '9'; ++p, ++digits)
+        {
+            if(mantissa < 100000000000000000ull)
+                mantissa = mantissa * 10 + (*p - '0');
+            else
+                ++exponent;
+        }
+        if(p < end && *p == '.')
+        {
+            for(++p; p < end && *p >= '0' && *p <= '9'; ++p, ++digits)
+            {
+                if(mantissa < 100000000000000000ull)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    --exponent;
+                }
+            }
+        }
+        if(p < end && (*p == 'e' || *p == 'E'))
+        {
+            const char* q = p + 1;
+            bool negativeExponent = false;
+            if(q < end && (*q == '-' || *q == '+'))
+                negativeExponent = *q++ == '-';
+            int e = 0;
+            bool any = false;
+            for(; q < end && *q >= '0' && *q <= '9'; ++q, any = true)
+                e = std::min(e * 10 + (*q - '0'), 10000);
+            if(any)
+            {
+                exponent += negativeExponent ? -e : e;
+                p = q;
+            }
+        }
+
+        double result = (double)mantissa;
+        while(exponent > 22)
+        {
+            result *= 1e22;
+            exponent -= 22;
+        }
+        while(exponent < -22)
+        {
+            result /= 1e22;
+            exponent += 22;
+        }
+        result = exponent >= 0 ? result * PowersOfTen[exponent] : result / PowersOfTen[-exponent];
+        value = (float)(negative ? -result : result);
+        return digits ? p : NULL;
+    }
+
+// Indices and counts fit in 32 bits (and in a long), so longer
+// numbers fail instead of overflowing
+    const char* parseInt(const char* p, const char* end, long& value)
+    {
+        const uint64_t Limit = std::min<uint64_t>(0xffffffffu, (uint64_t)std::numeric_limits<long>::max());
+        bool negative = false;
+        if(p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+        const char* start = p;
+        uint64_t result = 0;
+        for(; p < end && *p >= '0' && *p <= '9'; ++p)
+        {
+            result = result * 10 + (uint64_t)(*p - '0');
+            if(result > Limit)
+                return NULL;
+        }
+        value = negative ? -(long)result : (long)result;
+        return p > start ? p : NULL;
+    }
+
+/**************************************************************
+ * splitLines()
+ * -----------
+ * Splits [data, data + size) into about count ranges that
+ * start and end on line boundaries.
+ *************************************************************/
+    std::vector<size_t> splitLines(const char* data, size_t size, size_t count)
+    {
+        std::vector<size_t> bounds(1, 0);
+        size_t step = std::max<size_t>(size / std::max<size_t>(count, 1), 1);
+        for(size_t i = 1; i < count; ++i)
+        {
+            size_t at = std::max(bounds.back(), std::min(i * step, size));
+            const char* newline = (const char*)std::memchr(data + at, '\n', size - at);
+            size_t next = newline ? (size_t)(newline - data) + 1 : size;
+            if(next > bounds.back() && next < size)
+                bounds.push_back(next);
+        }
+        bounds.push_back(size);
+        return bounds;
+    }
+
+/**************************************************************
+ * weldCorners()
+ * ------------
+ * Turns face corners into unique interleaved vertices and a
+ * 32-bit index list. Returns false on out of range indices.
+ *************************************************************/
+    bool weldCorners(const std::vector<glm::vec3>& positions, const std::vector<glm::vec2>& uvs,
+                     const std::vector<glm::vec3>& normals, const std::vector<Corner>& corners,
+                     Mesh& mesh, MeshImportStats* stats)
+    {
+        Clock::time_point start = Clock::now();
+
+        mesh.vertices.clear();
+        mesh.indices.clear();
+        mesh.indices.reserve(corners.size());
+
+        std::unordered_map<MeshVertex, uint32_t, MeshVertexHash> unique;
+        unique.reserve(corners.size() / 2 + 1);
+
+        bool missingNormals = false;
+        for(size_t i = 0; i < corners.size(); ++i)
+        {
+            const Corner& corner = corners[i];
+            if(corner.position >= positions.size())
+                return false;
+
+            MeshVertex vertex;
+            vertex.position = positions[corner.position];
+            vertex.uv = glm::vec2(0.0f);
+            vertex.normal = glm::vec3(0.0f);
+            if(corner.uv != NoIndex)
+            {
+                if(corner.uv >= uvs.size())
+                    return false;
+                vertex.uv = uvs[corner.uv];
+            }
+            if(corner.normal != NoIndex)
+            {
+                if(corner.normal >= normals.size())
+                    return false;
+                vertex.normal = normals[corner.normal];
+            }
+            else
+                missingNormals = true;
+
+            std::pair<std::unordered_map<MeshVertex, uint32_t, MeshVertexHash>::iterator, bool> inserted =
+                unique.insert(std::make_pair(vertex, (uint32_t)mesh.vertices.size()));
+            if(inserted.second)
+                mesh.vertices.push_back(vertex);
+            mesh.indices.push_back(inserted.first->second);
+        }
+
+        if(missingNormals)
+            computeNormals(mesh);
+        computeBounds(mesh);
+
+        if(stats)
+        {
+            stats->cornersRead = corners.size();
+            stats->verticesWelded = mesh.vertices.size();
+            stats->triangles = mesh.indices.size() / 3;
+            stats->weldSeconds = secondsSince(start);
+            stats->normalsGenerated = missingNormals;
+        }
+        return true;
+    }
+
+/**************************************************************
+ * OBJ
+ * ---
+ * Each chunk collects its own v/vt/vn arrays and triangulated
+ * corners. Positive indices are absolute; negative ones are
+ * resolved against the chunk's local counts and flagged so
+ * the chunk's starting offset can be added afterwards.
+ *************************************************************/
+    struct ObjChunk
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> uvs;
+        std::vector<glm::vec3> normals;
+        std::vector<Corner> corners;
+        bool valid;
+    };
+
+    uint32_t resolveObjIndex(long index, size_t localCount, bool& valid)
+    {
+        if(index > 0)
+            return (uint32_t)(index - 1);
+        if(index < 0)
+        {
+        // May point into an earlier chunk, so keep the sign in 30
+        // bits; 31 would make -1 collide with NoIndex
+            long local = (long)localCount + index;
+            return ((uint32_t)local & 0x3FFFFFFFu) | RelativeFlag;
+        }
+        valid = false;
+        return NoIndex;
+    }
+
+    void parseObjChunk(const char* p, const char* end, ObjChunk& chunk)
+    {
+        chunk.valid = true;
+        std::vector<Corner> face;
+        while(p < end)
+        {
+            const char* lineEnd = (const char*)std::memchr(p, '\n', end - p);
+            if(!lineEnd)
+                lineEnd = end;
+            const char* q = skipSpaces(p, lineEnd);
+
+            if(q + 1 < lineEnd && q[0] == 'v' && (q[1] == ' ' || q[1] == '\t'))
+            {
+                glm::vec3 v(0.0f);
+                q = parseFloat(q + 1, lineEnd, v.x);
+                if(q) q = parseFloat(q, lineEnd, v.y);
+                if(q) q = parseFloat(q, lineEnd, v.z);
+                chunk.valid &= q != NULL;
+                chunk.positions.push_back(v);
+            }
+            else if(q + 2 < lineEnd && q[0] == 'v' && q[1] == 't' && (q[2] == ' ' || q[2] == '\t'))
+            {
+                glm::vec2 uv(0.0f);
+                q = parseFloat(q + 2, lineEnd, uv.x);
+                if(q) q = parseFloat(q, lineEnd, uv.y);
+                chunk.valid &= q != NULL;
+                chunk.uvs.push_back(uv);
+            }
+            else if(q + 2 < lineEnd && q[0] == 'v' && q[1] == 'n' && (q[2] == ' ' || q[2] == '\t'))
+            {
+                glm::vec3 n(0.0f);
+                q = parseFloat(q + 2, lineEnd, n.x);
+                if(q) q = parseFloat(q, lineEnd, n.y);
+                if(q) q = parseFloat(q, lineEnd, n.z);
+                chunk.valid &= q != NULL;
+                chunk.normals.push_back(n);
+            }
+            else if(q + 1 < lineEnd && q[0] == 'f' && (q[1] == ' ' || q[1] == '\t'))
+            {
+                face.clear();
+                q = skipSpaces(q + 1, lineEnd);
+                while(q < lineEnd && *q != '#')
+                {
+                    Corner corner = { NoIndex, NoIndex, NoIndex };
+                    long index;
+                    q = parseInt(q, lineEnd, index);
+                    if(!q)
+                    {
+                        chunk.valid = false;
+                        break;
+                    }
+                    corner.position = resolveObjIndex(index, chunk.positions.size(), chunk.valid);
+                    if(q < lineEnd && *q == '/')
+                    {
+                        ++q;
+                        if(q < lineEnd && *q != '/')
+                        {
+                            q = parseInt(q, lineEnd, index);
+                            if(!q)
+                            {
+                                chunk.valid = false;
+                                break;
+                            }
+                            corner.uv = resolveObjIndex(index, chunk.uvs.size(), chunk.valid);
+                        }
+                        if(q < lineEnd && *q == '/')
+                        {
+                            q = parseInt(q + 1, lineEnd, index);
+                            if(!q)
+                            {
+                                chunk.valid = false;
+                                break;
+                            }
+                            corner.normal = resolveObjIndex(index, chunk.normals.size(), chunk.valid);
+                        }
+                    }
+                    face.push_back(corner);
+                    q = skipSpaces(q, lineEnd);
+                }
+                for(size_t i = 2; i < face.size(); ++i)
+                {
+                    chunk.corners.push_back(face[0]);
+                    chunk.corners.push_back(face[i - 1]);
+                    chunk.corners.push_back(face[i]);
+                }
+            }
+            p = lineEnd < end ? lineEnd + 1 : end;
+        }
+    }
+
+    inline void rebaseIndex(uint32_t& index, size_t offset)
+    {
+        if(index != NoIndex && (index & RelativeFlag))
+        {
+            int32_t local = (int32_t)(index << 2) >> 2;
+            long absolute = (long)offset + local;
+            index = absolute >= 0 ? (uint32_t)absolute : NoIndex - 1;
+        }
+    }
+
+/**************************************************************
+ * PLY
+ * ---
+ * Header description and value decoding for the vertex and
+ * face elements; other elements are skipped.
+ *************************************************************/
+    enum PlyType
+    {
+        PlyInvalid, PlyInt8, PlyUInt8, PlyInt16, PlyUInt16, PlyInt32, PlyUInt32, PlyFloat32, PlyFloat64
+    };
+
+    struct PlyProperty
+    {
+        std::string name;
+        PlyType type;
+        PlyType countType;      // PlyInvalid unless this is a list
+    };
+
+    struct PlyElement
+    {
+        std::string name;
+        size_t count;
+        std::vector<PlyProperty> properties;
+    };
+
+    PlyType plyType(const std::string& name)
+    {
+        if(name == "char" || name == "int8") return PlyInt8;
+        if(name == "uchar" || name == "uint8") return PlyUInt8;
+        if(name == "short" || name == "int16") return PlyInt16;
+        if(name == "ushort" || name == "uint16") return PlyUInt16;
+        if(name == "int" || name == "int32") return PlyInt32;
+        if(name == "uint" || name == "uint32") return PlyUInt32;
+        if(name == "float" || name == "float32") return PlyFloat32;
+        if(name == "double" || name == "float64") return PlyFloat64;
+        return PlyInvalid;
+    }
+
+    size_t plySize(PlyType type)
+    {
+        static const size_t Sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+        return Sizes[type];
+    }
+
+    double readPly(const uint8_t* p, PlyType type, bool bigEndian)
+    {
+        uint8_t bytes[8];
+        size_t size = plySize(type);
+        for(size_t i = 0; i < size; ++i)
+            bytes[i] = bigEndian ? p[size - 1 - i] : p[i];
+
+        switch(type)
+        {
+            case PlyInt8:    return (double)(int8_t)bytes[0];
+            case PlyUInt8:   return (double)bytes[0];
+            case PlyInt16:   { int16_t v; std::memcpy(&v, bytes, 2); return v; }
+            case PlyUInt16:  { uint16_t v; std::memcpy(&v, bytes, 2); return v; }
+            case PlyInt32:   { int32_t v; std::memcpy(&v, bytes, 4); return v; }
+            case PlyUInt32:  { uint32_t v; std::memcpy(&v, bytes, 4); return v; }
+            case PlyFloat32: { float v; std::memcpy(&v, bytes, 4); return v; }
+            case PlyFloat64: { double v; std::memcpy(&v, bytes, 8); return v; }
+            default:         return 0.0;
+        }
+    }
+
+    enum VertexField
+    {
+        FieldNone, FieldX, FieldY, FieldZ, FieldNX, FieldNY, FieldNZ, FieldU, FieldV
+    };
+
+    VertexField vertexField(const std::string& name)
+    {
+        if(name == "x") return FieldX;
+        if(name == "y") return FieldY;
+        if(name == "z") return FieldZ;
+        if(name == "nx") return FieldNX;
+        if(name == "ny") return FieldNY;
+        if(name == "nz") return FieldNZ;
+        if(name == "u" || name == "s" || name == "texture_u" || name == "texture_s") return FieldU;
+        if(name == "v" || name == "t" || name == "texture_v" || name == "texture_t") return FieldV;
+        return FieldNone;
+    }
+
+    void storeField(VertexField field, float value, glm::vec3& position, glm::vec3& normal, glm::vec2& uv)
+    {
+        switch(field)
+        {
+            case FieldX:  position.x = value; break;
+            case FieldY:  position.y = value; break;
+            case FieldZ:  position.z = value; break;
+            case FieldNX: normal.x = value; break;
+            case FieldNY: normal.y = value; break;
+            case FieldNZ: normal.z = value; break;
+            case FieldU:  uv.x = value; break;
+            case FieldV:  uv.y = value; break;
+            default: break;
+        }
+    }
+
+    bool isFaceList(const PlyProperty& property)
+    {
+        return property.countType != PlyInvalid
+            && (property.name == "vertex_indices" || property.name == "vertex_index");
+    }
+
+    void addFanCorners(const std::vector<uint32_t>& polygon, bool hasUV, bool hasNormal, std::vector<Corner>& corners)
+    {
+        for(size_t i = 2; i < polygon.size(); ++i)
+        {
+            uint32_t tri[3] = { polygon[0], polygon[i - 1], polygon[i] };
+            for(int c = 0; c < 3; ++c)
+            {
+                Corner corner = { tri[c], hasUV ? tri[c] : NoIndex, hasNormal ? tri[c] : NoIndex };
+                corners.push_back(corner);
+            }
+        }
+    }
+}
+
+/**************************************************************
+ * importMesh()
+ * -----------
+ * Reads a whole file and imports it by extension (.obj or
+ * .ply, case insensitive).
+ *************************************************************/
+bool importMesh(const std::string& path, Mesh& mesh, MeshImportStats* stats)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if(!file)
+        return false;
+    file.seekg(0, std::ios::end);
+    std::streamoff size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    if(size <= 0)
+        return false;
+
+    std::vector<char> data((size_t)size);
+    if(!file.read(&data[0], size))
+        return false;
+
+    std::string extension;
+    size_t dot = path.find_last_of('.');
+    if(dot != std::string::npos)
+        extension = path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    if(extension == "ply")
+        return importPly(&data[0], data.size(), mesh, stats);
+    if(extension == "obj")
+        return importObj(&data[0], data.size(), mesh, stats);
+    return false;
+}
+
+/**************************************************************
+ * importObj()
+ * ----------
+ * Parses OBJ text in parallel chunks, then welds.
+ *************************************************************/
+bool importObj(const char* data, size_t size, Mesh& mesh, MeshImportStats* stats)
+{
+    Clock::time_point start = Clock::now();
+    if(stats)
+        *stats = MeshImportStats();
+
+    std::vector<size_t> bounds = splitLines(data, size, hardwareThreadCount() * 4);
+    std::vector<ObjChunk> chunks(bounds.size() - 1);
+    parallelFor(0, chunks.size(), 1, [&](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; ++i)
+            parseObjChunk(data + bounds[i], data + bounds[i + 1], chunks[i]);
+    });
+
+// Concatenate chunks, rebasing relative indices
+    size_t positionCount = 0, uvCount = 0, normalCount = 0, cornerCount = 0;
+    for(size_t i = 0; i < chunks.size(); ++i)
+    {
+        if(!chunks[i].valid)
+            return false;
+        positionCount += chunks[i].positions.size();
+        uvCount += chunks[i].uvs.size();
+        normalCount += chunks[i].normals.size();
+        cornerCount += chunks[i].corners.size();
+    }
+
+    std::vector<glm::vec3> positions, normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<Corner> corners;
+    positions.reserve(positionCount);
+    uvs.reserve(uvCount);
+    normals.reserve(normalCount);
+    corners.reserve(cornerCount);
+    for(size_t i = 0; i < chunks.size(); ++i)
+    {
+        ObjChunk& chunk = chunks[i];
+        for(size_t c = 0; c < chunk.corners.size(); ++c)
+        {
+            rebaseIndex(chunk.corners[c].position, positions.size());
+            rebaseIndex(chunk.corners[c].uv, uvs.size());
+            rebaseIndex(chunk.corners[c].normal, normals.size());
+        }
+        positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+        uvs.insert(uvs.end(), chunk.uvs.begin(), chunk.uvs.end());
+        normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+        corners.insert(corners.end(), chunk.corners.begin(), chunk.corners.end());
+        chunk = ObjChunk();
+    }
+    chunks.clear();
+
+    if(stats)
+        stats->parseSeconds = secondsSince(start);
+    return !corners.empty() && weldCorners(positions, uvs, normals, corners, mesh, stats);
+}
+
+/**************************************************************
+ * importPly()
+ * ----------
+ * Parses the header, then decodes vertices and faces. ASCII
+ * lines are parsed in parallel once their starts are known;
+ * binary vertex records are decoded in parallel when every
+ * vertex property has a fixed size.
+ *************************************************************/
+bool importPly(const char* data, size_t size, Mesh& mesh, MeshImportStats* stats)
+{
+    Clock::time_point start = Clock::now();
+    if(stats)
+        *stats = MeshImportStats();
+    const char* end = data + size;
+    if(size < 4 || std::strncmp(data, "ply", 3) != 0)
+        return false;
+
+// Header
+    bool ascii = false, bigEndian = false;
+    std::vector<PlyElement> elements;
+    const char* p = nextLine(data, end);
+    while(p < end)
+    {
+        const char* lineEnd = nextLine(p, end);
+        std::string line(p, lineEnd);
+        p = lineEnd;
+        while(!line.empty() && (line[line.size() - 1] == '\n' || line[line.size() - 1] == '\r'))
+            line.erase(line.size() - 1);
+
+        char word[64] = "", a[64] = "", b[64] = "", c[64] = "";
+        int fields = std::sscanf(line.c_str(), "%63s %63s %63s %63s", word, a, b, c);
+        std::string keyword = word;
+        if(keyword == "end_header")
+            break;
+        if(keyword == "format" && fields >= 2)
+        {
+            ascii = std::strcmp(a, "ascii") == 0;
+            bigEndian = std::strcmp(a, "binary_big_endian") == 0;
+            if(!ascii && !bigEndian && std::strcmp(a, "binary_little_endian") != 0)
+                return false;
+        }
+        else if(keyword == "element" && fields >= 3)
+        {
+            PlyElement element;
+            element.name = a;
+            element.count = (size_t)std::strtoull(b, NULL, 10);
+            elements.push_back(element);
+        }
+        else if(keyword == "property" && fields >= 3 && !elements.empty())
+        {
+            PlyProperty property;
+            if(std::strcmp(a, "list") == 0 && fields >= 4)
+            {
+                property.countType = plyType(b);
+                property.type = plyType(c);
+                property.name = line.substr(line.find_last_of(" \t") + 1);
+            }
+            else
+            {
+                property.countType = PlyInvalid;
+                property.type = plyType(a);
+                property.name = b;
+            }
+            if(property.type == PlyInvalid)
+                return false;
+            elements.back().properties.push_back(property);
+        }
+    }
+
+    std::vector<glm::vec3> positions, normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<Corner> corners;
+    bool hasUV = false, hasNormal = false;
+
+    for(size_t e = 0; e < elements.size(); ++e)
+    {
+        const PlyElement& element = elements[e];
+        bool isVertex = element.name == "vertex";
+        bool isFace = element.name == "face";
+
+        std::vector<VertexField> fields(element.properties.size(), FieldNone);
+        size_t recordSize = 0, minimumRecordSize = 0;
+        bool fixedSize = true;
+        for(size_t i = 0; i < element.properties.size(); ++i)
+        {
+            const PlyProperty& property = element.properties[i];
+            if(property.countType != PlyInvalid)
+                fixedSize = false;
+            recordSize += plySize(property.type);
+            minimumRecordSize += plySize(property.countType != PlyInvalid ? property.countType : property.type);
+            if(isVertex)
+            {
+                fields[i] = vertexField(property.name);
+                hasNormal |= fields[i] == FieldNX;
+                hasUV |= fields[i] == FieldU;
+            }
+        }
+
+    // Every record takes at least a line or its smallest binary
+    // size, so a count the data cannot hold is rejected before
+    // anything is allocated for it
+        if(element.count > (size_t)(end - p) / (ascii ? 1 : std::max<size_t>(minimumRecordSize, 1)))
+            return false;
+
+        if(isVertex)
+        {
+            positions.assign(element.count, glm::vec3(0.0f));
+            normals.assign(hasNormal ? element.count : 0, glm::vec3(0.0f));
+            uvs.assign(hasUV ? element.count : 0, glm::vec2(0.0f));
+        }
+
+        if(ascii)
+        {
+        // Find where each line starts, then parse lines in parallel
+            std::vector<const char*> lines(element.count + 1);
+            for(size_t i = 0; i < element.count; ++i)
+            {
+                if(p >= end)
+                    return false;
+                lines[i] = p;
+                p = nextLine(p, end);
+            }
+            lines[element.count] = p;
+            if(!isVertex && !isFace)
+                continue;
+
+            std::vector<std::vector<Corner> > chunkCorners;
+            size_t grain = 4096;
+            if(isFace)
+                chunkCorners.resize((element.count + grain - 1) / grain);
+            std::atomic<bool> valid(true);
+
+            parallelFor(0, element.count, grain, [&](size_t begin, size_t stop)
+            {
+                std::vector<uint32_t> polygon;
+                for(size_t i = begin; i < stop; ++i)
+                {
+                    const char* q = lines[i];
+                    const char* lineEnd = lines[i + 1];
+                    glm::vec3 position(0.0f), normal(0.0f);
+                    glm::vec2 uv(0.0f);
+                    for(size_t k = 0; k < element.properties.size() && q; ++k)
+                    {
+                        const PlyProperty& property = element.properties[k];
+                        if(property.countType != PlyInvalid)
+                        {
+                            long count = 0;
+                            q = parseInt(skipSpaces(q, lineEnd), lineEnd, count);
+                            if(count < 0)
+                                q = NULL;
+                            polygon.clear();
+                            for(long n = 0; n < count && q; ++n)
+                            {
+                                long index;
+                                q = parseInt(skipSpaces(q, lineEnd), lineEnd, index);
+                                if(q && index < 0)
+                                    q = NULL;
+                                polygon.push_back((uint32_t)index);
+                            }
+                            if(q && isFace && isFaceList(property))
+                                addFanCorners(polygon, hasUV, hasNormal, chunkCorners[begin / grain]);
+                        }
+                        else
+                        {
+                            float value;
+                            q = parseFloat(q, lineEnd, value);
+                            if(isVertex)
+                                storeField(fields[k], value, position, normal, uv);
+                        }
+                    }
+                    if(!q)
+                        valid = false;
+                    if(isVertex)
+                    {
+                        positions[i] = position;
+                        if(hasNormal) normals[i] = normal;
+                        if(hasUV) uvs[i] = uv;
+                    }
+                }
+            });
+            if(!valid)
+                return false;
+            for(size_t i = 0; i < chunkCorners.size(); ++i)
+                corners.insert(corners.end(), chunkCorners[i].begin(), chunkCorners[i].end());
+        }
+        else if(fixedSize)
+        {
+            if((size_t)(end - p) < recordSize * element.count)
+                return false;
+            const uint8_t* records = (const uint8_t*)p;
+            p += recordSize * element.count;
+            if(!isVertex)
+                continue;
+
+            parallelFor(0, element.count, 16384, [&](size_t begin, size_t stop)
+            {
+                for(size_t i = begin; i < stop; ++i)
+                {
+                    const uint8_t* q = records + i * recordSize;
+                    glm::vec3 position(0.0f), normal(0.0f);
+                    glm::vec2 uv(0.0f);
+                    for(size_t k = 0; k < element.properties.size(); ++k)
+                    {
+                        PlyType type = element.properties[k].type;
+                        storeField(fields[k], (float)readPly(q, type, bigEndian), position, normal, uv);
+                        q += plySize(type);
+                    }
+                    positions[i] = position;
+                    if(hasNormal) normals[i] = normal;
+                    if(hasUV) uvs[i] = uv;
+                }
+            });
+        }
+        else
+        {
+        // Variable sized records have to be walked in order
+            std::vector<uint32_t> polygon;
+            for(size_t i = 0; i < element.count; ++i)
+            {
+                glm::vec3 position(0.0f), normal(0.0f);
+                glm::vec2 uv(0.0f);
+                for(size_t k = 0; k < element.properties.size(); ++k)
+                {
+                    const PlyProperty& property = element.properties[k];
+                    if(property.countType != PlyInvalid)
+                    {
+                        size_t countSize = plySize(property.countType);
+                        if((size_t)(end - p) < countSize)
+                            return false;
+                        double listCount = readPly((const uint8_t*)p, property.countType, bigEndian);
+                        if(listCount < 0.0 || listCount > 0xffffffffu)
+                            return false;
+                        size_t count = (size_t)listCount;
+                        p += countSize;
+                        size_t itemSize = plySize(property.type);
+                        if((size_t)(end - p) < count * itemSize)
+                            return false;
+                        polygon.resize(count);
+                        for(size_t n = 0; n < count; ++n, p += itemSize)
+                        {
+                            double index = readPly((const uint8_t*)p, property.type, bigEndian);
+                            if(index < 0.0 || index > 0xffffffffu)
+                                return false;
+                            polygon[n] = (uint32_t)index;
+                        }
+                        if(isFace && isFaceList(property))
+                            addFanCorners(polygon, hasUV, hasNormal, corners);
+                    }
+                    else
+                    {
+                        size_t itemSize = plySize(property.type);
+                        if((size_t)(end - p) < itemSize)
+                            return false;
+                        float value = (float)readPly((const uint8_t*)p, property.type, bigEndian);
+                        p += itemSize;
+                        if(isVertex)
+                            storeField(fields[k], value, position, normal, uv);
+                    }
+                }
+                if(isVertex)
+                {
+                    positions[i] = position;
+                    if(hasNormal) normals[i] = normal;
+                    if(hasUV) uvs[i] = uv;
+                }
+            }
+        }
+    }
+
+    if(stats)
+        stats->parseSeconds = secondsSince(start);
+    return !corners.empty() && weldCorners(positions, uvs, normals, corners, mesh, stats);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "mesh/mesh.h"
+
+#include <string>
+
+/*************************************************************
+ * Mesh Import
+ * -----------
+ * Loads Wavefront OBJ and PLY (ASCII or binary little/big
+ * endian) into a welded, indexed Mesh. Text is parsed in
+ * parallel over line-aligned chunks of the file; binary PLY
+ * vertex records are decoded in parallel. Identical vertices
+ * (same position, normal and uv) are welded through a hash
+ * map keyed on the gtx/hash std::hash specialisations.
+ * Polygons are triangulated as fans. Missing normals are
+ * generated from the faces.
+ ************************************************************/
+struct MeshImportStats
+{
+    size_t cornersRead;         // face corners before welding
+    size_t verticesWelded;      // unique vertices after welding
+    size_t triangles;
+    double parseSeconds;
+    double weldSeconds;
+    bool normalsGenerated;      // the file had no normals for some corners
+};
+
+bool importMesh(const std::string& path, Mesh& mesh, MeshImportStats* stats);
+bool importObj(const char* data, size_t size, Mesh& mesh, MeshImportStats* stats);
+bool importPly(const char* data, size_t size, Mesh& mesh, MeshImportStats* stats);
@@ -0,0 +1,366 @@
+#include "mesh/mesh_optimize.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+    const uint32_t NoVertex = ~0u;
+
+/**************************************************************
+ * FifoCache
+ * ---------
+ * Post-transform cache model. A vertex is resident while
+ * fewer than size other vertices have been inserted after it,
+ * so a lookup is one subtraction against its insertion time.
+ *************************************************************/
+    struct FifoCache
+    {
+        std::vector<uint32_t> stamp;
+        uint32_t time;
+        uint32_t size;
+
+        FifoCache(size_t vertexCount, unsigned cacheSize)
+            : stamp(vertexCount, 0), time(cacheSize + 1), size(cacheSize)
+        {
+        }
+
+        void reset()
+        {
+            time += size + 1;
+        }
+
+    // Returns true on a miss
+        bool touch(uint32_t vertex)
+        {
+            if(time - stamp[vertex] <= size)
+                return false;
+            stamp[vertex] = time++;
+            return true;
+        }
+    };
+
+    struct Cluster
+    {
+        uint32_t first;
+        uint32_t count;
+        float key;
+    };
+}
+
+/**************************************************************
+ * defaultMeshOptimizeSettings()
+ * ----------------------------
+ * A 16 entry FIFO is a conservative model of current GPUs;
+ * a larger real cache only does better with the same order.
+ *************************************************************/
+MeshOptimizeSettings defaultMeshOptimizeSettings()
+{
+    MeshOptimizeSettings settings;
+    settings.cacheSize = 16;
+    settings.overdraw = true;
+    settings.overdrawThreshold = 1.05f;
+    return settings;
+}
+
+/**************************************************************
+ * simulateVertexCache()
+ * --------------------
+ * Replays the index list through a FIFO of cacheSize entries
+ * and reports ACMR (misses per triangle) and ATVR (misses per
+ * distinct vertex).
+ *************************************************************/
+VertexCacheStats simulateVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, unsigned cacheSize)
+{
+    VertexCacheStats stats = VertexCacheStats();
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<char> seen(vertexCount, 0);
+
+    for(size_t i = 0; i < indices.size(); ++i)
+    {
+        uint32_t v = indices[i];
+        if(v >= vertexCount)
+            continue;
+        if(cache.touch(v))
+            ++stats.transforms;
+        if(!seen[v])
+        {
+            seen[v] = 1;
+            ++stats.vertices;
+        }
+    }
+
+    stats.triangles = indices.size() / 3;
+    stats.acmr = stats.triangles ? (float)stats.transforms / stats.triangles : 0.0f;
+    stats.atvr = stats.vertices ? (float)stats.transforms / stats.vertices : 0.0f;
+    return stats;
+}
+
+/**************************************************************
+ * optimizeVertexCache()
+ * --------------------
+ * Tipsify: fans around a current vertex, emitting all of its
+ * remaining triangles, then moves to the neighbour that will
+ * still be in the cache after its own fan, or to a recently
+ * used vertex with triangles left when the fan is a dead end.
+ * If clusters is given it receives the first triangle of each
+ * run that started from such a dead end.
+ *************************************************************/
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, unsigned cacheSize,
+                         std::vector<uint32_t>* clusters)
+{
+    size_t triangleCount = indices.size() / 3;
+    if(clusters)
+        clusters->clear();
+    if(triangleCount == 0)
+        return;
+
+// Vertex to triangle adjacency and live triangle counts
+    std::vector<uint32_t> live(vertexCount, 0);
+    for(size_t i = 0; i < triangleCount * 3; ++i)
+        ++live[indices[i]];
+
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for(size_t v = 0; v < vertexCount; ++v)
+        offsets[v + 1] = offsets[v] + live[v];
+
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for(size_t i = 0; i < triangleCount * 3; ++i)
+        adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+
+    std::vector<uint32_t> stamp(vertexCount, 0);
+    std::vector<char> emitted(triangleCount, 0);
+    std::vector<uint32_t> deadEnd, candidates, result;
+    result.reserve(triangleCount * 3);
+    uint32_t time = cacheSize + 1;
+    uint32_t cursor = 0;
+
+    uint32_t fan = NoVertex;
+    while(cursor < vertexCount && fan == NoVertex)
+    {
+        if(live[cursor] > 0)
+            fan = cursor;
+        ++cursor;
+    }
+    if(clusters)
+        clusters->push_back(0);
+
+    while(fan != NoVertex)
+    {
+    // Emit every remaining triangle around the fan vertex
+        candidates.clear();
+        for(uint32_t k = offsets[fan]; k < offsets[fan + 1]; ++k)
+        {
+            uint32_t t = adjacency[k];
+            if(emitted[t])
+                continue;
+            emitted[t] = 1;
+            for(int c = 0; c < 3; ++c)
+            {
+                uint32_t v = indices[t * 3 + c];
+                result.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if(time - stamp[v] > cacheSize)
+                    stamp[v] = time++;
+            }
+        }
+
+    // Prefer the oldest candidate that survives its own fan
+        uint32_t next = NoVertex;
+        int bestPriority = -1;
+        for(size_t i = 0; i < candidates.size(); ++i)
+        {
+            uint32_t v = candidates[i];
+            if(live[v] == 0)
+                continue;
+            int priority = 0;
+            if(time - stamp[v] + 2 * live[v] <= cacheSize)
+                priority = (int)(time - stamp[v]);
+            if(priority > bestPriority)
+            {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+
+        if(next == NoVertex)
+        {
+            while(!deadEnd.empty() && next == NoVertex)
+            {
+                if(live[deadEnd.back()] > 0)
+                    next = deadEnd.back();
+                deadEnd.pop_back();
+            }
+            while(cursor < vertexCount && next == NoVertex)
+            {
+                if(live[cursor] > 0)
+                    next = cursor;
+                ++cursor;
+            }
+            if(clusters && next != NoVertex)
+                clusters->push_back((uint32_t)(result.size() / 3));
+        }
+        fan = next;
+    }
+
+    indices.swap(result);
+}
+
+/**************************************************************
+ * optimizeOverdraw()
+ * -----------------
+ * Splits each cluster wherever the cache cost of the part
+ * so far is within threshold of the whole cluster's, then
+ * orders clusters by the dot product of their area weighted
+ * normal with the offset from the mesh centroid, largest
+ * first. Returns the number of clusters.
+ *************************************************************/
+size_t optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<MeshVertex>& vertices,
+                        const std::vector<uint32_t>& clusters, unsigned cacheSize, float threshold)
+{
+    uint32_t triangleCount = (uint32_t)(indices.size() / 3);
+    if(triangleCount == 0)
+        return 0;
+
+    std::vector<uint32_t> hard(clusters);
+    if(hard.empty() || hard[0] != 0)
+        hard.insert(hard.begin(), 0);
+    hard.push_back(triangleCount);
+
+// Soft boundaries inside each hard cluster
+    FifoCache cache(vertices.size(), cacheSize);
+    std::vector<Cluster> soft;
+    for(size_t h = 0; h + 1 < hard.size(); ++h)
+    {
+        uint32_t first = hard[h], last = hard[h + 1];
+        if(first >= last)
+            continue;
+
+        cache.reset();
+        uint32_t misses = 0;
+        for(uint32_t t = first; t < last; ++t)
+            for(int c = 0; c < 3; ++c)
+                misses += cache.touch(indices[t * 3 + c]);
+        float limit = threshold * misses / (last - first);
+
+        cache.reset();
+        uint32_t start = first;
+        misses = 0;
+        for(uint32_t t = first; t < last; ++t)
+        {
+            for(int c = 0; c < 3; ++c)
+                misses += cache.touch(indices[t * 3 + c]);
+            if(t + 1 < last && (float)misses / (t + 1 - start) <= limit)
+            {
+                Cluster cluster = { start, t + 1 - start, 0.0f };
+                soft.push_back(cluster);
+                cache.reset();
+                start = t + 1;
+                misses = 0;
+            }
+        }
+        Cluster cluster = { start, last - start, 0.0f };
+        soft.push_back(cluster);
+    }
+
+// Area weighted centroid and normal per cluster
+    std::vector<glm::vec3> centroids(soft.size()), normals(soft.size());
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for(size_t i = 0; i < soft.size(); ++i)
+    {
+        glm::vec3 centroid(0.0f), normal(0.0f), average(0.0f);
+        float area = 0.0f;
+        for(uint32_t t = soft[i].first; t < soft[i].first + soft[i].count; ++t)
+        {
+            const glm::vec3& p0 = vertices[indices[t * 3 + 0]].position;
+            const glm::vec3& p1 = vertices[indices[t * 3 + 1]].position;
+            const glm::vec3& p2 = vertices[indices[t * 3 + 2]].position;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float a = glm::length(n);
+            glm::vec3 center = (p0 + p1 + p2) / 3.0f;
+            centroid += center * a;
+            average += center;
+            normal += n;
+            area += a;
+        }
+        meshCentroid += centroid;
+        meshArea += area;
+        centroids[i] = area > 0.0f ? centroid / area : average / (float)soft[i].count;
+        float length = glm::length(normal);
+        normals[i] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+    }
+    if(meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    for(size_t i = 0; i < soft.size(); ++i)
+        soft[i].key = glm::dot(centroids[i] - meshCentroid, normals[i]);
+    std::stable_sort(soft.begin(), soft.end(), [](const Cluster& a, const Cluster& b)
+    {
+        return a.key > b.key;
+    });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for(size_t i = 0; i < soft.size(); ++i)
+        result.insert(result.end(), indices.begin() + soft[i].first * 3,
+                      indices.begin() + (soft[i].first + soft[i].count) * 3);
+    indices.swap(result);
+    return soft.size();
+}
+
+/**************************************************************
+ * optimizeVertexFetch()
+ * --------------------
+ * Renumbers vertices in order of first reference and drops
+ * vertices no triangle uses.
+ *************************************************************/
+void optimizeVertexFetch(Mesh& mesh)
+{
+    std::vector<uint32_t> remap(mesh.vertices.size(), NoVertex);
+    std::vector<MeshVertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+
+    for(size_t i = 0; i < mesh.indices.size(); ++i)
+    {
+        uint32_t& index = mesh.indices[i];
+        if(remap[index] == NoVertex)
+        {
+            remap[index] = (uint32_t)vertices.size();
+            vertices.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+    mesh.vertices.swap(vertices);
+}
+
+/**************************************************************
+ * optimizeMesh()
+ * -------------
+ * Runs the vertex cache, overdraw and vertex fetch passes in
+ * that order and reports the simulated cache before and after.
+ *************************************************************/
+void optimizeMesh(Mesh& mesh, const MeshOptimizeSettings& settings, MeshOptimizeReport* report)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if(report)
+        report->before = simulateVertexCache(mesh.indices, mesh.vertices.size(), settings.cacheSize);
+
+    std::vector<uint32_t> clusters;
+    optimizeVertexCache(mesh.indices, mesh.vertices.size(), settings.cacheSize, &clusters);
+    size_t clusterCount = clusters.size();
+    if(settings.overdraw)
+        clusterCount = optimizeOverdraw(mesh.indices, mesh.vertices, clusters, settings.cacheSize,
+                                        settings.overdrawThreshold);
+    optimizeVertexFetch(mesh);
+
+    if(report)
+    {
+        report->after = simulateVertexCache(mesh.indices, mesh.vertices.size(), settings.cacheSize);
+        report->clusters = clusterCount;
+        report->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
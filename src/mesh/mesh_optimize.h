@@ -0,0 +1,57 @@
+#pragma once
+
+#include "mesh/mesh.h"
+
+/*************************************************************
+ * Mesh Optimization
+ * -----------------
+ * Offline reordering of imported meshes:
+ *
+ *  1. Triangles are reordered for the post-transform vertex
+ *     cache with Tipsify (Sander, Nehab, Barczak 2007), which
+ *     also yields clusters wherever the cache had to restart.
+ *  2. Those clusters are split further where the cache cost
+ *     stays within a threshold, then sorted by how much they
+ *     face away from the mesh centre so that outer surfaces
+ *     tend to be drawn first, independent of the view.
+ *  3. Vertices are renumbered in order of first use so that
+ *     vertex fetch walks memory forwards.
+ *
+ * simulateVertexCache() replays an index list through a FIFO
+ * cache so the effect can be measured without a GPU.
+ ************************************************************/
+struct VertexCacheStats
+{
+    size_t triangles;
+    size_t vertices;            // distinct vertices referenced
+    size_t transforms;          // cache misses
+    float acmr;                 // transforms per triangle, 0.5 at best
+    float atvr;                 // transforms per vertex, 1.0 at best
+};
+
+struct MeshOptimizeSettings
+{
+    unsigned cacheSize;         // FIFO entries assumed by both optimizer and simulator
+    bool overdraw;
+    float overdrawThreshold;    // allowed ACMR growth when splitting clusters
+};
+
+struct MeshOptimizeReport
+{
+    VertexCacheStats before;
+    VertexCacheStats after;
+    size_t clusters;
+    double seconds;
+};
+
+MeshOptimizeSettings defaultMeshOptimizeSettings();
+
+VertexCacheStats simulateVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, unsigned cacheSize);
+
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, unsigned cacheSize,
+                         std::vector<uint32_t>* clusters);
+size_t optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<MeshVertex>& vertices,
+                        const std::vector<uint32_t>& clusters, unsigned cacheSize, float threshold);
+void optimizeVertexFetch(Mesh& mesh);
+
+void optimizeMesh(Mesh& mesh, const MeshOptimizeSettings& settings, MeshOptimizeReport* report);
@@ -0,0 +1,247 @@
+#include "mesh/mesh_quantize.h"
+
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    const uint32_t PositionOffset = 0;
+    const uint32_t NormalOffset = 8;
+
+    uint32_t uvOffset(NormalEncoding encoding)
+    {
+        return encoding == NormalQTangent ? 16 : 12;
+    }
+
+// atan2 rather than acos, which cannot resolve angles below
+// about 0.02 degrees in single precision
+    float angleDegrees(const glm::vec3& a, const glm::vec3& b)
+    {
+        return glm::degrees(std::atan2(glm::length(glm::cross(a, b)), glm::dot(a, b)));
+    }
+
+/**************************************************************
+ * Octahedral Normals
+ * ------------------
+ * The unit sphere is projected onto an octahedron and the
+ * lower half folded over the upper, giving a square. Of the
+ * four snorm16 neighbours around the projected point, the one
+ * that decodes closest to the input is kept.
+ *************************************************************/
+    glm::vec2 signNotZero(const glm::vec2& v)
+    {
+        return glm::vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+    }
+
+    glm::vec3 octDecode(const glm::vec2& e)
+    {
+        glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+        if(n.z < 0.0f)
+        {
+            glm::vec2 folded = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * signNotZero(glm::vec2(n.x, n.y));
+            n.x = folded.x;
+            n.y = folded.y;
+        }
+        return glm::normalize(n);
+    }
+
+    uint32_t octEncode(const glm::vec3& normal)
+    {
+        glm::vec3 n = normal / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+        glm::vec2 e(n.x, n.y);
+        if(n.z < 0.0f)
+            e = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * signNotZero(e);
+
+        glm::vec2 base = glm::floor(glm::clamp(e, -1.0f, 1.0f) * 32767.0f);
+        uint32_t best = 0;
+        float bestDot = -2.0f;
+        for(int i = 0; i < 4; ++i)
+        {
+            glm::vec2 candidate = glm::clamp((base + glm::vec2(float(i & 1), float(i >> 1))) / 32767.0f, -1.0f, 1.0f);
+            uint32_t packed = glm::packSnorm2x16(candidate);
+            float d = glm::dot(octDecode(glm::unpackSnorm2x16(packed)), normal);
+            if(d > bestDot)
+            {
+                bestDot = d;
+                best = packed;
+            }
+        }
+        return best;
+    }
+
+/**************************************************************
+ * QTangent
+ * --------
+ * The frame (tangent, cross(normal, tangent), normal) is a
+ * rotation, stored as a quaternion with w kept positive and
+ * away from zero so that negating the whole quaternion, which
+ * leaves the rotation unchanged, can flag a mirrored
+ * bitangent.
+ *************************************************************/
+    uint64_t qtangentEncode(const glm::vec3& normal, const glm::vec4& tangent)
+    {
+        glm::vec3 n = glm::normalize(normal);
+        glm::vec3 t = glm::normalize(glm::vec3(tangent) - n * glm::dot(n, glm::vec3(tangent)));
+        glm::mat3 frame(t, glm::cross(n, t), n);
+        glm::quat q = glm::normalize(glm::quat_cast(frame));
+        if(q.w < 0.0f)
+            q = -q;
+
+        const float Bias = 1.0f / 32767.0f;
+        if(q.w < Bias)
+        {
+            float scale = std::sqrt(1.0f - Bias * Bias) / std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z);
+            q = glm::quat(Bias, q.x * scale, q.y * scale, q.z * scale);
+        }
+        if(tangent.w < 0.0f)
+            q = -q;
+        return glm::packSnorm4x16(glm::vec4(q.x, q.y, q.z, q.w));
+    }
+
+    void qtangentDecode(uint64_t packed, glm::vec3& normal, glm::vec4& tangent)
+    {
+        glm::vec4 v = glm::unpackSnorm4x16(packed);
+        glm::quat q = glm::normalize(glm::quat(v.w, v.x, v.y, v.z));
+        glm::mat3 frame = glm::mat3_cast(q);
+        normal = frame[2];
+        tangent = glm::vec4(frame[0], v.w < 0.0f ? -1.0f : 1.0f);
+    }
+}
+
+/**************************************************************
+ * quantizedVertexSize()
+ * --------------------
+ * Bytes per vertex for an encoding.
+ *************************************************************/
+uint32_t quantizedVertexSize(NormalEncoding encoding)
+{
+    return uvOffset(encoding) + 4;
+}
+
+/**************************************************************
+ * quantizeMesh()
+ * -------------
+ * Packs every vertex and, with a report, decodes the result
+ * again to measure the largest error of each attribute.
+ *************************************************************/
+void quantizeMesh(const Mesh& mesh, NormalEncoding encoding, QuantizedMesh& quantized, QuantizationReport* report)
+{
+    quantized.encoding = encoding;
+    quantized.stride = quantizedVertexSize(encoding);
+    quantized.indices = mesh.indices;
+    quantized.positionBias = mesh.boundsMin;
+    quantized.positionScale = mesh.boundsMax - mesh.boundsMin;
+    quantized.vertices.assign(mesh.vertices.size() * quantized.stride, 0);
+
+    std::vector<glm::vec4> tangents;
+    if(encoding == NormalQTangent)
+        computeTangents(mesh, tangents);
+
+    glm::vec3 inverseScale;
+    for(int k = 0; k < 3; ++k)
+        inverseScale[k] = quantized.positionScale[k] > 0.0f ? 1.0f / quantized.positionScale[k] : 0.0f;
+
+    for(size_t i = 0; i < mesh.vertices.size(); ++i)
+    {
+        const MeshVertex& v = mesh.vertices[i];
+        uint8_t* out = &quantized.vertices[i * quantized.stride];
+
+        glm::vec3 unit = (v.position - quantized.positionBias) * inverseScale;
+        uint64_t position = glm::packUnorm4x16(glm::vec4(glm::clamp(unit, 0.0f, 1.0f), 0.0f));
+        std::memcpy(out + PositionOffset, &position, sizeof(position));
+
+        if(encoding == NormalOctahedral)
+        {
+            uint32_t normal = octEncode(v.normal);
+            std::memcpy(out + NormalOffset, &normal, sizeof(normal));
+        }
+        else if(encoding == NormalPacked1010102)
+        {
+            uint32_t normal = glm::packSnorm3x10_1x2(glm::vec4(v.normal, 0.0f));
+            std::memcpy(out + NormalOffset, &normal, sizeof(normal));
+        }
+        else
+        {
+            uint64_t frame = qtangentEncode(v.normal, tangents[i]);
+            std::memcpy(out + NormalOffset, &frame, sizeof(frame));
+        }
+
+        uint32_t uv = glm::packHalf2x16(v.uv);
+        std::memcpy(out + uvOffset(encoding), &uv, sizeof(uv));
+    }
+
+    if(!report)
+        return;
+
+    std::vector<MeshVertex> decoded;
+    std::vector<glm::vec4> decodedTangents;
+    decodeQuantizedMesh(quantized, decoded, encoding == NormalQTangent ? &decodedTangents : NULL);
+
+    *report = QuantizationReport();
+    report->floatBytes = sizeof(MeshVertex) + (encoding == NormalQTangent ? sizeof(glm::vec4) : 0);
+    report->packedBytes = quantized.stride;
+    report->ratio = (float)report->floatBytes / report->packedBytes;
+    for(size_t i = 0; i < decoded.size(); ++i)
+    {
+        const MeshVertex& a = mesh.vertices[i];
+        const MeshVertex& b = decoded[i];
+        glm::vec3 dp = glm::abs(a.position - b.position);
+        glm::vec2 duv = glm::abs(a.uv - b.uv);
+        report->maxPositionError = std::max(report->maxPositionError, std::max(dp.x, std::max(dp.y, dp.z)));
+        report->maxUVError = std::max(report->maxUVError, std::max(duv.x, duv.y));
+        report->maxNormalError = std::max(report->maxNormalError, angleDegrees(a.normal, b.normal));
+        if(encoding == NormalQTangent)
+            report->maxTangentError = std::max(report->maxTangentError,
+                angleDegrees(glm::vec3(tangents[i]), glm::vec3(decodedTangents[i])));
+    }
+}
+
+/**************************************************************
+ * decodeQuantizedMesh()
+ * --------------------
+ * CPU decode, matching shaders/quantized_vertex.glsl.
+ *************************************************************/
+void decodeQuantizedMesh(const QuantizedMesh& quantized, std::vector<MeshVertex>& vertices,
+                         std::vector<glm::vec4>* tangents)
+{
+    size_t count = quantized.stride ? quantized.vertices.size() / quantized.stride : 0;
+    vertices.resize(count);
+    if(tangents)
+        tangents->assign(count, glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        const uint8_t* in = &quantized.vertices[i * quantized.stride];
+        MeshVertex& v = vertices[i];
+
+        uint64_t position;
+        std::memcpy(&position, in + PositionOffset, sizeof(position));
+        v.position = glm::vec3(glm::unpackUnorm4x16(position)) * quantized.positionScale + quantized.positionBias;
+
+        if(quantized.encoding == NormalQTangent)
+        {
+            uint64_t frame;
+            std::memcpy(&frame, in + NormalOffset, sizeof(frame));
+            glm::vec4 tangent;
+            qtangentDecode(frame, v.normal, tangent);
+            if(tangents)
+                (*tangents)[i] = tangent;
+        }
+        else
+        {
+            uint32_t normal;
+            std::memcpy(&normal, in + NormalOffset, sizeof(normal));
+            if(quantized.encoding == NormalOctahedral)
+                v.normal = octDecode(glm::unpackSnorm2x16(normal));
+            else
+                v.normal = glm::normalize(glm::vec3(glm::unpackSnorm3x10_1x2(normal)));
+        }
+
+        uint32_t uv;
+        std::memcpy(&uv, in + uvOffset(quantized.encoding), sizeof(uv));
+        v.uv = glm::unpackHalf2x16(uv);
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "mesh/mesh.h"
+
+/*************************************************************
+ * Vertex Quantization
+ * -------------------
+ * Packs a Mesh into a compact vertex format for upload:
+ *
+ *  position  unorm16 x3 relative to the mesh bounds (8 bytes,
+ *            one short of padding)
+ *  normal    octahedral snorm16 x2, or snorm 10:10:10:2
+ *            (4 bytes), or the whole tangent frame as a
+ *            snorm16 x4 quaternion (8 bytes) whose sign of w
+ *            carries the bitangent handedness
+ *  uv        half x2 (4 bytes)
+ *
+ * That is 16 or 20 bytes against 32, or 48 with a float
+ * tangent. decodeQuantizedMesh() is the CPU reference of the
+ * decode in shaders/quantized_vertex.glsl and is what the
+ * error report is measured with. render/quantized_vertex.h
+ * sets up the matching attribute pointers.
+ ************************************************************/
+enum NormalEncoding
+{
+    NormalOctahedral,
+    NormalPacked1010102,
+    NormalQTangent
+};
+
+struct QuantizedMesh
+{
+    NormalEncoding encoding;
+    uint32_t stride;
+    std::vector<uint8_t> vertices;
+    std::vector<uint32_t> indices;
+    glm::vec3 positionScale;    // position = unorm * scale + bias
+    glm::vec3 positionBias;
+};
+
+struct QuantizationReport
+{
+    size_t floatBytes;          // per vertex, with a vec4 tangent for NormalQTangent
+    size_t packedBytes;
+    float ratio;
+    float maxPositionError;     // world units
+    float maxNormalError;       // degrees
+    float maxTangentError;      // degrees, NormalQTangent only
+    float maxUVError;
+};
+
+uint32_t quantizedVertexSize(NormalEncoding encoding);
+void quantizeMesh(const Mesh& mesh, NormalEncoding encoding, QuantizedMesh& quantized, QuantizationReport* report);
+void decodeQuantizedMesh(const QuantizedMesh& quantized, std::vector<MeshVertex>& vertices,
+                         std::vector<glm::vec4>* tangents);
@@ -0,0 +1,532 @@
+#include "mesh/mesh_simplify.h"
+
+#include <glm/gtx/hash.hpp>
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace
+{
+    const uint32_t NoVertex = ~0u;
+
+// Border planes are weighted well above surface planes so
+// that border vertices do not wander off the outline
+    const double BorderWeight = 10.0;
+
+// Collapses that would leave a vertex with a larger fan are
+// skipped; they make long slivers and slow every later update
+    const size_t MaxFanTriangles = 48;
+
+    enum VertexKind
+    {
+        VertexInterior,
+        VertexBorder,
+        VertexLocked
+    };
+
+/**************************************************************
+ * Quadric
+ * -------
+ * Symmetric 4x4 matrix of summed plane equations, so that
+ * evaluate(p) is the weighted sum of squared distances of p
+ * to every plane added.
+ *************************************************************/
+    struct Quadric
+    {
+        double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+        double weight;
+
+        Quadric()
+            : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0), weight(0)
+        {
+        }
+
+        void addPlane(const glm::vec3& n, float distance, double w)
+        {
+            double a = n.x, b = n.y, c = n.z, d = distance;
+            a2 += w * a * a; ab += w * a * b; ac += w * a * c; ad += w * a * d;
+            b2 += w * b * b; bc += w * b * c; bd += w * b * d;
+            c2 += w * c * c; cd += w * c * d;
+            d2 += w * d * d;
+            weight += w;
+        }
+
+        void add(const Quadric& q)
+        {
+            a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+            b2 += q.b2; bc += q.bc; bd += q.bd;
+            c2 += q.c2; cd += q.cd;
+            d2 += q.d2;
+            weight += q.weight;
+        }
+
+        double evaluate(const glm::vec3& p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double e = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+                     + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+                     + c2 * z * z + 2 * cd * z
+                     + d2;
+            return std::max(e, 0.0);
+        }
+    };
+
+// Ties, common on flat areas, go to the shortest edge; left
+// to chance they pile collapses onto one vertex and grow fans
+// with thousands of triangles
+    struct Collapse
+    {
+        double cost;
+        float length;
+        uint32_t from;
+        uint32_t to;
+        uint32_t fromVersion;
+        uint32_t toVersion;
+
+        bool operator<(const Collapse& other) const
+        {
+            return cost != other.cost ? cost > other.cost : length > other.length;
+        }
+    };
+
+    inline uint64_t edgeKey(uint32_t a, uint32_t b)
+    {
+        return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+    }
+
+/**************************************************************
+ * Simplifier
+ * ----------
+ * State of one simplifyMesh() call: live triangles, the
+ * triangles around each vertex, quadrics, and per-vertex
+ * versions that invalidate queued collapses lazily.
+ *************************************************************/
+    class Simplifier
+    {
+    public:
+        Simplifier(const Mesh& mesh, const std::vector<uint32_t>& indices);
+
+        float run(size_t targetTriangles, float targetError);
+        void output(std::vector<uint32_t>& result) const;
+
+    private:
+        void classifyVertices();
+        void computeQuadrics();
+        void pushCollapses(uint32_t vertex);
+        void pushCollapse(uint32_t from, uint32_t to);
+        bool canCollapse(uint32_t from, uint32_t to) const;
+        bool flips(uint32_t from, uint32_t to) const;
+        void collapse(uint32_t from, uint32_t to);
+
+        const Mesh& m_mesh;
+        std::vector<uint32_t> m_indices;
+        std::vector<char> m_triangleLive;
+        std::vector<std::vector<uint32_t> > m_vertexTriangles;
+        std::vector<uint32_t> m_canonical;
+        std::vector<char> m_kind;
+        std::unordered_set<uint64_t> m_borderEdges;
+        std::vector<Quadric> m_quadrics;
+        std::vector<uint32_t> m_version;
+        std::vector<char> m_removed;
+        std::vector<uint32_t> m_stamp;
+        uint32_t m_stampValue;
+        std::priority_queue<Collapse> m_queue;
+        size_t m_liveTriangles;
+    };
+
+    Simplifier::Simplifier(const Mesh& mesh, const std::vector<uint32_t>& indices)
+        : m_mesh(mesh), m_indices(indices), m_stampValue(0), m_liveTriangles(0)
+    {
+        size_t vertexCount = mesh.vertices.size();
+        size_t triangleCount = indices.size() / 3;
+        m_indices.resize(triangleCount * 3);
+        m_triangleLive.assign(triangleCount, 1);
+        m_vertexTriangles.resize(vertexCount);
+        m_version.assign(vertexCount, 0);
+        m_removed.assign(vertexCount, 0);
+        m_stamp.assign(vertexCount, 0);
+
+        for(size_t t = 0; t < triangleCount; ++t)
+        {
+            uint32_t a = m_indices[t * 3], b = m_indices[t * 3 + 1], c = m_indices[t * 3 + 2];
+            if(a == b || b == c || a == c)
+            {
+                m_triangleLive[t] = 0;
+                continue;
+            }
+            for(int k = 0; k < 3; ++k)
+                m_vertexTriangles[m_indices[t * 3 + k]].push_back((uint32_t)t);
+            ++m_liveTriangles;
+        }
+
+        classifyVertices();
+        computeQuadrics();
+    }
+
+/**************************************************************
+ * Simplifier::classifyVertices()
+ * -----------------------------
+ * Works on positions rather than indices so that seams do
+ * not look like borders. Seam vertices, vertices on edges
+ * shared by more than two triangles and border vertices that
+ * are not on a simple border path are locked.
+ *************************************************************/
+    void Simplifier::classifyVertices()
+    {
+        size_t vertexCount = m_mesh.vertices.size();
+        m_canonical.resize(vertexCount);
+        std::vector<uint32_t> wedges(vertexCount, 0);
+        std::unordered_map<glm::vec3, uint32_t> positions;
+        positions.reserve(vertexCount);
+        for(size_t v = 0; v < vertexCount; ++v)
+        {
+            m_canonical[v] = positions.insert(std::make_pair(m_mesh.vertices[v].position, (uint32_t)v)).first->second;
+            ++wedges[m_canonical[v]];
+        }
+
+        std::unordered_map<uint64_t, uint32_t> edgeUse;
+        edgeUse.reserve(m_indices.size());
+        for(size_t t = 0; t < m_triangleLive.size(); ++t)
+        {
+            if(!m_triangleLive[t])
+                continue;
+            for(int k = 0; k < 3; ++k)
+                ++edgeUse[edgeKey(m_canonical[m_indices[t * 3 + k]], m_canonical[m_indices[t * 3 + (k + 1) % 3]])];
+        }
+
+        std::vector<uint32_t> borderDegree(vertexCount, 0);
+        std::vector<char> nonManifold(vertexCount, 0);
+        for(std::unordered_map<uint64_t, uint32_t>::const_iterator it = edgeUse.begin(); it != edgeUse.end(); ++it)
+        {
+            if(it->second > 2)
+                nonManifold[(uint32_t)(it->first >> 32)] = nonManifold[(uint32_t)it->first] = 1;
+            if(it->second != 1)
+                continue;
+            m_borderEdges.insert(it->first);
+            ++borderDegree[(uint32_t)(it->first >> 32)];
+            ++borderDegree[(uint32_t)it->first];
+        }
+
+        m_kind.resize(vertexCount);
+        for(size_t v = 0; v < vertexCount; ++v)
+        {
+            uint32_t c = m_canonical[v];
+            if(wedges[c] > 1 || nonManifold[c])
+                m_kind[v] = VertexLocked;
+            else if(borderDegree[c] == 0)
+                m_kind[v] = VertexInterior;
+            else
+                m_kind[v] = borderDegree[c] == 2 ? VertexBorder : VertexLocked;
+        }
+    }
+
+/**************************************************************
+ * Simplifier::computeQuadrics()
+ * ----------------------------
+ * Area weighted triangle planes on every corner, plus a plane
+ * through each border edge perpendicular to its triangle.
+ *************************************************************/
+    void Simplifier::computeQuadrics()
+    {
+        m_quadrics.assign(m_mesh.vertices.size(), Quadric());
+        for(size_t t = 0; t < m_triangleLive.size(); ++t)
+        {
+            if(!m_triangleLive[t])
+                continue;
+            const uint32_t* tri = &m_indices[t * 3];
+            glm::vec3 p[3] = { m_mesh.vertices[tri[0]].position, m_mesh.vertices[tri[1]].position,
+                               m_mesh.vertices[tri[2]].position };
+            glm::vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+            float area = glm::length(n);
+            if(area == 0.0f)
+                continue;
+            n /= area;
+
+            Quadric q;
+            q.addPlane(n, -glm::dot(n, p[0]), area * 0.5);
+            for(int k = 0; k < 3; ++k)
+                m_quadrics[tri[k]].add(q);
+
+            for(int k = 0; k < 3; ++k)
+            {
+                uint32_t a = tri[k], b = tri[(k + 1) % 3];
+                if(!m_borderEdges.count(edgeKey(m_canonical[a], m_canonical[b])))
+                    continue;
+                glm::vec3 edge = p[(k + 1) % 3] - p[k];
+                float length = glm::length(edge);
+                if(length == 0.0f)
+                    continue;
+                glm::vec3 side = glm::normalize(glm::cross(edge, n));
+                Quadric border;
+                border.addPlane(side, -glm::dot(side, p[k]), BorderWeight * length * length);
+                m_quadrics[a].add(border);
+                m_quadrics[b].add(border);
+            }
+        }
+    }
+
+/**************************************************************
+ * Simplifier::run()
+ * ----------------
+ * Pops the cheapest collapse until the triangle target is
+ * met or the next collapse would exceed targetError. Returns
+ * the largest error of any applied collapse.
+ *************************************************************/
+    float Simplifier::run(size_t targetTriangles, float targetError)
+    {
+        for(uint32_t v = 0; v < (uint32_t)m_mesh.vertices.size(); ++v)
+            pushCollapses(v);
+
+        double maxCost = (double)targetError * targetError;
+        double worst = 0.0;
+        while(m_liveTriangles > targetTriangles && !m_queue.empty())
+        {
+            Collapse c = m_queue.top();
+            m_queue.pop();
+            if(m_removed[c.from] || m_removed[c.to] || m_version[c.from] != c.fromVersion
+               || m_version[c.to] != c.toVersion)
+                continue;
+            if(c.cost > maxCost)
+                break;
+            if(!canCollapse(c.from, c.to) || flips(c.from, c.to)
+               || m_vertexTriangles[c.from].size() + m_vertexTriangles[c.to].size() > MaxFanTriangles)
+                continue;
+
+            collapse(c.from, c.to);
+            worst = std::max(worst, c.cost);
+        }
+        return (float)std::sqrt(worst);
+    }
+
+    void Simplifier::output(std::vector<uint32_t>& result) const
+    {
+        result.clear();
+        for(size_t t = 0; t < m_triangleLive.size(); ++t)
+        {
+            if(m_triangleLive[t])
+                result.insert(result.end(), m_indices.begin() + t * 3, m_indices.begin() + t * 3 + 3);
+        }
+    }
+
+// Queues collapses of vertex onto each neighbour and back
+    void Simplifier::pushCollapses(uint32_t vertex)
+    {
+        ++m_stampValue;
+        const std::vector<uint32_t>& triangles = m_vertexTriangles[vertex];
+        for(size_t i = 0; i < triangles.size(); ++i)
+        {
+            uint32_t t = triangles[i];
+            if(!m_triangleLive[t])
+                continue;
+            for(int k = 0; k < 3; ++k)
+            {
+                uint32_t other = m_indices[t * 3 + k];
+                if(other == vertex || m_stamp[other] == m_stampValue)
+                    continue;
+                m_stamp[other] = m_stampValue;
+                pushCollapse(vertex, other);
+                pushCollapse(other, vertex);
+            }
+        }
+    }
+
+    void Simplifier::pushCollapse(uint32_t from, uint32_t to)
+    {
+        if(!canCollapse(from, to))
+            return;
+        Quadric q = m_quadrics[from];
+        q.add(m_quadrics[to]);
+        const glm::vec3& target = m_mesh.vertices[to].position;
+        double cost = q.weight > 0.0 ? q.evaluate(target) / q.weight : 0.0;
+        Collapse c = { cost, glm::distance(m_mesh.vertices[from].position, target), from, to,
+                       m_version[from], m_version[to] };
+        m_queue.push(c);
+    }
+
+    bool Simplifier::canCollapse(uint32_t from, uint32_t to) const
+    {
+        if(m_kind[from] == VertexInterior)
+            return true;
+        if(m_kind[from] == VertexBorder)
+            return m_borderEdges.count(edgeKey(m_canonical[from], m_canonical[to])) != 0;
+        return false;
+    }
+
+/**************************************************************
+ * Simplifier::flips()
+ * ------------------
+ * True if moving from onto to would turn any surviving
+ * triangle around from over, or squash it to nothing.
+ *************************************************************/
+    bool Simplifier::flips(uint32_t from, uint32_t to) const
+    {
+        const glm::vec3& target = m_mesh.vertices[to].position;
+        const std::vector<uint32_t>& triangles = m_vertexTriangles[from];
+        for(size_t i = 0; i < triangles.size(); ++i)
+        {
+            uint32_t t = triangles[i];
+            if(!m_triangleLive[t])
+                continue;
+            const uint32_t* tri = &m_indices[t * 3];
+            if(tri[0] == to || tri[1] == to || tri[2] == to)
+                continue;
+
+            glm::vec3 p[3], q[3];
+            for(int k = 0; k < 3; ++k)
+            {
+                p[k] = m_mesh.vertices[tri[k]].position;
+                q[k] = tri[k] == from ? target : p[k];
+            }
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            if(glm::dot(before, after) <= 0.05f * glm::length(before) * glm::length(after))
+                return true;
+        }
+        return false;
+    }
+
+/**************************************************************
+ * Simplifier::collapse()
+ * ---------------------
+ * Replaces from with to in every triangle, drops the ones
+ * that degenerate, and re-queues the collapses around to.
+ *************************************************************/
+    void Simplifier::collapse(uint32_t from, uint32_t to)
+    {
+        std::vector<uint32_t>& triangles = m_vertexTriangles[from];
+        std::vector<uint32_t>& target = m_vertexTriangles[to];
+        for(size_t i = 0; i < triangles.size(); ++i)
+        {
+            uint32_t t = triangles[i];
+            if(!m_triangleLive[t])
+                continue;
+            uint32_t* tri = &m_indices[t * 3];
+            if(tri[0] == to || tri[1] == to || tri[2] == to)
+            {
+                m_triangleLive[t] = 0;
+                --m_liveTriangles;
+                continue;
+            }
+            for(int k = 0; k < 3; ++k)
+            {
+                if(tri[k] == from)
+                    tri[k] = to;
+            }
+            target.push_back(t);
+        }
+        std::vector<uint32_t>().swap(triangles);
+
+    // Drop triangles that died from the target's list too
+        size_t live = 0;
+        for(size_t i = 0; i < target.size(); ++i)
+        {
+            if(m_triangleLive[target[i]])
+                target[live++] = target[i];
+        }
+        target.resize(live);
+
+    // Slide the border: from's other border edge now ends at to
+        if(m_kind[from] == VertexBorder)
+        {
+            uint32_t a = m_canonical[from], b = m_canonical[to];
+            m_borderEdges.erase(edgeKey(a, b));
+            for(size_t i = 0; i < target.size(); ++i)
+            {
+                const uint32_t* tri = &m_indices[target[i] * 3];
+                for(int k = 0; k < 3; ++k)
+                {
+                    uint32_t c = m_canonical[tri[k]];
+                    if(c != b && m_borderEdges.erase(edgeKey(a, c)))
+                        m_borderEdges.insert(edgeKey(b, c));
+                }
+            }
+        }
+
+        m_quadrics[to].add(m_quadrics[from]);
+        m_removed[from] = 1;
+        ++m_version[to];
+        pushCollapses(to);
+    }
+}
+
+/**************************************************************
+ * simplifyMesh()
+ * -------------
+ * Simplifies the triangles in indices, which may already be
+ * a simplified subset of mesh, down to targetIndexCount
+ * indices or until the error would pass targetError. Returns
+ * the error reached.
+ *************************************************************/
+float simplifyMesh(const Mesh& mesh, const std::vector<uint32_t>& indices, size_t targetIndexCount,
+                   float targetError, std::vector<uint32_t>& result)
+{
+    Simplifier simplifier(mesh, indices);
+    float error = simplifier.run(targetIndexCount / 3, targetError);
+    simplifier.output(result);
+    return error;
+}
+
+/**************************************************************
+ * buildLodChain()
+ * --------------
+ * LOD 0 is the mesh itself; each further LOD simplifies the
+ * previous one by reduction. The chain stops early once a
+ * step removes less than a tenth of the triangles, which
+ * happens when seams and borders are all that is left.
+ *************************************************************/
+void buildLodChain(const Mesh& mesh, size_t maxLods, float reduction, LodChain& chain)
+{
+    chain.indices = mesh.indices;
+    chain.lods.clear();
+    MeshLod base = { 0, (uint32_t)mesh.indices.size(), 0.0f };
+    chain.lods.push_back(base);
+
+    std::vector<uint32_t> current(mesh.indices), simplified;
+    while(chain.lods.size() < maxLods)
+    {
+        size_t target = (size_t)(current.size() / 3 * reduction) * 3;
+        float error = simplifyMesh(mesh, current, target, 1e30f, simplified);
+        if(simplified.empty() || simplified.size() > current.size() * 9 / 10)
+            break;
+
+        MeshLod lod = { (uint32_t)chain.indices.size(), (uint32_t)simplified.size(), chain.lods.back().error + error };
+        chain.indices.insert(chain.indices.end(), simplified.begin(), simplified.end());
+        chain.lods.push_back(lod);
+        current.swap(simplified);
+    }
+}
+
+/**************************************************************
+ * projectedErrorPixels()
+ * ---------------------
+ * Height in pixels of an object-space error at a view
+ * distance, using the vertical scale of a perspective()
+ * matrix.
+ *************************************************************/
+float projectedErrorPixels(float error, float distance, const glm::mat4& projection, float viewportHeight)
+{
+    if(distance <= 0.0f)
+        return error > 0.0f ? 1e30f : 0.0f;
+    return error / distance * projection[1][1] * viewportHeight * 0.5f;
+}
+
+/**************************************************************
+ * selectLod()
+ * ----------
+ * Coarsest LOD whose error, scaled by the object's world
+ * scale, projects to at most maxErrorPixels at distance.
+ *************************************************************/
+size_t selectLod(const LodChain& chain, float scale, float distance, const glm::mat4& projection,
+                 float viewportHeight, float maxErrorPixels)
+{
+    size_t selected = 0;
+    for(size_t i = 1; i < chain.lods.size(); ++i)
+    {
+        if(projectedErrorPixels(chain.lods[i].error * scale, distance, projection, viewportHeight) > maxErrorPixels)
+            break;
+        selected = i;
+    }
+    return selected;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "mesh/mesh.h"
+
+/*************************************************************
+ * Mesh Simplification
+ * -------------------
+ * Quadric error metric edge collapse (Garland and Heckbert
+ * 1997). Each vertex carries the area weighted sum of the
+ * plane quadrics of its triangles; a vertex is collapsed onto
+ * a neighbour in order of least quadric error. Collapses only
+ * ever remove vertices, never create them, so every LOD is
+ * just another index list over the same vertex buffer.
+ *
+ * Vertices on an attribute seam (several vertices sharing a
+ * position) never move, which keeps uv and normal
+ * discontinuities exactly where they were. Vertices on an
+ * open border only slide along the border, held there by
+ * extra quadrics perpendicular to the border faces.
+ *
+ * Errors are RMS distances to the original triangle planes
+ * around a vertex, in mesh units.
+ ************************************************************/
+struct MeshLod
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;                // accumulated from LOD 0
+};
+
+struct LodChain
+{
+    std::vector<uint32_t> indices;
+    std::vector<MeshLod> lods;
+};
+
+float simplifyMesh(const Mesh& mesh, const std::vector<uint32_t>& indices, size_t targetIndexCount,
+                   float targetError, std::vector<uint32_t>& result);
+
+void buildLodChain(const Mesh& mesh, size_t maxLods, float reduction, LodChain& chain);
+
+float projectedErrorPixels(float error, float distance, const glm::mat4& projection, float viewportHeight);
+size_t selectLod(const LodChain& chain, float scale, float distance, const glm::mat4& projection,
+                 float viewportHeight, float maxErrorPixels);
@@ -0,0 +1,310 @@
+#include "mesh/meshlet.h"
+#include "culling/frustum.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+    const uint32_t NoTriangle = ~0u;
+    const uint32_t NoMeshlet = ~0u;
+
+/**************************************************************
+ * computeMeshletBounds()
+ * ---------------------
+ * Sphere around the centre of the meshlet's box, and the
+ * narrowest cone around the average triangle normal that
+ * holds every triangle normal. If the normals span a half
+ * space or more the cutoff is 1, which never culls.
+ *************************************************************/
+    void computeMeshletBounds(const Mesh& mesh, const std::vector<uint32_t>& indices, Meshlet& meshlet)
+    {
+        glm::vec3 lower(FLT_MAX), upper(-FLT_MAX);
+        for(uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; ++i)
+        {
+            lower = glm::min(lower, mesh.vertices[indices[i]].position);
+            upper = glm::max(upper, mesh.vertices[indices[i]].position);
+        }
+        meshlet.center = (lower + upper) * 0.5f;
+        meshlet.radius = 0.0f;
+        for(uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; ++i)
+            meshlet.radius = std::max(meshlet.radius, glm::distance(meshlet.center, mesh.vertices[indices[i]].position));
+
+        std::vector<glm::vec3> normals;
+        glm::vec3 sum(0.0f);
+        for(uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3)
+        {
+            const glm::vec3& p0 = mesh.vertices[indices[i + 0]].position;
+            const glm::vec3& p1 = mesh.vertices[indices[i + 1]].position;
+            const glm::vec3& p2 = mesh.vertices[indices[i + 2]].position;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float length = glm::length(n);
+            if(length == 0.0f)
+                continue;
+            normals.push_back(n / length);
+            sum += normals.back();
+        }
+
+        meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+        meshlet.coneCutoff = 1.0f;
+        float length = glm::length(sum);
+        if(normals.empty() || length < 1e-6f)
+            return;
+
+        meshlet.coneAxis = sum / length;
+        float minDot = 1.0f;
+        for(size_t i = 0; i < normals.size(); ++i)
+            minDot = std::min(minDot, glm::dot(normals[i], meshlet.coneAxis));
+        if(minDot > 0.0f)
+            meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+    }
+
+/**************************************************************
+ * projectSphere()
+ * --------------
+ * Tight screen-space bounds of a view-space sphere under a
+ * perspective projection (Mara and McGuire 2013), in NDC.
+ * Returns false when the sphere reaches the near plane.
+ *************************************************************/
+    bool projectSphere(const glm::vec3& center, float radius, float zNear, float p00, float p11, glm::vec4& bounds)
+    {
+    // GL view space looks down -z
+        float depth = -center.z;
+        if(depth < radius + zNear)
+            return false;
+
+        glm::vec2 cx(center.x, depth);
+        glm::vec2 vx(std::sqrt(glm::dot(cx, cx) - radius * radius), radius);
+        glm::vec2 minX(vx.x * cx.x - vx.y * cx.y, vx.y * cx.x + vx.x * cx.y);
+        glm::vec2 maxX(vx.x * cx.x + vx.y * cx.y, -vx.y * cx.x + vx.x * cx.y);
+
+        glm::vec2 cy(center.y, depth);
+        glm::vec2 vy(std::sqrt(glm::dot(cy, cy) - radius * radius), radius);
+        glm::vec2 minY(vy.x * cy.x - vy.y * cy.y, vy.y * cy.x + vy.x * cy.y);
+        glm::vec2 maxY(vy.x * cy.x + vy.y * cy.y, -vy.y * cy.x + vy.x * cy.y);
+
+        bounds = glm::vec4(minX.x / minX.y * p00, minY.x / minY.y * p11, maxX.x / maxX.y * p00, maxY.x / maxY.y * p11);
+        return true;
+    }
+
+// True if [lower, upper] in pixels contains no pixel centre
+    bool missesPixelCenters(float lower, float upper)
+    {
+        return std::ceil(lower - 0.5f) > std::floor(upper - 0.5f);
+    }
+}
+
+/**************************************************************
+ * buildMeshlets()
+ * --------------
+ * Grows one meshlet at a time from the first unused triangle,
+ * always adding the neighbouring triangle that brings the
+ * fewest new vertices. Ties go to triangles whose vertices
+ * have the fewest unused triangles left, which mops up ragged
+ * borders instead of leaving slivers for later meshlets, and
+ * then to the one closest to the meshlet's centroid. A
+ * meshlet closes when it is full or has no unused neighbours
+ * that fit. Running the vertex cache optimizer first gives
+ * the seeds good locality.
+ *************************************************************/
+void buildMeshlets(const Mesh& mesh, uint32_t maxVertices, uint32_t maxTriangles, MeshletMesh& meshlets)
+{
+    uint32_t triangleCount = (uint32_t)(mesh.indices.size() / 3);
+    size_t vertexCount = mesh.vertices.size();
+    meshlets.meshlets.clear();
+    meshlets.indices.clear();
+    meshlets.indices.reserve(triangleCount * 3);
+    maxVertices = std::max(maxVertices, 3u);
+    maxTriangles = std::max(maxTriangles, 1u);
+
+// Vertex to triangle adjacency and triangle centroids
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for(uint32_t i = 0; i < triangleCount * 3; ++i)
+        ++offsets[mesh.indices[i] + 1];
+    for(size_t v = 0; v < vertexCount; ++v)
+        offsets[v + 1] += offsets[v];
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for(uint32_t i = 0; i < triangleCount * 3; ++i)
+        adjacency[fill[mesh.indices[i]]++] = i / 3;
+
+    std::vector<glm::vec3> centroids(triangleCount);
+    for(uint32_t t = 0; t < triangleCount; ++t)
+        centroids[t] = (mesh.vertices[mesh.indices[t * 3]].position + mesh.vertices[mesh.indices[t * 3 + 1]].position
+                        + mesh.vertices[mesh.indices[t * 3 + 2]].position) / 3.0f;
+
+    std::vector<uint32_t> live(vertexCount);
+    for(size_t v = 0; v < vertexCount; ++v)
+        live[v] = offsets[v + 1] - offsets[v];
+
+    std::vector<char> used(triangleCount, 0);
+    std::vector<uint32_t> vertexMeshlet(vertexCount, NoMeshlet);
+    std::vector<uint32_t> candidateMeshlet(triangleCount, NoMeshlet);
+    std::vector<uint32_t> candidates;
+
+    for(uint32_t seed = 0; seed < triangleCount; ++seed)
+    {
+        if(used[seed])
+            continue;
+
+        uint32_t id = (uint32_t)meshlets.meshlets.size();
+        Meshlet meshlet = Meshlet();
+        meshlet.firstIndex = (uint32_t)meshlets.indices.size();
+        glm::vec3 centroidSum(0.0f);
+        candidates.clear();
+
+        uint32_t next = seed;
+        while(next != NoTriangle)
+        {
+            used[next] = 1;
+            for(int c = 0; c < 3; ++c)
+            {
+                uint32_t v = mesh.indices[next * 3 + c];
+                meshlets.indices.push_back(v);
+                --live[v];
+                if(vertexMeshlet[v] != id)
+                {
+                    vertexMeshlet[v] = id;
+                    ++meshlet.vertexCount;
+                }
+                for(uint32_t k = offsets[v]; k < offsets[v + 1]; ++k)
+                {
+                    uint32_t t = adjacency[k];
+                    if(!used[t] && candidateMeshlet[t] != id)
+                    {
+                        candidateMeshlet[t] = id;
+                        candidates.push_back(t);
+                    }
+                }
+            }
+            meshlet.indexCount += 3;
+            centroidSum += centroids[next];
+            if(meshlet.indexCount / 3 >= maxTriangles)
+                break;
+
+        // Pick the best neighbour that still fits
+            glm::vec3 centroid = centroidSum / (float)(meshlet.indexCount / 3);
+            next = NoTriangle;
+            int bestNew = 4;
+            uint32_t bestLive = ~0u;
+            float bestDistance = FLT_MAX;
+            for(size_t i = 0; i < candidates.size();)
+            {
+                uint32_t t = candidates[i];
+                if(used[t])
+                {
+                    candidates[i] = candidates.back();
+                    candidates.pop_back();
+                    continue;
+                }
+                ++i;
+
+                int added = 0;
+                uint32_t remaining = 0;
+                for(int c = 0; c < 3; ++c)
+                {
+                    uint32_t v = mesh.indices[t * 3 + c];
+                    added += vertexMeshlet[v] != id;
+                    remaining += live[v];
+                }
+                if(meshlet.vertexCount + added > maxVertices)
+                    continue;
+                float distance = glm::dot(centroids[t] - centroid, centroids[t] - centroid);
+                if(added < bestNew || (added == bestNew && (remaining < bestLive
+                   || (remaining == bestLive && distance < bestDistance))))
+                {
+                    bestNew = added;
+                    bestLive = remaining;
+                    bestDistance = distance;
+                    next = t;
+                }
+            }
+        }
+
+        computeMeshletBounds(mesh, meshlets.indices, meshlet);
+        meshlets.meshlets.push_back(meshlet);
+    }
+}
+
+/**************************************************************
+ * cullMeshlets()
+ * -------------
+ * Tests every meshlet against the frustum, its normal cone
+ * against the camera position and its projected sphere
+ * against the pixel grid, and writes the index ranges of the
+ * survivors, merging ranges that touch.
+ *************************************************************/
+void cullMeshlets(const MeshletMesh& meshlets, const MeshletCullSettings& settings,
+                  std::vector<IndexRange>& ranges, MeshletCullStats* stats)
+{
+    ranges.clear();
+    MeshletCullStats counts = MeshletCullStats();
+    counts.meshlets = meshlets.meshlets.size();
+
+    glm::mat4 modelView = settings.view * settings.model;
+    Frustum frustum = makeFrustum(settings.projection * modelView);
+    glm::vec3 camera = glm::vec3(glm::inverse(modelView)[3]);
+
+// Perspective only: near distance from the projection matrix
+    bool perspective = settings.projection[2][3] != 0.0f;
+    float zNear = perspective ? settings.projection[3][2] / (settings.projection[2][2] - 1.0f) : 0.0f;
+    float p00 = settings.projection[0][0], p11 = settings.projection[1][1];
+    glm::vec3 scale(glm::length(glm::vec3(modelView[0])), glm::length(glm::vec3(modelView[1])),
+                    glm::length(glm::vec3(modelView[2])));
+    float viewScale = std::max(scale.x, std::max(scale.y, scale.z));
+
+    for(size_t i = 0; i < meshlets.meshlets.size(); ++i)
+    {
+        const Meshlet& meshlet = meshlets.meshlets[i];
+        counts.trianglesTotal += meshlet.indexCount / 3;
+
+    // Frustum and cone in object space, where the bounds live
+        if(settings.frustum && !frustumIntersectsSphere(frustum, meshlet.center, meshlet.radius))
+        {
+            ++counts.frustumCulled;
+            continue;
+        }
+
+        if(settings.backface)
+        {
+            glm::vec3 toCenter = meshlet.center - camera;
+            if(glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius)
+            {
+                ++counts.backfaceCulled;
+                continue;
+            }
+        }
+
+        if(settings.smallPrimitives && perspective)
+        {
+            glm::vec3 center = glm::vec3(modelView * glm::vec4(meshlet.center, 1.0f));
+            glm::vec4 bounds;
+            if(projectSphere(center, meshlet.radius * viewScale, zNear, p00, p11, bounds))
+            {
+                glm::vec4 pixels = (bounds * 0.5f + 0.5f)
+                                 * glm::vec4(settings.viewportSize.x, settings.viewportSize.y,
+                                             settings.viewportSize.x, settings.viewportSize.y);
+                if(missesPixelCenters(pixels.x, pixels.z) || missesPixelCenters(pixels.y, pixels.w))
+                {
+                    ++counts.smallCulled;
+                    continue;
+                }
+            }
+        }
+
+        ++counts.visible;
+        counts.trianglesSubmitted += meshlet.indexCount / 3;
+        if(!ranges.empty() && ranges.back().firstIndex + ranges.back().count == meshlet.firstIndex)
+            ranges.back().count += meshlet.indexCount;
+        else
+        {
+            IndexRange range = { meshlet.firstIndex, meshlet.indexCount };
+            ranges.push_back(range);
+        }
+    }
+
+    counts.ranges = ranges.size();
+    if(stats)
+        *stats = counts;
+}
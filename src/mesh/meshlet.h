@@ -0,0 +1,73 @@
+#pragma once
+
+#include "mesh/mesh.h"
+
+/*************************************************************
+ * Meshlets
+ * --------
+ * Splits an indexed mesh into small clusters of at most
+ * maxVertices distinct vertices and maxTriangles triangles,
+ * grown greedily across shared vertices so each cluster is a
+ * compact patch. The mesh's index list is reordered so every
+ * meshlet is one contiguous index range, which lets visible
+ * meshlets be drawn with glMultiDrawElements (or merged into
+ * fewer ranges where neighbours are both visible).
+ *
+ * Each meshlet carries a bounding sphere and a normal cone;
+ * cullMeshlets() uses them to drop clusters outside the
+ * frustum, facing away from the camera, or too small to
+ * cover any pixel centre.
+ ************************************************************/
+struct Meshlet
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t vertexCount;
+    glm::vec3 center;
+    float radius;
+    glm::vec3 coneAxis;
+    float coneCutoff;           // sin of the cone's half angle widened by 90 degrees; 1 never culls
+};
+
+struct MeshletMesh
+{
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> indices;
+};
+
+struct IndexRange
+{
+    uint32_t firstIndex;
+    uint32_t count;
+};
+
+// model may rotate, translate and scale uniformly; the normal
+// cones do not survive non-uniform scale or shear. The small
+// primitive test assumes a perspective projection and one
+// sample per pixel.
+struct MeshletCullSettings
+{
+    glm::mat4 model;
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec2 viewportSize;
+    bool frustum;
+    bool backface;
+    bool smallPrimitives;
+};
+
+struct MeshletCullStats
+{
+    size_t meshlets;
+    size_t visible;
+    size_t frustumCulled;
+    size_t backfaceCulled;
+    size_t smallCulled;
+    size_t trianglesTotal;
+    size_t trianglesSubmitted;
+    size_t ranges;
+};
+
+void buildMeshlets(const Mesh& mesh, uint32_t maxVertices, uint32_t maxTriangles, MeshletMesh& meshlets);
+void cullMeshlets(const MeshletMesh& meshlets, const MeshletCullSettings& settings,
+                  std::vector<IndexRange>& ranges, MeshletCullStats* stats);
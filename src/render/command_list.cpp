@@ -0,0 +1,385 @@
+#include "render/command_list.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+// Packets start on 8-byte boundaries so their fields can be
+// read in place
+    const size_t PacketAlignment = 8;
+
+    struct PacketHeader
+    {
+        uint32_t type;
+        uint32_t size;              // including this header and padding
+    };
+
+    struct ProgramPacket
+    {
+        GLuint program;
+    };
+
+    struct VertexArrayPacket
+    {
+        GLuint vao;
+    };
+
+    struct TexturePacket
+    {
+        GLuint unit;
+        GLenum target;
+        GLuint texture;
+    };
+
+    struct UniformBufferPacket
+    {
+        GLuint index;
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    struct UniformDataPacket
+    {
+        GLuint index;
+        uint32_t size;              // followed by size bytes, from the next 8-byte boundary
+    };
+
+    struct DrawIndexedPacket
+    {
+        GLenum mode;
+        GLsizei indexCount;
+        GLenum indexType;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLsizei instanceCount;
+    };
+
+    inline size_t alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    inline size_t indexSize(GLenum type)
+    {
+        return type == GL_UNSIGNED_INT ? 4 : type == GL_UNSIGNED_SHORT ? 2 : 1;
+    }
+
+    const size_t HeaderSize = alignUp(sizeof(PacketHeader), PacketAlignment);
+    const size_t UniformDataHeaderSize = alignUp(sizeof(UniformDataPacket), PacketAlignment);
+
+// Smallest valid payload of each packet type, 0 for unknown types
+    size_t payloadSize(uint32_t type)
+    {
+        switch(type)
+        {
+        case CommandList::UseProgram:           return sizeof(ProgramPacket);
+        case CommandList::BindVertexArray:      return sizeof(VertexArrayPacket);
+        case CommandList::BindTexture:          return sizeof(TexturePacket);
+        case CommandList::BindUniformBuffer:    return sizeof(UniformBufferPacket);
+        case CommandList::UniformData:          return UniformDataHeaderSize;
+        case CommandList::DrawIndexed:          return sizeof(DrawIndexedPacket);
+        }
+        return 0;
+    }
+
+    GLuint remapped(const std::unordered_map<GLuint, GLuint>& names, GLuint name)
+    {
+        std::unordered_map<GLuint, GLuint>::const_iterator found = names.find(name);
+        return found != names.end() ? found->second : name;
+    }
+}
+
+CommandList::CommandList()
+    : m_used(0), m_packets(0), m_draws(0), m_uniformBytes(0), m_uniformBlocks(0)
+{
+}
+
+void CommandList::reset()
+{
+    m_used = 0;
+    m_packets = 0;
+    m_draws = 0;
+    m_uniformBytes = 0;
+    m_uniformBlocks = 0;
+}
+
+/**************************************************************
+ * CommandList::append()
+ * --------------------
+ * Adds a packet header and returns room for size bytes after
+ * it, padded to the packet alignment. The storage doubles
+ * when full and is otherwise only bumped.
+ *************************************************************/
+void* CommandList::append(PacketType type, size_t size)
+{
+    size_t total = HeaderSize + alignUp(size, PacketAlignment);
+    size_t start = m_used;
+    if(start + total > m_data.size())
+        m_data.resize(std::max(m_data.size() * 2, start + total));
+    m_used += total;
+
+    PacketHeader* header = (PacketHeader*)&m_data[start];
+    header->type = (uint32_t)type;
+    header->size = (uint32_t)total;
+    ++m_packets;
+    return &m_data[start + HeaderSize];
+}
+
+void CommandList::useProgram(GLuint program)
+{
+    ProgramPacket* packet = (ProgramPacket*)append(UseProgram, sizeof(ProgramPacket));
+    packet->program = program;
+}
+
+void CommandList::bindVertexArray(GLuint vao)
+{
+    VertexArrayPacket* packet = (VertexArrayPacket*)append(BindVertexArray, sizeof(VertexArrayPacket));
+    packet->vao = vao;
+}
+
+void CommandList::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+    TexturePacket* packet = (TexturePacket*)append(BindTexture, sizeof(TexturePacket));
+    packet->unit = unit;
+    packet->target = target;
+    packet->texture = texture;
+}
+
+void CommandList::bindUniformBuffer(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    UniformBufferPacket* packet = (UniformBufferPacket*)append(BindUniformBuffer, sizeof(UniformBufferPacket));
+    packet->index = index;
+    packet->buffer = buffer;
+    packet->offset = offset;
+    packet->size = size;
+}
+
+/**************************************************************
+ * CommandList::uniformData()
+ * -------------------------
+ * Records size bytes of uniform block data for binding point
+ * index and returns where to write them. At replay they are
+ * copied to the uniform ring and bound there for the draws
+ * that follow.
+ *************************************************************/
+void* CommandList::uniformData(GLuint index, size_t size)
+{
+    uint8_t* packet = (uint8_t*)append(UniformData, UniformDataHeaderSize + size);
+    UniformDataPacket* header = (UniformDataPacket*)packet;
+    header->index = index;
+    header->size = (uint32_t)size;
+    m_uniformBytes += size;
+    ++m_uniformBlocks;
+    return packet + UniformDataHeaderSize;
+}
+
+void CommandList::drawIndexed(GLenum mode, GLsizei indexCount, GLenum indexType, GLuint firstIndex,
+                              GLint baseVertex, GLsizei instanceCount)
+{
+    DrawIndexedPacket* packet = (DrawIndexedPacket*)append(DrawIndexed, sizeof(DrawIndexedPacket));
+    packet->mode = mode;
+    packet->indexCount = indexCount;
+    packet->indexType = indexType;
+    packet->firstIndex = firstIndex;
+    packet->baseVertex = baseVertex;
+    packet->instanceCount = instanceCount;
+    ++m_draws;
+}
+
+/**************************************************************
+ * executeCommandLists()
+ * --------------------
+ * Two walks over the packets: the first copies every uniform
+ * block into the ring (so the unsynchronized ring path maps
+ * and unmaps once), the second issues the binds and draws.
+ * The offsets found by the first walk are kept in an array
+ * taken from scratch.
+ *************************************************************/
+bool executeCommandLists(GLStateCache& cache, UniformRing& uniformRing, LinearArena& scratch,
+                         const CommandList* lists, size_t listCount, CommandListStats* stats)
+{
+    size_t blockCount = 0;
+    for(size_t l = 0; l < listCount; ++l)
+        blockCount += lists[l].uniformBlockCount();
+    GLintptr* offsets = scratch.allocateArray<GLintptr>(blockCount);
+    size_t uniformBlock = 0;
+
+    for(size_t l = 0; l < listCount; ++l)
+    {
+        const uint8_t* data = lists[l].data();
+        for(size_t at = 0; at < lists[l].byteSize(); at += ((const PacketHeader*)(data + at))->size)
+        {
+            if(((const PacketHeader*)(data + at))->type != CommandList::UniformData)
+                continue;
+            const UniformDataPacket* packet = (const UniformDataPacket*)(data + at + HeaderSize);
+            GLintptr offset = 0;
+            void* target = uniformRing.allocate(packet->size, offset);
+            if(!target)
+                return false;
+            std::memcpy(target, (const uint8_t*)packet + UniformDataHeaderSize, packet->size);
+            offsets[uniformBlock++] = offset;
+        }
+    }
+    uniformRing.flush();
+
+    GLStateCounters before = cache.counters();
+    uniformBlock = 0;
+    uint32_t packets = 0, draws = 0, uniformBytes = 0;
+    for(size_t l = 0; l < listCount; ++l)
+    {
+        const uint8_t* data = lists[l].data();
+        for(size_t at = 0; at < lists[l].byteSize(); at += ((const PacketHeader*)(data + at))->size, ++packets)
+        {
+            const void* packet = data + at + HeaderSize;
+            switch(((const PacketHeader*)(data + at))->type)
+            {
+            case CommandList::UseProgram:
+                cache.useProgram(((const ProgramPacket*)packet)->program);
+                break;
+            case CommandList::BindVertexArray:
+                cache.bindVertexArray(((const VertexArrayPacket*)packet)->vao);
+                break;
+            case CommandList::BindTexture:
+            {
+                const TexturePacket* texture = (const TexturePacket*)packet;
+                cache.bindTexture(texture->unit, texture->target, texture->texture);
+                break;
+            }
+            case CommandList::BindUniformBuffer:
+            {
+                const UniformBufferPacket* range = (const UniformBufferPacket*)packet;
+                cache.bindUniformBufferRange(range->index, range->buffer, range->offset, range->size);
+                break;
+            }
+            case CommandList::UniformData:
+            {
+                const UniformDataPacket* block = (const UniformDataPacket*)packet;
+                uniformRing.bind(cache, block->index, offsets[uniformBlock++], block->size);
+                uniformBytes += block->size;
+                break;
+            }
+            case CommandList::DrawIndexed:
+            {
+                const DrawIndexedPacket* draw = (const DrawIndexedPacket*)packet;
+                if(draw->instanceCount == 0)
+                    break;
+                const void* indices = (const void*)(draw->firstIndex * indexSize(draw->indexType));
+                if(draw->instanceCount > 1)
+                    glDrawElementsInstancedBaseVertex(draw->mode, draw->indexCount, draw->indexType, indices,
+                                                      draw->instanceCount, draw->baseVertex);
+                else
+                    glDrawElementsBaseVertex(draw->mode, draw->indexCount, draw->indexType, indices,
+                                             draw->baseVertex);
+                ++draws;
+                break;
+            }
+            }
+        }
+    }
+
+    if(stats)
+    {
+        const GLStateCounters& after = cache.counters();
+        stats->packets = packets;
+        stats->draws = draws;
+        stats->uniformBytes = uniformBytes;
+        stats->bindsIssued = after.totalIssued() - before.totalIssued();
+        stats->bindsAvoided = after.totalSkipped() - before.totalSkipped();
+    }
+    return true;
+}
+
+void collectCommandListNames(const CommandList& list, CommandListNames& names)
+{
+    const uint8_t* data = list.data();
+    for(size_t at = 0; at < list.byteSize(); at += ((const PacketHeader*)(data + at))->size)
+    {
+        const void* packet = data + at + HeaderSize;
+        switch(((const PacketHeader*)(data + at))->type)
+        {
+        case CommandList::UseProgram:
+            names.programs[((const ProgramPacket*)packet)->program] = ((const ProgramPacket*)packet)->program;
+            break;
+        case CommandList::BindVertexArray:
+            names.vertexArrays[((const VertexArrayPacket*)packet)->vao] = ((const VertexArrayPacket*)packet)->vao;
+            break;
+        case CommandList::BindTexture:
+        {
+            const TexturePacket* texture = (const TexturePacket*)packet;
+            names.textures[texture->texture] = texture->texture;
+            names.textureTargets[texture->texture] = texture->target;
+            break;
+        }
+        case CommandList::BindUniformBuffer:
+            names.buffers[((const UniformBufferPacket*)packet)->buffer] = ((const UniformBufferPacket*)packet)->buffer;
+            break;
+        }
+    }
+}
+
+/**************************************************************
+ * remapCommandPackets()
+ * --------------------
+ * Records the packets of another list, such as one read back
+ * from a capture, into target with GL names translated.
+ * Packets of an unknown type, or too short for their payload,
+ * end the walk.
+ *************************************************************/
+void remapCommandPackets(const uint8_t* packets, size_t size, const CommandListNames& names, CommandList& target)
+{
+    for(size_t at = 0; at + HeaderSize <= size;)
+    {
+        const PacketHeader* header = (const PacketHeader*)(packets + at);
+        if(header->size < HeaderSize || header->size > size - at || header->size % PacketAlignment)
+            return;
+        size_t space = header->size - HeaderSize;
+        size_t payload = payloadSize(header->type);
+        if(payload == 0 || space < payload)
+            return;
+        const void* packet = packets + at + HeaderSize;
+        at += header->size;
+
+        switch(header->type)
+        {
+        case CommandList::UseProgram:
+            target.useProgram(remapped(names.programs, ((const ProgramPacket*)packet)->program));
+            break;
+        case CommandList::BindVertexArray:
+            target.bindVertexArray(remapped(names.vertexArrays, ((const VertexArrayPacket*)packet)->vao));
+            break;
+        case CommandList::BindTexture:
+        {
+            const TexturePacket* texture = (const TexturePacket*)packet;
+            target.bindTexture(texture->unit, texture->target, remapped(names.textures, texture->texture));
+            break;
+        }
+        case CommandList::BindUniformBuffer:
+        {
+            const UniformBufferPacket* range = (const UniformBufferPacket*)packet;
+            target.bindUniformBuffer(range->index, remapped(names.buffers, range->buffer), range->offset,
+                                     range->size);
+            break;
+        }
+        case CommandList::UniformData:
+        {
+            const UniformDataPacket* block = (const UniformDataPacket*)packet;
+            if(block->size > space - UniformDataHeaderSize)
+                return;
+            std::memcpy(target.uniformData(block->index, block->size),
+                        (const uint8_t*)packet + UniformDataHeaderSize, block->size);
+            break;
+        }
+        case CommandList::DrawIndexed:
+        {
+            const DrawIndexedPacket* draw = (const DrawIndexedPacket*)packet;
+            target.drawIndexed(draw->mode, draw->indexCount, draw->indexType, draw->firstIndex, draw->baseVertex,
+                               draw->instanceCount);
+            break;
+        }
+        default:
+            return;
+        }
+    }
+}
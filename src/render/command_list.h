@@ -0,0 +1,128 @@
+#pragma once
+
+#include "core/frame_arena.h"
+#include "render/gl.h"
+#include "render/gl_state_cache.h"
+#include "render/uniform_ring.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/*************************************************************
+ * CommandList
+ * -----------
+ * Draws, binds and uniform block data recorded as packed
+ * packets in one growing byte array, without touching GL, so
+ * any thread can fill its own list. Only replay issues GL
+ * calls, on the thread that owns the context:
+ *
+ *     // workers, one list each
+ *     list.reset();
+ *     list.useProgram(program);
+ *     memcpy(list.uniformData(ObjectBinding, size), &data, size);
+ *     list.drawIndexed(GL_TRIANGLES, count, GL_UNSIGNED_INT, 0, 0, 1);
+ *
+ *     // render thread, in order
+ *     executeCommandLists(cache, ring, frameArena.local(), lists, listCount);
+ *
+ * Handles and enums are GL's, but as plain values: recording
+ * needs no context. reset() keeps the memory, so a list
+ * reused every frame stops allocating once it has grown to
+ * its working size. Pointers returned by uniformData() are
+ * only valid until the next call on the list.
+ ************************************************************/
+class CommandList
+{
+public:
+    enum PacketType
+    {
+        UseProgram,
+        BindVertexArray,
+        BindTexture,
+        BindUniformBuffer,
+        UniformData,
+        DrawIndexed
+    };
+
+    CommandList();
+
+    void reset();
+    void reserve(size_t bytes) { m_data.resize(std::max(m_data.size(), bytes)); }
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vao);
+    void bindTexture(GLuint unit, GLenum target, GLuint texture);
+    void bindUniformBuffer(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    void* uniformData(GLuint index, size_t size);
+    void drawIndexed(GLenum mode, GLsizei indexCount, GLenum indexType, GLuint firstIndex, GLint baseVertex,
+                     GLsizei instanceCount);
+
+    bool empty() const { return m_used == 0; }
+    size_t byteSize() const { return m_used; }
+    size_t packetCount() const { return m_packets; }
+    size_t drawCount() const { return m_draws; }
+    size_t uniformBytes() const { return m_uniformBytes; }
+    size_t uniformBlockCount() const { return m_uniformBlocks; }
+    const uint8_t* data() const { return m_data.empty() ? 0 : &m_data[0]; }
+
+private:
+    void* append(PacketType type, size_t size);
+
+    std::vector<uint8_t> m_data;
+    size_t m_used;
+    size_t m_packets;
+    size_t m_draws;
+    size_t m_uniformBytes;
+    size_t m_uniformBlocks;
+};
+
+/*************************************************************
+ * Command List Replay
+ * -------------------
+ * Executes lists one after the other through a GLStateCache,
+ * so binds repeated within or across lists are dropped.
+ * Uniform data is first copied into the ring, a
+ * GL_UNIFORM_BUFFER UniformRing, and flushed once before any
+ * draw; its packets then bind that range. Draws recorded
+ * with no instances are skipped. Returns false, without
+ * drawing anything, when the ring segment cannot hold the
+ * frame's uniform data. The ring offsets are kept in an array
+ * from scratch, usually the render thread's
+ * FrameArena::local(), until it is reset.
+ ************************************************************/
+struct CommandListStats
+{
+    uint32_t packets;
+    uint32_t draws;
+    uint32_t uniformBytes;
+    uint32_t bindsIssued;
+    uint32_t bindsAvoided;
+};
+
+bool executeCommandLists(GLStateCache& cache, UniformRing& uniformRing, LinearArena& scratch,
+                         const CommandList* lists, size_t listCount, CommandListStats* stats = 0);
+
+/*************************************************************
+ * Command List Names
+ * ------------------
+ * The GL objects recorded packets refer to, for frame capture
+ * and replay. collectCommandListNames() adds every program,
+ * VAO, texture (with its target) and uniform buffer a list
+ * uses, each mapped to itself. remapCommandPackets() records
+ * packets into target with the names replaced through the
+ * maps, so a captured stream can run against objects created
+ * anew; names missing from a map are kept.
+ ************************************************************/
+struct CommandListNames
+{
+    std::unordered_map<GLuint, GLuint> programs;
+    std::unordered_map<GLuint, GLuint> vertexArrays;
+    std::unordered_map<GLuint, GLuint> textures;
+    std::unordered_map<GLuint, GLenum> textureTargets;
+    std::unordered_map<GLuint, GLuint> buffers;
+};
+
+void collectCommandListNames(const CommandList& list, CommandListNames& names);
+void remapCommandPackets(const uint8_t* packets, size_t size, const CommandListNames& names, CommandList& target);
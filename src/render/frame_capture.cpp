@@ -0,0 +1,801 @@
+#include "render/frame_capture.h"
+#include "mesh/mesh_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+// Formats textures are read back in and uploaded from, chosen
+// so the round trip is exact
+    struct TextureFormat
+    {
+        GLenum internalFormat;
+        GLenum format;
+        GLenum type;
+        uint32_t pixelSize;
+    };
+
+    const TextureFormat TextureFormats[] =
+    {
+        { GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4 },
+        { GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE, 4 },
+        { GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE, 3 },
+        { GL_SRGB8, GL_RGB, GL_UNSIGNED_BYTE, 3 },
+        { GL_RG8, GL_RG, GL_UNSIGNED_BYTE, 2 },
+        { GL_R8, GL_RED, GL_UNSIGNED_BYTE, 1 },
+        { GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, 8 },
+        { GL_RGB16F, GL_RGB, GL_HALF_FLOAT, 6 },
+        { GL_RG16F, GL_RG, GL_HALF_FLOAT, 4 },
+        { GL_R16F, GL_RED, GL_HALF_FLOAT, 2 },
+        { GL_RGBA32F, GL_RGBA, GL_FLOAT, 16 },
+        { GL_RGB32F, GL_RGB, GL_FLOAT, 12 },
+        { GL_R32F, GL_RED, GL_FLOAT, 4 },
+        { GL_R11F_G11F_B10F, GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV, 4 },
+        { GL_RGB9_E5, GL_RGB, GL_UNSIGNED_INT_5_9_9_9_REV, 4 },
+        { GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, 4 },
+        { GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT, 4 }
+    };
+
+    const TextureFormat* findTextureFormat(GLenum internalFormat)
+    {
+        for(size_t i = 0; i < sizeof(TextureFormats) / sizeof(TextureFormats[0]); ++i)
+            if(TextureFormats[i].internalFormat == internalFormat)
+                return &TextureFormats[i];
+        return NULL;
+    }
+
+    class CaptureWriter
+    {
+    public:
+        void u32(uint32_t value)
+        {
+            bytes((const uint8_t*)&value, sizeof(value));
+        }
+
+        void f32(float value)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            u32(bits);
+        }
+
+    // Length, then the bytes padded to 4
+        void blob(const void* data, size_t size)
+        {
+            u32((uint32_t)size);
+            bytes((const uint8_t*)data, size);
+            static const uint8_t Padding[4] = { 0 };
+            bytes(Padding, (4 - size % 4) % 4);
+        }
+
+        void bytes(const uint8_t* data, size_t size)
+        {
+            if(size)
+                m_data.insert(m_data.end(), data, data + size);
+        }
+
+        std::vector<uint8_t>& data() { return m_data; }
+
+    private:
+        std::vector<uint8_t> m_data;
+    };
+
+    class CaptureReader
+    {
+    public:
+        CaptureReader(const uint8_t* data, size_t size) : m_data(data), m_size(size), m_at(0), m_ok(true) {}
+
+        uint32_t u32()
+        {
+            uint32_t value = 0;
+            if(!check(sizeof(value)))
+                return 0;
+            std::memcpy(&value, m_data + m_at, sizeof(value));
+            m_at += sizeof(value);
+            return value;
+        }
+
+        float f32()
+        {
+            uint32_t bits = u32();
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        const uint8_t* blob(size_t& size)
+        {
+            size = u32();
+            size_t padded = size + (4 - size % 4) % 4;
+            if(!check(padded))
+                return NULL;
+            const uint8_t* data = m_data + m_at;
+            m_at += padded;
+            return data;
+        }
+
+        void blob(std::vector<uint8_t>& out)
+        {
+            size_t size = 0;
+            const uint8_t* data = blob(size);
+            out.assign(data, data ? data + size : data);
+        }
+
+        void text(std::string& out)
+        {
+            size_t size = 0;
+            const uint8_t* data = blob(size);
+            out.assign(data ? (const char*)data : "", data ? size : 0);
+        }
+
+    // Element counts are checked against the bytes left, so a
+    // corrupt count cannot cause a huge allocation
+        uint32_t count(size_t minimumElementSize)
+        {
+            uint32_t value = u32();
+            if(value > (m_size - m_at) / minimumElementSize)
+                m_ok = false;
+            return m_ok ? value : 0;
+        }
+
+        bool ok() const { return m_ok; }
+        bool finished() const { return m_at == m_size; }
+
+    private:
+        bool check(size_t size)
+        {
+            if(!m_ok || size > m_size - m_at)
+                m_ok = false;
+            return m_ok;
+        }
+
+        const uint8_t* m_data;
+        size_t m_size;
+        size_t m_at;
+        bool m_ok;
+    };
+
+    GLuint compileShader(GLenum stage, const std::string& source, std::string& log)
+    {
+        const GLchar* text = source.c_str();
+        GLuint shader = glCreateShader(stage);
+        glShaderSource(shader, 1, &text, NULL);
+        glCompileShader(shader);
+
+        GLint compiled = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+        if(compiled != GL_TRUE)
+        {
+            GLint length = 0;
+            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+            std::string message((size_t)std::max(length, 1), '\0');
+            glGetShaderInfoLog(shader, length, NULL, &message[0]);
+            log += message.c_str();
+        }
+        return shader;
+    }
+
+    GLuint buildProgram(const CapturedProgram& captured, std::string& log)
+    {
+        GLuint vertex = compileShader(GL_VERTEX_SHADER, captured.vertexSource, log);
+        GLuint fragment = compileShader(GL_FRAGMENT_SHADER, captured.fragmentSource, log);
+        GLuint program = glCreateProgram();
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        glLinkProgram(program);
+        glDetachShader(program, vertex);
+        glDetachShader(program, fragment);
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if(linked == GL_TRUE)
+            return program;
+        GLint length = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        std::string message((size_t)std::max(length, 1), '\0');
+        glGetProgramInfoLog(program, length, NULL, &message[0]);
+        log += message.c_str();
+        glDeleteProgram(program);
+        return 0;
+    }
+}
+
+/**************************************************************
+ * writeFrameCapture()
+ * ------------------
+ * Serialises the capture in record order: header, buffers,
+ * textures, vertex arrays, programs, command lists, checksum.
+ *************************************************************/
+bool writeFrameCapture(const std::string& path, const FrameCaptureData& data)
+{
+    CaptureWriter writer;
+    writer.u32(FrameCaptureMagic);
+    writer.u32(FrameCaptureVersion);
+    writer.u32(data.width);
+    writer.u32(data.height);
+    for(int i = 0; i < 4; ++i)
+        writer.f32(data.clearColor[i]);
+    const CapturedState& state = data.state;
+    GLint stateValues[] = { state.depthTest, state.depthFunc, state.depthMask, state.cullFace, state.cullMode,
+                            state.frontFace, state.blend, state.blendFunc[0], state.blendFunc[1],
+                            state.blendFunc[2], state.blendFunc[3] };
+    for(size_t i = 0; i < sizeof(stateValues) / sizeof(stateValues[0]); ++i)
+        writer.u32((uint32_t)stateValues[i]);
+
+    writer.u32((uint32_t)data.buffers.size());
+    for(size_t i = 0; i < data.buffers.size(); ++i)
+    {
+        const CapturedBuffer& buffer = data.buffers[i];
+        writer.u32(buffer.name);
+        writer.blob(buffer.data.empty() ? NULL : &buffer.data[0], buffer.data.size());
+    }
+
+    writer.u32((uint32_t)data.textures.size());
+    for(size_t i = 0; i < data.textures.size(); ++i)
+    {
+        const CapturedTexture& texture = data.textures[i];
+        GLint values[] = { (GLint)texture.name, (GLint)texture.internalFormat, (GLint)texture.format,
+                           (GLint)texture.type, texture.minFilter, texture.magFilter, texture.wrapS, texture.wrapT };
+        for(size_t v = 0; v < sizeof(values) / sizeof(values[0]); ++v)
+            writer.u32((uint32_t)values[v]);
+        writer.u32((uint32_t)texture.levels.size());
+        for(size_t l = 0; l < texture.levels.size(); ++l)
+        {
+            const CapturedTextureLevel& level = texture.levels[l];
+            writer.u32(level.width);
+            writer.u32(level.height);
+            writer.blob(level.data.empty() ? NULL : &level.data[0], level.data.size());
+        }
+    }
+
+    writer.u32((uint32_t)data.vertexArrays.size());
+    for(size_t i = 0; i < data.vertexArrays.size(); ++i)
+    {
+        const CapturedVertexArray& vao = data.vertexArrays[i];
+        writer.u32(vao.name);
+        writer.u32(vao.elementBuffer);
+        writer.u32((uint32_t)vao.attributes.size());
+        for(size_t a = 0; a < vao.attributes.size(); ++a)
+        {
+            const CapturedAttribute& attribute = vao.attributes[a];
+            GLint values[] = { (GLint)attribute.location, (GLint)attribute.buffer, attribute.components,
+                               (GLint)attribute.type, attribute.normalized, attribute.integer, attribute.stride,
+                               (GLint)attribute.offset, (GLint)attribute.divisor };
+            for(size_t v = 0; v < sizeof(values) / sizeof(values[0]); ++v)
+                writer.u32((uint32_t)values[v]);
+        }
+    }
+
+    writer.u32((uint32_t)data.programs.size());
+    for(size_t i = 0; i < data.programs.size(); ++i)
+    {
+        const CapturedProgram& program = data.programs[i];
+        writer.u32(program.name);
+        writer.blob(program.vertexSource.data(), program.vertexSource.size());
+        writer.blob(program.fragmentSource.data(), program.fragmentSource.size());
+    }
+
+    writer.u32((uint32_t)data.commandLists.size());
+    for(size_t i = 0; i < data.commandLists.size(); ++i)
+    {
+        const std::vector<uint8_t>& list = data.commandLists[i];
+        writer.blob(list.empty() ? NULL : &list[0], list.size());
+    }
+
+    uint64_t checksum = meshCacheChecksum(&writer.data()[0], writer.data().size());
+    writer.u32((uint32_t)checksum);
+    writer.u32((uint32_t)(checksum >> 32));
+
+    std::ofstream file(path.c_str(), std::ios::binary);
+    if(!file)
+        return false;
+    file.write((const char*)&writer.data()[0], writer.data().size());
+    return (bool)file;
+}
+
+/**************************************************************
+ * readFrameCapture()
+ * -----------------
+ * Reads a whole capture, checking the magic, version and
+ * checksum before parsing and every size while parsing.
+ *************************************************************/
+bool readFrameCapture(const std::string& path, FrameCaptureData& data)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if(!file)
+        return false;
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    std::string bytes = contents.str();
+    if(bytes.size() < 16 || bytes.size() % 4 != 0)
+        return false;
+
+    const uint8_t* base = (const uint8_t*)bytes.data();
+    size_t payload = bytes.size() - 8;
+    uint32_t stored[2];
+    std::memcpy(stored, base + payload, sizeof(stored));
+    uint64_t checksum = meshCacheChecksum(base, payload);
+    if(stored[0] != (uint32_t)checksum || stored[1] != (uint32_t)(checksum >> 32))
+        return false;
+
+    CaptureReader reader(base, payload);
+    if(reader.u32() != FrameCaptureMagic || reader.u32() != FrameCaptureVersion)
+        return false;
+    data.width = reader.u32();
+    data.height = reader.u32();
+    for(int i = 0; i < 4; ++i)
+        data.clearColor[i] = reader.f32();
+    CapturedState& state = data.state;
+    GLint* stateValues[] = { &state.depthTest, &state.depthFunc, &state.depthMask, &state.cullFace,
+                             &state.cullMode, &state.frontFace, &state.blend, &state.blendFunc[0],
+                             &state.blendFunc[1], &state.blendFunc[2], &state.blendFunc[3] };
+    for(size_t i = 0; i < sizeof(stateValues) / sizeof(stateValues[0]); ++i)
+        *stateValues[i] = (GLint)reader.u32();
+
+    data.buffers.resize(reader.count(8));
+    for(size_t i = 0; i < data.buffers.size(); ++i)
+    {
+        data.buffers[i].name = reader.u32();
+        reader.blob(data.buffers[i].data);
+    }
+
+    data.textures.resize(reader.count(36));
+    for(size_t i = 0; i < data.textures.size(); ++i)
+    {
+        CapturedTexture& texture = data.textures[i];
+        texture.name = reader.u32();
+        texture.internalFormat = reader.u32();
+        texture.format = reader.u32();
+        texture.type = reader.u32();
+        texture.minFilter = (GLint)reader.u32();
+        texture.magFilter = (GLint)reader.u32();
+        texture.wrapS = (GLint)reader.u32();
+        texture.wrapT = (GLint)reader.u32();
+        texture.levels.resize(reader.count(12));
+        for(size_t l = 0; l < texture.levels.size(); ++l)
+        {
+            texture.levels[l].width = reader.u32();
+            texture.levels[l].height = reader.u32();
+            reader.blob(texture.levels[l].data);
+        }
+    }
+
+    data.vertexArrays.resize(reader.count(12));
+    for(size_t i = 0; i < data.vertexArrays.size(); ++i)
+    {
+        CapturedVertexArray& vao = data.vertexArrays[i];
+        vao.name = reader.u32();
+        vao.elementBuffer = reader.u32();
+        vao.attributes.resize(reader.count(36));
+        for(size_t a = 0; a < vao.attributes.size(); ++a)
+        {
+            CapturedAttribute& attribute = vao.attributes[a];
+            attribute.location = reader.u32();
+            attribute.buffer = reader.u32();
+            attribute.components = (GLint)reader.u32();
+            attribute.type = reader.u32();
+            attribute.normalized = (GLint)reader.u32();
+            attribute.integer = (GLint)reader.u32();
+            attribute.stride = (GLint)reader.u32();
+            attribute.offset = reader.u32();
+            attribute.divisor = reader.u32();
+        }
+    }
+
+    data.programs.resize(reader.count(12));
+    for(size_t i = 0; i < data.programs.size(); ++i)
+    {
+        data.programs[i].name = reader.u32();
+        reader.text(data.programs[i].vertexSource);
+        reader.text(data.programs[i].fragmentSource);
+    }
+
+    data.commandLists.resize(reader.count(4));
+    for(size_t i = 0; i < data.commandLists.size(); ++i)
+        reader.blob(data.commandLists[i]);
+
+    return reader.ok() && reader.finished();
+}
+
+void FrameCapture::begin(uint32_t width, uint32_t height, const float clearColor[4])
+{
+    m_data = FrameCaptureData();
+    m_data.width = width;
+    m_data.height = height;
+    for(int i = 0; i < 4; ++i)
+        m_data.clearColor[i] = clearColor[i];
+    m_error.clear();
+}
+
+void FrameCapture::addProgram(GLuint program, const std::string& vertexSource, const std::string& fragmentSource)
+{
+    for(size_t i = 0; i < m_data.programs.size(); ++i)
+        if(m_data.programs[i].name == program)
+            m_data.programs.erase(m_data.programs.begin() + i);
+    CapturedProgram captured;
+    captured.name = program;
+    captured.vertexSource = vertexSource;
+    captured.fragmentSource = fragmentSource;
+    m_data.programs.push_back(captured);
+}
+
+/**************************************************************
+ * FrameCapture::capture()
+ * ----------------------
+ * Copies the lists and reads back every object they use,
+ * vertex arrays first since they add buffers of their own.
+ * Call it just before the lists are executed, so the fixed
+ * function state read back is the state they draw with.
+ *************************************************************/
+bool FrameCapture::capture(GLStateCache& cache, const CommandList* lists, size_t listCount)
+{
+    CommandListNames names;
+    m_data.commandLists.resize(listCount);
+    for(size_t i = 0; i < listCount; ++i)
+    {
+        collectCommandListNames(lists[i], names);
+        m_data.commandLists[i].assign(lists[i].data(), lists[i].data() + lists[i].byteSize());
+    }
+
+    for(std::unordered_map<GLuint, GLuint>::const_iterator it = names.programs.begin(); it != names.programs.end();
+        ++it)
+    {
+        bool registered = it->first == 0;
+        for(size_t i = 0; i < m_data.programs.size() && !registered; ++i)
+            registered = m_data.programs[i].name == it->first;
+        if(!registered)
+        {
+            std::ostringstream message;
+            message << "program " << it->first << " was drawn with but not added";
+            m_error = message.str();
+            return false;
+        }
+    }
+
+    for(std::unordered_map<GLuint, GLuint>::const_iterator it = names.vertexArrays.begin();
+        it != names.vertexArrays.end(); ++it)
+    {
+        if(it->first && !captureVertexArray(cache, it->first, names))
+            return false;
+    }
+    for(std::unordered_map<GLuint, GLuint>::const_iterator it = names.buffers.begin(); it != names.buffers.end();
+        ++it)
+    {
+        if(it->first && !captureBuffer(it->first))
+            return false;
+    }
+    for(std::unordered_map<GLuint, GLenum>::const_iterator it = names.textureTargets.begin();
+        it != names.textureTargets.end(); ++it)
+    {
+        if(it->first && !captureTexture(cache, it->first, it->second))
+            return false;
+    }
+    captureState();
+    return true;
+}
+
+// Reads through GL_COPY_READ_BUFFER, which the cache leaves alone
+bool FrameCapture::captureBuffer(GLuint buffer)
+{
+    CapturedBuffer captured;
+    captured.name = buffer;
+    GLint size = 0;
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+    captured.data.resize((size_t)std::max(size, 0));
+    if(size > 0)
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, size, &captured.data[0]);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    m_data.buffers.push_back(captured);
+    return true;
+}
+
+/**************************************************************
+ * FrameCapture::captureTexture()
+ * -----------------------------
+ * Reads back every defined mip level of a 2D texture in a
+ * format that uploads to the same bits.
+ *************************************************************/
+bool FrameCapture::captureTexture(GLStateCache& cache, GLuint texture, GLenum target)
+{
+    std::ostringstream message;
+    if(target != GL_TEXTURE_2D)
+    {
+        message << "texture " << texture << " is not a 2D texture";
+        m_error = message.str();
+        return false;
+    }
+
+    cache.bindTexture(0, target, texture);
+    GLint internalFormat = 0;
+    glGetTexLevelParameteriv(target, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+    const TextureFormat* format = findTextureFormat((GLenum)internalFormat);
+    if(!format)
+    {
+        message << "texture " << texture << " has unsupported format 0x" << std::hex << internalFormat;
+        m_error = message.str();
+        return false;
+    }
+
+    CapturedTexture captured;
+    captured.name = texture;
+    captured.internalFormat = format->internalFormat;
+    captured.format = format->format;
+    captured.type = format->type;
+    glGetTexParameteriv(target, GL_TEXTURE_MIN_FILTER, &captured.minFilter);
+    glGetTexParameteriv(target, GL_TEXTURE_MAG_FILTER, &captured.magFilter);
+    glGetTexParameteriv(target, GL_TEXTURE_WRAP_S, &captured.wrapS);
+    glGetTexParameteriv(target, GL_TEXTURE_WRAP_T, &captured.wrapT);
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for(GLint level = 0; level < 16; ++level)
+    {
+        GLint width = 0, height = 0;
+        glGetTexLevelParameteriv(target, level, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(target, level, GL_TEXTURE_HEIGHT, &height);
+        if(width <= 0 || height <= 0)
+            break;
+        CapturedTextureLevel captureLevel;
+        captureLevel.width = (uint32_t)width;
+        captureLevel.height = (uint32_t)height;
+        captureLevel.data.resize((size_t)width * height * format->pixelSize);
+        glGetTexImage(target, level, format->format, format->type, &captureLevel.data[0]);
+        captured.levels.push_back(captureLevel);
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    m_data.textures.push_back(captured);
+    return true;
+}
+
+/**************************************************************
+ * FrameCapture::captureVertexArray()
+ * ---------------------------------
+ * Reads the element buffer and every enabled attribute of a
+ * VAO, adding the buffers they source to names.
+ *************************************************************/
+bool FrameCapture::captureVertexArray(GLStateCache& cache, GLuint vao, CommandListNames& names)
+{
+    CapturedVertexArray captured;
+    captured.name = vao;
+    cache.bindVertexArray(vao);
+
+    GLint elementBuffer = 0, attributeCount = 0;
+    glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &elementBuffer);
+    glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &attributeCount);
+    captured.elementBuffer = (GLuint)elementBuffer;
+    if(elementBuffer)
+        names.buffers[(GLuint)elementBuffer] = (GLuint)elementBuffer;
+
+    for(GLint location = 0; location < attributeCount; ++location)
+    {
+        GLint enabled = 0;
+        glGetVertexAttribiv(location, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &enabled);
+        if(!enabled)
+            continue;
+
+        CapturedAttribute attribute;
+        GLint buffer = 0, type = 0, divisor = 0;
+        void* pointer = NULL;
+        attribute.location = (GLuint)location;
+        glGetVertexAttribiv(location, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &buffer);
+        glGetVertexAttribiv(location, GL_VERTEX_ATTRIB_ARRAY_SIZE, &attribute.components);
+        glGetVertexAttribiv(location, GL_VERTEX_ATTRIB_ARRAY_TYPE, &type);
+        glGetVertexAttribiv(location, GL_VERTEX_ATTRIB_ARRAY_NORMALIZED, &attribute.normalized);
+        glGetVertexAttribiv(location, GL_VERTEX_ATTRIB_ARRAY_INTEGER, &attribute.integer);
+        glGetVertexAttribiv(location, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &attribute.stride);
+        glGetVertexAttribiv(location, GL_VERTEX_ATTRIB_ARRAY_DIVISOR, &divisor);
+        glGetVertexAttribPointerv(location, GL_VERTEX_ATTRIB_ARRAY_POINTER, &pointer);
+        attribute.buffer = (GLuint)buffer;
+        attribute.type = (GLenum)type;
+        attribute.divisor = (GLuint)divisor;
+        attribute.offset = (GLuint)(uintptr_t)pointer;
+        captured.attributes.push_back(attribute);
+        if(buffer)
+            names.buffers[(GLuint)buffer] = (GLuint)buffer;
+    }
+    m_data.vertexArrays.push_back(captured);
+    return true;
+}
+
+void FrameCapture::captureState()
+{
+    CapturedState& state = m_data.state;
+    state.depthTest = glIsEnabled(GL_DEPTH_TEST);
+    glGetIntegerv(GL_DEPTH_FUNC, &state.depthFunc);
+    glGetIntegerv(GL_DEPTH_WRITEMASK, &state.depthMask);
+    state.cullFace = glIsEnabled(GL_CULL_FACE);
+    glGetIntegerv(GL_CULL_FACE_MODE, &state.cullMode);
+    glGetIntegerv(GL_FRONT_FACE, &state.frontFace);
+    state.blend = glIsEnabled(GL_BLEND);
+    glGetIntegerv(GL_BLEND_SRC_RGB, &state.blendFunc[0]);
+    glGetIntegerv(GL_BLEND_DST_RGB, &state.blendFunc[1]);
+    glGetIntegerv(GL_BLEND_SRC_ALPHA, &state.blendFunc[2]);
+    glGetIntegerv(GL_BLEND_DST_ALPHA, &state.blendFunc[3]);
+}
+
+FrameReplay::FrameReplay()
+    : m_cache(NULL), m_width(0), m_height(0)
+{
+    std::memset(m_clearColor, 0, sizeof(m_clearColor));
+    std::memset(&m_state, 0, sizeof(m_state));
+}
+
+FrameReplay::~FrameReplay()
+{
+    destroy();
+}
+
+/**************************************************************
+ * FrameReplay::load()
+ * ------------------
+ * Creates every captured object under a new name and records
+ * the lists again with the names translated. The uniform ring
+ * gets a segment large enough for all of the frame's uniform
+ * data at worst-case alignment.
+ *************************************************************/
+bool FrameReplay::load(GLStateCache& cache, const FrameCaptureData& data)
+{
+    destroy();
+    m_cache = &cache;
+    m_width = data.width;
+    m_height = data.height;
+    std::memcpy(m_clearColor, data.clearColor, sizeof(m_clearColor));
+    m_state = data.state;
+
+    for(size_t i = 0; i < data.buffers.size(); ++i)
+    {
+        const CapturedBuffer& captured = data.buffers[i];
+        GLuint buffer = 0;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)captured.data.size(),
+                     captured.data.empty() ? NULL : &captured.data[0], GL_STATIC_DRAW);
+        m_buffers.push_back(buffer);
+        m_names.buffers[captured.name] = buffer;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for(size_t i = 0; i < data.textures.size(); ++i)
+    {
+        const CapturedTexture& captured = data.textures[i];
+        GLuint texture = 0;
+        glGenTextures(1, &texture);
+        cache.bindTexture(0, GL_TEXTURE_2D, texture);
+        for(size_t l = 0; l < captured.levels.size(); ++l)
+        {
+            const CapturedTextureLevel& level = captured.levels[l];
+            glTexImage2D(GL_TEXTURE_2D, (GLint)l, (GLint)captured.internalFormat, (GLsizei)level.width,
+                         (GLsizei)level.height, 0, captured.format, captured.type,
+                         level.data.empty() ? NULL : &level.data[0]);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, std::max((GLint)captured.levels.size() - 1, 0));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, captured.minFilter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, captured.magFilter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, captured.wrapS);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, captured.wrapT);
+        m_textures.push_back(texture);
+        m_names.textures[captured.name] = texture;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    for(size_t i = 0; i < data.programs.size(); ++i)
+    {
+        std::string log;
+        GLuint program = buildProgram(data.programs[i], log);
+        if(!program)
+        {
+            std::ostringstream message;
+            message << "program " << data.programs[i].name << " failed to build:\n" << log;
+            m_error = message.str();
+            destroy();
+            return false;
+        }
+        m_programs.push_back(program);
+        m_names.programs[data.programs[i].name] = program;
+    }
+
+    for(size_t i = 0; i < data.vertexArrays.size(); ++i)
+    {
+        const CapturedVertexArray& captured = data.vertexArrays[i];
+        GLuint vao = 0;
+        glGenVertexArrays(1, &vao);
+        cache.bindVertexArray(vao);
+        if(captured.elementBuffer)
+            cache.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_names.buffers[captured.elementBuffer]);
+        for(size_t a = 0; a < captured.attributes.size(); ++a)
+        {
+            const CapturedAttribute& attribute = captured.attributes[a];
+            const void* offset = (const void*)(uintptr_t)attribute.offset;
+            cache.bindBuffer(GL_ARRAY_BUFFER, m_names.buffers[attribute.buffer]);
+            glEnableVertexAttribArray(attribute.location);
+            if(attribute.integer)
+                glVertexAttribIPointer(attribute.location, attribute.components, attribute.type, attribute.stride,
+                                       offset);
+            else
+                glVertexAttribPointer(attribute.location, attribute.components, attribute.type,
+                                      (GLboolean)attribute.normalized, attribute.stride, offset);
+            glVertexAttribDivisor(attribute.location, attribute.divisor);
+        }
+        m_vertexArrays.push_back(vao);
+        m_names.vertexArrays[captured.name] = vao;
+    }
+    cache.bindVertexArray(0);
+
+    size_t uniformSpace = 256;
+    m_lists.resize(data.commandLists.size());
+    for(size_t i = 0; i < data.commandLists.size(); ++i)
+    {
+        const std::vector<uint8_t>& packets = data.commandLists[i];
+        remapCommandPackets(packets.empty() ? NULL : &packets[0], packets.size(), m_names, m_lists[i]);
+        uniformSpace += m_lists[i].uniformBytes() + m_lists[i].packetCount() * 256;
+    }
+    if(!m_ring.create(GL_UNIFORM_BUFFER, uniformSpace, 3))
+    {
+        m_error = "uniform ring could not be created";
+        destroy();
+        return false;
+    }
+    return true;
+}
+
+// Deletes through the cache given to load(), which bound them
+void FrameReplay::destroy()
+{
+    if(!m_cache)
+        return;
+    if(!m_buffers.empty())
+        m_cache->deleteBuffers((GLsizei)m_buffers.size(), &m_buffers[0]);
+    if(!m_textures.empty())
+        m_cache->deleteTextures((GLsizei)m_textures.size(), &m_textures[0]);
+    if(!m_vertexArrays.empty())
+        m_cache->deleteVertexArrays((GLsizei)m_vertexArrays.size(), &m_vertexArrays[0]);
+    for(size_t i = 0; i < m_programs.size(); ++i)
+        glDeleteProgram(m_programs[i]);
+    m_buffers.clear();
+    m_textures.clear();
+    m_vertexArrays.clear();
+    m_programs.clear();
+    m_names = CommandListNames();
+    m_lists.clear();
+    m_ring.destroy(m_cache);
+}
+
+/**************************************************************
+ * FrameReplay::execute()
+ * ---------------------
+ * Replays the frame into the bound framebuffer: full state
+ * reset to the captured values, clear, then the lists.
+ *************************************************************/
+bool FrameReplay::execute(GLStateCache& cache, CommandListStats* stats)
+{
+    m_scratch.reset();
+    m_ring.beginFrame();
+    cache.viewport(0, 0, (GLsizei)m_width, (GLsizei)m_height);
+    cache.setEnabled(GL_SCISSOR_TEST, false);
+    cache.colorMask(true, true, true, true);
+    cache.depthMask(true);
+    cache.clearColor(m_clearColor[0], m_clearColor[1], m_clearColor[2], m_clearColor[3]);
+    cache.clearDepth(1.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    cache.setEnabled(GL_DEPTH_TEST, m_state.depthTest != 0);
+    cache.depthFunc((GLenum)m_state.depthFunc);
+    cache.depthMask(m_state.depthMask != 0);
+    cache.setEnabled(GL_CULL_FACE, m_state.cullFace != 0);
+    cache.cullFace((GLenum)m_state.cullMode);
+    cache.frontFace((GLenum)m_state.frontFace);
+    cache.setEnabled(GL_BLEND, m_state.blend != 0);
+    cache.blendFunc((GLenum)m_state.blendFunc[0], (GLenum)m_state.blendFunc[1], (GLenum)m_state.blendFunc[2],
+                    (GLenum)m_state.blendFunc[3]);
+
+    bool executed = executeCommandLists(cache, m_ring, m_scratch, m_lists.empty() ? NULL : &m_lists[0], m_lists.size(),
+                                        stats);
+    m_ring.endFrame();
+    return executed;
+}
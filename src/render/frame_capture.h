@@ -0,0 +1,191 @@
+#pragma once
+
+#include "render/command_list.h"
+#include "render/gl.h"
+#include "render/gl_state_cache.h"
+#include "render/uniform_ring.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*************************************************************
+ * Frame Capture
+ * -------------
+ * One frame's command lists together with everything they
+ * draw from: the contents of every buffer, texture and vertex
+ * array they reference, read back from GL at capture time,
+ * the program sources, and the fixed function state they ran
+ * under. Written to disk it is a self-contained binary file
+ * that replays without the application or its assets.
+ *
+ * The file is a header and length-prefixed records, 4-byte
+ * aligned, closed by a checksum over everything before it;
+ * readers reject any other magic or version and any file
+ * whose checksum does not match.
+ ************************************************************/
+const uint32_t FrameCaptureMagic = 0x50414346;     // "FCAP"
+const uint32_t FrameCaptureVersion = 1;
+
+struct CapturedBuffer
+{
+    GLuint name;
+    std::vector<uint8_t> data;
+};
+
+struct CapturedTextureLevel
+{
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint8_t> data;
+};
+
+// 2D textures with the sampling state that affects results
+struct CapturedTexture
+{
+    GLuint name;
+    GLenum internalFormat;
+    GLenum format;
+    GLenum type;
+    GLint minFilter;
+    GLint magFilter;
+    GLint wrapS;
+    GLint wrapT;
+    std::vector<CapturedTextureLevel> levels;
+};
+
+struct CapturedAttribute
+{
+    GLuint location;
+    GLuint buffer;
+    GLint components;
+    GLenum type;
+    GLint normalized;
+    GLint integer;
+    GLint stride;
+    GLuint offset;
+    GLuint divisor;
+};
+
+struct CapturedVertexArray
+{
+    GLuint name;
+    GLuint elementBuffer;
+    std::vector<CapturedAttribute> attributes;
+};
+
+struct CapturedProgram
+{
+    GLuint name;
+    std::string vertexSource;
+    std::string fragmentSource;
+};
+
+struct CapturedState
+{
+    GLint depthTest;
+    GLint depthFunc;
+    GLint depthMask;
+    GLint cullFace;
+    GLint cullMode;
+    GLint frontFace;
+    GLint blend;
+    GLint blendFunc[4];         // source and destination RGB, then alpha
+};
+
+struct FrameCaptureData
+{
+    uint32_t width;
+    uint32_t height;
+    float clearColor[4];
+    CapturedState state;
+    std::vector<CapturedBuffer> buffers;
+    std::vector<CapturedTexture> textures;
+    std::vector<CapturedVertexArray> vertexArrays;
+    std::vector<CapturedProgram> programs;
+    std::vector<std::vector<uint8_t> > commandLists;    // packets as recorded
+};
+
+bool writeFrameCapture(const std::string& path, const FrameCaptureData& data);
+bool readFrameCapture(const std::string& path, FrameCaptureData& data);
+
+/*************************************************************
+ * FrameCapture
+ * ------------
+ * Builds a FrameCaptureData from the lists a frame is about
+ * to execute. Programs cannot be read back as source, so the
+ * application registers each one it draws with:
+ *
+ *     capture.begin(width, height, clearColor);
+ *     capture.addProgram(program, vertexSource, fragmentSource);
+ *     if(capture.capture(cache, lists, listCount))
+ *         writeFrameCapture("frame.fcap", capture.data());
+ *
+ * Only 2D textures in uncompressed formats can be captured;
+ * anything else fails the capture, with the reason in
+ * error(). Reading back stalls the pipeline, so capture a
+ * frame only on request.
+ ************************************************************/
+class FrameCapture
+{
+public:
+    void begin(uint32_t width, uint32_t height, const float clearColor[4]);
+    void addProgram(GLuint program, const std::string& vertexSource, const std::string& fragmentSource);
+    bool capture(GLStateCache& cache, const CommandList* lists, size_t listCount);
+
+    const FrameCaptureData& data() const { return m_data; }
+    const std::string& error() const { return m_error; }
+
+private:
+    bool captureBuffer(GLuint buffer);
+    bool captureTexture(GLStateCache& cache, GLuint texture, GLenum target);
+    bool captureVertexArray(GLStateCache& cache, GLuint vao, CommandListNames& names);
+    void captureState();
+
+    FrameCaptureData m_data;
+    std::string m_error;
+};
+
+/*************************************************************
+ * FrameReplay
+ * -----------
+ * Recreates a capture's objects and re-issues its frame, as
+ * many times as needed, into the bound framebuffer. Every
+ * execute() sets the captured state, clears and replays the
+ * same calls with the same data, so under a given driver the
+ * image is the same every time; with Mesa llvmpipe that holds
+ * on any machine, which makes image diffs usable in CI. The
+ * cache passed to load() binds the objects, so it also
+ * deletes them and has to outlive the replay.
+ ************************************************************/
+class FrameReplay
+{
+public:
+    FrameReplay();
+    ~FrameReplay();
+
+    bool load(GLStateCache& cache, const FrameCaptureData& data);
+    void destroy();
+    bool execute(GLStateCache& cache, CommandListStats* stats = 0);
+
+    const std::string& error() const { return m_error; }
+
+private:
+    FrameReplay(const FrameReplay&);
+    FrameReplay& operator=(const FrameReplay&);
+
+    GLStateCache* m_cache;
+    uint32_t m_width;
+    uint32_t m_height;
+    float m_clearColor[4];
+    CapturedState m_state;
+    CommandListNames m_names;
+    std::vector<CommandList> m_lists;
+    UniformRing m_ring;
+    LinearArena m_scratch;
+    std::vector<GLuint> m_buffers;
+    std::vector<GLuint> m_textures;
+    std::vector<GLuint> m_vertexArrays;
+    std::vector<GLuint> m_programs;
+    std::string m_error;
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+/*************************************************************
+ * OpenGL Entry Points
+ * -------------------
+ * Every file that talks to OpenGL includes this instead of
+ * GLEW directly, so the static GLEW configuration used by
+ * main.cpp stays the same across the whole program.
+ ************************************************************/
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif
+#include <GL/glew.h>
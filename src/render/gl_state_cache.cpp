@@ -0,0 +1,481 @@
+#include "render/gl_state_cache.h"
+
+#include <cstring>
+#include <limits>
+
+namespace
+{
+// Never a valid GL name or enum, so the first call is always
+// issued; NaN compares unequal to every float for the same
+// reason.
+    const GLuint Unknown = ~0u;
+    const GLfloat UnknownFloat = std::numeric_limits<GLfloat>::quiet_NaN();
+
+    const GLenum BufferTargets[] =
+    {
+        GL_ARRAY_BUFFER,
+        GL_UNIFORM_BUFFER,
+        GL_DRAW_INDIRECT_BUFFER,
+        GL_PIXEL_UNPACK_BUFFER,
+        GL_PIXEL_PACK_BUFFER,
+        GL_TEXTURE_BUFFER,
+        GL_SHADER_STORAGE_BUFFER
+    };
+
+    const GLenum Capabilities[] =
+    {
+        GL_BLEND,
+        GL_DEPTH_TEST,
+        GL_CULL_FACE,
+        GL_SCISSOR_TEST,
+        GL_STENCIL_TEST,
+        GL_POLYGON_OFFSET_FILL,
+        GL_MULTISAMPLE,
+        GL_FRAMEBUFFER_SRGB
+    };
+
+    const char* KindNames[GLStateKindCount] =
+    {
+        "program", "vertex array", "active texture", "texture", "buffer", "buffer range",
+        "capability", "blend", "depth", "raster", "clear"
+    };
+}
+
+uint32_t GLStateCounters::totalIssued() const
+{
+    uint32_t total = 0;
+    for(int i = 0; i < GLStateKindCount; ++i)
+        total += issued[i];
+    return total;
+}
+
+uint32_t GLStateCounters::totalSkipped() const
+{
+    uint32_t total = 0;
+    for(int i = 0; i < GLStateKindCount; ++i)
+        total += skipped[i];
+    return total;
+}
+
+const char* glStateKindName(GLStateKind kind)
+{
+    return kind < GLStateKindCount ? KindNames[kind] : "unknown";
+}
+
+GLStateCache::GLStateCache()
+{
+    invalidate();
+    beginFrame();
+}
+
+/**************************************************************
+ * GLStateCache::invalidate()
+ * -------------------------
+ * Forgets the shadow state so every next call is issued.
+ *************************************************************/
+void GLStateCache::invalidate()
+{
+    m_program = Unknown;
+    m_vertexArray = Unknown;
+    m_elementBuffer = Unknown;
+    m_activeTexture = Unknown;
+    for(int i = 0; i < BufferTargetCount; ++i)
+        m_buffers[i] = Unknown;
+    for(int i = 0; i < MaxTextureUnits; ++i)
+    {
+        m_textures[i].target = GL_NONE;
+        m_textures[i].texture = Unknown;
+    }
+    for(int i = 0; i < MaxBufferBindings; ++i)
+    {
+        m_uniformRanges[i].buffer = Unknown;
+        m_uniformRanges[i].offset = -1;
+        m_uniformRanges[i].size = -1;
+        m_storageRanges[i] = m_uniformRanges[i];
+    }
+
+    for(int i = 0; i < CapabilityCount; ++i)
+        m_capabilities[i] = -1;
+    for(int i = 0; i < 4; ++i)
+        m_blend[i] = Unknown;
+    m_blendEquation[0] = m_blendEquation[1] = Unknown;
+    m_depthFunc = Unknown;
+    m_depthMask = -1;
+    m_cullFace = Unknown;
+    m_frontFace = Unknown;
+    m_colorMask = -1;
+    m_polygonOffset[0] = m_polygonOffset[1] = UnknownFloat;
+    for(int i = 0; i < 4; ++i)
+    {
+        m_viewport[i] = -1;
+        m_scissor[i] = -1;
+        m_clearColor[i] = UnknownFloat;
+    }
+    m_clearDepth = UnknownFloat;
+}
+
+/**************************************************************
+ * GLStateCache::beginFrame()
+ * -------------------------
+ * Resets the per-frame counters; the shadow state is kept.
+ *************************************************************/
+void GLStateCache::beginFrame()
+{
+    std::memset(&m_counters, 0, sizeof(m_counters));
+}
+
+void GLStateCache::useProgram(GLuint program)
+{
+    if(!changed(GLStateProgram, m_program != program))
+        return;
+    m_program = program;
+    glUseProgram(program);
+}
+
+/**************************************************************
+ * GLStateCache::bindVertexArray()
+ * ------------------------------
+ * Binds a VAO. The element buffer binding belongs to the VAO,
+ * so its shadow is forgotten whenever the VAO changes.
+ *************************************************************/
+void GLStateCache::bindVertexArray(GLuint vao)
+{
+    if(!changed(GLStateVertexArray, m_vertexArray != vao))
+        return;
+    m_vertexArray = vao;
+    m_elementBuffer = Unknown;
+    glBindVertexArray(vao);
+}
+
+/**************************************************************
+ * GLStateCache::bindBuffer()
+ * -------------------------
+ * Binds buffer to a generic target. Untracked targets, the
+ * copy targets included, always go to the driver.
+ *************************************************************/
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer)
+{
+    GLuint* shadow = NULL;
+    if(target == GL_ELEMENT_ARRAY_BUFFER)
+        shadow = &m_elementBuffer;
+    else
+    {
+        int slot = bufferSlot(target);
+        if(slot >= 0)
+            shadow = &m_buffers[slot];
+    }
+
+    if(shadow)
+    {
+        if(!changed(GLStateBuffer, *shadow != buffer))
+            return;
+        *shadow = buffer;
+    }
+    else
+        ++m_counters.issued[GLStateBuffer];
+    glBindBuffer(target, buffer);
+}
+
+/**************************************************************
+ * GLStateCache::bindTexture()
+ * --------------------------
+ * Binds texture to unit, switching the active unit only when
+ * the binding actually has to change.
+ *************************************************************/
+void GLStateCache::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+    if(unit >= MaxTextureUnits)
+    {
+        ++m_counters.issued[GLStateTexture];
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(target, texture);
+        m_activeTexture = Unknown;
+        return;
+    }
+
+    TextureBinding& binding = m_textures[unit];
+    if(!changed(GLStateTexture, binding.target != target || binding.texture != texture))
+        return;
+
+    if(changed(GLStateActiveTexture, m_activeTexture != unit))
+    {
+        m_activeTexture = unit;
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+// A unit holds one texture per target; unbind the old target
+// so a stale texture of another type cannot linger
+    if(binding.target != GL_NONE && binding.target != target && binding.texture != Unknown)
+        glBindTexture(binding.target, 0);
+
+    binding.target = target;
+    binding.texture = texture;
+    glBindTexture(target, texture);
+}
+
+void GLStateCache::bindUniformBufferRange(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    bindBufferRange(GL_UNIFORM_BUFFER, m_uniformRanges, index, buffer, offset, size);
+}
+
+/**************************************************************
+ * GLStateCache::bindShaderStorageBufferRange()
+ * -------------------------------------------
+ * As bindUniformBufferRange() for shader storage blocks; the
+ * target only exists with GL 4.3 or ARB_shader_storage_buffer
+ * _object, which the caller has to check.
+ *************************************************************/
+void GLStateCache::bindShaderStorageBufferRange(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    bindBufferRange(GL_SHADER_STORAGE_BUFFER, m_storageRanges, index, buffer, offset, size);
+}
+
+/**************************************************************
+ * GLStateCache::deleteBuffers()
+ * ----------------------------
+ * Deletes buffers and forgets them in the shadow, where GL
+ * resets every binding of a deleted buffer to 0. Names of 0
+ * are ignored, as glDeleteBuffers does.
+ *************************************************************/
+void GLStateCache::deleteBuffers(GLsizei count, const GLuint* buffers)
+{
+    for(GLsizei i = 0; i < count; ++i)
+        if(buffers[i])
+            forgetBuffer(buffers[i]);
+    glDeleteBuffers(count, buffers);
+}
+
+void GLStateCache::deleteTextures(GLsizei count, const GLuint* textures)
+{
+    for(GLsizei i = 0; i < count; ++i)
+        for(int unit = 0; unit < MaxTextureUnits && textures[i]; ++unit)
+            if(m_textures[unit].texture == textures[i])
+                m_textures[unit].texture = 0;
+    glDeleteTextures(count, textures);
+}
+
+/**************************************************************
+ * GLStateCache::deleteVertexArrays()
+ * ---------------------------------
+ * Deleting the bound VAO binds VAO 0, and with it that VAO's
+ * element buffer, which is not known.
+ *************************************************************/
+void GLStateCache::deleteVertexArrays(GLsizei count, const GLuint* vaos)
+{
+    for(GLsizei i = 0; i < count; ++i)
+        if(vaos[i] && m_vertexArray == vaos[i])
+        {
+            m_vertexArray = 0;
+            m_elementBuffer = Unknown;
+        }
+    glDeleteVertexArrays(count, vaos);
+}
+
+void GLStateCache::setEnabled(GLenum capability, bool enabled)
+{
+    int slot = capabilitySlot(capability);
+    if(slot >= 0)
+    {
+        if(!changed(GLStateCapability, m_capabilities[slot] != (int)enabled))
+            return;
+        m_capabilities[slot] = enabled;
+    }
+    else
+        ++m_counters.issued[GLStateCapability];
+
+    if(enabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+}
+
+void GLStateCache::blendFunc(GLenum sourceRGB, GLenum destRGB, GLenum sourceAlpha, GLenum destAlpha)
+{
+    if(!changed(GLStateBlend, m_blend[0] != sourceRGB || m_blend[1] != destRGB
+                           || m_blend[2] != sourceAlpha || m_blend[3] != destAlpha))
+        return;
+    m_blend[0] = sourceRGB;
+    m_blend[1] = destRGB;
+    m_blend[2] = sourceAlpha;
+    m_blend[3] = destAlpha;
+    glBlendFuncSeparate(sourceRGB, destRGB, sourceAlpha, destAlpha);
+}
+
+void GLStateCache::blendEquation(GLenum modeRGB, GLenum modeAlpha)
+{
+    if(!changed(GLStateBlend, m_blendEquation[0] != modeRGB || m_blendEquation[1] != modeAlpha))
+        return;
+    m_blendEquation[0] = modeRGB;
+    m_blendEquation[1] = modeAlpha;
+    glBlendEquationSeparate(modeRGB, modeAlpha);
+}
+
+void GLStateCache::depthFunc(GLenum func)
+{
+    if(!changed(GLStateDepth, m_depthFunc != func))
+        return;
+    m_depthFunc = func;
+    glDepthFunc(func);
+}
+
+void GLStateCache::depthMask(bool write)
+{
+    if(!changed(GLStateDepth, m_depthMask != (int)write))
+        return;
+    m_depthMask = write;
+    glDepthMask(write ? GL_TRUE : GL_FALSE);
+}
+
+void GLStateCache::cullFace(GLenum face)
+{
+    if(!changed(GLStateRaster, m_cullFace != face))
+        return;
+    m_cullFace = face;
+    glCullFace(face);
+}
+
+void GLStateCache::frontFace(GLenum winding)
+{
+    if(!changed(GLStateRaster, m_frontFace != winding))
+        return;
+    m_frontFace = winding;
+    glFrontFace(winding);
+}
+
+void GLStateCache::colorMask(bool red, bool green, bool blue, bool alpha)
+{
+    int mask = (red ? 1 : 0) | (green ? 2 : 0) | (blue ? 4 : 0) | (alpha ? 8 : 0);
+    if(!changed(GLStateRaster, m_colorMask != mask))
+        return;
+    m_colorMask = mask;
+    glColorMask(red, green, blue, alpha);
+}
+
+void GLStateCache::polygonOffset(GLfloat factor, GLfloat units)
+{
+    if(!changed(GLStateRaster, !(m_polygonOffset[0] == factor && m_polygonOffset[1] == units)))
+        return;
+    m_polygonOffset[0] = factor;
+    m_polygonOffset[1] = units;
+    glPolygonOffset(factor, units);
+}
+
+void GLStateCache::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    if(!changed(GLStateRaster, m_viewport[0] != x || m_viewport[1] != y
+                            || m_viewport[2] != width || m_viewport[3] != height))
+        return;
+    m_viewport[0] = x;
+    m_viewport[1] = y;
+    m_viewport[2] = width;
+    m_viewport[3] = height;
+    glViewport(x, y, width, height);
+}
+
+void GLStateCache::scissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    if(!changed(GLStateRaster, m_scissor[0] != x || m_scissor[1] != y
+                            || m_scissor[2] != width || m_scissor[3] != height))
+        return;
+    m_scissor[0] = x;
+    m_scissor[1] = y;
+    m_scissor[2] = width;
+    m_scissor[3] = height;
+    glScissor(x, y, width, height);
+}
+
+void GLStateCache::clearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+    if(!changed(GLStateClear, !(m_clearColor[0] == red && m_clearColor[1] == green
+                             && m_clearColor[2] == blue && m_clearColor[3] == alpha)))
+        return;
+    m_clearColor[0] = red;
+    m_clearColor[1] = green;
+    m_clearColor[2] = blue;
+    m_clearColor[3] = alpha;
+    glClearColor(red, green, blue, alpha);
+}
+
+void GLStateCache::clearDepth(GLdouble depth)
+{
+    if(!changed(GLStateClear, !(m_clearDepth == depth)))
+        return;
+    m_clearDepth = depth;
+    glClearDepth(depth);
+}
+
+bool GLStateCache::changed(GLStateKind kind, bool differs)
+{
+    if(differs)
+        ++m_counters.issued[kind];
+    else
+        ++m_counters.skipped[kind];
+    return differs;
+}
+
+/**************************************************************
+ * GLStateCache::bindBufferRange()
+ * ------------------------------
+ * Binds a range to an indexed block binding of target. GL
+ * also binds the buffer to the generic target, so that shadow
+ * is updated too, but only when the range bind is issued.
+ *************************************************************/
+void GLStateCache::bindBufferRange(GLenum target, BufferRange* ranges, GLuint index, GLuint buffer,
+                                   GLintptr offset, GLsizeiptr size)
+{
+    if(index >= MaxBufferBindings)
+        ++m_counters.issued[GLStateBufferRange];
+    else
+    {
+        BufferRange& range = ranges[index];
+        if(!changed(GLStateBufferRange, range.buffer != buffer || range.offset != offset || range.size != size))
+            return;
+        range.buffer = buffer;
+        range.offset = offset;
+        range.size = size;
+    }
+
+    int slot = bufferSlot(target);
+    if(slot >= 0)
+        m_buffers[slot] = buffer;
+    glBindBufferRange(target, index, buffer, offset, size);
+}
+
+/**************************************************************
+ * GLStateCache::forgetBuffer()
+ * ---------------------------
+ * Drops every shadow binding of a buffer about to be deleted.
+ * Indexed ranges become unknown rather than 0, so the next
+ * range bind is issued whatever its offset.
+ *************************************************************/
+void GLStateCache::forgetBuffer(GLuint buffer)
+{
+    if(m_elementBuffer == buffer)
+        m_elementBuffer = 0;
+    for(int i = 0; i < BufferTargetCount; ++i)
+        if(m_buffers[i] == buffer)
+            m_buffers[i] = 0;
+    for(int i = 0; i < MaxBufferBindings; ++i)
+    {
+        if(m_uniformRanges[i].buffer == buffer)
+            m_uniformRanges[i].buffer = Unknown;
+        if(m_storageRanges[i].buffer == buffer)
+            m_storageRanges[i].buffer = Unknown;
+    }
+}
+
+int GLStateCache::bufferSlot(GLenum target) const
+{
+    for(int i = 0; i < BufferTargetCount; ++i)
+        if(BufferTargets[i] == target)
+            return i;
+    return -1;
+}
+
+int GLStateCache::capabilitySlot(GLenum capability) const
+{
+    for(int i = 0; i < CapabilityCount; ++i)
+        if(Capabilities[i] == capability)
+            return i;
+    return -1;
+}
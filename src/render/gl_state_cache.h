@@ -0,0 +1,153 @@
+#pragma once
+
+#include "render/gl.h"
+
+#include <cstdint>
+
+/*************************************************************
+ * GLStateCache
+ * ------------
+ * Shadow copy of the GL state the renderer touches: program,
+ * VAO, buffer and texture bindings, capabilities, blend,
+ * depth and raster state. Each call compares against the
+ * shadow and only reaches the driver when something changes.
+ * Counters record issued and skipped calls per kind of state
+ * since the last beginFrame().
+ *
+ * The shadow starts out unknown, so the first call of each
+ * kind is always issued. Call invalidate() after any code
+ * that touches GL state behind the cache's back. Delete
+ * buffers, textures and VAOs through the cache as well:
+ * deleting unbinds them, and glGen* soon hands the same names
+ * out again, which a stale shadow would take as still bound.
+ * Only core GL 3.3 entry points are used, so the counts are
+ * the same on any driver, including Mesa llvmpipe in CI.
+ *
+ * GL_COPY_READ_BUFFER and GL_COPY_WRITE_BUFFER are left
+ * untracked on purpose: code that needs a buffer bound just
+ * to create, map or upload it uses those targets and cannot
+ * disturb the shadow.
+ ************************************************************/
+enum GLStateKind
+{
+    GLStateProgram,
+    GLStateVertexArray,
+    GLStateActiveTexture,
+    GLStateTexture,
+    GLStateBuffer,
+    GLStateBufferRange,
+    GLStateCapability,
+    GLStateBlend,
+    GLStateDepth,
+    GLStateRaster,
+    GLStateClear,
+    GLStateKindCount
+};
+
+struct GLStateCounters
+{
+    uint32_t issued[GLStateKindCount];
+    uint32_t skipped[GLStateKindCount];
+
+    uint32_t totalIssued() const;
+    uint32_t totalSkipped() const;
+};
+
+const char* glStateKindName(GLStateKind kind);
+
+class GLStateCache
+{
+public:
+    enum
+    {
+        MaxTextureUnits = 32,
+        MaxBufferBindings = 16
+    };
+
+    GLStateCache();
+
+    void invalidate();
+    void beginFrame();
+
+// Objects
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vao);
+    void bindBuffer(GLenum target, GLuint buffer);
+    void bindTexture(GLuint unit, GLenum target, GLuint texture);
+    void bindUniformBufferRange(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    void bindShaderStorageBufferRange(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    void deleteBuffers(GLsizei count, const GLuint* buffers);
+    void deleteTextures(GLsizei count, const GLuint* textures);
+    void deleteVertexArrays(GLsizei count, const GLuint* vaos);
+
+// Fixed function state
+    void setEnabled(GLenum capability, bool enabled);
+    void blendFunc(GLenum sourceRGB, GLenum destRGB, GLenum sourceAlpha, GLenum destAlpha);
+    void blendEquation(GLenum modeRGB, GLenum modeAlpha);
+    void depthFunc(GLenum func);
+    void depthMask(bool write);
+    void cullFace(GLenum face);
+    void frontFace(GLenum winding);
+    void colorMask(bool red, bool green, bool blue, bool alpha);
+    void polygonOffset(GLfloat factor, GLfloat units);
+    void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    void scissor(GLint x, GLint y, GLsizei width, GLsizei height);
+    void clearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+    void clearDepth(GLdouble depth);
+
+    const GLStateCounters& counters() const { return m_counters; }
+
+private:
+    bool changed(GLStateKind kind, bool differs);
+    int bufferSlot(GLenum target) const;
+    int capabilitySlot(GLenum capability) const;
+    void forgetBuffer(GLuint buffer);
+
+    struct BufferRange;
+    void bindBufferRange(GLenum target, BufferRange* ranges, GLuint index, GLuint buffer, GLintptr offset,
+                         GLsizeiptr size);
+
+    enum
+    {
+        BufferTargetCount = 7,
+        CapabilityCount = 8
+    };
+
+    struct TextureBinding
+    {
+        GLenum target;
+        GLuint texture;
+    };
+
+    struct BufferRange
+    {
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    GLuint m_program;
+    GLuint m_vertexArray;
+    GLuint m_elementBuffer;         // part of the bound VAO
+    GLuint m_activeTexture;
+    GLuint m_buffers[BufferTargetCount];
+    TextureBinding m_textures[MaxTextureUnits];
+    BufferRange m_uniformRanges[MaxBufferBindings];
+    BufferRange m_storageRanges[MaxBufferBindings];
+
+    int m_capabilities[CapabilityCount];    // -1 unknown, 0 off, 1 on
+    GLenum m_blend[4];
+    GLenum m_blendEquation[2];
+    GLenum m_depthFunc;
+    int m_depthMask;
+    GLenum m_cullFace;
+    GLenum m_frontFace;
+    int m_colorMask;                        // RGBA bits, -1 unknown
+    GLfloat m_polygonOffset[2];
+    GLint m_viewport[4];
+    GLint m_scissor[4];
+    GLfloat m_clearColor[4];
+    GLdouble m_clearDepth;
+
+    GLStateCounters m_counters;
+};
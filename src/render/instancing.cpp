@@ -0,0 +1,264 @@
+#include "render/instancing.h"
+
+#include <algorithm>
+
+namespace
+{
+    const size_t MaxCommandsPerFrame = 4096;
+
+    size_t indexSize(GLenum type)
+    {
+        return type == GL_UNSIGNED_INT ? 4 : type == GL_UNSIGNED_SHORT ? 2 : 1;
+    }
+}
+
+InstanceRenderer::InstanceRenderer()
+    : m_state(NULL), m_format(InstanceFormatAffine), m_firstAttribute(0), m_stride(0), m_multiDraw(false),
+      m_drawCalls(0), m_instances(0)
+{
+}
+
+InstanceRenderer::~InstanceRenderer()
+{
+    m_instanceRing.destroy(m_state);
+    m_commandRing.destroy(m_state);
+}
+
+/**************************************************************
+ * InstanceRenderer::init()
+ * -----------------------
+ * Creates the instance ring, sized for maxInstancesPerFrame
+ * in each of framesInFlight segments, and the indirect
+ * command ring when multi-draw-indirect is available.
+ *************************************************************/
+bool InstanceRenderer::init(GLStateCache& state, InstanceFormat format, GLuint firstAttribute,
+                            size_t maxInstancesPerFrame, int framesInFlight)
+{
+// Rings from an earlier init() were bound through the old cache
+    m_instanceRing.destroy(m_state);
+    m_commandRing.destroy(m_state);
+    m_state = &state;
+    m_format = format;
+    m_firstAttribute = firstAttribute;
+    m_stride = format == InstanceFormatMatrix ? sizeof(InstanceMatrix) : sizeof(InstanceAffine);
+    m_multiDraw = GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+
+// One extra stride per segment leaves room for alignment
+    if(!m_instanceRing.create(GL_ARRAY_BUFFER, (maxInstancesPerFrame + 1) * m_stride, framesInFlight))
+        return false;
+    if(m_multiDraw && !m_commandRing.create(GL_DRAW_INDIRECT_BUFFER,
+                                            MaxCommandsPerFrame * sizeof(DrawElementsIndirectCommand), framesInFlight))
+        m_multiDraw = false;
+    return true;
+}
+
+/**************************************************************
+ * InstanceRenderer::addMesh()
+ * --------------------------
+ * Registers a mesh and returns its handle for reserve(). With
+ * multi-draw-indirect the instance attributes are attached to
+ * the VAO once, at the start of the ring, and each draw picks
+ * its instances through baseInstance.
+ *************************************************************/
+uint32_t InstanceRenderer::addMesh(const InstancedMesh& mesh)
+{
+    if(m_multiDraw)
+    {
+        bool configured = false;
+        for(size_t i = 0; i < m_meshes.size() && !configured; ++i)
+            configured = m_meshes[i].vao == mesh.vao;
+        if(!configured)
+        {
+            m_state->bindVertexArray(mesh.vao);
+            bindInstanceAttributes(0);
+        }
+    }
+    m_meshes.push_back(mesh);
+    return (uint32_t)(m_meshes.size() - 1);
+}
+
+/**************************************************************
+ * InstanceRenderer::beginFrame()
+ * -----------------------------
+ * Starts a frame; may wait on the GPU if it is more than
+ * framesInFlight frames behind.
+ *************************************************************/
+void InstanceRenderer::beginFrame()
+{
+    m_instanceRing.beginFrame();
+    if(m_multiDraw)
+        m_commandRing.beginFrame();
+    m_batches.clear();
+    m_drawCalls = 0;
+    m_instances = 0;
+}
+
+/**************************************************************
+ * InstanceRenderer::reserve()
+ * --------------------------
+ * Returns space for count instances of mesh, in the format
+ * chosen at init, directly inside the mapped ring. Returns
+ * NULL once this frame's segment is full.
+ *************************************************************/
+void* InstanceRenderer::reserve(uint32_t mesh, uint32_t count)
+{
+    if(mesh >= m_meshes.size() || count == 0)
+        return NULL;
+
+    GLintptr offset;
+    void* data = m_instanceRing.allocate(count * m_stride, m_stride, offset);
+    if(!data)
+        return NULL;
+
+    Batch batch = { mesh, count, offset };
+    m_batches.push_back(batch);
+    return data;
+}
+
+/**************************************************************
+ * InstanceRenderer::draw()
+ * -----------------------
+ * Draws every batch reserved this frame.
+ *************************************************************/
+void InstanceRenderer::draw()
+{
+    if(m_batches.empty())
+        return;
+
+    m_instanceRing.flush();
+    if(m_multiDraw)
+        drawMultiIndirect();
+    else
+        drawInstanced();
+}
+
+/**************************************************************
+ * InstanceRenderer::endFrame()
+ * ---------------------------
+ * Fences this frame's ring segments.
+ *************************************************************/
+void InstanceRenderer::endFrame()
+{
+    m_instanceRing.endFrame();
+    if(m_multiDraw)
+        m_commandRing.endFrame();
+}
+
+/**************************************************************
+ * InstanceRenderer::drawMultiIndirect()
+ * ------------------------------------
+ * Writes one indirect command per batch and issues one
+ * glMultiDrawElementsIndirect per VAO and index type.
+ *************************************************************/
+void InstanceRenderer::drawMultiIndirect()
+{
+    std::stable_sort(m_batches.begin(), m_batches.end(), [this](const Batch& a, const Batch& b)
+    {
+        const InstancedMesh& ma = m_meshes[a.mesh];
+        const InstancedMesh& mb = m_meshes[b.mesh];
+        return ma.vao != mb.vao ? ma.vao < mb.vao : ma.indexType < mb.indexType;
+    });
+
+    m_state->bindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandRing.buffer());
+    size_t first = 0;
+    while(first < m_batches.size())
+    {
+        const InstancedMesh& head = m_meshes[m_batches[first].mesh];
+        size_t last = first + 1;
+        while(last < m_batches.size() && m_meshes[m_batches[last].mesh].vao == head.vao
+              && m_meshes[m_batches[last].mesh].indexType == head.indexType)
+            ++last;
+
+        GLintptr offset;
+        GLsizei count = (GLsizei)(last - first);
+        DrawElementsIndirectCommand* commands = (DrawElementsIndirectCommand*)m_commandRing.allocate(
+            count * sizeof(DrawElementsIndirectCommand), sizeof(GLuint), offset);
+        if(!commands)
+            break;
+
+        for(size_t i = first; i < last; ++i)
+        {
+            const Batch& batch = m_batches[i];
+            const InstancedMesh& mesh = m_meshes[batch.mesh];
+            DrawElementsIndirectCommand& command = commands[i - first];
+            command.count = mesh.indexCount;
+            command.instanceCount = batch.count;
+            command.firstIndex = mesh.firstIndex;
+            command.baseVertex = mesh.baseVertex;
+            command.baseInstance = (GLuint)(batch.offset / m_stride);
+            m_instances += batch.count;
+        }
+        m_commandRing.flush();
+
+        m_state->bindVertexArray(head.vao);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, head.indexType, (const void*)offset, count, 0);
+        ++m_drawCalls;
+        first = last;
+    }
+}
+
+/**************************************************************
+ * InstanceRenderer::drawInstanced()
+ * --------------------------------
+ * GL 3.3 path: without baseInstance the instance attributes
+ * are re-pointed at each batch's offset before its draw.
+ *************************************************************/
+void InstanceRenderer::drawInstanced()
+{
+    for(size_t i = 0; i < m_batches.size(); ++i)
+    {
+        const Batch& batch = m_batches[i];
+        const InstancedMesh& mesh = m_meshes[batch.mesh];
+        m_state->bindVertexArray(mesh.vao);
+        bindInstanceAttributes(batch.offset);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, mesh.indexCount, mesh.indexType,
+            (const void*)(mesh.firstIndex * indexSize(mesh.indexType)), batch.count, mesh.baseVertex);
+        ++m_drawCalls;
+        m_instances += batch.count;
+    }
+}
+
+/**************************************************************
+ * InstanceRenderer::bindInstanceAttributes()
+ * -----------------------------------------
+ * Points the instance attributes of the bound VAO at offset
+ * in the instance ring, advancing once per instance.
+ *************************************************************/
+void InstanceRenderer::bindInstanceAttributes(GLintptr offset)
+{
+    m_state->bindBuffer(GL_ARRAY_BUFFER, m_instanceRing.buffer());
+
+    GLuint vectors = m_format == InstanceFormatMatrix ? 4 : 3;
+    for(GLuint i = 0; i < vectors; ++i)
+    {
+        GLuint location = m_firstAttribute + i;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, (GLsizei)m_stride,
+                              (const void*)(offset + i * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+    }
+
+    GLuint material = m_firstAttribute + vectors;
+    glEnableVertexAttribArray(material);
+    glVertexAttribIPointer(material, 1, GL_UNSIGNED_INT, (GLsizei)m_stride,
+                           (const void*)(offset + vectors * sizeof(glm::vec4)));
+    glVertexAttribDivisor(material, 1);
+}
+
+/**************************************************************
+ * InstanceRenderer::writeInstance()
+ * --------------------------------
+ * Helpers to fill reserved instances from a mat4.
+ *************************************************************/
+void InstanceRenderer::writeInstance(InstanceMatrix* out, const glm::mat4& transform, uint32_t material)
+{
+    out->transform = transform;
+    out->material = material;
+}
+
+void InstanceRenderer::writeInstance(InstanceAffine* out, const glm::mat4& transform, uint32_t material)
+{
+    for(int r = 0; r < 3; ++r)
+        out->rows[r] = glm::vec4(transform[0][r], transform[1][r], transform[2][r], transform[3][r]);
+    out->material = material;
+}
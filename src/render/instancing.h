@@ -0,0 +1,128 @@
+#pragma once
+
+#include "render/gl.h"
+#include "render/gl_state_cache.h"
+#include "render/persistent_ring.h"
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+/*************************************************************
+ * Instance Formats
+ * ----------------
+ * Per-instance data as the vertex shader reads it. The
+ * affine format stores the top three rows of the transform
+ * (a transposed mat3x4), 52 bytes instead of 68.
+ ************************************************************/
+struct InstanceMatrix
+{
+    glm::mat4 transform;
+    uint32_t material;
+};
+
+struct InstanceAffine
+{
+    glm::vec4 rows[3];
+    uint32_t material;
+};
+
+enum InstanceFormat
+{
+    InstanceFormatMatrix,
+    InstanceFormatAffine
+};
+
+/*************************************************************
+ * InstancedMesh
+ * -------------
+ * An indexed mesh inside a VAO. Meshes that share a VAO (one
+ * big vertex and index buffer) are drawn with a single
+ * glMultiDrawElementsIndirect when the driver supports it.
+ ************************************************************/
+struct InstancedMesh
+{
+    GLuint vao;
+    GLenum indexType;
+    GLuint indexCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+};
+
+/*************************************************************
+ * InstanceRenderer
+ * ----------------
+ * Collects instances per mesh straight into a persistently
+ * mapped ring and draws each mesh with one instanced call, so
+ * submission cost depends on the number of meshes, not
+ * instances. Per frame:
+ *
+ *     renderer.beginFrame();
+ *     InstanceAffine* out = (InstanceAffine*)renderer.reserve(mesh, count);
+ *     ... fill out[0..count) ...
+ *     renderer.draw();
+ *     renderer.endFrame();
+ *
+ * Instance attributes occupy locations firstAttribute onwards
+ * (see shaders/instancing.glsl). Binds and deletes go through
+ * the state cache given to init(), which has to outlive the
+ * renderer.
+ ************************************************************/
+class InstanceRenderer
+{
+public:
+    InstanceRenderer();
+    ~InstanceRenderer();
+
+    bool init(GLStateCache& state, InstanceFormat format, GLuint firstAttribute,
+              size_t maxInstancesPerFrame, int framesInFlight);
+    uint32_t addMesh(const InstancedMesh& mesh);
+
+    void beginFrame();
+    void* reserve(uint32_t mesh, uint32_t count);
+    void draw();
+    void endFrame();
+
+    static void writeInstance(InstanceMatrix* out, const glm::mat4& transform, uint32_t material);
+    static void writeInstance(InstanceAffine* out, const glm::mat4& transform, uint32_t material);
+
+    size_t stride() const { return m_stride; }
+    bool multiDrawIndirect() const { return m_multiDraw; }
+    uint32_t drawCalls() const { return m_drawCalls; }
+    uint32_t instancesDrawn() const { return m_instances; }
+
+private:
+    struct Batch
+    {
+        uint32_t mesh;
+        uint32_t count;
+        GLintptr offset;
+    };
+
+    struct DrawElementsIndirectCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    void bindInstanceAttributes(GLintptr offset);
+    void drawMultiIndirect();
+    void drawInstanced();
+
+    GLStateCache* m_state;
+    InstanceFormat m_format;
+    GLuint m_firstAttribute;
+    size_t m_stride;
+    bool m_multiDraw;
+
+    PersistentRingBuffer m_instanceRing;
+    PersistentRingBuffer m_commandRing;
+    std::vector<InstancedMesh> m_meshes;
+    std::vector<Batch> m_batches;
+
+    uint32_t m_drawCalls;
+    uint32_t m_instances;
+};
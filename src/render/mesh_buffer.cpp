@@ -0,0 +1,85 @@
+#include "render/mesh_buffer.h"
+#include "render/quantized_vertex.h"
+
+#include <cstddef>
+
+namespace
+{
+    GLuint createStaticBuffer(const void* data, size_t size)
+    {
+        GLuint buffer = 0;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        if(GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage)
+            glBufferStorage(GL_COPY_WRITE_BUFFER, (GLsizeiptr)size, data, 0);
+        else
+            glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)size, data, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return buffer;
+    }
+
+    void setFloatAttributes(GLStateCache& state, GLuint buffer, GLuint firstLocation)
+    {
+        GLsizei stride = (GLsizei)sizeof(MeshVertex);
+        state.bindBuffer(GL_ARRAY_BUFFER, buffer);
+
+        glEnableVertexAttribArray(firstLocation);
+        glVertexAttribPointer(firstLocation, 3, GL_FLOAT, GL_FALSE, stride,
+                              (const void*)offsetof(MeshVertex, position));
+        glEnableVertexAttribArray(firstLocation + 1);
+        glVertexAttribPointer(firstLocation + 1, 3, GL_FLOAT, GL_FALSE, stride,
+                              (const void*)offsetof(MeshVertex, normal));
+        glEnableVertexAttribArray(firstLocation + 2);
+        glVertexAttribPointer(firstLocation + 2, 2, GL_FLOAT, GL_FALSE, stride,
+                              (const void*)offsetof(MeshVertex, uv));
+    }
+}
+
+/**************************************************************
+ * uploadMeshCache()
+ * ----------------
+ * Creates the buffers and VAO for an open cache file. The
+ * file can be closed as soon as this returns.
+ *************************************************************/
+bool uploadMeshCache(GLStateCache& state, const MeshCacheFile& file, GLuint firstLocation, GpuMesh& mesh)
+{
+    mesh.vao = mesh.vertexBuffer = mesh.indexBuffer = 0;
+    if(!file.isOpen())
+        return false;
+
+    const MeshCacheHeader& header = file.header();
+    bool quantized = header.vertexFormat != MeshCacheFloatVertices;
+    if(quantized ? header.vertexFormat > NormalQTangent + 1 : header.vertexStride != sizeof(MeshVertex))
+        return false;
+
+    size_t vertexBytes = 0, indexBytes = 0;
+    const void* vertices = file.section(MeshCacheVertices, vertexBytes);
+    const void* indices = file.section(MeshCacheIndices, indexBytes);
+    if(vertexBytes == 0 || indexBytes == 0)
+        return false;
+
+    mesh.vertexBuffer = createStaticBuffer(vertices, vertexBytes);
+    mesh.indexBuffer = createStaticBuffer(indices, indexBytes);
+    mesh.indexType = header.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    mesh.indexCount = header.indexCount;
+    mesh.vertexCount = header.vertexCount;
+
+    glGenVertexArrays(1, &mesh.vao);
+    state.bindVertexArray(mesh.vao);
+    if(quantized)
+        setQuantizedAttributes(state, mesh.vertexBuffer, (NormalEncoding)(header.vertexFormat - 1), firstLocation);
+    else
+        setFloatAttributes(state, mesh.vertexBuffer, firstLocation);
+    state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+    state.bindVertexArray(0);
+    return true;
+}
+
+void destroyGpuMesh(GLStateCache& state, GpuMesh& mesh)
+{
+    if(mesh.vao)
+        state.deleteVertexArrays(1, &mesh.vao);
+    GLuint buffers[2] = { mesh.vertexBuffer, mesh.indexBuffer };
+    state.deleteBuffers(2, buffers);
+    mesh.vao = mesh.vertexBuffer = mesh.indexBuffer = 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "mesh/mesh_cache.h"
+#include "render/gl_state_cache.h"
+
+/*************************************************************
+ * Mesh Buffers
+ * ------------
+ * GL side of mesh/mesh_cache.h: a VAO with vertex and index
+ * buffers created straight from a mapped cache file. With
+ * GL 4.4 or ARB_buffer_storage the mapped sections are the
+ * source of immutable glBufferStorage buffers, so the only
+ * copy is the one the driver makes; otherwise glBufferData
+ * is used with the same pointers.
+ *
+ * Float vertices use attribute locations firstLocation to +2
+ * as position, normal and uv; quantized vertices use the
+ * layout of render/quantized_vertex.h.
+ ************************************************************/
+struct GpuMesh
+{
+    GLuint vao;
+    GLuint vertexBuffer;
+    GLuint indexBuffer;
+    GLenum indexType;
+    GLuint indexCount;
+    GLuint vertexCount;
+};
+
+bool uploadMeshCache(GLStateCache& state, const MeshCacheFile& file, GLuint firstLocation, GpuMesh& mesh);
+void destroyGpuMesh(GLStateCache& state, GpuMesh& mesh);
@@ -0,0 +1,179 @@
+#include "render/persistent_ring.h"
+
+PersistentRingBuffer::PersistentRingBuffer()
+    : m_target(GL_ARRAY_BUFFER), m_buffer(0), m_persistent(false), m_segmentSize(0), m_segmentCount(0),
+      m_segment(0), m_used(0), m_mappedFrom(0), m_mapped(NULL), m_stalls(0)
+{
+    for(int i = 0; i < MaxSegments; ++i)
+        m_fences[i] = 0;
+}
+
+PersistentRingBuffer::~PersistentRingBuffer()
+{
+    destroy();
+}
+
+/**************************************************************
+ * PersistentRingBuffer::create()
+ * -----------------------------
+ * Allocates segmentCount segments of segmentSize bytes,
+ * preferring immutable persistent storage when available.
+ * target is what the buffer will be used as; all binds made
+ * here go through GL_COPY_WRITE_BUFFER so they never disturb
+ * the state cache.
+ *************************************************************/
+bool PersistentRingBuffer::create(GLenum target, size_t segmentSize, int segmentCount)
+{
+    destroy();
+    if(segmentCount < 1 || segmentCount > MaxSegments || segmentSize == 0)
+        return false;
+
+    m_target = target;
+    m_segmentSize = segmentSize;
+    m_segmentCount = segmentCount;
+    m_segment = 0;
+    m_used = 0;
+    m_persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+
+    GLsizeiptr total = (GLsizeiptr)(segmentSize * segmentCount);
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+    if(m_persistent)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, total, NULL, flags);
+        m_mapped = (uint8_t*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, total, flags);
+        if(!m_mapped)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            destroy();
+            return false;
+        }
+    }
+    else
+        glBufferData(GL_COPY_WRITE_BUFFER, total, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return true;
+}
+
+/**************************************************************
+ * PersistentRingBuffer::destroy()
+ * ------------------------------
+ * Releases the fences and the buffer; pass the cache the
+ * buffer was bound through, so it forgets the name.
+ *************************************************************/
+void PersistentRingBuffer::destroy(GLStateCache* cache)
+{
+    for(int i = 0; i < MaxSegments; ++i)
+    {
+        if(m_fences[i])
+            glDeleteSync(m_fences[i]);
+        m_fences[i] = 0;
+    }
+    if(m_buffer)
+    {
+    // Deleting a buffer implicitly unmaps it
+        if(cache)
+            cache->deleteBuffers(1, &m_buffer);
+        else
+            glDeleteBuffers(1, &m_buffer);
+        m_buffer = 0;
+    }
+    m_mapped = NULL;
+}
+
+/**************************************************************
+ * PersistentRingBuffer::beginFrame()
+ * ---------------------------------
+ * Waits until the GPU has finished with the segment this
+ * frame is about to reuse. With enough segments in flight
+ * the fence has long signalled and this returns at once.
+ *************************************************************/
+void PersistentRingBuffer::beginFrame()
+{
+    m_used = 0;
+    GLsync fence = m_fences[m_segment];
+    if(!fence)
+        return;
+
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if(status == GL_TIMEOUT_EXPIRED)
+    {
+        ++m_stalls;
+        do
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        while(status == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(fence);
+    m_fences[m_segment] = 0;
+}
+
+/**************************************************************
+ * PersistentRingBuffer::allocate()
+ * -------------------------------
+ * Returns a write pointer for size bytes in this frame's
+ * segment and the matching buffer offset, aligned to
+ * alignment (which need not be a power of two, so vertex
+ * strides work). Returns NULL when the segment is full.
+ *************************************************************/
+void* PersistentRingBuffer::allocate(size_t size, size_t alignment, GLintptr& offset)
+{
+    if(alignment == 0)
+        alignment = 1;
+
+    size_t base = (size_t)m_segment * m_segmentSize;
+    size_t start = ((base + m_used + alignment - 1) / alignment) * alignment - base;
+    if(start + size > m_segmentSize)
+        return NULL;
+    m_used = start + size;
+    offset = (GLintptr)(base + start);
+
+    if(m_persistent)
+        return m_mapped + base + start;
+
+// Unsynchronized path: the fence in beginFrame() already
+// guarantees the GPU is done with the rest of the segment
+    if(!m_mapped)
+    {
+        m_mappedFrom = start;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+        m_mapped = (uint8_t*)glMapBufferRange(GL_COPY_WRITE_BUFFER, (GLintptr)(base + start), (GLsizeiptr)(m_segmentSize - start),
+            GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        if(!m_mapped)
+            return NULL;
+    }
+    return m_mapped + (start - m_mappedFrom);
+}
+
+/**************************************************************
+ * PersistentRingBuffer::flush()
+ * ----------------------------
+ * Makes writes visible before drawing. Coherent persistent
+ * mappings need nothing; otherwise the segment is unmapped
+ * and the next allocate() maps the remainder again.
+ *************************************************************/
+void PersistentRingBuffer::flush()
+{
+    if(m_persistent || !m_mapped)
+        return;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    m_mapped = NULL;
+}
+
+/**************************************************************
+ * PersistentRingBuffer::endFrame()
+ * -------------------------------
+ * Fences everything issued against this segment and moves on
+ * to the next one.
+ *************************************************************/
+void PersistentRingBuffer::endFrame()
+{
+    flush();
+    if(m_fences[m_segment])
+        glDeleteSync(m_fences[m_segment]);
+    m_fences[m_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_segment = (m_segment + 1) % m_segmentCount;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "render/gl.h"
+#include "render/gl_state_cache.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/*************************************************************
+ * PersistentRingBuffer
+ * --------------------
+ * Streaming buffer split into one segment per frame in
+ * flight. With GL_ARB_buffer_storage the whole buffer is
+ * mapped once, persistent and coherent, and writing data is a
+ * plain store; without it each segment is mapped
+ * unsynchronized for the frame instead. Either way a fence
+ * per segment stops the CPU from overwriting data the GPU is
+ * still reading.
+ *
+ *     ring.beginFrame();
+ *     void* p = ring.allocate(bytes, alignment, offset);
+ *     ... write p, draw from offset ...
+ *     ring.endFrame();
+ ************************************************************/
+class PersistentRingBuffer
+{
+public:
+    PersistentRingBuffer();
+    ~PersistentRingBuffer();
+
+    bool create(GLenum target, size_t segmentSize, int segmentCount);
+    void destroy(GLStateCache* cache = NULL);
+
+    void beginFrame();
+    void* allocate(size_t size, size_t alignment, GLintptr& offset);
+    void flush();
+    void endFrame();
+
+    GLuint buffer() const { return m_buffer; }
+    GLenum target() const { return m_target; }
+    bool persistent() const { return m_persistent; }
+    size_t segmentSize() const { return m_segmentSize; }
+    size_t segmentUsed() const { return m_used; }
+
+// Frames where beginFrame() had to wait for the GPU
+    uint64_t stalls() const { return m_stalls; }
+
+private:
+    enum { MaxSegments = 4 };
+
+    GLenum m_target;
+    GLuint m_buffer;
+    bool m_persistent;
+    size_t m_segmentSize;
+    int m_segmentCount;
+    int m_segment;
+    size_t m_used;
+    size_t m_mappedFrom;        // unsynchronized path: start of the current mapping
+    uint8_t* m_mapped;
+    GLsync m_fences[MaxSegments];
+    uint64_t m_stalls;
+};
@@ -0,0 +1,35 @@
+#include "render/quantized_vertex.h"
+
+namespace
+{
+    const size_t PositionOffset = 0;
+    const size_t NormalOffset = 8;
+}
+
+/**************************************************************
+ * setQuantizedAttributes()
+ * -----------------------
+ * Points position, normal (or tangent frame) and uv at
+ * firstLocation, +1 and +2 of the bound VAO.
+ *************************************************************/
+void setQuantizedAttributes(GLStateCache& state, GLuint buffer, NormalEncoding encoding, GLuint firstLocation)
+{
+    GLsizei stride = (GLsizei)quantizedVertexSize(encoding);
+    state.bindBuffer(GL_ARRAY_BUFFER, buffer);
+
+    glEnableVertexAttribArray(firstLocation);
+    glVertexAttribPointer(firstLocation, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (const void*)PositionOffset);
+
+    glEnableVertexAttribArray(firstLocation + 1);
+    if(encoding == NormalOctahedral)
+        glVertexAttribPointer(firstLocation + 1, 2, GL_SHORT, GL_TRUE, stride, (const void*)NormalOffset);
+    else if(encoding == NormalPacked1010102)
+        glVertexAttribPointer(firstLocation + 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride,
+                              (const void*)NormalOffset);
+    else
+        glVertexAttribPointer(firstLocation + 1, 4, GL_SHORT, GL_TRUE, stride, (const void*)NormalOffset);
+
+    glEnableVertexAttribArray(firstLocation + 2);
+    glVertexAttribPointer(firstLocation + 2, 2, GL_HALF_FLOAT, GL_FALSE, stride,
+                          (const void*)(size_t)(stride - 4));
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "mesh/mesh_quantize.h"
+#include "render/gl_state_cache.h"
+
+/*************************************************************
+ * Quantized Vertex Attributes
+ * ---------------------------
+ * GL side of mesh/mesh_quantize.h: attribute pointers for a
+ * buffer holding QuantizedMesh::vertices, decoded by
+ * shaders/quantized_vertex.glsl.
+ ************************************************************/
+void setQuantizedAttributes(GLStateCache& state, GLuint buffer, NormalEncoding encoding, GLuint firstLocation);
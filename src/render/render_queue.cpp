@@ -0,0 +1,186 @@
+#include "render/render_queue.h"
+#include "core/parallel.h"
+
+#include <glm/glm.hpp>
+#include <cstring>
+
+namespace
+{
+    const int DepthBits = 20;
+    const uint32_t DepthMax = (1u << DepthBits) - 1;
+
+    size_t indexSize(GLenum type)
+    {
+        return type == GL_UNSIGNED_INT ? 4 : type == GL_UNSIGNED_SHORT ? 2 : 1;
+    }
+}
+
+/**************************************************************
+ * makeSortKey()
+ * ------------
+ * Packs the fields described in render_queue.h. depth is the
+ * normalised view depth in [0, 1]; ids are masked to fit.
+ *************************************************************/
+SortKey makeSortKey(uint32_t pass, uint32_t shader, uint32_t material, uint32_t texture,
+                    float depth, bool backToFront)
+{
+    uint32_t quantized = (uint32_t)(glm::clamp(depth, 0.0f, 1.0f) * DepthMax);
+    if(backToFront)
+        quantized = DepthMax - quantized;
+
+    return ((SortKey)(pass & 0xF) << 60)
+         | ((SortKey)(shader & 0xFFF) << 48)
+         | ((SortKey)(material & 0xFFFF) << 32)
+         | ((SortKey)(texture & 0xFFF) << 20)
+         | (SortKey)quantized;
+}
+
+RenderQueue::RenderQueue()
+{
+    std::memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void RenderQueue::clear()
+{
+    m_keys.clear();
+    m_commands.clear();
+}
+
+void RenderQueue::submit(SortKey key, const DrawCommand& command)
+{
+    Entry entry = { key, (uint32_t)m_commands.size() };
+    m_keys.push_back(entry);
+    m_commands.push_back(command);
+}
+
+/**************************************************************
+ * RenderQueue::sort()
+ * ------------------
+ * Stable LSD radix sort, one byte per pass. Passes where
+ * every key has the same byte (common for the pass and
+ * shader bytes) are skipped after the histogram.
+ *************************************************************/
+void RenderQueue::sort()
+{
+    size_t count = m_keys.size();
+    if(count < 2)
+        return;
+    m_scratch.resize(count);
+
+    Entry* source = &m_keys[0];
+    Entry* target = &m_scratch[0];
+    for(int shift = 0; shift < 64; shift += 8)
+    {
+        size_t histogram[256];
+        std::memset(histogram, 0, sizeof(histogram));
+        for(size_t i = 0; i < count; ++i)
+            ++histogram[(source[i].key >> shift) & 0xFF];
+
+        if(histogram[(source[0].key >> shift) & 0xFF] == count)
+            continue;
+
+        size_t offset = 0;
+        for(int b = 0; b < 256; ++b)
+        {
+            size_t n = histogram[b];
+            histogram[b] = offset;
+            offset += n;
+        }
+        for(size_t i = 0; i < count; ++i)
+            target[histogram[(source[i].key >> shift) & 0xFF]++] = source[i];
+
+        Entry* swap = source;
+        source = target;
+        target = swap;
+    }
+
+    if(source != &m_keys[0])
+        m_keys.swap(m_scratch);
+}
+
+/**************************************************************
+ * RenderQueue::execute()
+ * ---------------------
+ * Issues the queued draws in key order, skipping those with
+ * no instances. Call sort() first.
+ *************************************************************/
+void RenderQueue::execute(GLStateCache& cache)
+{
+    GLStateCounters before = cache.counters();
+
+    uint32_t draws = 0;
+    for(size_t i = 0; i < m_keys.size(); ++i)
+    {
+        const DrawCommand& command = m_commands[m_keys[i].command];
+        if(command.instanceCount == 0)
+            continue;
+        cache.useProgram(command.program);
+        cache.bindVertexArray(command.vao);
+        for(GLuint t = 0; t < DrawCommand::MaxTextures; ++t)
+            if(command.textures[t])
+                cache.bindTexture(t, command.textureTargets[t], command.textures[t]);
+        if(command.materialBuffer)
+            cache.bindUniformBufferRange(MaterialBinding, command.materialBuffer,
+                                         command.materialOffset, command.materialSize);
+
+        const void* indices = (const void*)(command.firstIndex * indexSize(command.indexType));
+        if(command.instanceCount > 1)
+            glDrawElementsInstancedBaseVertex(command.mode, command.indexCount, command.indexType,
+                                              indices, command.instanceCount, command.baseVertex);
+        else
+            glDrawElementsBaseVertex(command.mode, command.indexCount, command.indexType,
+                                     indices, command.baseVertex);
+        ++draws;
+    }
+
+    const GLStateCounters& after = cache.counters();
+    m_stats.draws = draws;
+    m_stats.bindsIssued = after.totalIssued() - before.totalIssued();
+    m_stats.bindsAvoided = after.totalSkipped() - before.totalSkipped();
+}
+
+/**************************************************************
+ * RenderQueue::record()
+ * --------------------
+ * Appends the sorted draws [begin, end) to list, with the
+ * same binds execute() would make.
+ *************************************************************/
+void RenderQueue::record(CommandList& list, size_t begin, size_t end) const
+{
+    for(size_t i = begin; i < end && i < m_keys.size(); ++i)
+    {
+        const DrawCommand& command = m_commands[m_keys[i].command];
+        if(command.instanceCount == 0)
+            continue;
+        list.useProgram(command.program);
+        list.bindVertexArray(command.vao);
+        for(GLuint t = 0; t < DrawCommand::MaxTextures; ++t)
+            if(command.textures[t])
+                list.bindTexture(t, command.textureTargets[t], command.textures[t]);
+        if(command.materialBuffer)
+            list.bindUniformBuffer(MaterialBinding, command.materialBuffer, command.materialOffset,
+                                   command.materialSize);
+        list.drawIndexed(command.mode, command.indexCount, command.indexType, command.firstIndex,
+                         command.baseVertex, command.instanceCount);
+    }
+}
+
+/**************************************************************
+ * RenderQueue::record()
+ * --------------------
+ * Resets the lists and records an equal share of the sorted
+ * draws into each, in parallel. Replaying the lists in order
+ * issues the draws in key order. Call sort() first.
+ *************************************************************/
+void RenderQueue::record(CommandList* lists, size_t listCount, unsigned threadCount) const
+{
+    size_t count = m_keys.size();
+    parallelFor(0, listCount, 1, threadCount, [&](size_t begin, size_t end)
+    {
+        for(size_t l = begin; l < end; ++l)
+        {
+            lists[l].reset();
+            record(lists[l], count * l / listCount, count * (l + 1) / listCount);
+        }
+    });
+}
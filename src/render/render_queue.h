@@ -0,0 +1,105 @@
+#pragma once
+
+#include "render/command_list.h"
+#include "render/gl.h"
+#include "render/gl_state_cache.h"
+
+#include <cstdint>
+#include <vector>
+
+/*************************************************************
+ * Sort Keys
+ * ---------
+ * 64-bit draw key, most significant field first:
+ *
+ *     63..60  pass        (opaque before transparent, ...)
+ *     59..48  shader id
+ *     47..32  material id
+ *     31..20  texture id
+ *     19..0   depth       (quantized, front to back)
+ *
+ * so sorting the keys groups draws by the costliest state
+ * change first. Ids are small dense numbers chosen by the
+ * caller, not GL names. Passes flagged backToFront invert the
+ * depth bits for blending.
+ ************************************************************/
+typedef uint64_t SortKey;
+
+SortKey makeSortKey(uint32_t pass, uint32_t shader, uint32_t material, uint32_t texture,
+                    float depth, bool backToFront);
+
+/*************************************************************
+ * DrawCommand
+ * -----------
+ * Everything needed to issue one indexed draw. Unused texture
+ * slots are 0; a material buffer of 0 binds nothing.
+ ************************************************************/
+struct DrawCommand
+{
+    enum { MaxTextures = 4 };
+
+    GLuint program;
+    GLuint vao;
+    GLenum textureTargets[MaxTextures];
+    GLuint textures[MaxTextures];
+    GLuint materialBuffer;
+    GLintptr materialOffset;
+    GLsizeiptr materialSize;
+    GLenum mode;
+    GLenum indexType;
+    GLsizei indexCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLsizei instanceCount;
+};
+
+/*************************************************************
+ * RenderQueue
+ * -----------
+ * Per-frame list of draws. submit() only records; execute()
+ * radix sorts the keys and issues everything through a
+ * GLStateCache so binds shared by neighbouring draws are
+ * skipped. The material buffer is bound to uniform block
+ * binding MaterialBinding.
+ *
+ * Instead of execute(), record() can turn the sorted draws
+ * into command lists, split into contiguous ranges recorded
+ * on worker threads, for executeCommandLists() to replay in
+ * the same order.
+ ************************************************************/
+struct RenderQueueStats
+{
+    uint32_t draws;
+    uint32_t bindsIssued;
+    uint32_t bindsAvoided;
+};
+
+class RenderQueue
+{
+public:
+    enum { MaterialBinding = 1 };
+
+    RenderQueue();
+
+    void clear();
+    void submit(SortKey key, const DrawCommand& command);
+    void sort();
+    void execute(GLStateCache& cache);
+    void record(CommandList& list, size_t begin, size_t end) const;
+    void record(CommandList* lists, size_t listCount, unsigned threadCount) const;
+
+    size_t size() const { return m_keys.size(); }
+    const RenderQueueStats& stats() const { return m_stats; }
+
+private:
+    struct Entry
+    {
+        SortKey key;
+        uint32_t command;
+    };
+
+    std::vector<Entry> m_keys;
+    std::vector<Entry> m_scratch;
+    std::vector<DrawCommand> m_commands;
+    RenderQueueStats m_stats;
+};
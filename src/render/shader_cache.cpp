@@ -0,0 +1,613 @@
+#include "render/shader_cache.h"
+#include "mesh/mesh_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+// Nesting limit for #include, which also stops include cycles
+    const int MaxIncludeDepth = 16;
+
+    const GLenum Stages[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+
+    struct ShaderBinaryHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t format;
+        uint32_t size;
+        uint64_t driverHash;
+        uint64_t key;
+        uint64_t checksum;
+    };
+
+    bool readFile(const std::string& path, std::string& contents)
+    {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if(!file)
+            return false;
+        std::ostringstream buffer;
+        buffer << file.rdbuf();
+        contents = buffer.str();
+        return true;
+    }
+
+    std::string glString(GLenum name)
+    {
+        const GLubyte* value = glGetString(name);
+        return value ? (const char*)value : "";
+    }
+
+    std::string shaderLog(GLuint shader)
+    {
+        GLint length = 0;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+        if(length <= 1)
+            return "";
+        std::string log((size_t)length, '\0');
+        glGetShaderInfoLog(shader, length, NULL, &log[0]);
+        log.resize(std::strlen(log.c_str()));
+        return log;
+    }
+
+    std::string programLog(GLuint program)
+    {
+        GLint length = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        if(length <= 1)
+            return "";
+        std::string log((size_t)length, '\0');
+        glGetProgramInfoLog(program, length, NULL, &log[0]);
+        log.resize(std::strlen(log.c_str()));
+        return log;
+    }
+}
+
+ShaderCache::ShaderCache()
+    : m_binaryCache(false), m_parallelCompile(false), m_driverHash(0)
+{
+    std::memset(&m_stats, 0, sizeof(m_stats));
+}
+
+ShaderCache::~ShaderCache()
+{
+    destroy();
+}
+
+/**************************************************************
+ * ShaderCache::init()
+ * ------------------
+ * Needs a current context. Binaries are only cached with GL
+ * 4.1 or ARB_get_program_binary, a driver exposing at least
+ * one binary format, and a cache directory, which is created
+ * if missing. Asks the driver for as many compiler threads as
+ * it likes when parallel compilation is available.
+ *************************************************************/
+bool ShaderCache::init(const std::string& shaderDirectory, const std::string& cacheDirectory)
+{
+    destroy();
+    m_shaderDirectory = shaderDirectory;
+    m_cacheDirectory = cacheDirectory;
+
+    if(!glGetString(GL_VERSION))
+        return false;
+    std::string driver = glString(GL_VENDOR) + '\n' + glString(GL_RENDERER) + '\n' + glString(GL_VERSION);
+    m_driverHash = meshCacheChecksum(driver.data(), driver.size());
+
+    GLint formats = 0;
+    if(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    m_binaryCache = formats > 0 && !cacheDirectory.empty();
+    if(m_binaryCache)
+    {
+#ifdef _WIN32
+        _mkdir(cacheDirectory.c_str());
+#else
+        mkdir(cacheDirectory.c_str(), 0755);
+#endif
+    }
+
+    m_parallelCompile = GLEW_ARB_parallel_shader_compile != 0;
+    if(m_parallelCompile)
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+    return true;
+}
+
+/**************************************************************
+ * ShaderCache::destroy()
+ * ---------------------
+ * Deletes every program, finished or not; handles from
+ * earlier requests become invalid.
+ *************************************************************/
+void ShaderCache::destroy()
+{
+    for(size_t i = 0; i < m_programs.size(); ++i)
+    {
+        Program& program = m_programs[i];
+        deleteShaders(program.program, program.shaders);
+        if(program.program)
+            glDeleteProgram(program.program);
+        deleteShaders(program.rebuild, program.rebuildShaders);
+        if(program.rebuild)
+            glDeleteProgram(program.rebuild);
+    }
+    m_programs.clear();
+    m_byKey.clear();
+    std::memset(&m_stats, 0, sizeof(m_stats));
+}
+
+/**************************************************************
+ * ShaderCache::request()
+ * ---------------------
+ * Preprocesses both stages and starts building the program,
+ * from its cached binary when there is a valid one. The same
+ * preprocessed sources requested again give the same handle.
+ *************************************************************/
+ShaderHandle ShaderCache::request(const ShaderProgramDesc& desc)
+{
+    Program program;
+    program.desc = desc;
+    program.key = 0;
+    program.program = 0;
+    program.shaders[0] = program.shaders[1] = 0;
+    program.state = Building;
+    program.rebuildKey = 0;
+    program.rebuild = 0;
+    program.rebuildShaders[0] = program.rebuildShaders[1] = 0;
+
+    std::string sources[2];
+    if(!prepare(program, sources, program.key))
+    {
+        program.state = Failed;
+        ++m_stats.failed;
+        m_programs.push_back(program);
+        return (ShaderHandle)(m_programs.size() - 1);
+    }
+
+    std::unordered_map<uint64_t, ShaderHandle>::const_iterator existing = m_byKey.find(program.key);
+    if(existing != m_byKey.end())
+        return existing->second;
+
+    ++m_stats.programs;
+    program.program = glCreateProgram();
+    if(m_binaryCache && loadBinary(program))
+    {
+        program.state = Linked;
+        ++m_stats.binaryHits;
+    }
+    else
+        compile(program.program, program.shaders, sources);
+
+    ShaderHandle handle = (ShaderHandle)m_programs.size();
+    m_programs.push_back(program);
+    m_byKey[program.key] = handle;
+    return handle;
+}
+
+/**************************************************************
+ * ShaderCache::ready()
+ * -------------------
+ * True once program() would not block: always, unless the
+ * driver compiles in parallel and is still building it.
+ *************************************************************/
+bool ShaderCache::ready(ShaderHandle handle) const
+{
+    if(handle >= m_programs.size() || m_programs[handle].state != Building || !m_parallelCompile)
+        return true;
+    GLint complete = GL_FALSE;
+    glGetProgramiv(m_programs[handle].program, GL_COMPLETION_STATUS_ARB, &complete);
+    return complete == GL_TRUE;
+}
+
+GLuint ShaderCache::program(ShaderHandle handle)
+{
+    if(handle >= m_programs.size())
+        return 0;
+    Program& program = m_programs[handle];
+    if(program.state == Building)
+        complete(program);
+    return program.state == Linked ? program.program : 0;
+}
+
+void ShaderCache::finish()
+{
+    for(size_t i = 0; i < m_programs.size(); ++i)
+        if(m_programs[i].state == Building)
+            complete(m_programs[i]);
+}
+
+/**************************************************************
+ * ShaderCache::reload()
+ * --------------------
+ * Starts rebuilding every program that read path, given as
+ * the shader directory joined with the file's name. Programs
+ * whose preprocessed sources did not change, or that fail to
+ * preprocess now, are left alone. Returns how many rebuilds
+ * were started.
+ *************************************************************/
+size_t ShaderCache::reload(const std::string& path)
+{
+    size_t started = 0;
+    for(size_t i = 0; i < m_programs.size(); ++i)
+    {
+        Program& program = m_programs[i];
+        if(std::find(program.files.begin(), program.files.end(), path) == program.files.end())
+            continue;
+
+        std::string sources[2];
+        uint64_t key = 0;
+        program.log.clear();
+        if(!prepare(program, sources, key))
+            continue;
+
+    // Reverted to what is linked: a rebuild of the edit in
+    // between would otherwise be swapped in by update()
+        if(key == program.key && program.state == Linked)
+        {
+            cancelRebuild(program);
+            continue;
+        }
+
+    // A program that never built has nothing to keep showing;
+    // build it in place
+        if(program.state == Failed)
+        {
+            program.key = key;
+            program.program = glCreateProgram();
+            program.state = Building;
+            compile(program.program, program.shaders, sources);
+            m_byKey[key] = (ShaderHandle)i;
+            ++started;
+            continue;
+        }
+
+        if(program.state == Building)
+            complete(program);
+        cancelRebuild(program);
+        program.rebuildKey = key;
+        program.rebuild = glCreateProgram();
+        compile(program.rebuild, program.rebuildShaders, sources);
+        ++started;
+    }
+    return started;
+}
+
+/**************************************************************
+ * ShaderCache::update()
+ * --------------------
+ * Swaps in rebuilt programs that have finished linking; with
+ * parallel compilation, ones still compiling wait for a later
+ * frame.
+ *************************************************************/
+void ShaderCache::update()
+{
+    for(size_t i = 0; i < m_programs.size(); ++i)
+    {
+        Program& program = m_programs[i];
+        if(!program.rebuild)
+            continue;
+        if(m_parallelCompile)
+        {
+            GLint complete = GL_FALSE;
+            glGetProgramiv(program.rebuild, GL_COMPLETION_STATUS_ARB, &complete);
+            if(complete != GL_TRUE)
+                continue;
+        }
+        completeRebuild((ShaderHandle)i);
+    }
+}
+
+const std::string& ShaderCache::log(ShaderHandle handle) const
+{
+    static const std::string None;
+    return handle < m_programs.size() ? m_programs[handle].log : None;
+}
+
+/**************************************************************
+ * ShaderCache::prepare()
+ * ---------------------
+ * Preprocesses both stages of a program, refreshing its file
+ * list, and computes their key: both stages, separated so
+ * text cannot move between them, and the driver.
+ *************************************************************/
+bool ShaderCache::prepare(Program& program, std::string sources[2], uint64_t& key)
+{
+    program.files.clear();
+    const std::string* paths[2] = { &program.desc.vertexPath, &program.desc.fragmentPath };
+    for(int s = 0; s < 2; ++s)
+    {
+        if(!preprocess(*paths[s], program.desc.defines, 0, sources[s], program.log, program.files))
+            return false;
+    }
+
+    std::string keyed = sources[0];
+    keyed += '\0';
+    keyed += sources[1];
+    uint64_t hashes[2] = { meshCacheChecksum(keyed.data(), keyed.size()), m_driverHash };
+    key = meshCacheChecksum(hashes, sizeof(hashes));
+    return true;
+}
+
+/**************************************************************
+ * ShaderCache::preprocess()
+ * ------------------------
+ * Appends path to out with its includes expanded in place,
+ * and every file it reads, found or not, to files.
+ * At the top level the defines follow #version, or open the
+ * source when there is none. #line directives keep compiler
+ * messages on the line numbers of the file they came from.
+ *************************************************************/
+bool ShaderCache::preprocess(const std::string& path, const std::vector<std::string>& defines, int depth,
+                             std::string& out, std::string& error, std::vector<std::string>& files) const
+{
+    if(depth > MaxIncludeDepth)
+    {
+        error += path + ": includes nested too deeply\n";
+        return false;
+    }
+    std::string source;
+    files.push_back(m_shaderDirectory + "/" + path);
+    if(!readFile(files.back(), source))
+    {
+        error += path + ": cannot be read\n";
+        return false;
+    }
+
+    bool definesPending = depth == 0;
+    if(definesPending && source.find("#version") == std::string::npos)
+    {
+        for(size_t i = 0; i < defines.size(); ++i)
+            out += "#define " + defines[i] + "\n";
+        out += "#line 1\n";
+        definesPending = false;
+    }
+
+    std::istringstream lines(source);
+    std::string line;
+    for(int number = 1; std::getline(lines, line); ++number)
+    {
+        size_t start = line.find_first_not_of(" \t");
+        if(start != std::string::npos && line.compare(start, 8, "#include") == 0)
+        {
+            size_t open = line.find('"', start + 8);
+            size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            if(close == std::string::npos)
+            {
+                std::ostringstream message;
+                message << path << "(" << number << "): malformed #include\n";
+                error += message.str();
+                return false;
+            }
+            out += "#line 1\n";
+            if(!preprocess(line.substr(open + 1, close - open - 1), defines, depth + 1, out, error, files))
+                return false;
+            std::ostringstream resume;
+            resume << "#line " << number + 1 << "\n";
+            out += resume.str();
+            continue;
+        }
+
+        out += line;
+        out += '\n';
+        if(definesPending && start != std::string::npos && line.compare(start, 8, "#version") == 0)
+        {
+            for(size_t i = 0; i < defines.size(); ++i)
+                out += "#define " + defines[i] + "\n";
+            std::ostringstream resume;
+            resume << "#line " << number + 1 << "\n";
+            out += resume.str();
+            definesPending = false;
+        }
+    }
+    return true;
+}
+
+/**************************************************************
+ * ShaderCache::loadBinary()
+ * ------------------------
+ * Hands the cached binary for the program's key to the
+ * driver. Files written for another key, driver or format
+ * version, truncated or corrupted ones are ignored; the
+ * driver can still refuse the binary, which counts as
+ * rejected.
+ *************************************************************/
+bool ShaderCache::loadBinary(Program& program)
+{
+    std::ifstream file(binaryPath(program.key).c_str(), std::ios::binary);
+    if(!file)
+        return false;
+
+    ShaderBinaryHeader header;
+    if(!file.read((char*)&header, sizeof(header)) || header.magic != ShaderBinaryMagic
+        || header.version != ShaderBinaryVersion || header.driverHash != m_driverHash
+        || header.key != program.key || header.size == 0)
+        return false;
+
+    std::vector<uint8_t> binary(header.size);
+    if(!file.read((char*)&binary[0], header.size)
+        || meshCacheChecksum(&binary[0], binary.size()) != header.checksum)
+        return false;
+
+    glProgramBinary(program.program, (GLenum)header.format, &binary[0], (GLsizei)header.size);
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program.program, GL_LINK_STATUS, &linked);
+    if(linked == GL_TRUE)
+        return true;
+    ++m_stats.binaryRejected;
+    return false;
+}
+
+/**************************************************************
+ * ShaderCache::saveBinary()
+ * ------------------------
+ * Writes the linked program's binary next to a temporary
+ * name and renames it into place, so a concurrent launch
+ * never reads half a file.
+ *************************************************************/
+void ShaderCache::saveBinary(GLuint program, uint64_t key) const
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0)
+        return;
+
+    std::vector<uint8_t> binary((size_t)length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, &binary[0]);
+    if(written <= 0)
+        return;
+
+    ShaderBinaryHeader header;
+    header.magic = ShaderBinaryMagic;
+    header.version = ShaderBinaryVersion;
+    header.format = format;
+    header.size = (uint32_t)written;
+    header.driverHash = m_driverHash;
+    header.key = key;
+    header.checksum = meshCacheChecksum(&binary[0], (size_t)written);
+
+    std::string path = binaryPath(key);
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary.c_str(), std::ios::binary);
+        if(!file)
+            return;
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)&binary[0], written);
+        if(!file)
+            return;
+    }
+    std::remove(path.c_str());
+    std::rename(temporary.c_str(), path.c_str());
+}
+
+/**************************************************************
+ * ShaderCache::compile()
+ * ---------------------
+ * Issues compiles and the link without querying any status,
+ * so nothing waits for the compiler here.
+ *************************************************************/
+void ShaderCache::compile(GLuint program, GLuint shaders[2], const std::string sources[2])
+{
+    for(int s = 0; s < 2; ++s)
+    {
+        const GLchar* text = sources[s].c_str();
+        shaders[s] = glCreateShader(Stages[s]);
+        glShaderSource(shaders[s], 1, &text, NULL);
+        glCompileShader(shaders[s]);
+        glAttachShader(program, shaders[s]);
+    }
+    if(m_binaryCache)
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+}
+
+/**************************************************************
+ * ShaderCache::complete()
+ * ----------------------
+ * Waits for a compiled program's link, keeping the compiler
+ * output on failure and caching the binary on success.
+ *************************************************************/
+void ShaderCache::complete(Program& program)
+{
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program.program, GL_LINK_STATUS, &linked);
+    if(linked == GL_TRUE)
+    {
+        ++m_stats.compiled;
+        program.state = Linked;
+        if(m_binaryCache)
+            saveBinary(program.program, program.key);
+        deleteShaders(program.program, program.shaders);
+        return;
+    }
+
+    ++m_stats.failed;
+    program.state = Failed;
+    for(int s = 0; s < 2; ++s)
+        program.log += shaderLog(program.shaders[s]);
+    program.log += programLog(program.program);
+    deleteShaders(program.program, program.shaders);
+    glDeleteProgram(program.program);
+    program.program = 0;
+}
+
+/**************************************************************
+ * ShaderCache::completeRebuild()
+ * -----------------------------
+ * Replaces a program by its finished rebuild, or drops the
+ * rebuild and keeps the program when it failed.
+ *************************************************************/
+void ShaderCache::completeRebuild(ShaderHandle handle)
+{
+    Program& program = m_programs[handle];
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program.rebuild, GL_LINK_STATUS, &linked);
+    if(linked == GL_TRUE)
+    {
+        ++m_stats.compiled;
+        ++m_stats.reloaded;
+        if(m_binaryCache)
+            saveBinary(program.rebuild, program.rebuildKey);
+        deleteShaders(program.rebuild, program.rebuildShaders);
+        glDeleteProgram(program.program);
+
+        std::unordered_map<uint64_t, ShaderHandle>::iterator old = m_byKey.find(program.key);
+        if(old != m_byKey.end() && old->second == handle)
+            m_byKey.erase(old);
+        m_byKey[program.rebuildKey] = handle;
+        program.key = program.rebuildKey;
+        program.program = program.rebuild;
+        program.log.clear();
+    }
+    else
+    {
+        ++m_stats.failed;
+        for(int s = 0; s < 2; ++s)
+            program.log += shaderLog(program.rebuildShaders[s]);
+        program.log += programLog(program.rebuild);
+        deleteShaders(program.rebuild, program.rebuildShaders);
+        glDeleteProgram(program.rebuild);
+    }
+    program.rebuild = 0;
+}
+
+// Shaders are only needed until the link has finished
+void ShaderCache::deleteShaders(GLuint program, GLuint shaders[2])
+{
+    for(int s = 0; s < 2; ++s)
+    {
+        if(!shaders[s])
+            continue;
+        glDetachShader(program, shaders[s]);
+        glDeleteShader(shaders[s]);
+        shaders[s] = 0;
+    }
+}
+
+void ShaderCache::cancelRebuild(Program& program)
+{
+    if(!program.rebuild)
+        return;
+    deleteShaders(program.rebuild, program.rebuildShaders);
+    glDeleteProgram(program.rebuild);
+    program.rebuild = 0;
+}
+
+std::string ShaderCache::binaryPath(uint64_t key) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+    return m_cacheDirectory + "/" + name;
+}
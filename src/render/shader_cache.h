@@ -0,0 +1,139 @@
+#pragma once
+
+#include "render/gl.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*************************************************************
+ * ShaderCache
+ * -----------
+ * Builds GLSL programs from files in a shader directory and
+ * keeps their linked binaries on disk, so a warm start loads
+ * every program with glProgramBinary and compiles nothing.
+ *
+ * Sources are preprocessed first: #include "file" lines are
+ * expanded from the shader directory and the requested
+ * defines are inserted after #version. The binary is keyed on
+ * a hash of the preprocessed stages and of the driver's
+ * vendor, renderer and version strings, so editing a shader,
+ * an include or a define, or updating the driver, misses the
+ * cache. A binary the driver rejects anyway falls back to
+ * compiling, and the fresh binary replaces it.
+ *
+ * request() only starts the work: compiles and links are
+ * issued without waiting on their status, which with
+ * GL_ARB_parallel_shader_compile lets the driver build every
+ * requested program on its own threads. ready() polls that;
+ * program() waits for one program, finish() for all of them.
+ *
+ *     ShaderProgramDesc desc;
+ *     desc.vertexPath = "lit.vert";
+ *     desc.fragmentPath = "lit.frag";
+ *     desc.defines.push_back("MAX_LIGHTS 32");
+ *     ShaderHandle lit = shaders.request(desc);
+ *     ...
+ *     cache.useProgram(shaders.program(lit));
+ *
+ * Programs failing to build give 0 from program(), with the
+ * compiler output in log().
+ *
+ * For hot reloading, reload() rebuilds only the programs that
+ * read a changed file, itself or through an include, into
+ * new program objects; update() swaps each one in under the
+ * same handle once it has linked, at a frame boundary. A
+ * rebuild that fails keeps the old program and sets log().
+ ************************************************************/
+typedef uint32_t ShaderHandle;
+const ShaderHandle NullShader = ~0u;
+
+const uint32_t ShaderBinaryMagic = 0x4e424753;     // "SGBN"
+const uint32_t ShaderBinaryVersion = 1;
+
+struct ShaderProgramDesc
+{
+    std::string vertexPath;                 // relative to the shader directory
+    std::string fragmentPath;
+    std::vector<std::string> defines;       // "NAME" or "NAME VALUE"
+};
+
+struct ShaderCacheStats
+{
+    uint32_t programs;          // distinct programs requested
+    uint32_t binaryHits;        // loaded from a cached binary
+    uint32_t binaryRejected;    // cached binary refused by the driver
+    uint32_t compiled;          // built from source
+    uint32_t failed;            // missing source, compile or link errors
+    uint32_t reloaded;          // rebuilds swapped in by update()
+};
+
+class ShaderCache
+{
+public:
+    ShaderCache();
+    ~ShaderCache();
+
+    bool init(const std::string& shaderDirectory, const std::string& cacheDirectory);
+    void destroy();
+
+    ShaderHandle request(const ShaderProgramDesc& desc);
+    bool ready(ShaderHandle handle) const;
+    GLuint program(ShaderHandle handle);
+    void finish();
+    size_t reload(const std::string& path);
+    void update();
+
+    const std::string& log(ShaderHandle handle) const;
+    bool binaryCache() const { return m_binaryCache; }
+    bool parallelCompile() const { return m_parallelCompile; }
+    uint64_t driverHash() const { return m_driverHash; }
+    const ShaderCacheStats& stats() const { return m_stats; }
+
+private:
+    enum ProgramState
+    {
+        Building,
+        Linked,
+        Failed
+    };
+
+    struct Program
+    {
+        ShaderProgramDesc desc;
+        std::vector<std::string> files;     // sources and includes read
+        uint64_t key;
+        GLuint program;
+        GLuint shaders[2];
+        ProgramState state;
+        std::string log;
+        uint64_t rebuildKey;
+        GLuint rebuild;                     // replacement being built, 0 if none
+        GLuint rebuildShaders[2];
+    };
+
+    ShaderCache(const ShaderCache&);
+    ShaderCache& operator=(const ShaderCache&);
+
+    bool prepare(Program& program, std::string sources[2], uint64_t& key);
+    bool preprocess(const std::string& path, const std::vector<std::string>& defines, int depth,
+                    std::string& out, std::string& error, std::vector<std::string>& files) const;
+    bool loadBinary(Program& program);
+    void saveBinary(GLuint program, uint64_t key) const;
+    void compile(GLuint program, GLuint shaders[2], const std::string sources[2]);
+    void complete(Program& program);
+    void completeRebuild(ShaderHandle handle);
+    void deleteShaders(GLuint program, GLuint shaders[2]);
+    void cancelRebuild(Program& program);
+    std::string binaryPath(uint64_t key) const;
+
+    std::string m_shaderDirectory;
+    std::string m_cacheDirectory;
+    bool m_binaryCache;
+    bool m_parallelCompile;
+    uint64_t m_driverHash;
+    std::vector<Program> m_programs;
+    std::unordered_map<uint64_t, ShaderHandle> m_byKey;
+    ShaderCacheStats m_stats;
+};
@@ -0,0 +1,264 @@
+#include "render/shader_permutations.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    inline uint32_t fieldMask(uint32_t bits, uint32_t shift)
+    {
+        return (uint32_t)((((uint64_t)1 << bits) - 1) << shift);
+    }
+
+    bool moreUsed(const std::pair<uint64_t, uint32_t>& a, const std::pair<uint64_t, uint32_t>& b)
+    {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    }
+}
+
+ShaderPermutations::ShaderPermutations(ShaderCache& cache, const std::string& vertexPath,
+                                       const std::string& fragmentPath)
+    : m_cache(cache), m_usedBits(0)
+{
+    m_desc.vertexPath = vertexPath;
+    m_desc.fragmentPath = fragmentPath;
+}
+
+/**************************************************************
+ * ShaderPermutations::addDefine()
+ * ------------------------------
+ * Adds a define shared by every permutation.
+ *************************************************************/
+void ShaderPermutations::addDefine(const std::string& define)
+{
+    m_desc.defines.push_back(define);
+}
+
+/**************************************************************
+ * ShaderPermutations::addFlag()
+ * ----------------------------
+ * Returns the flag's bit, or 0 when the mask is full.
+ *************************************************************/
+uint32_t ShaderPermutations::addFlag(const std::string& name)
+{
+    if(m_usedBits + 1 > MaxBits)
+        return 0;
+    Feature flag;
+    flag.name = name;
+    flag.shift = m_usedBits;
+    flag.bits = 1;
+    m_features.push_back(flag);
+    m_usedBits += 1;
+    return 1u << flag.shift;
+}
+
+/**************************************************************
+ * ShaderPermutations::addOption()
+ * ------------------------------
+ * Adds an option taking one of valueCount values and returns
+ * the bits it occupies, or 0 when they do not fit.
+ *************************************************************/
+uint32_t ShaderPermutations::addOption(const std::string& name, const int* values, int valueCount)
+{
+    if(valueCount < 1)
+        return 0;
+    uint32_t bits = 0;
+    while((1 << bits) < valueCount)
+        ++bits;
+    if(m_usedBits + bits > MaxBits)
+        return 0;
+
+    Feature option;
+    option.name = name;
+    option.shift = m_usedBits;
+    option.bits = bits;
+    option.values.assign(values, values + valueCount);
+    m_features.push_back(option);
+    m_usedBits += bits;
+    return fieldMask(bits, option.shift);
+}
+
+// Mask bits selecting value valueIndex of an option
+uint32_t ShaderPermutations::option(const std::string& name, int valueIndex) const
+{
+    const Feature* option = feature(name);
+    if(!option || option->values.empty())
+        return 0;
+    valueIndex = std::max(0, std::min(valueIndex, (int)option->values.size() - 1));
+    return (uint32_t)valueIndex << option->shift;
+}
+
+/**************************************************************
+ * ShaderPermutations::bucket()
+ * ---------------------------
+ * Mask bits selecting the smallest value of an option that is
+ * at least value, or its largest.
+ *************************************************************/
+uint32_t ShaderPermutations::bucket(const std::string& name, int value) const
+{
+    const Feature* option = feature(name);
+    if(!option || option->values.empty())
+        return 0;
+    std::vector<int>::const_iterator found = std::lower_bound(option->values.begin(), option->values.end(), value);
+    int index = (int)(found - option->values.begin());
+    return this->option(name, index);
+}
+
+/**************************************************************
+ * ShaderPermutations::request()
+ * ----------------------------
+ * Starts building the permutation, if not already, without
+ * waiting for it or counting a use.
+ *************************************************************/
+ShaderHandle ShaderPermutations::request(uint32_t mask)
+{
+    return lookup(mask).handle;
+}
+
+GLuint ShaderPermutations::program(uint32_t mask)
+{
+    Permutation& permutation = lookup(mask);
+    ++permutation.uses;
+    return m_cache.program(permutation.handle);
+}
+
+// Masks used so far, most used first
+std::vector<uint32_t> ShaderPermutations::hotMasks() const
+{
+    std::vector<std::pair<uint64_t, uint32_t> > used;
+    for(std::unordered_map<uint32_t, Permutation>::const_iterator it = m_permutations.begin();
+        it != m_permutations.end(); ++it)
+    {
+        if(it->second.uses > 0)
+            used.push_back(std::make_pair(it->second.uses, it->first));
+    }
+    std::sort(used.begin(), used.end(), moreUsed);
+
+    std::vector<uint32_t> masks(used.size());
+    for(size_t i = 0; i < used.size(); ++i)
+        masks[i] = used[i].second;
+    return masks;
+}
+
+/**************************************************************
+ * ShaderPermutations::saveHotList()
+ * --------------------------------
+ * Text file: the feature signature on the first line, then
+ * one hexadecimal mask per line.
+ *************************************************************/
+bool ShaderPermutations::saveHotList(const std::string& path) const
+{
+    std::ofstream file(path.c_str());
+    if(!file)
+        return false;
+    file << signature() << "\n";
+    std::vector<uint32_t> masks = hotMasks();
+    for(size_t i = 0; i < masks.size(); ++i)
+        file << std::hex << masks[i] << "\n";
+    return (bool)file;
+}
+
+bool ShaderPermutations::loadHotList(const std::string& path)
+{
+    std::ifstream file(path.c_str());
+    std::string line;
+    if(!file || !std::getline(file, line) || line != signature())
+        return false;
+
+    m_preload.clear();
+    while(std::getline(file, line))
+    {
+        std::istringstream parse(line);
+        uint32_t mask = 0;
+        if(parse >> std::hex >> mask)
+            m_preload.push_back(validMask(mask));
+    }
+    return true;
+}
+
+/**************************************************************
+ * ShaderPermutations::precompile()
+ * -------------------------------
+ * Requests every permutation of the loaded hot list, so the
+ * driver builds them together; ShaderCache::finish() waits.
+ *************************************************************/
+void ShaderPermutations::precompile()
+{
+    for(size_t i = 0; i < m_preload.size(); ++i)
+        lookup(m_preload[i]);
+}
+
+ShaderPermutations::Permutation& ShaderPermutations::lookup(uint32_t mask)
+{
+    mask = validMask(mask);
+    std::unordered_map<uint32_t, Permutation>::iterator found = m_permutations.find(mask);
+    if(found != m_permutations.end())
+        return found->second;
+
+    ShaderProgramDesc desc = m_desc;
+    for(size_t i = 0; i < m_features.size(); ++i)
+    {
+        const Feature& feature = m_features[i];
+        uint32_t value = (mask & fieldMask(feature.bits, feature.shift)) >> feature.shift;
+        if(feature.values.empty())
+        {
+            if(value)
+                desc.defines.push_back(feature.name);
+        }
+        else
+        {
+            std::ostringstream define;
+            define << feature.name << " " << feature.values[value];
+            desc.defines.push_back(define.str());
+        }
+    }
+
+    Permutation& permutation = m_permutations[mask];
+    permutation.handle = m_cache.request(desc);
+    permutation.uses = 0;
+    return permutation;
+}
+
+const ShaderPermutations::Feature* ShaderPermutations::feature(const std::string& name) const
+{
+    for(size_t i = 0; i < m_features.size(); ++i)
+        if(m_features[i].name == name)
+            return &m_features[i];
+    return NULL;
+}
+
+/**************************************************************
+ * ShaderPermutations::validMask()
+ * ------------------------------
+ * Clears unused bits and clamps option fields to their last
+ * value, so every mask names an existing permutation.
+ *************************************************************/
+uint32_t ShaderPermutations::validMask(uint32_t mask) const
+{
+    uint32_t valid = 0;
+    for(size_t i = 0; i < m_features.size(); ++i)
+    {
+        const Feature& feature = m_features[i];
+        uint32_t value = (mask & fieldMask(feature.bits, feature.shift)) >> feature.shift;
+        if(!feature.values.empty())
+            value = std::min(value, (uint32_t)feature.values.size() - 1);
+        valid |= value << feature.shift;
+    }
+    return valid;
+}
+
+std::string ShaderPermutations::signature() const
+{
+    std::ostringstream text;
+    text << "permutations " << m_desc.vertexPath << " " << m_desc.fragmentPath;
+    for(size_t i = 0; i < m_desc.defines.size(); ++i)
+        text << " [" << m_desc.defines[i] << "]";
+    for(size_t i = 0; i < m_features.size(); ++i)
+    {
+        text << " " << m_features[i].name;
+        for(size_t v = 0; v < m_features[i].values.size(); ++v)
+            text << (v ? "," : "=") << m_features[i].values[v];
+    }
+    return text.str();
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "render/shader_cache.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*************************************************************
+ * ShaderPermutations
+ * ------------------
+ * One shader source specialised at compile time by a feature
+ * mask, instead of branching on uniforms at run time or
+ * keeping a file per variant. Flags are one bit each and
+ * become "#define NAME"; options take a few bits and become
+ * "#define NAME value" for one of a fixed list of values,
+ * such as light count buckets:
+ *
+ *     ShaderPermutations lit(shaders, "lit.vert", "lit.frag");
+ *     uint32_t normalMap = lit.addFlag("NORMAL_MAP");
+ *     uint32_t shadows = lit.addFlag("SHADOWS");
+ *     lit.addOption("LIGHT_COUNT", buckets, 4);   // 1, 4, 16, 64
+ *     ...
+ *     uint32_t mask = normalMap | lit.bucket("LIGHT_COUNT", lightCount);
+ *     cache.useProgram(lit.program(mask));
+ *
+ * Permutations are requested from the ShaderCache the first
+ * time their mask is used, so only variants actually drawn
+ * are built, and come from its binaries on later runs. Every
+ * use is counted; saveHotList() writes the masks used, most
+ * used first, and precompile() requests them all up front on
+ * the next start so none is built mid-frame. A hot list
+ * written for a different feature set is ignored.
+ *
+ * Features are added before the first request; option values
+ * are listed in increasing order for bucket().
+ ************************************************************/
+class ShaderPermutations
+{
+public:
+    enum { MaxBits = 32 };
+
+    ShaderPermutations(ShaderCache& cache, const std::string& vertexPath, const std::string& fragmentPath);
+
+    void addDefine(const std::string& define);
+    uint32_t addFlag(const std::string& name);
+    uint32_t addOption(const std::string& name, const int* values, int valueCount);
+    uint32_t option(const std::string& name, int valueIndex) const;
+    uint32_t bucket(const std::string& name, int value) const;
+
+    ShaderHandle request(uint32_t mask);
+    GLuint program(uint32_t mask);
+    size_t permutationCount() const { return m_permutations.size(); }
+
+    std::vector<uint32_t> hotMasks() const;
+    bool saveHotList(const std::string& path) const;
+    bool loadHotList(const std::string& path);
+    void precompile();
+
+private:
+    struct Feature
+    {
+        std::string name;
+        uint32_t shift;
+        uint32_t bits;
+        std::vector<int> values;    // empty for flags
+    };
+
+    struct Permutation
+    {
+        ShaderHandle handle;
+        uint64_t uses;
+    };
+
+    ShaderPermutations(const ShaderPermutations&);
+    ShaderPermutations& operator=(const ShaderPermutations&);
+
+    Permutation& lookup(uint32_t mask);
+    const Feature* feature(const std::string& name) const;
+    uint32_t validMask(uint32_t mask) const;
+    std::string signature() const;
+
+    ShaderCache& m_cache;
+    ShaderProgramDesc m_desc;
+    std::vector<Feature> m_features;
+    uint32_t m_usedBits;
+    std::unordered_map<uint32_t, Permutation> m_permutations;
+    std::vector<uint32_t> m_preload;
+};
@@ -0,0 +1,58 @@
+#include "render/uniform_ring.h"
+
+#include <cstring>
+
+UniformRing::UniformRing()
+    : m_alignment(256)
+{
+}
+
+/**************************************************************
+ * UniformRing::create()
+ * --------------------
+ * Creates the ring for GL_UNIFORM_BUFFER or GL_SHADER_STORAGE
+ * _BUFFER and reads the offset alignment its ranges need.
+ *************************************************************/
+bool UniformRing::create(GLenum target, size_t segmentSize, int segmentCount)
+{
+    GLenum alignmentQuery = GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT;
+    if(target == GL_SHADER_STORAGE_BUFFER)
+    {
+        if(!GLEW_VERSION_4_3 && !GLEW_ARB_shader_storage_buffer_object)
+            return false;
+        alignmentQuery = GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT;
+    }
+    else if(target != GL_UNIFORM_BUFFER)
+        return false;
+
+    GLint alignment = 0;
+    glGetIntegerv(alignmentQuery, &alignment);
+    m_alignment = alignment > 0 ? (size_t)alignment : 256;
+    return m_ring.create(target, segmentSize, segmentCount);
+}
+
+void UniformRing::bind(GLStateCache& cache, GLuint binding, GLintptr offset, size_t size)
+{
+    if(m_ring.target() == GL_SHADER_STORAGE_BUFFER)
+        cache.bindShaderStorageBufferRange(binding, m_ring.buffer(), offset, (GLsizeiptr)size);
+    else
+        cache.bindUniformBufferRange(binding, m_ring.buffer(), offset, (GLsizeiptr)size);
+}
+
+/**************************************************************
+ * UniformRing::upload()
+ * --------------------
+ * Copies size bytes into this frame's segment and binds them
+ * to binding. Returns false, binding nothing, when the
+ * segment is full.
+ *************************************************************/
+bool UniformRing::upload(GLStateCache& cache, GLuint binding, const void* data, size_t size)
+{
+    GLintptr offset = 0;
+    void* target = allocate(size, offset);
+    if(!target)
+        return false;
+    std::memcpy(target, data, size);
+    bind(cache, binding, offset, size);
+    return true;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "render/gl.h"
+#include "render/gl_state_cache.h"
+#include "render/persistent_ring.h"
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+
+/*************************************************************
+ * UniformRing
+ * -----------
+ * PersistentRingBuffer for uniform or shader storage blocks,
+ * triple buffered by default. Sub-allocations are aligned to
+ * the target's GL_*_BUFFER_OFFSET_ALIGNMENT, queried once at
+ * create(), so any of them can be bound as a block range.
+ * With persistent mapping an upload is a memcpy and a cached
+ * bind; fences on each segment keep the CPU from overwriting
+ * what the GPU still reads.
+ *
+ *     ring.beginFrame();
+ *     ring.upload(cache, CameraBinding, camera);
+ *     LightBlock* lights = (LightBlock*)ring.allocate(lightBlockSize(count), offset);
+ *     ... fill, ring.bind(cache, LightBinding, offset, size) ...
+ *     ring.flush();            // before the first draw
+ *     ... draws ...
+ *     ring.endFrame();
+ *
+ * flush() only matters without ARB_buffer_storage, where the
+ * segment is mapped unsynchronized and has to be unmapped
+ * before drawing. Storage blocks need GL 4.3 or ARB_shader_
+ * storage_buffer_object; create() fails without them.
+ ************************************************************/
+class UniformRing
+{
+public:
+    UniformRing();
+
+    bool create(GLenum target, size_t segmentSize, int segmentCount = 3);
+    void destroy(GLStateCache* cache = NULL) { m_ring.destroy(cache); }
+
+    void beginFrame() { m_ring.beginFrame(); }
+    void* allocate(size_t size, GLintptr& offset) { return m_ring.allocate(size, m_alignment, offset); }
+    void bind(GLStateCache& cache, GLuint binding, GLintptr offset, size_t size);
+    bool upload(GLStateCache& cache, GLuint binding, const void* data, size_t size);
+    template<typename T> bool upload(GLStateCache& cache, GLuint binding, const T& data);
+    void flush() { m_ring.flush(); }
+    void endFrame() { m_ring.endFrame(); }
+
+    GLenum target() const { return m_ring.target(); }
+    GLuint buffer() const { return m_ring.buffer(); }
+    size_t alignment() const { return m_alignment; }
+    const PersistentRingBuffer& ring() const { return m_ring; }
+
+private:
+    PersistentRingBuffer m_ring;
+    size_t m_alignment;
+};
+
+template<typename T>
+bool UniformRing::upload(GLStateCache& cache, GLuint binding, const T& data)
+{
+    return upload(cache, binding, &data, sizeof(T));
+}
+
+/*************************************************************
+ * Uniform Blocks
+ * --------------
+ * Binding points and std140 layouts shared with
+ * shaders/uniform_blocks.glsl; keep the two in step.
+ * MaterialBinding is RenderQueue's, ObjectBinding is free for
+ * per-draw data recorded into command lists. LightBlock is
+ * followed by count entries laid out as SceneLight; as a
+ * uniform block its range must hold MAX_LIGHTS of them, as a
+ * storage block only count.
+ ************************************************************/
+enum UniformBinding
+{
+    CameraBinding = 0,
+    MaterialBinding = 1,
+    LightBinding = 2,
+    ObjectBinding = 3
+};
+
+struct CameraBlock
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::vec4 position;         // w: unused
+    glm::vec4 viewport;         // width, height, 1 / width, 1 / height
+};
+
+struct LightBlock
+{
+    uint32_t count;
+    uint32_t padding[3];
+};
+
+// Bytes for a LightBlock followed by count lights
+inline size_t lightBlockSize(size_t count)
+{
+    return sizeof(LightBlock) + count * 3 * sizeof(glm::vec4);
+}
@@ -0,0 +1,213 @@
+#include "scene/scene.h"
+#include "core/parallel.h"
+
+#include <atomic>
+#include <cmath>
+
+Transform makeTransform(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+{
+    Transform transform;
+    transform.position = position;
+    transform.rotation = rotation;
+    transform.scale = scale;
+    transform.parent = NullEntity;
+    transform.world = glm::mat4(1.0f);
+    return transform;
+}
+
+Scene::Scene()
+    : m_entityCount(0)
+{
+}
+
+/**************************************************************
+ * Scene::create()
+ * --------------
+ * Returns a new entity with no components, reusing the most
+ * recently freed slot under its next generation.
+ *************************************************************/
+Entity Scene::create()
+{
+    uint32_t index;
+    if(!m_freeList.empty())
+    {
+        index = m_freeList.back();
+        m_freeList.pop_back();
+    }
+    else
+    {
+        index = (uint32_t)m_generations.size();
+        m_generations.push_back(0);
+    }
+    ++m_entityCount;
+    return index | ((Entity)m_generations[index] << 24);
+}
+
+/**************************************************************
+ * Scene::destroy()
+ * ---------------
+ * Removes every component of entity and frees its slot.
+ * Stale handles are ignored.
+ *************************************************************/
+void Scene::destroy(Entity entity)
+{
+    if(!alive(entity))
+        return;
+
+    m_transforms.remove(entity);
+    m_lights.remove(entity);
+    m_meshes.remove(entity);
+    m_materials.remove(entity);
+
+    uint32_t index = entityIndex(entity);
+    ++m_generations[index];
+    m_freeList.push_back(index);
+    --m_entityCount;
+}
+
+bool Scene::alive(Entity entity) const
+{
+    uint32_t index = entityIndex(entity);
+    return index < m_generations.size() && m_generations[index] == entityGeneration(entity);
+}
+
+void Scene::clear()
+{
+    m_generations.clear();
+    m_freeList.clear();
+    m_entityCount = 0;
+    m_transforms.clear();
+    m_lights.clear();
+    m_meshes.clear();
+    m_materials.clear();
+    m_hierarchy.invalidate();
+}
+
+/**************************************************************
+ * Scene::setParent()
+ * -----------------
+ * Attaches child's transform under parent's, or makes it a
+ * root for NullEntity. The local transform is kept, so the
+ * child moves with its new parent. Fails if either lacks a
+ * transform or parent is child or one of its descendants.
+ *************************************************************/
+bool Scene::setParent(Entity child, Entity parent)
+{
+    if(!m_transforms.has(child) || (parent != NullEntity && !m_transforms.has(parent)))
+        return false;
+    for(Entity ancestor = parent; ancestor != NullEntity && m_transforms.has(ancestor);
+        ancestor = m_transforms.get(ancestor).parent)
+    {
+        if(ancestor == child)
+            return false;
+    }
+
+    m_transforms.modify(child).parent = parent;
+    m_hierarchy.invalidate();
+    return true;
+}
+
+void Scene::clearChanged()
+{
+    m_transforms.clearChanged();
+    m_lights.clearChanged();
+    m_meshes.clearChanged();
+    m_materials.clearChanged();
+}
+
+/**************************************************************
+ * updateWorldTransforms()
+ * ----------------------
+ * Recomputes the world matrices of changed transforms and
+ * their descendants. The changed bits are left set for the
+ * systems that follow.
+ *************************************************************/
+void updateWorldTransforms(Scene& scene, unsigned threadCount)
+{
+    scene.hierarchy().update(scene.transforms(), threadCount);
+}
+
+/**************************************************************
+ * updateCullingVolumes()
+ * ---------------------
+ * Transforms the local bounds of every mesh instance whose
+ * mesh or transform changed into a world box (the transformed
+ * centre, extents through the absolute matrix) and the sphere
+ * around that box. Instances without a transform stay in
+ * local space. Returns the number of volumes written.
+ *************************************************************/
+size_t updateCullingVolumes(const Scene& scene, CullingVolumes& volumes, unsigned threadCount)
+{
+    const ComponentArray<MeshInstance>& meshes = scene.meshes();
+    const ComponentArray<Transform>& transforms = scene.transforms();
+
+    bool rebuild = volumes.size() != meshes.size();
+    if(rebuild)
+    {
+        volumes.clear();
+        volumes.reserve(meshes.size());
+        for(size_t i = 0; i < meshes.size(); ++i)
+            volumes.add(glm::vec3(0.0f), 0.0f, glm::vec3(0.0f), glm::vec3(0.0f));
+    }
+
+    std::atomic<size_t> updated(0);
+    parallelFor(0, meshes.size(), ComponentArray<MeshInstance>::ParallelGrain, threadCount,
+                [&](size_t begin, size_t end)
+    {
+        size_t count = 0;
+        for(size_t i = begin; i < end; ++i)
+        {
+            uint32_t transform = transforms.slot(meshes.entity(i));
+            bool moved = transform != ComponentArray<Transform>::NullSlot && transforms.changed(transform);
+            if(!rebuild && !meshes.changed(i) && !moved)
+                continue;
+
+            const MeshInstance& mesh = meshes.data()[i];
+            glm::vec3 center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+            glm::vec3 extent = (mesh.boundsMax - mesh.boundsMin) * 0.5f;
+            if(transform != ComponentArray<Transform>::NullSlot)
+            {
+                const glm::mat4& world = transforms.data()[transform].world;
+                center = glm::vec3(world * glm::vec4(center, 1.0f));
+                extent = glm::abs(glm::vec3(world[0])) * extent.x + glm::abs(glm::vec3(world[1])) * extent.y
+                       + glm::abs(glm::vec3(world[2])) * extent.z;
+            }
+            volumes.setSphere((uint32_t)i, center, glm::length(extent));
+            volumes.setBox((uint32_t)i, center - extent, center + extent);
+            ++count;
+        }
+        updated += count;
+    });
+    return updated;
+}
+
+/**************************************************************
+ * gatherLights()
+ * -------------
+ * Replaces lights with one entry per light component. Lights
+ * without a transform sit at the origin facing -Z.
+ *************************************************************/
+void gatherLights(const Scene& scene, std::vector<SceneLight>& lights)
+{
+    const ComponentArray<Light>& source = scene.lights();
+    const ComponentArray<Transform>& transforms = scene.transforms();
+
+    lights.resize(source.size());
+    for(size_t i = 0; i < source.size(); ++i)
+    {
+        const Light& light = source.data()[i];
+        glm::vec3 position(0.0f), direction(0.0f, 0.0f, -1.0f);
+        uint32_t transform = transforms.slot(source.entity(i));
+        if(transform != ComponentArray<Transform>::NullSlot)
+        {
+            const glm::mat4& world = transforms.data()[transform].world;
+            position = glm::vec3(world[3]);
+            direction = -glm::normalize(glm::vec3(world[2]));
+        }
+
+        SceneLight& packed = lights[i];
+        packed.position = glm::vec4(position, std::max(light.range, 0.0f));
+        packed.direction = glm::vec4(direction, std::cos(light.spotAngle));
+        packed.color = glm::vec4(light.color * light.intensity, (float)light.type);
+    }
+}
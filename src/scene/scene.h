@@ -0,0 +1,329 @@
+#pragma once
+
+#include "culling/frustum_culling.h"
+#include "scene/transform_hierarchy.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/*************************************************************
+ * Entity
+ * ------
+ * An index into the scene's entity slots in the low 24 bits
+ * and that slot's generation in the high 8, so a handle kept
+ * after destroy() stops matching once the slot is reused.
+ ************************************************************/
+typedef uint32_t Entity;
+
+const Entity NullEntity = 0xffffffffu;
+
+inline uint32_t entityIndex(Entity entity) { return entity & 0xffffffu; }
+inline uint32_t entityGeneration(Entity entity) { return entity >> 24; }
+
+/*************************************************************
+ * ComponentArray
+ * --------------
+ * Sparse set holding one component type: the components and
+ * their entities are packed in dense arrays (slots) that
+ * systems stream through, and a sparse array indexed by
+ * entity index maps back to the slot. Removal moves the last
+ * component into the hole, so slots are not stable across
+ * add() and remove().
+ *
+ * Each slot has a changed bit, set by add(), modify() and
+ * markChanged() and cleared by clearChanged(), usually once
+ * per frame after every system has run. Bits are packed 64
+ * to a word, so parallel systems must split the slots into
+ * chunks of a multiple of 64 (see ParallelGrain) to never
+ * share a word between threads. layoutVersion() changes
+ * whenever slots are added, removed or moved, for systems
+ * that cache slot indices.
+ ************************************************************/
+template<typename T>
+class ComponentArray
+{
+public:
+    enum
+    {
+        NullSlot = 0xffffffffu,
+        ParallelGrain = 1024
+    };
+
+    ComponentArray() : m_layoutVersion(0) {}
+
+    T& add(Entity entity, const T& component);
+    void remove(Entity entity);
+    void clear();
+
+    uint32_t slot(Entity entity) const;
+    bool has(Entity entity) const { return slot(entity) != NullSlot; }
+    const T& get(Entity entity) const { return m_components[slot(entity)]; }
+    T& modify(Entity entity);
+
+    size_t size() const { return m_components.size(); }
+    T* data() { return m_components.empty() ? 0 : &m_components[0]; }
+    const T* data() const { return m_components.empty() ? 0 : &m_components[0]; }
+    Entity entity(size_t slot) const { return m_entities[slot]; }
+
+    void markChanged(size_t slot) { m_changed[slot >> 6] |= uint64_t(1) << (slot & 63); }
+    bool changed(size_t slot) const { return (m_changed[slot >> 6] >> (slot & 63)) & 1; }
+    bool anyChanged() const;
+    void clearChanged();
+    uint32_t layoutVersion() const { return m_layoutVersion; }
+
+private:
+    void clearBit(size_t slot) { m_changed[slot >> 6] &= ~(uint64_t(1) << (slot & 63)); }
+
+    std::vector<T> m_components;
+    std::vector<Entity> m_entities;
+    std::vector<uint32_t> m_sparse;
+    std::vector<uint64_t> m_changed;
+    uint32_t m_layoutVersion;
+};
+
+/*************************************************************
+ * Components
+ * ----------
+ * Transform holds the position, rotation and scale relative
+ * to its parent (set with Scene::setParent(), NullEntity for
+ * roots) and the world matrix computed from them by
+ * updateWorldTransforms(); it is changed when either moved.
+ * MeshInstance refers to a mesh by the caller's dense id and
+ * keeps its local bounds for culling. Material holds the ids
+ * that go into the render queue's sort key. Lights shine
+ * along the entity's -Z axis; a range of zero or less means
+ * unbounded, spotAngle is the cone's half angle in radians.
+ ************************************************************/
+struct Transform
+{
+    glm::vec3 position;
+    glm::quat rotation;
+    glm::vec3 scale;
+    Entity parent;
+    glm::mat4 world;
+};
+
+struct Light
+{
+    enum Type
+    {
+        Directional,
+        Point,
+        Spot
+    };
+
+    Type type;
+    glm::vec3 color;
+    float intensity;
+    float range;
+    float spotAngle;
+};
+
+struct MeshInstance
+{
+    uint32_t mesh;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+};
+
+struct Material
+{
+    uint32_t pass;
+    uint32_t shader;
+    uint32_t material;
+    uint32_t texture;
+};
+
+Transform makeTransform(const glm::vec3& position, const glm::quat& rotation = glm::quat(),
+                        const glm::vec3& scale = glm::vec3(1.0f));
+
+/*************************************************************
+ * Scene
+ * -----
+ * Entity allocator and the component arrays. An entity is
+ * just an id; it has whichever components were added for it,
+ * and destroy() removes them all. Children of a destroyed
+ * entity become roots, keeping their local transform.
+ ************************************************************/
+class Scene
+{
+public:
+    Scene();
+
+    Entity create();
+    void destroy(Entity entity);
+    bool alive(Entity entity) const;
+    size_t entityCount() const { return m_entityCount; }
+    void clear();
+    void clearChanged();
+    bool setParent(Entity child, Entity parent);
+
+    ComponentArray<Transform>& transforms() { return m_transforms; }
+    const ComponentArray<Transform>& transforms() const { return m_transforms; }
+    ComponentArray<Light>& lights() { return m_lights; }
+    const ComponentArray<Light>& lights() const { return m_lights; }
+    ComponentArray<MeshInstance>& meshes() { return m_meshes; }
+    const ComponentArray<MeshInstance>& meshes() const { return m_meshes; }
+    ComponentArray<Material>& materials() { return m_materials; }
+    const ComponentArray<Material>& materials() const { return m_materials; }
+    TransformHierarchy& hierarchy() { return m_hierarchy; }
+
+private:
+    std::vector<uint8_t> m_generations;
+    std::vector<uint32_t> m_freeList;
+    size_t m_entityCount;
+
+    ComponentArray<Transform> m_transforms;
+    ComponentArray<Light> m_lights;
+    ComponentArray<MeshInstance> m_meshes;
+    ComponentArray<Material> m_materials;
+    TransformHierarchy m_hierarchy;
+};
+
+/*************************************************************
+ * Scene Systems
+ * -------------
+ * Per-frame passes over the component arrays, run in order
+ * before clearChanged():
+ *
+ * updateWorldTransforms() recomputes the world matrix of
+ * every changed transform and its descendants, marking the
+ * descendants changed too (see TransformHierarchy).
+ *
+ * updateCullingVolumes() keeps one culling volume per mesh
+ * instance, at the same index as its slot, refreshing those
+ * whose mesh or transform changed. The volumes are rebuilt
+ * when the mesh count changes. Visible indices returned by
+ * cullFrustum() map back through meshes().entity().
+ *
+ * gatherLights() packs every light, in world space, into an
+ * array laid out for a std140 uniform or storage buffer.
+ ************************************************************/
+struct SceneLight
+{
+    glm::vec4 position;         // w: range, 0 for unbounded
+    glm::vec4 direction;        // w: cosine of the spot angle
+    glm::vec4 color;            // color times intensity, w: Light::Type
+};
+
+void updateWorldTransforms(Scene& scene, unsigned threadCount);
+size_t updateCullingVolumes(const Scene& scene, CullingVolumes& volumes, unsigned threadCount);
+void gatherLights(const Scene& scene, std::vector<SceneLight>& lights);
+
+/**************************************************************
+ * ComponentArray::add()
+ * --------------------
+ * Adds a component for entity, or overwrites the one it has.
+ *************************************************************/
+template<typename T>
+T& ComponentArray<T>::add(Entity entity, const T& component)
+{
+    uint32_t existing = slot(entity);
+    if(existing != NullSlot)
+    {
+        markChanged(existing);
+        return m_components[existing] = component;
+    }
+
+    uint32_t index = entityIndex(entity);
+    if(index >= m_sparse.size())
+        m_sparse.resize(index + 1, NullSlot);
+    size_t added = m_components.size();
+    m_sparse[index] = (uint32_t)added;
+    ++m_layoutVersion;
+    m_components.push_back(component);
+    m_entities.push_back(entity);
+    if(added / 64 >= m_changed.size())
+        m_changed.push_back(0);
+    markChanged(added);
+    return m_components.back();
+}
+
+/**************************************************************
+ * ComponentArray::remove()
+ * -----------------------
+ * Fills the removed slot with the last component, marking it
+ * changed since its slot moved. Does nothing if the entity
+ * has no component.
+ *************************************************************/
+template<typename T>
+void ComponentArray<T>::remove(Entity entity)
+{
+    uint32_t removed = slot(entity);
+    if(removed == NullSlot)
+        return;
+
+    size_t last = m_components.size() - 1;
+    if(removed != last)
+    {
+        m_components[removed] = m_components[last];
+        m_entities[removed] = m_entities[last];
+        m_sparse[entityIndex(m_entities[removed])] = removed;
+        markChanged(removed);
+    }
+    clearBit(last);
+    m_components.pop_back();
+    m_entities.pop_back();
+    m_sparse[entityIndex(entity)] = NullSlot;
+    ++m_layoutVersion;
+}
+
+template<typename T>
+void ComponentArray<T>::clear()
+{
+    m_components.clear();
+    m_entities.clear();
+    m_sparse.clear();
+    m_changed.clear();
+    ++m_layoutVersion;
+}
+
+/**************************************************************
+ * ComponentArray::slot()
+ * ---------------------
+ * Slot of entity's component, or NullSlot if it has none or
+ * the handle is stale.
+ *************************************************************/
+template<typename T>
+uint32_t ComponentArray<T>::slot(Entity entity) const
+{
+    uint32_t index = entityIndex(entity);
+    if(index >= m_sparse.size())
+        return NullSlot;
+    uint32_t found = m_sparse[index];
+    return found != NullSlot && m_entities[found] == entity ? found : (uint32_t)NullSlot;
+}
+
+/**************************************************************
+ * ComponentArray::modify()
+ * -----------------------
+ * Mutable access to entity's component, marking it changed.
+ * The entity must have the component.
+ *************************************************************/
+template<typename T>
+T& ComponentArray<T>::modify(Entity entity)
+{
+    uint32_t found = slot(entity);
+    markChanged(found);
+    return m_components[found];
+}
+
+template<typename T>
+bool ComponentArray<T>::anyChanged() const
+{
+    for(size_t i = 0; i < m_changed.size(); ++i)
+    {
+        if(m_changed[i])
+            return true;
+    }
+    return false;
+}
+
+template<typename T>
+void ComponentArray<T>::clearChanged()
+{
+    std::fill(m_changed.begin(), m_changed.end(), 0);
+}
@@ -0,0 +1,162 @@
+#include "scene/transform_hierarchy.h"
+#include "scene/scene.h"
+#include "core/parallel.h"
+#include "core/simd.h"
+
+#include <atomic>
+
+namespace
+{
+// Nodes per parallel chunk within a level
+    const size_t LevelGrain = 256;
+
+    const uint32_t NullSlot = ComponentArray<Transform>::NullSlot;
+
+    inline glm::mat4 localMatrix(const Transform& transform)
+    {
+        glm::mat3 rotation = glm::mat3_cast(transform.rotation);
+        return glm::mat4(glm::vec4(rotation[0] * transform.scale.x, 0.0f),
+                         glm::vec4(rotation[1] * transform.scale.y, 0.0f),
+                         glm::vec4(rotation[2] * transform.scale.z, 0.0f),
+                         glm::vec4(transform.position, 1.0f));
+    }
+}
+
+TransformHierarchy::TransformHierarchy()
+    : m_layoutVersion(0), m_updated(0), m_valid(false)
+{
+}
+
+/**************************************************************
+ * TransformHierarchy::rebuild()
+ * ----------------------------
+ * Resolves every parent link to a slot, finds each node's
+ * depth and counting-sorts the slots by it. Nodes whose
+ * parent lost its transform become roots and are marked
+ * changed so their world matrix is recomputed.
+ *************************************************************/
+void TransformHierarchy::rebuild(ComponentArray<Transform>& transforms)
+{
+    size_t count = transforms.size();
+    Transform* data = transforms.data();
+    std::vector<uint32_t> parents(count);
+    for(size_t i = 0; i < count; ++i)
+    {
+        parents[i] = NullSlot;
+        if(data[i].parent == NullEntity)
+            continue;
+        parents[i] = transforms.slot(data[i].parent);
+        if(parents[i] == NullSlot)
+        {
+            data[i].parent = NullEntity;
+            transforms.markChanged(i);
+        }
+    }
+
+// Walk up to the first node of known depth, then assign depths
+// back down the path. Reaching a node already on the path can
+// only be a cycle made by editing parent directly; the link
+// into it is cut, so the path holds each node once
+    const uint32_t Unknown = 0xffffffffu;
+    std::vector<uint32_t> depths(count, Unknown);
+    std::vector<uint32_t> walked(count, Unknown);
+    std::vector<uint32_t> path;
+    uint32_t maxDepth = 0;
+    for(size_t i = 0; i < count; ++i)
+    {
+        path.clear();
+        uint32_t node = (uint32_t)i;
+        while(node != NullSlot && depths[node] == Unknown)
+        {
+            if(walked[node] == i)
+            {
+                parents[path.back()] = NullSlot;
+                node = NullSlot;
+                break;
+            }
+            walked[node] = (uint32_t)i;
+            path.push_back(node);
+            node = parents[node];
+        }
+        uint32_t depth = node == NullSlot ? 0 : depths[node] + 1;
+        for(size_t k = path.size(); k-- > 0; ++depth)
+            depths[path[k]] = depth;
+        if(!path.empty())
+            maxDepth = std::max(maxDepth, depths[path[0]]);
+    }
+
+    m_levels.assign(count ? maxDepth + 2 : 1, 0);
+    for(size_t i = 0; i < count; ++i)
+        ++m_levels[depths[i] + 1];
+    for(size_t level = 1; level < m_levels.size(); ++level)
+        m_levels[level] += m_levels[level - 1];
+
+    std::vector<size_t> next(m_levels.begin(), m_levels.end() - 1);
+    m_order.resize(count);
+    m_parents.resize(count);
+    for(size_t i = 0; i < count; ++i)
+    {
+        size_t position = next[depths[i]]++;
+        m_order[position] = (uint32_t)i;
+        m_parents[position] = parents[i];
+    }
+
+    m_dirty.assign(count, 0);
+    m_layoutVersion = transforms.layoutVersion();
+    m_valid = true;
+}
+
+/**************************************************************
+ * TransformHierarchy::update()
+ * ---------------------------
+ * Propagates changed transforms down the hierarchy, level by
+ * level, then marks the descendants reached changed in chunks
+ * aligned to the changed-bit words.
+ *************************************************************/
+void TransformHierarchy::update(ComponentArray<Transform>& transforms, unsigned threadCount)
+{
+    if(!m_valid || m_layoutVersion != transforms.layoutVersion())
+        rebuild(transforms);
+    m_updated = 0;
+    if(!transforms.anyChanged())
+        return;
+
+    Transform* data = transforms.data();
+    std::atomic<size_t> updated(0);
+    for(size_t level = 0; level + 1 < m_levels.size(); ++level)
+    {
+        parallelFor(m_levels[level], m_levels[level + 1], LevelGrain, threadCount, [&](size_t begin, size_t end)
+        {
+            size_t count = 0;
+            for(size_t i = begin; i < end; ++i)
+            {
+                uint32_t slot = m_order[i];
+                uint32_t parent = m_parents[i];
+                bool dirty = transforms.changed(slot) || (parent != NullSlot && m_dirty[parent]);
+                m_dirty[slot] = dirty;
+                if(!dirty)
+                    continue;
+
+                Transform& transform = data[slot];
+                glm::mat4 local = localMatrix(transform);
+                if(parent == NullSlot)
+                    transform.world = local;
+                else
+                    simdMultiplyMat4(&data[parent].world[0][0], &local[0][0], &transform.world[0][0]);
+                ++count;
+            }
+            updated += count;
+        });
+    }
+
+    parallelFor(0, transforms.size(), ComponentArray<Transform>::ParallelGrain, threadCount,
+                [&](size_t begin, size_t end)
+    {
+        for(size_t slot = begin; slot < end; ++slot)
+        {
+            if(m_dirty[slot] && !transforms.changed(slot))
+                transforms.markChanged(slot);
+        }
+    });
+    m_updated = updated;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+template<typename T>
+class ComponentArray;
+struct Transform;
+
+/*************************************************************
+ * TransformHierarchy
+ * ------------------
+ * World matrix propagation for the scene's transforms. The
+ * parent links are flattened into an array of transform slots
+ * sorted by depth, roots first, with each node's parent slot
+ * alongside, and rebuilt only when transforms are added,
+ * removed or reparented.
+ *
+ * update() walks the levels in order; a node is dirty when
+ * its own transform changed or its parent was dirty, and only
+ * dirty nodes recompute world = parent world * local. Each
+ * level is split across threads, and a level only starts
+ * once the one above has finished. Dirty descendants get
+ * their changed bit set, so later systems see every world
+ * matrix that moved. With no changed transform at all an
+ * update is a scan of the changed bits.
+ ************************************************************/
+class TransformHierarchy
+{
+public:
+    TransformHierarchy();
+
+    void invalidate() { m_valid = false; }
+    void update(ComponentArray<Transform>& transforms, unsigned threadCount);
+
+    size_t levelCount() const { return m_levels.empty() ? 0 : m_levels.size() - 1; }
+    size_t updatedCount() const { return m_updated; }
+
+private:
+    void rebuild(ComponentArray<Transform>& transforms);
+
+    std::vector<uint32_t> m_order;      // transform slots by depth
+    std::vector<uint32_t> m_parents;    // parent slot of each m_order entry
+    std::vector<size_t> m_levels;       // first m_order entry of each level, then the end
+    std::vector<uint8_t> m_dirty;       // per slot, written every update
+    uint32_t m_layoutVersion;
+    size_t m_updated;
+    bool m_valid;
+};
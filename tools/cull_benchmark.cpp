@@ -0,0 +1,370 @@
+#include "core/parallel.h"
+#include "culling/dynamic_bvh.h"
+#include "culling/frustum_culling.h"
+#include "culling/occlusion_buffer.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/intersect.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+/*************************************************************
+ * cull_benchmark
+ * --------------
+ * Scatters objects through a cube around a camera and times
+ * frustum culling them: the scalar per-object test from
+ * culling/frustum.h, the SIMD kernel on one thread, and the
+ * SIMD kernel on every thread. The SIMD results are checked
+ * against the scalar ones before any timing is printed.
+ * With --bvh the same objects also go into a DynamicBVH, to
+ * compare hierarchical culling and time moves and queries.
+ * --occlusion N places N wall occluders in front of the
+ * camera and times occlusion culling of the objects that
+ * survive the frustum.
+ ************************************************************/
+void printUsage();
+void fillVolumes(size_t count, float extent, CullingVolumes& volumes);
+size_t cullScalar(const Frustum& frustum, const CullingVolumes& volumes, std::vector<uint32_t>& visible);
+int runBvhBenchmark(const CullingVolumes& volumes, const Frustum& frustum, float extent, int repeats);
+int runOcclusionBenchmark(const CullingVolumes& volumes, const glm::mat4& viewProjection, const glm::vec3& forward,
+                          int walls, unsigned threads, int repeats);
+template<typename Body> double bestMilliseconds(int repeats, Body body);
+
+/**************************************************************
+ * main()
+ * -----
+ * Parses the command line and runs the benchmark.
+ *************************************************************/
+int main(int argc, const char * argv[])
+{
+    size_t count = 1000000;
+    unsigned threads = hardwareThreadCount();
+    int repeats = 50;
+    FrustumCullMode mode = CullSphere;
+    bool bvh = false;
+    int walls = 0;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        int remaining = argc - i - 1;
+        if(arg == "--objects" && remaining >= 1)
+            count = (size_t)std::atol(argv[++i]);
+        else if(arg == "--threads" && remaining >= 1)
+            threads = (unsigned)std::max(1, std::atoi(argv[++i]));
+        else if(arg == "--repeat" && remaining >= 1)
+            repeats = std::max(1, std::atoi(argv[++i]));
+        else if(arg == "--boxes")
+            mode = CullBox;
+        else if(arg == "--both")
+            mode = CullSphereAndBox;
+        else if(arg == "--bvh")
+            bvh = true;
+        else if(arg == "--occlusion" && remaining >= 1)
+            walls = std::max(1, std::atoi(argv[++i]));
+        else
+        {
+            std::cerr << "Unknown or incomplete option " << arg << std::endl;
+            printUsage();
+            return 1;
+        }
+    }
+
+    const float extent = 1000.0f;
+    CullingVolumes volumes;
+    fillVolumes(count, extent, volumes);
+
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, extent);
+    glm::vec3 forward = glm::normalize(glm::vec3(1.0f, 0.2f, 0.5f));
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), forward, glm::vec3(0.0f, 1.0f, 0.0f));
+    Frustum frustum = makeFrustum(projection * view);
+
+    std::vector<uint32_t> reference, single, parallel;
+    if(mode == CullSphere)
+    {
+        cullScalar(frustum, volumes, reference);
+        cullFrustum(frustum, volumes, mode, single);
+        cullFrustumParallel(frustum, volumes, mode, threads, parallel);
+        if(single != reference || parallel != reference)
+        {
+            std::cerr << "SIMD result differs from the scalar test (" << single.size() << " / " << parallel.size()
+                      << " vs " << reference.size() << " visible)" << std::endl;
+            return 1;
+        }
+    }
+
+    double scalarMs = bestMilliseconds(repeats, [&]() { cullScalar(frustum, volumes, reference); });
+    double singleMs = bestMilliseconds(repeats, [&]() { cullFrustum(frustum, volumes, mode, single); });
+    double parallelMs = bestMilliseconds(repeats, [&]()
+    {
+        cullFrustumParallel(frustum, volumes, mode, threads, parallel);
+    });
+
+    std::printf("%zu objects, %zu visible, %u-wide SIMD, best of %d\n", count, single.size(),
+                frustumCullWidth(), repeats);
+    std::printf("scalar spheres       %8.3f ms\n", scalarMs);
+    std::printf("SIMD, 1 thread       %8.3f ms  %5.1fx\n", singleMs, scalarMs / singleMs);
+    std::printf("SIMD, %2u threads     %8.3f ms  %5.1fx  %6.0f M objects/s\n", threads, parallelMs,
+                scalarMs / parallelMs, count / parallelMs / 1000.0);
+    if(bvh && runBvhBenchmark(volumes, frustum, extent, repeats) != 0)
+        return 1;
+    if(walls && runOcclusionBenchmark(volumes, projection * view, forward, walls, threads, repeats) != 0)
+        return 1;
+    return 0;
+}
+
+/**************************************************************
+ * printUsage()
+ * -----------
+ * Prints the command line options.
+ *************************************************************/
+void printUsage()
+{
+    std::cerr << "usage: cull_benchmark [options]\n"
+                 "  --objects N            objects to cull (1000000)\n"
+                 "  --threads N            threads for the parallel run (all)\n"
+                 "  --repeat N             runs per measurement, best is reported (50)\n"
+                 "  --boxes                cull boxes instead of spheres\n"
+                 "  --both                 cull spheres and boxes\n"
+                 "  --bvh                  also time a DynamicBVH over the same objects\n"
+                 "  --occlusion N          also time occlusion culling behind N walls" << std::endl;
+}
+
+/**************************************************************
+ * fillVolumes()
+ * ------------
+ * Random boxes of 0.5 to 5 units, with their bounding
+ * spheres, spread uniformly through [-extent, extent]^3.
+ *************************************************************/
+void fillVolumes(size_t count, float extent, CullingVolumes& volumes)
+{
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(-extent, extent);
+    std::uniform_real_distribution<float> size(0.25f, 2.5f);
+
+    volumes.clear();
+    volumes.reserve(count);
+    for(size_t i = 0; i < count; ++i)
+    {
+        glm::vec3 center(position(random), position(random), position(random));
+        glm::vec3 halfExtent(size(random), size(random), size(random));
+        volumes.add(center, glm::length(halfExtent), center - halfExtent, center + halfExtent);
+    }
+}
+
+/**************************************************************
+ * cullScalar()
+ * -----------
+ * The baseline: frustumIntersectsSphere() on each object.
+ *************************************************************/
+size_t cullScalar(const Frustum& frustum, const CullingVolumes& volumes, std::vector<uint32_t>& visible)
+{
+    visible.clear();
+    for(size_t i = 0; i < volumes.size(); ++i)
+    {
+        glm::vec3 center(volumes.sphereX[i], volumes.sphereY[i], volumes.sphereZ[i]);
+        if(frustumIntersectsSphere(frustum, center, volumes.radius[i]))
+            visible.push_back((uint32_t)i);
+    }
+    return visible.size();
+}
+
+/**************************************************************
+ * bestMilliseconds()
+ * -----------------
+ * Fastest of repeats runs of body, which filters out the
+ * runs that were interrupted.
+ *************************************************************/
+template<typename Body> double bestMilliseconds(int repeats, Body body)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    double best = 1e30;
+    for(int r = 0; r < repeats; ++r)
+    {
+        Clock::time_point start = Clock::now();
+        body();
+        best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+    return best;
+}
+
+/**************************************************************
+ * runBvhBenchmark()
+ * ----------------
+ * Builds a DynamicBVH over the boxes and times a frustum
+ * query (checked to return every box the flat cull keeps),
+ * moving a tenth of the objects and committing, closest-hit
+ * rays against the spheres and small sphere queries.
+ *************************************************************/
+int runBvhBenchmark(const CullingVolumes& volumes, const Frustum& frustum, float extent, int repeats)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    size_t count = volumes.size();
+    std::vector<glm::vec3> centers(count), extents(count);
+    for(size_t i = 0; i < count; ++i)
+    {
+        centers[i] = glm::vec3(volumes.boxX[i], volumes.boxY[i], volumes.boxZ[i]);
+        extents[i] = glm::vec3(volumes.extentX[i], volumes.extentY[i], volumes.extentZ[i]);
+    }
+
+    DynamicBVH tree(0.5f);
+    std::vector<uint32_t> proxies(count);
+    Clock::time_point start = Clock::now();
+    for(size_t i = 0; i < count; ++i)
+        proxies[i] = tree.insert(centers[i] - extents[i], centers[i] + extents[i], (uint32_t)i);
+    double buildMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    std::vector<uint32_t> flat, hierarchical;
+    cullFrustum(frustum, volumes, CullBox, flat);
+    tree.queryFrustum(frustum, hierarchical);
+    std::vector<char> found(count, 0);
+    for(size_t i = 0; i < hierarchical.size(); ++i)
+        found[hierarchical[i]] = 1;
+    for(size_t i = 0; i < flat.size(); ++i)
+    {
+        if(!found[flat[i]])
+        {
+            std::cerr << "BVH frustum query missed object " << flat[i] << std::endl;
+            return 1;
+        }
+    }
+
+    double flatMs = bestMilliseconds(repeats, [&]() { cullFrustum(frustum, volumes, CullBox, flat); });
+    double treeMs = bestMilliseconds(repeats, [&]()
+    {
+        hierarchical.clear();
+        tree.queryFrustum(frustum, hierarchical);
+    });
+    size_t treeVisible = hierarchical.size();
+
+    std::mt19937 random(99);
+    std::uniform_real_distribution<float> step(-2.0f, 2.0f);
+    float areaBefore = tree.areaRatio();
+    size_t moved = 0;
+    start = Clock::now();
+    for(size_t i = 0; i < count; i += 10)
+    {
+        centers[i] += glm::vec3(step(random), step(random), step(random));
+        moved += tree.move(proxies[i], centers[i] - extents[i], centers[i] + extents[i]);
+    }
+    tree.commit();
+    double moveMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    const size_t RayCount = 10000;
+    std::uniform_real_distribution<float> position(-extent, extent);
+    size_t hits = 0;
+    start = Clock::now();
+    for(size_t r = 0; r < RayCount; ++r)
+    {
+        glm::vec3 origin(position(random), position(random), position(random));
+        glm::vec3 direction = glm::normalize(glm::vec3(step(random), step(random), step(random)));
+        bool hit = false;
+        tree.raycast(origin, direction, extent, [&](uint32_t object, float tMax)
+        {
+            glm::vec3 center(volumes.sphereX[object], volumes.sphereY[object], volumes.sphereZ[object]);
+            float t;
+            if(glm::intersectRaySphere(origin, direction, center, volumes.radius[object] * volumes.radius[object], t)
+               && t < tMax)
+            {
+                hit = true;
+                return t;
+            }
+            return tMax;
+        });
+        hits += hit;
+    }
+    double rayMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    size_t neighbours = 0;
+    start = Clock::now();
+    for(size_t q = 0; q < RayCount; ++q)
+    {
+        hierarchical.clear();
+        tree.querySphere(glm::vec3(position(random), position(random), position(random)), 20.0f, hierarchical);
+        neighbours += hierarchical.size();
+    }
+    double sphereMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    std::printf("\nDynamicBVH: %zu leaves, height %d, area ratio %.1f\n", tree.leafCount(), tree.height(),
+                areaBefore);
+    std::printf("insert all           %8.3f ms\n", buildMs);
+    std::printf("frustum, flat boxes  %8.3f ms  %zu visible\n", flatMs, flat.size());
+    std::printf("frustum, BVH         %8.3f ms  %zu visible (fat boxes)\n", treeMs, treeVisible);
+    std::printf("move %zu, commit      %8.3f ms  %zu left their fat box, area ratio %.1f\n", (count + 9) / 10,
+                moveMs, moved, tree.areaRatio());
+    std::printf("%zu rays           %8.3f ms  %zu hit\n", RayCount, rayMs, hits);
+    std::printf("%zu sphere queries %8.3f ms  %.1f objects each\n", RayCount, sphereMs,
+                (double)neighbours / RayCount);
+    return 0;
+}
+
+/**************************************************************
+ * runOcclusionBenchmark()
+ * ----------------------
+ * Scatters wall boxes 30 to 300 units down the view direction
+ * as occluders, then times binning them, rasterizing and
+ * building the pyramid, and testing every object the frustum
+ * cull keeps.
+ *************************************************************/
+int runOcclusionBenchmark(const CullingVolumes& volumes, const glm::mat4& viewProjection, const glm::vec3& forward,
+                          int walls, unsigned threads, int repeats)
+{
+    static const glm::vec3 CubePositions[8] =
+    {
+        glm::vec3(-1, -1, -1), glm::vec3(1, -1, -1), glm::vec3(-1, 1, -1), glm::vec3(1, 1, -1),
+        glm::vec3(-1, -1, 1), glm::vec3(1, -1, 1), glm::vec3(-1, 1, 1), glm::vec3(1, 1, 1)
+    };
+    static const uint32_t CubeIndices[36] =
+    {
+        0, 2, 1, 1, 2, 3,  4, 5, 6, 5, 7, 6,  0, 1, 4, 1, 5, 4,
+        2, 6, 3, 3, 6, 7,  0, 4, 2, 2, 4, 6,  1, 3, 5, 3, 7, 5
+    };
+
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> distance(30.0f, 300.0f);
+    std::uniform_real_distribution<float> lateral(-0.4f, 0.4f);
+    std::uniform_real_distribution<float> size(5.0f, 25.0f);
+    glm::vec3 side = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+    glm::vec3 up = glm::cross(side, forward);
+
+    std::vector<glm::mat4> models(walls);
+    for(int w = 0; w < walls; ++w)
+    {
+        float d = distance(random);
+        glm::vec3 center = forward * d + (side * lateral(random) + up * lateral(random) * 0.6f) * d;
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), center);
+        models[w] = glm::scale(model, glm::vec3(size(random), size(random), size(random)));
+    }
+
+    std::vector<uint32_t> frustumVisible, visible;
+    cullFrustum(makeFrustum(viewProjection), volumes, CullBox, frustumVisible);
+
+    OcclusionBuffer buffer;
+    buffer.init(320, 192);
+    double binMs = bestMilliseconds(repeats, [&]()
+    {
+        buffer.begin(viewProjection);
+        for(int w = 0; w < walls; ++w)
+            buffer.addOccluder(CubePositions, CubeIndices, 36, models[w]);
+    });
+    double rasterMs = bestMilliseconds(repeats, [&]() { buffer.rasterize(threads); });
+    double testMs = bestMilliseconds(repeats, [&]()
+    {
+        visible = frustumVisible;
+        buffer.cullOccluded(volumes, visible, threads);
+    });
+
+    std::printf("\nOcclusion: %d walls, %zu triangles, %dx%d depth, %d levels\n", walls, buffer.triangleCount(),
+                buffer.width(), buffer.height(), buffer.levelCount());
+    std::printf("bin occluders        %8.3f ms\n", binMs);
+    std::printf("rasterize + HiZ      %8.3f ms\n", rasterMs);
+    size_t occluded = frustumVisible.size() - visible.size();
+    std::printf("test %7zu boxes   %8.3f ms  %zu visible, %.1f%% occluded\n", frustumVisible.size(), testMs,
+                visible.size(), 100.0 * occluded / std::max<size_t>(frustumVisible.size(), 1));
+    return 0;
+}
@@ -0,0 +1,230 @@
+#include "core/allocation_stats.h"
+#include "mesh/mesh_cache.h"
+#include "render/frame_capture.h"
+
+#include <GL/glfw3.h>
+#include <SOIL/SOIL.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*************************************************************
+ * frame_replay
+ * ------------
+ * Loads a frame capture (render/frame_capture.h) and replays
+ * it offscreen: a hidden window provides the context and the
+ * frame renders into a framebuffer object at the captured
+ * size. After the warm-up frames every replay is timed to
+ * glFinish, and the image is read back and hashed after the
+ * first and the last replay; the two must match, and the hash
+ * is printed so CI can compare it between runs and machines.
+ * The timed replays must also not allocate from the heap:
+ * replay scratch comes from an arena that has grown by then.
+ ************************************************************/
+void printUsage();
+bool createWindow(GLFWwindow*& window);
+bool createFramebuffer(uint32_t width, uint32_t height, GLuint& framebuffer, GLuint renderbuffers[2]);
+uint64_t readImage(uint32_t width, uint32_t height, std::vector<uint8_t>& pixels);
+bool saveImage(const std::string& path, uint32_t width, uint32_t height, const std::vector<uint8_t>& pixels);
+
+/**************************************************************
+ * main()
+ * -----
+ * Parses the command line and runs the replay.
+ *************************************************************/
+int main(int argc, const char * argv[])
+{
+    std::string capturePath;
+    std::string imagePath;
+    int repeats = 100;
+    int warmup = 3;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        int remaining = argc - i - 1;
+        if(arg == "--repeat" && remaining >= 1)
+            repeats = std::max(1, std::atoi(argv[++i]));
+        else if(arg == "--warmup" && remaining >= 1)
+            warmup = std::max(0, std::atoi(argv[++i]));
+        else if(arg == "--image" && remaining >= 1)
+            imagePath = argv[++i];
+        else if(capturePath.empty() && arg[0] != '-')
+            capturePath = arg;
+        else
+        {
+            std::cerr << "Unknown or incomplete option " << arg << std::endl;
+            printUsage();
+            return 1;
+        }
+    }
+    if(capturePath.empty())
+    {
+        printUsage();
+        return 1;
+    }
+
+    FrameCaptureData capture;
+    if(!readFrameCapture(capturePath, capture))
+    {
+        std::cerr << "Failed to read frame capture " << capturePath << std::endl;
+        return 1;
+    }
+
+    GLFWwindow* window = NULL;
+    if(!createWindow(window))
+        return 1;
+
+    int result = 1;
+    GLuint framebuffer = 0, renderbuffers[2] = { 0, 0 };
+    {
+        GLStateCache cache;
+        FrameReplay replay;
+        CommandListStats stats = CommandListStats();
+        std::vector<uint8_t> pixels;
+        std::vector<double> times;
+        uint64_t firstImage = 0, lastImage = 0;
+        typedef std::chrono::high_resolution_clock Clock;
+
+        if(!createFramebuffer(capture.width, capture.height, framebuffer, renderbuffers))
+            std::cerr << "Failed to create a " << capture.width << "x" << capture.height << " framebuffer" << std::endl;
+        else if(!replay.load(cache, capture))
+            std::cerr << "Failed to load frame capture: " << replay.error() << std::endl;
+        else if(!replay.execute(cache, &stats))
+            std::cerr << "Frame capture has malformed command lists" << std::endl;
+        else
+        {
+            firstImage = readImage(capture.width, capture.height, pixels);
+            for(int w = 0; w < warmup; ++w)
+                replay.execute(cache);
+            glFinish();
+
+            times.reserve(repeats);
+            HeapStats heap = heapStats();
+            for(int r = 0; r < repeats; ++r)
+            {
+                Clock::time_point start = Clock::now();
+                replay.execute(cache);
+                glFinish();
+                times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+            }
+            uint64_t heapAllocations = heapStats().allocations - heap.allocations;
+            lastImage = readImage(capture.width, capture.height, pixels);
+
+            std::sort(times.begin(), times.end());
+            double total = 0.0;
+            for(size_t t = 0; t < times.size(); ++t)
+                total += times[t];
+            std::printf("%s: %ux%u, %zu command lists, %u draws, %u binds issued, %u avoided\n",
+                        capturePath.c_str(), capture.width, capture.height, capture.commandLists.size(), stats.draws,
+                        stats.bindsIssued, stats.bindsAvoided);
+            std::printf("%s\n", (const char*)glGetString(GL_RENDERER));
+            std::printf("frame min %8.3f ms  median %8.3f ms  mean %8.3f ms  (%d replays)\n", times.front(),
+                        times[times.size() / 2], total / times.size(), repeats);
+            std::printf("image %016llx\n", (unsigned long long)lastImage);
+            std::printf("heap allocations while timed %llu\n", (unsigned long long)heapAllocations);
+
+            if(firstImage != lastImage)
+                std::cerr << "Replays differ: first image " << std::hex << firstImage << ", last " << lastImage
+                          << std::endl;
+            else if(heapAllocations != 0)
+                std::cerr << "Timed replays allocated from the heap " << heapAllocations << " times" << std::endl;
+            else if(!imagePath.empty() && !saveImage(imagePath, capture.width, capture.height, pixels))
+                std::cerr << "Failed to write " << imagePath << std::endl;
+            else
+                result = 0;
+        }
+        replay.destroy();
+    }
+
+    glDeleteRenderbuffers(2, renderbuffers);
+    glDeleteFramebuffers(1, &framebuffer);
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return result;
+}
+
+void printUsage()
+{
+    std::cerr << "Usage: frame_replay capture.fcap [--repeat N] [--warmup N] [--image out.tga]" << std::endl;
+}
+
+/**************************************************************
+ * createWindow()
+ * -------------
+ * Creates a hidden window for its GL context, with the same
+ * context version and profile as the application.
+ *************************************************************/
+bool createWindow(GLFWwindow*& window)
+{
+    if(!glfwInit())
+    {
+        std::cerr << "GLFW Initialization Failed" << std::endl;
+        return false;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    window = glfwCreateWindow(64, 64, "frame_replay", NULL, NULL);
+    if(!window)
+    {
+        std::cerr << "Failed to create a GL 3.3 context" << std::endl;
+        glfwTerminate();
+        return false;
+    }
+    glfwMakeContextCurrent(window);
+
+    glewExperimental = GL_TRUE;
+    if(glewInit() != GLEW_OK)
+    {
+        std::cerr << "GLEW Initialization Failed" << std::endl;
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return false;
+    }
+    glGetError();
+    return true;
+}
+
+// RGBA8 color and 24-bit depth, bound for drawing and reading
+bool createFramebuffer(uint32_t width, uint32_t height, GLuint& framebuffer, GLuint renderbuffers[2])
+{
+    glGenRenderbuffers(2, renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, (GLsizei)width, (GLsizei)height);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, (GLsizei)width, (GLsizei)height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+    return width > 0 && height > 0 && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+uint64_t readImage(uint32_t width, uint32_t height, std::vector<uint8_t>& pixels)
+{
+    pixels.resize((size_t)width * height * 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, (GLsizei)width, (GLsizei)height, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    return meshCacheChecksum(&pixels[0], pixels.size());
+}
+
+// GL rows start at the bottom, TGA rows as SOIL writes them at the top
+bool saveImage(const std::string& path, uint32_t width, uint32_t height, const std::vector<uint8_t>& pixels)
+{
+    size_t row = (size_t)width * 4;
+    std::vector<uint8_t> flipped(pixels.size());
+    for(uint32_t y = 0; y < height; ++y)
+        std::copy(pixels.begin() + (height - 1 - y) * row, pixels.begin() + (height - y) * row,
+                  flipped.begin() + y * row);
+    return SOIL_save_image(path.c_str(), SOIL_SAVE_TYPE_TGA, (int)width, (int)height, 4, &flipped[0]) != 0;
+}
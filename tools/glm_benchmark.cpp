@@ -0,0 +1,480 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/noise.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtx/fast_square_root.hpp>
+#include <glm/gtx/fast_trigonometry.hpp>
+#include <glm/gtx/simd_mat4.hpp>
+#include <glm/gtx/simd_quat.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*************************************************************
+ * glm_benchmark
+ * -------------
+ * Times the glm kernels the engine leans on: mat4 multiply
+ * and inverse, scalar against fmat4x4SIMD; normalize, dot and
+ * cross; quaternion slerp, tquat against fquatSIMD; perlin and
+ * simplex noise; packing; and fastSqrt and fastSin against
+ * the standard library. Each kernel runs over the same seeded
+ * inputs and reports the best of --repeat batches in ns per
+ * call, the estimate least disturbed by the rest of the
+ * machine. Compare runs on a quiet machine with a fixed
+ * clock; scheduling noise alone can exceed 5%.
+ *
+ * --json writes the results with a fixed order and format, so
+ * runs diff cleanly. --baseline reads such a file back and
+ * marks every kernel more than --threshold percent (default
+ * 5) slower than it was; the exit status is 1 if any was.
+ ************************************************************/
+struct BenchmarkResult
+{
+    std::string name;
+    double nanoseconds;         // per call
+};
+
+const size_t ElementCount = 1024;
+const double BatchMilliseconds = 2.0;
+
+void printUsage();
+void fillInputs();
+void runBenchmarks(int repeats, std::vector<BenchmarkResult>& results);
+bool writeJson(const std::string& path, int repeats, const std::vector<BenchmarkResult>& results);
+bool readJson(const std::string& path, std::vector<BenchmarkResult>& results);
+int compareResults(const std::vector<BenchmarkResult>& baseline, const std::vector<BenchmarkResult>& results,
+                   double threshold);
+const char* simdName();
+template<typename Body> void timeKernel(std::vector<BenchmarkResult>& results, int repeats, const char* name,
+                                        Body body);
+template<typename Body> double bestMilliseconds(int repeats, Body body);
+
+// Inputs shared by every kernel, and a sink results are
+// folded into so the compiler cannot drop the work
+std::vector<glm::mat4> matrices;
+std::vector<glm::vec3> vectors;
+std::vector<glm::vec4> colors;
+std::vector<glm::quat> rotations;
+std::vector<float> scalars;
+volatile float sink;
+
+/**************************************************************
+ * main()
+ * -----
+ * Parses the command line, runs every kernel and prints,
+ * writes or compares the results.
+ *************************************************************/
+int main(int argc, const char * argv[])
+{
+    int repeats = 30;
+    double threshold = 5.0;
+    std::string jsonPath;
+    std::string baselinePath;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        int remaining = argc - i - 1;
+        if(arg == "--repeat" && remaining >= 1)
+            repeats = std::max(1, std::atoi(argv[++i]));
+        else if(arg == "--json" && remaining >= 1)
+            jsonPath = argv[++i];
+        else if(arg == "--baseline" && remaining >= 1)
+            baselinePath = argv[++i];
+        else if(arg == "--threshold" && remaining >= 1)
+            threshold = std::max(0.0, std::atof(argv[++i]));
+        else
+        {
+            std::cerr << "Unknown or incomplete option " << arg << std::endl;
+            printUsage();
+            return 1;
+        }
+    }
+
+    std::vector<BenchmarkResult> baseline;
+    if(!baselinePath.empty() && !readJson(baselinePath, baseline))
+    {
+        std::cerr << "Failed to read benchmark results from " << baselinePath << std::endl;
+        return 1;
+    }
+
+    fillInputs();
+    std::vector<BenchmarkResult> results;
+    runBenchmarks(repeats, results);
+
+    if(!jsonPath.empty() && !writeJson(jsonPath, repeats, results))
+    {
+        std::cerr << "Failed to write " << jsonPath << std::endl;
+        return 1;
+    }
+    if(!baselinePath.empty())
+        return compareResults(baseline, results, threshold);
+
+    std::printf("glm %d.%d.%d, %s, best of %d\n", GLM_VERSION_MAJOR, GLM_VERSION_MINOR, GLM_VERSION_PATCH,
+                simdName(), repeats);
+    for(size_t i = 0; i < results.size(); ++i)
+        std::printf("%-24s %9.3f ns\n", results[i].name.c_str(), results[i].nanoseconds);
+    return 0;
+}
+
+void printUsage()
+{
+    std::cerr << "Usage: glm_benchmark [--repeat N] [--json results.json] [--baseline baseline.json] "
+                 "[--threshold percent]" << std::endl;
+}
+
+// Fixed seed, so every run times the same values
+void fillInputs()
+{
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> positive(0.01f, 100.0f);
+    std::uniform_real_distribution<float> angle(-glm::pi<float>(), glm::pi<float>());
+
+    matrices.resize(ElementCount);
+    vectors.resize(ElementCount);
+    colors.resize(ElementCount);
+    rotations.resize(ElementCount);
+    scalars.resize(ElementCount);
+    for(size_t i = 0; i < ElementCount; ++i)
+    {
+        glm::vec3 axis(value(random), value(random), value(random) + 2.0f);
+        glm::vec3 offset(value(random), value(random), value(random));
+        rotations[i] = glm::angleAxis(angle(random), glm::normalize(axis));
+        matrices[i] = glm::mat4_cast(rotations[i]);
+        matrices[i][3] = glm::vec4(offset * 10.0f, 1.0f);
+        vectors[i] = offset * positive(random);
+        colors[i] = glm::vec4(value(random), value(random), value(random), value(random)) * 0.5f + 0.5f;
+        scalars[i] = positive(random);
+    }
+}
+
+/**************************************************************
+ * runBenchmarks()
+ * --------------
+ * Times every kernel over all the inputs, in a fixed order.
+ * Paired kernels (scalar and SIMD, exact and fast) share a
+ * name prefix.
+ *************************************************************/
+void runBenchmarks(int repeats, std::vector<BenchmarkResult>& results)
+{
+    const size_t n = ElementCount;
+    std::vector<glm::mat4> matrixOut(n);
+    std::vector<glm::vec3> vectorOut(n);
+    std::vector<glm::vec4> colorOut(n);
+    std::vector<glm::quat> rotationOut(n);
+    std::vector<glm::uint> packed(n);
+    std::vector<glm::uint64> packedWide(n);
+    std::vector<float> scalarOut(n);
+
+    std::vector<glm::detail::fmat4x4SIMD> simdMatrices(n), simdMatrixOut(n);
+    std::vector<glm::detail::fquatSIMD> simdRotations(n), simdRotationOut(n);
+    for(size_t i = 0; i < n; ++i)
+    {
+        simdMatrices[i] = glm::detail::fmat4x4SIMD(matrices[i]);
+        simdRotations[i] = glm::detail::fquatSIMD(rotations[i]);
+    }
+    for(size_t i = 0; i < n; ++i)
+    {
+        packed[i] = glm::packUnorm4x8(colors[i]);
+        packedWide[i] = glm::packHalf4x16(colors[i]);
+    }
+
+    timeKernel(results, repeats, "mat4_mul", [&]()
+    {
+        for(size_t i = 0; i < n; ++i)
+            matrixOut[i] = matrices[i] * matrices[n - 1 - i];
+        sink = matrixOut[0][3][0];
+    });
+    timeKernel(results, repeats, "mat4_mul_simd", [&]()
+    {
+        for(size_t i = 0; i < n; ++i)
+            simdMatrixOut[i] = simdMatrices[i] * simdMatrices[n - 1 - i];
+        sink = glm::mat4_cast(simdMatrixOut[0])[3][0];
+    });
+    timeKernel(results, repeats, "mat4_inverse", [&]()
+    {
+        for(size_t i = 0; i < n; ++i)
+            matrixOut[i] = glm::inverse(matrices[i]);
+        sink = matrixOut[0][3][0];
+    });
+    timeKernel(results, repeats, "mat4_inverse_simd", [&]()
+    {
+        // glm 0.9.7 declares this in glm but defines it in glm::detail
+        for(size_t i = 0; i < n; ++i)
+            simdMatrixOut[i] = glm::detail::inverse(simdMatrices[i]);
+        sink = glm::mat4_cast(simdMatrixOut[0])[3][0];
+    });
+    timeKernel(results, repeats, "vec3_normalize", [&]()
+    {
+        for(size_t i = 0; i < n; ++i)
+            vectorOut[i] = glm::normalize(vectors[i]);
+        sink = vectorOut[0].x;
+    });
+    timeKernel(results, repeats, "vec3_dot", [&]()
+    {
+        float sum = 0.0f;
+        for(size_t i = 0; i < n; ++i)
+            sum += glm::dot(vectors[i], vectors[n - 1 - i]);
+        sink = sum;
+    });
+    timeKernel(results, repeats, "vec3_cross", [&]()
+    {
+        for(size_t i = 0; i < n; ++i)
+            vectorOut[i] = glm::cross(vectors[i], vectors[n - 1 - i]);
+        sink = vectorOut[0].x;
+    });
+    timeKernel(results, repeats, "quat_slerp", [&]()
+    {
+        for(size_t i = 0; i < n; ++i)
+            rotationOut[i] = glm::slerp(rotations[i], rotations[n - 1 - i], colors[i].x);
+        sink = rotationOut[0].w;
+    });
+    timeKernel(results, repeats, "quat_slerp_simd", [&]()
+    {
+        for(size_t i = 0; i < n; ++i)
+            simdRotationOut[i] = glm::slerp(simdRotations[i], simdRotations[n - 1 - i], colors[i].x);
+        sink = glm::quat_cast(simdRotationOut[0]).w;
+    });
+    timeKernel(results, repeats, "noise_perlin_vec3", [&]()
+    {
+        for(size_t i = 0; i < n; ++i)
+            scalarOut[i] = glm::perlin(vectors[i]);
+        sink = scalarOut[0];
+    });
+    timeKernel(results, repeats, "noise_simplex_vec3", [&]()
+    {
+        for(size_t i = 0; i < n; ++i)
+            scalarOut[i] = glm::simplex(vectors[i]);
+        sink = scalarOut[0];
+    });
+    timeKernel(results, repeats, "pack_unorm4x8", [&]()
+    {
+        for(size_t i = 0; i < n; ++i)
+            packed[i] = glm::packUnorm4x8(colors[i]);
+        sink = (float)packed[0];
+    });
+    timeKernel(results, repeats, "unpack_unorm4x8", [&]()
+    {
+        for(size_t i = 0; i < n; ++i)
+            colorOut[i] = glm::unpackUnorm4x8(packed[i]);
+        sink = colorOut[0].x;
+    });
+    timeKernel(results, repeats, "pack_half4x16", [&]()
+    {
+        for(size_t i = 0; i < n; ++i)
+            packedWide[i] = glm::packHalf4x16(colors[i]);
+        sink = (float)packedWide[0];
+    });
+    timeKernel(results, repeats, "unpack_half4x16", [&]()
+    {
+        for(size_t i = 0; i < n; ++i)
+            colorOut[i] = glm::unpackHalf4x16(packedWide[i]);
+        sink = colorOut[0].x;
+    });
+    timeKernel(results, repeats, "sqrt", [&]()
+    {
+        for(size_t i = 0; i < n; ++i)
+            scalarOut[i] = std::sqrt(scalars[i]);
+        sink = scalarOut[0];
+    });
+    timeKernel(results, repeats, "sqrt_fast", [&]()
+    {
+        for(size_t i = 0; i < n; ++i)
+            scalarOut[i] = glm::fastSqrt(scalars[i]);
+        sink = scalarOut[0];
+    });
+    timeKernel(results, repeats, "sin", [&]()
+    {
+        for(size_t i = 0; i < n; ++i)
+            scalarOut[i] = std::sin(vectors[i].x);
+        sink = scalarOut[0];
+    });
+    timeKernel(results, repeats, "sin_fast", [&]()
+    {
+        for(size_t i = 0; i < n; ++i)
+            scalarOut[i] = glm::fastSin(vectors[i].x);
+        sink = scalarOut[0];
+    });
+}
+
+/**************************************************************
+ * writeJson()
+ * ----------
+ * One result per line, in run order, with three decimals, so
+ * two files from the same build differ only in their timings.
+ *************************************************************/
+bool writeJson(const std::string& path, int repeats, const std::vector<BenchmarkResult>& results)
+{
+    std::ofstream file(path.c_str());
+    if(!file)
+        return false;
+    char line[256];
+    file << "{\n";
+    file << "  \"benchmark\": \"glm_benchmark\",\n";
+    std::snprintf(line, sizeof(line), "  \"glm_version\": \"%d.%d.%d.%d\",\n", GLM_VERSION_MAJOR,
+                  GLM_VERSION_MINOR, GLM_VERSION_PATCH, GLM_VERSION_REVISION);
+    file << line;
+    file << "  \"simd\": \"" << simdName() << "\",\n";
+    file << "  \"repeats\": " << repeats << ",\n";
+    file << "  \"results\": [\n";
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        std::snprintf(line, sizeof(line), "    { \"name\": \"%s\", \"ns_per_op\": %.3f }%s\n",
+                      results[i].name.c_str(), results[i].nanoseconds, i + 1 < results.size() ? "," : "");
+        file << line;
+    }
+    file << "  ]\n}\n";
+    return (bool)file;
+}
+
+/**************************************************************
+ * readJson()
+ * ---------
+ * Reads the name and ns_per_op pairs back out of a file
+ * written by writeJson(). Not a general JSON parser: it only
+ * has to read this tool's own output.
+ *************************************************************/
+bool readJson(const std::string& path, std::vector<BenchmarkResult>& results)
+{
+    std::ifstream file(path.c_str());
+    if(!file)
+        return false;
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    const std::string text = contents.str();
+
+    const std::string nameKey = "\"name\"", timeKey = "\"ns_per_op\"";
+    for(size_t at = text.find(nameKey); at != std::string::npos; at = text.find(nameKey, at))
+    {
+        size_t open = text.find('"', text.find(':', at + nameKey.size()));
+        size_t close = open == std::string::npos ? open : text.find('"', open + 1);
+        size_t time = close == std::string::npos ? close : text.find(timeKey, close);
+        size_t colon = time == std::string::npos ? time : text.find(':', time + timeKey.size());
+        if(colon == std::string::npos)
+            return false;
+
+        BenchmarkResult result;
+        result.name = text.substr(open + 1, close - open - 1);
+        char* end = NULL;
+        result.nanoseconds = std::strtod(text.c_str() + colon + 1, &end);
+        if(end == text.c_str() + colon + 1)
+            return false;
+        results.push_back(result);
+        at = (size_t)(end - text.c_str());
+    }
+    return !results.empty();
+}
+
+/**************************************************************
+ * compareResults()
+ * ---------------
+ * Prints each kernel against the baseline and returns 1 if
+ * any got slower by more than threshold percent. Kernels
+ * missing from either side are listed but never fail.
+ *************************************************************/
+int compareResults(const std::vector<BenchmarkResult>& baseline, const std::vector<BenchmarkResult>& results,
+                   double threshold)
+{
+    int regressions = 0;
+    std::printf("%-24s %12s %12s %8s\n", "kernel", "baseline ns", "current ns", "change");
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchmarkResult* before = NULL;
+        for(size_t b = 0; b < baseline.size() && !before; ++b)
+            if(baseline[b].name == results[i].name)
+                before = &baseline[b];
+        if(!before || before->nanoseconds <= 0.0)
+        {
+            std::printf("%-24s %12s %12.3f %8s  new\n", results[i].name.c_str(), "-", results[i].nanoseconds, "");
+            continue;
+        }
+
+        double change = (results[i].nanoseconds / before->nanoseconds - 1.0) * 100.0;
+        bool regressed = change > threshold;
+        regressions += regressed ? 1 : 0;
+        std::printf("%-24s %12.3f %12.3f %+7.1f%%%s\n", results[i].name.c_str(), before->nanoseconds,
+                    results[i].nanoseconds, change, regressed ? "  REGRESSION" : "");
+    }
+    for(size_t b = 0; b < baseline.size(); ++b)
+    {
+        bool found = false;
+        for(size_t i = 0; i < results.size() && !found; ++i)
+            found = results[i].name == baseline[b].name;
+        if(!found)
+            std::printf("%-24s %12.3f %12s %8s  removed\n", baseline[b].name.c_str(), baseline[b].nanoseconds, "-",
+                        "");
+    }
+
+    if(regressions)
+        std::printf("%d kernel%s slower than the baseline by more than %.1f%%\n", regressions,
+                    regressions == 1 ? "" : "s", threshold);
+    return regressions ? 1 : 0;
+}
+
+// Widest instruction set glm was built for
+const char* simdName()
+{
+    if(GLM_ARCH & GLM_ARCH_AVX2)
+        return "avx2";
+    if(GLM_ARCH & GLM_ARCH_AVX)
+        return "avx";
+    if(GLM_ARCH & GLM_ARCH_SSE4)
+        return "sse4";
+    if(GLM_ARCH & GLM_ARCH_SSE3)
+        return "sse3";
+    if(GLM_ARCH & GLM_ARCH_SSE2)
+        return "sse2";
+    return "none";
+}
+
+/**************************************************************
+ * timeKernel()
+ * -----------
+ * Runs body once to warm caches and size the batch: each
+ * batch repeats body for about BatchMilliseconds, long enough
+ * that timer resolution and short interruptions vanish in the
+ * best batch, recorded as ns per call.
+ *************************************************************/
+template<typename Body> void timeKernel(std::vector<BenchmarkResult>& results, int repeats, const char* name,
+                                        Body body)
+{
+    double once = std::max(bestMilliseconds(1, body), 1e-6);
+    int passes = std::max(1, (int)(BatchMilliseconds / once));
+
+    BenchmarkResult result;
+    result.name = name;
+    result.nanoseconds = bestMilliseconds(repeats, [&]()
+    {
+        for(int pass = 0; pass < passes; ++pass)
+            body();
+    }) * 1e6 / ((double)ElementCount * passes);
+    results.push_back(result);
+}
+
+/**************************************************************
+ * bestMilliseconds()
+ * -----------------
+ * Fastest of repeats runs of body, which filters out the
+ * runs that were interrupted.
+ *************************************************************/
+template<typename Body> double bestMilliseconds(int repeats, Body body)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    double best = 1e30;
+    for(int r = 0; r < repeats; ++r)
+    {
+        Clock::time_point start = Clock::now();
+        body();
+        best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+    return best;
+}
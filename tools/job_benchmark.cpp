@@ -0,0 +1,186 @@
+#include "core/job_system.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*************************************************************
+ * job_benchmark
+ * -------------
+ * Measures the job system's overheads and scaling. For each
+ * thread count (1, 2, 4, ... up to --threads) a fresh
+ * JobSystem runs:
+ *
+ *     spawn     --jobs empty jobs queued by one thread, then
+ *               waited for: the cost of run(), the queue and
+ *               a steal when another thread takes the job
+ *     fan-out   a binary tree of jobs where every inner job
+ *               starts two children and waits for them, so
+ *               work is spread by stealing alone
+ *     scaling   a compute-bound parallelFor, reported as
+ *               speedup and efficiency against one thread
+ *
+ * Thread counts above the hardware's are still run; they
+ * show the cost of oversubscription rather than speedup.
+ ************************************************************/
+void printUsage();
+double timeSpawn(JobSystem& jobs, size_t count, int repeats);
+double timeFanOut(JobSystem& jobs, int depth, int repeats);
+double timeScaling(JobSystem& jobs, std::vector<float>& data, int repeats);
+void fanOut(JobSystem& jobs, int depth);
+template<typename Body> double bestMilliseconds(int repeats, Body body);
+
+/**************************************************************
+ * main()
+ * -----
+ * Parses the command line and prints one row per thread
+ * count.
+ *************************************************************/
+int main(int argc, const char * argv[])
+{
+    unsigned maxThreads = 64;
+    size_t jobCount = 100000;
+    int repeats = 5;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        int remaining = argc - i - 1;
+        if(arg == "--threads" && remaining >= 1)
+            maxThreads = (unsigned)std::max(1, std::atoi(argv[++i]));
+        else if(arg == "--jobs" && remaining >= 1)
+            jobCount = (size_t)std::max(1, std::atoi(argv[++i]));
+        else if(arg == "--repeat" && remaining >= 1)
+            repeats = std::max(1, std::atoi(argv[++i]));
+        else
+        {
+            std::cerr << "Unknown or incomplete option " << arg << std::endl;
+            printUsage();
+            return 1;
+        }
+    }
+
+    const int fanOutDepth = 16;
+    std::vector<float> data(1 << 18);
+    std::printf("%u hardware threads, %zu spawned jobs, %d fan-out jobs, best of %d\n\n", hardwareThreadCount(),
+                jobCount, (2 << fanOutDepth) - 1, repeats);
+    std::printf("threads   spawn ns/job  stolen   fan-out ns/job  stolen   parallelFor ms  speedup  efficiency\n");
+
+    std::vector<unsigned> threadCounts;
+    for(unsigned threads = 1; threads < maxThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+
+    double baseline = 0.0;
+    for(size_t row = 0; row < threadCounts.size(); ++row)
+    {
+        unsigned threads = threadCounts[row];
+        JobSystem jobs(threads);
+
+        jobs.resetStats();
+        double spawnMs = timeSpawn(jobs, jobCount, repeats);
+        JobSystemStats spawnStats = jobs.stats();
+
+        jobs.resetStats();
+        double fanOutMs = timeFanOut(jobs, fanOutDepth, repeats);
+        JobSystemStats fanOutStats = jobs.stats();
+
+        double scalingMs = timeScaling(jobs, data, repeats);
+        if(threads == 1)
+            baseline = scalingMs;
+        double speedup = baseline / scalingMs;
+
+        std::printf("%7u   %12.1f  %5.1f%%   %14.1f  %5.1f%%   %14.2f  %6.2fx  %9.0f%%\n", threads,
+                    spawnMs * 1e6 / jobCount, 100.0 * spawnStats.stolen / std::max<uint64_t>(spawnStats.executed, 1),
+                    fanOutMs * 1e6 / ((2 << fanOutDepth) - 1),
+                    100.0 * fanOutStats.stolen / std::max<uint64_t>(fanOutStats.executed, 1), scalingMs, speedup,
+                    100.0 * speedup / threads);
+    }
+    return 0;
+}
+
+void printUsage()
+{
+    std::cerr << "usage: job_benchmark [options]\n"
+                 "  --threads N            largest thread count to measure (64)\n"
+                 "  --jobs N               empty jobs in the spawn test (100000)\n"
+                 "  --repeat N             runs per measurement, best is reported (5)" << std::endl;
+}
+
+/**************************************************************
+ * timeSpawn()
+ * ----------
+ * Queues count empty jobs from the main thread and waits for
+ * them all.
+ *************************************************************/
+double timeSpawn(JobSystem& jobs, size_t count, int repeats)
+{
+    return bestMilliseconds(repeats, [&]()
+    {
+        JobCounter counter;
+        for(size_t i = 0; i < count; ++i)
+            jobs.run([]() {}, &counter);
+        jobs.wait(counter);
+    });
+}
+
+double timeFanOut(JobSystem& jobs, int depth, int repeats)
+{
+    return bestMilliseconds(repeats, [&]()
+    {
+        JobCounter counter;
+        jobs.run([&jobs, depth]() { fanOut(jobs, depth); }, &counter);
+        jobs.wait(counter);
+    });
+}
+
+/**************************************************************
+ * timeScaling()
+ * ------------
+ * A parallelFor over data where every element costs a few
+ * hundred nanoseconds of arithmetic and no memory traffic.
+ *************************************************************/
+double timeScaling(JobSystem& jobs, std::vector<float>& data, int repeats)
+{
+    return bestMilliseconds(repeats, [&]()
+    {
+        jobs.parallelFor(0, data.size(), 1024, jobs.threadCount(), [&](size_t begin, size_t end)
+        {
+            for(size_t i = begin; i < end; ++i)
+            {
+                float value = (float)i;
+                for(int k = 0; k < 32; ++k)
+                    value = value * 0.999f + std::sin(value);
+                data[i] = value;
+            }
+        });
+    });
+}
+
+void fanOut(JobSystem& jobs, int depth)
+{
+    if(depth == 0)
+        return;
+    JobCounter children;
+    jobs.run([&jobs, depth]() { fanOut(jobs, depth - 1); }, &children);
+    jobs.run([&jobs, depth]() { fanOut(jobs, depth - 1); }, &children);
+    jobs.wait(children);
+}
+
+template<typename Body> double bestMilliseconds(int repeats, Body body)
+{
+    double best = 1e30;
+    for(int r = 0; r < repeats; ++r)
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        body();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
@@ -0,0 +1,221 @@
+#include "bake/lightmap_baker.h"
+#include "bake/lightmap_unwrap.h"
+#include "bake/rgbe.h"
+#include "mesh/mesh_import.h"
+
+#include <SOIL/SOIL.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+/*************************************************************
+ * light_baker
+ * -----------
+ * Offline lightmap baker for static scenes. Unwraps lightmap
+ * UVs for an OBJ, path traces every texel on all cores and
+ * writes the result as an RGBE encoded TGA, plus the mesh
+ * with its lightmap UVs so the runtime can draw it with a
+ * single lightmap fetch.
+ ************************************************************/
+void printUsage();
+bool loadScene(const std::string& path, BakeScene& scene);
+bool saveLightmap(const std::string& path, const Lightmap& lightmap);
+bool saveMesh(const std::string& path, const BakeScene& scene, const LightmapLayout& layout);
+
+/**************************************************************
+ * main()
+ * -----
+ * Parses the command line and runs the bake.
+ *************************************************************/
+int main(int argc, const char * argv[])
+{
+    if(argc < 3)
+    {
+        printUsage();
+        return 1;
+    }
+
+    std::string scenePath = argv[1];
+    std::string lightmapPath = argv[2];
+    std::string meshPath;
+    int resolution = 512;
+    int padding = 2;
+
+    BakeScene scene;
+    scene.skyColor = glm::vec3(0.0f);
+    BakeSettings settings = defaultBakeSettings();
+
+    for(int i = 3; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        int remaining = argc - i - 1;
+        if(arg == "--resolution" && remaining >= 1)
+            resolution = std::atoi(argv[++i]);
+        else if(arg == "--padding" && remaining >= 1)
+            padding = std::atoi(argv[++i]);
+        else if(arg == "--samples" && remaining >= 1)
+            settings.samplesPerTexel = std::atoi(argv[++i]);
+        else if(arg == "--bounces" && remaining >= 1)
+            settings.maxBounces = std::atoi(argv[++i]);
+        else if(arg == "--threads" && remaining >= 1)
+            settings.threadCount = (unsigned)std::atoi(argv[++i]);
+        else if(arg == "--seed" && remaining >= 1)
+            settings.seed = (uint32_t)std::strtoul(argv[++i], NULL, 10);
+        else if(arg == "--indirect-only")
+            settings.indirectOnly = true;
+        else if(arg == "--mesh-out" && remaining >= 1)
+            meshPath = argv[++i];
+        else if(arg == "--sky" && remaining >= 3)
+        {
+            scene.skyColor = glm::vec3(std::atof(argv[i + 1]), std::atof(argv[i + 2]), std::atof(argv[i + 3]));
+            i += 3;
+        }
+        else if((arg == "--light" || arg == "--sun") && remaining >= 6)
+        {
+            BakeLight light;
+            glm::vec3 v(std::atof(argv[i + 1]), std::atof(argv[i + 2]), std::atof(argv[i + 3]));
+            light.directional = arg == "--sun";
+            light.position = v;
+            light.direction = v;
+            light.color = glm::vec3(std::atof(argv[i + 4]), std::atof(argv[i + 5]), std::atof(argv[i + 6]));
+            scene.lights.push_back(light);
+            i += 6;
+        }
+        else
+        {
+            std::cerr << "Unknown or incomplete option " << arg << std::endl;
+            printUsage();
+            return 1;
+        }
+    }
+
+    if(!loadScene(scenePath, scene))
+    {
+        std::cerr << "Failed to load " << scenePath << std::endl;
+        return 1;
+    }
+
+    LightmapLayout layout;
+    if(!unwrapLightmap(scene.positions, scene.indices, resolution, padding, layout))
+    {
+        std::cerr << "Scene does not fit a " << resolution << "x" << resolution << " lightmap" << std::endl;
+        return 1;
+    }
+
+    Lightmap lightmap;
+    BakeStats stats;
+    if(!bakeLightmap(scene, layout, settings, lightmap, &stats))
+    {
+        std::cerr << "Bake failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << stats.texels << " texels, " << stats.rays << " rays in " << stats.seconds << "s ("
+              << (stats.seconds > 0.0 ? stats.rays / stats.seconds / 1e6 : 0.0) << " Mrays/s on "
+              << settings.threadCount << " threads)" << std::endl;
+
+    if(!saveLightmap(lightmapPath, lightmap))
+    {
+        std::cerr << "Failed to write " << lightmapPath << std::endl;
+        return 1;
+    }
+    if(!meshPath.empty() && !saveMesh(meshPath, scene, layout))
+    {
+        std::cerr << "Failed to write " << meshPath << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+/**************************************************************
+ * printUsage()
+ * -----------
+ * Prints the command line options.
+ *************************************************************/
+void printUsage()
+{
+    std::cerr << "usage: light_baker <scene.obj|scene.ply> <lightmap.tga> [options]\n"
+                 "  --resolution N         lightmap width and height (512)\n"
+                 "  --padding N            texels between charts (2)\n"
+                 "  --samples N            hemisphere samples per texel (64)\n"
+                 "  --bounces N            maximum path length (8)\n"
+                 "  --threads N            worker threads (all cores)\n"
+                 "  --seed N               random seed (1)\n"
+                 "  --indirect-only        leave direct light to the runtime\n"
+                 "  --light x y z r g b    point light\n"
+                 "  --sun dx dy dz r g b   directional light\n"
+                 "  --sky r g b            radiance of rays that escape\n"
+                 "  --mesh-out file.obj    write the mesh with lightmap UVs" << std::endl;
+}
+
+/**************************************************************
+ * loadScene()
+ * ----------
+ * Imports an OBJ or PLY. Normals from the file are kept for
+ * shading; generated ones are dropped so hard edges keep
+ * their face normals. Everything gets one grey material.
+ *************************************************************/
+bool loadScene(const std::string& path, BakeScene& scene)
+{
+    Mesh mesh;
+    MeshImportStats stats;
+    if(!importMesh(path, mesh, &stats))
+        return false;
+
+    scene.positions.resize(mesh.vertices.size());
+    scene.normals.resize(stats.normalsGenerated ? 0 : mesh.vertices.size());
+    for(size_t i = 0; i < mesh.vertices.size(); ++i)
+    {
+        scene.positions[i] = mesh.vertices[i].position;
+        if(!stats.normalsGenerated)
+            scene.normals[i] = mesh.vertices[i].normal;
+    }
+    scene.indices.swap(mesh.indices);
+
+    BakeMaterial grey = { glm::vec3(0.8f), glm::vec3(0.0f) };
+    scene.materials.assign(1, grey);
+    scene.triangleMaterials.assign(scene.indices.size() / 3, 0);
+    return true;
+}
+
+/**************************************************************
+ * saveLightmap()
+ * -------------
+ * Writes the lightmap as RGBE in an RGBA TGA. Row 0 is v = 0,
+ * matching the order glTexImage2D expects.
+ *************************************************************/
+bool saveLightmap(const std::string& path, const Lightmap& lightmap)
+{
+    std::vector<unsigned char> data(lightmap.texels.size() * 4);
+    for(size_t i = 0; i < lightmap.texels.size(); ++i)
+        encodeRGBE(lightmap.texels[i], &data[i * 4]);
+    return SOIL_save_image(path.c_str(), SOIL_SAVE_TYPE_TGA, lightmap.width, lightmap.height, 4, &data[0]) != 0;
+}
+
+/**************************************************************
+ * saveMesh()
+ * ---------
+ * Writes the triangles with one lightmap UV per corner.
+ *************************************************************/
+bool saveMesh(const std::string& path, const BakeScene& scene, const LightmapLayout& layout)
+{
+    std::ofstream file(path.c_str());
+    if(!file)
+        return false;
+
+    for(size_t i = 0; i < scene.positions.size(); ++i)
+        file << "v " << scene.positions[i].x << " " << scene.positions[i].y << " " << scene.positions[i].z << "\n";
+    for(size_t i = 0; i < layout.uvs.size(); ++i)
+        file << "vt " << layout.uvs[i].x << " " << layout.uvs[i].y << "\n";
+    for(size_t i = 0; i < scene.indices.size(); i += 3)
+    {
+        file << "f";
+        for(size_t c = 0; c < 3; ++c)
+            file << " " << scene.indices[i + c] + 1 << "/" << i + c + 1;
+        file << "\n";
+    }
+    return file.good();
+}
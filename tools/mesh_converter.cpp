@@ -0,0 +1,202 @@
+#include "mesh/mesh_cache.h"
+#include "mesh/mesh_import.h"
+#include "mesh/mesh_optimize.h"
+#include "mesh/mesh_quantize.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+/*************************************************************
+ * mesh_converter
+ * --------------
+ * Turns an OBJ or PLY into a mesh cache (mesh/mesh_cache.h):
+ * optimized for the vertex cache and overdraw, split into
+ * meshlets, with an LOD chain and optionally quantized
+ * vertices. With --verify it instead maps an existing cache,
+ * checks every section checksum and prints the header and
+ * how fast the file mapped and verified.
+ ************************************************************/
+void printUsage();
+bool parseEncoding(const std::string& name, uint32_t& format);
+int convert(const std::string& inPath, const std::string& outPath, uint32_t format, size_t maxLods);
+int verify(const std::string& path);
+
+/**************************************************************
+ * main()
+ * -----
+ * Parses the command line and converts or verifies.
+ *************************************************************/
+int main(int argc, const char * argv[])
+{
+    if(argc < 3)
+    {
+        printUsage();
+        return 1;
+    }
+
+    std::string first = argv[1];
+    if(first == "--verify")
+        return verify(argv[2]);
+
+    std::string outPath = argv[2];
+    uint32_t format = MeshCacheFloatVertices;
+    size_t maxLods = 4;
+
+    for(int i = 3; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        int remaining = argc - i - 1;
+        if(arg == "--quantize" && remaining >= 1 && parseEncoding(argv[i + 1], format))
+            ++i;
+        else if(arg == "--lods" && remaining >= 1)
+            maxLods = (size_t)std::max(1, std::atoi(argv[++i]));
+        else
+        {
+            std::cerr << "Unknown or incomplete option " << arg << std::endl;
+            printUsage();
+            return 1;
+        }
+    }
+    return convert(first, outPath, format, maxLods);
+}
+
+/**************************************************************
+ * printUsage()
+ * -----------
+ * Prints the command line options.
+ *************************************************************/
+void printUsage()
+{
+    std::cerr << "usage: mesh_converter <mesh.obj|mesh.ply> <out.mesh> [options]\n"
+                 "       mesh_converter --verify <file.mesh>\n"
+                 "  --quantize oct|1010102|qtangent   store packed vertices\n"
+                 "  --lods N                          LODs to build, including the full mesh (4)" << std::endl;
+}
+
+/**************************************************************
+ * parseEncoding()
+ * --------------
+ * Maps a --quantize argument to a cache vertex format.
+ *************************************************************/
+bool parseEncoding(const std::string& name, uint32_t& format)
+{
+    if(name == "oct")
+        format = NormalOctahedral + 1;
+    else if(name == "1010102")
+        format = NormalPacked1010102 + 1;
+    else if(name == "qtangent")
+        format = NormalQTangent + 1;
+    else
+        return false;
+    return true;
+}
+
+/**************************************************************
+ * convert()
+ * --------
+ * Runs the import, optimize, meshlet and LOD pipeline and
+ * writes the cache. LOD 0 is the meshlet ordered index list,
+ * so meshlet ranges and LOD 0 share the same indices.
+ *************************************************************/
+int convert(const std::string& inPath, const std::string& outPath, uint32_t format, size_t maxLods)
+{
+    Mesh mesh;
+    MeshImportStats importStats;
+    if(!importMesh(inPath, mesh, &importStats))
+    {
+        std::cerr << "Failed to load " << inPath << std::endl;
+        return 1;
+    }
+    std::cout << importStats.triangles << " triangles, " << importStats.verticesWelded << " vertices" << std::endl;
+
+    optimizeMesh(mesh, defaultMeshOptimizeSettings(), NULL);
+
+    MeshletMesh meshlets;
+    buildMeshlets(mesh, 64, 124, meshlets);
+    mesh.indices = meshlets.indices;
+
+    LodChain chain;
+    buildLodChain(mesh, maxLods, 0.5f, chain);
+
+    MeshCacheContents contents;
+    contents.vertexFormat = format;
+    contents.indices.swap(chain.indices);
+    contents.meshlets.swap(meshlets.meshlets);
+    contents.lods.swap(chain.lods);
+    contents.boundsMin = mesh.boundsMin;
+    contents.boundsMax = mesh.boundsMax;
+    if(format == MeshCacheFloatVertices)
+    {
+        contents.vertexStride = sizeof(MeshVertex);
+        const uint8_t* begin = (const uint8_t*)&mesh.vertices[0];
+        contents.vertices.assign(begin, begin + mesh.vertices.size() * sizeof(MeshVertex));
+        contents.positionScale = glm::vec3(1.0f);
+        contents.positionBias = glm::vec3(0.0f);
+    }
+    else
+    {
+        QuantizedMesh quantized;
+        quantizeMesh(mesh, (NormalEncoding)(format - 1), quantized, NULL);
+        contents.vertexStride = quantized.stride;
+        contents.vertices.swap(quantized.vertices);
+        contents.positionScale = quantized.positionScale;
+        contents.positionBias = quantized.positionBias;
+    }
+
+    std::cout << contents.meshlets.size() << " meshlets, " << contents.lods.size() << " LODs" << std::endl;
+    if(!writeMeshCache(outPath, contents))
+    {
+        std::cerr << "Failed to write " << outPath << std::endl;
+        return 1;
+    }
+    return verify(outPath);
+}
+
+/**************************************************************
+ * verify()
+ * -------
+ * Maps the cache twice, without and with checksums, and
+ * prints the header and the throughput of each.
+ *************************************************************/
+int verify(const std::string& path)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    MeshCacheFile file;
+
+    Clock::time_point start = Clock::now();
+    bool mapped = file.open(path, false);
+    double mapSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    file.close();
+
+    start = Clock::now();
+    bool verified = mapped && file.open(path, true);
+    double verifySeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    if(!verified)
+    {
+        std::cerr << (mapped ? "Checksum mismatch in " : "Not a valid mesh cache: ") << path << std::endl;
+        return 1;
+    }
+
+    static const char* SectionNames[MeshCacheSectionCount] = { "vertices", "indices", "meshlets", "lods" };
+    static const char* FormatNames[] = { "float", "octahedral", "1010102", "qtangent" };
+    const MeshCacheHeader& h = file.header();
+    double megabytes = file.fileSize() / (1024.0 * 1024.0);
+
+    std::printf("version %u, %s vertices (%u bytes), %u-bit indices\n", h.version,
+                h.vertexFormat <= NormalQTangent + 1 ? FormatNames[h.vertexFormat] : "unknown", h.vertexStride,
+                h.indexSize * 8);
+    std::printf("%u vertices, %u indices, %u meshlets, %u LODs\n", h.vertexCount, h.indexCount, h.meshletCount,
+                h.lodCount);
+    for(int i = 0; i < MeshCacheSectionCount; ++i)
+        std::printf("  %-9s offset %10llu  size %10llu  checksum %016llx\n", SectionNames[i],
+                    (unsigned long long)h.sections[i].offset, (unsigned long long)h.sections[i].size,
+                    (unsigned long long)h.sections[i].checksum);
+    std::printf("%.2f MB: mapped in %.3f ms, verified at %.0f MB/s\n", megabytes, mapSeconds * 1000.0,
+                verifySeconds > 0.0 ? megabytes / verifySeconds : 0.0);
+    return 0;
+}
@@ -0,0 +1,283 @@
+#include "mesh/mesh_import.h"
+#include "mesh/mesh_optimize.h"
+#include "mesh/mesh_quantize.h"
+#include "mesh/meshlet.h"
+#include "mesh/mesh_simplify.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+/*************************************************************
+ * mesh_optimizer
+ * --------------
+ * Imports an OBJ or PLY, reorders it for the vertex cache,
+ * overdraw and vertex fetch, and prints the simulated cache
+ * behaviour before and after at a few cache sizes. The result
+ * can be written back out as an OBJ. With --quantize the
+ * size and worst-case error of each packed vertex format is
+ * reported as well, and --meshlets reports how many
+ * triangles meshlet culling submits from a ring of cameras.
+ * --lods builds a simplified LOD chain and shows which LOD
+ * would be drawn at a range of distances.
+ ************************************************************/
+void printUsage();
+void printCacheReport(const std::vector<uint32_t>& before, size_t beforeVertices, const Mesh& after);
+void printQuantizationReport(const Mesh& mesh);
+void printMeshletReport(const Mesh& mesh);
+void printLodReport(const Mesh& mesh);
+bool saveObj(const std::string& path, const Mesh& mesh);
+
+/**************************************************************
+ * main()
+ * -----
+ * Parses the command line and runs the optimizer.
+ *************************************************************/
+int main(int argc, const char * argv[])
+{
+    if(argc < 2)
+    {
+        printUsage();
+        return 1;
+    }
+
+    std::string meshPath = argv[1];
+    std::string outPath;
+    bool quantize = false;
+    bool meshlets = false;
+    bool lods = false;
+    MeshOptimizeSettings settings = defaultMeshOptimizeSettings();
+
+    for(int i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        int remaining = argc - i - 1;
+        if(arg == "--cache" && remaining >= 1)
+            settings.cacheSize = (unsigned)std::atoi(argv[++i]);
+        else if(arg == "--threshold" && remaining >= 1)
+            settings.overdrawThreshold = (float)std::atof(argv[++i]);
+        else if(arg == "--no-overdraw")
+            settings.overdraw = false;
+        else if(arg == "--quantize")
+            quantize = true;
+        else if(arg == "--meshlets")
+            meshlets = true;
+        else if(arg == "--lods")
+            lods = true;
+        else if(arg == "--out" && remaining >= 1)
+            outPath = argv[++i];
+        else
+        {
+            std::cerr << "Unknown or incomplete option " << arg << std::endl;
+            printUsage();
+            return 1;
+        }
+    }
+
+    Mesh mesh;
+    MeshImportStats importStats;
+    if(!importMesh(meshPath, mesh, &importStats))
+    {
+        std::cerr << "Failed to load " << meshPath << std::endl;
+        return 1;
+    }
+    std::cout << importStats.triangles << " triangles, " << importStats.verticesWelded << " vertices" << std::endl;
+
+    std::vector<uint32_t> original(mesh.indices);
+    size_t originalVertices = mesh.vertices.size();
+
+    MeshOptimizeReport report;
+    optimizeMesh(mesh, settings, &report);
+    std::cout << "optimized in " << report.seconds << "s, " << report.clusters << " clusters" << std::endl;
+    printCacheReport(original, originalVertices, mesh);
+    if(quantize)
+        printQuantizationReport(mesh);
+    if(meshlets)
+        printMeshletReport(mesh);
+    if(lods)
+        printLodReport(mesh);
+
+    if(!outPath.empty() && !saveObj(outPath, mesh))
+    {
+        std::cerr << "Failed to write " << outPath << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+/**************************************************************
+ * printUsage()
+ * -----------
+ * Prints the command line options.
+ *************************************************************/
+void printUsage()
+{
+    std::cerr << "usage: mesh_optimizer <mesh.obj|mesh.ply> [options]\n"
+                 "  --cache N              FIFO size to optimize for (16)\n"
+                 "  --threshold F          ACMR growth allowed for overdraw clusters (1.05)\n"
+                 "  --no-overdraw          skip the overdraw pass\n"
+                 "  --quantize             report packed vertex sizes and errors\n"
+                 "  --meshlets             report meshlet culling from a ring of cameras\n"
+                 "  --lods                 build an LOD chain and report selection by distance\n"
+                 "  --out file.obj         write the optimized mesh" << std::endl;
+}
+
+/**************************************************************
+ * printCacheReport()
+ * -----------------
+ * Simulated ACMR and ATVR before and after, for FIFO caches
+ * smaller and larger than the one optimized for.
+ *************************************************************/
+void printCacheReport(const std::vector<uint32_t>& before, size_t beforeVertices, const Mesh& after)
+{
+    static const unsigned CacheSizes[] = { 8, 16, 32 };
+
+    std::printf("cache   ACMR before  after    ATVR before  after\n");
+    for(size_t i = 0; i < sizeof(CacheSizes) / sizeof(CacheSizes[0]); ++i)
+    {
+        VertexCacheStats a = simulateVertexCache(before, beforeVertices, CacheSizes[i]);
+        VertexCacheStats b = simulateVertexCache(after.indices, after.vertices.size(), CacheSizes[i]);
+        std::printf("%5u   %11.3f  %5.3f    %11.3f  %5.3f\n", CacheSizes[i], a.acmr, b.acmr, a.atvr, b.atvr);
+    }
+}
+
+/**************************************************************
+ * printQuantizationReport()
+ * ------------------------
+ * Bytes per vertex and largest decode error for each
+ * normal encoding.
+ *************************************************************/
+void printQuantizationReport(const Mesh& mesh)
+{
+    static const char* Names[] = { "octahedral", "10:10:10:2", "qtangent" };
+
+    std::printf("encoding     bytes        position   normal(deg) tangent(deg) uv\n");
+    for(int i = 0; i < 3; ++i)
+    {
+        QuantizedMesh quantized;
+        QuantizationReport report;
+        quantizeMesh(mesh, (NormalEncoding)i, quantized, &report);
+        std::printf("%-10s   %2u -> %2u %3.1fx  %-9.3g  %6.4f    %6.4f    %.3g\n", Names[i],
+                    (unsigned)report.floatBytes, (unsigned)report.packedBytes, report.ratio,
+                    report.maxPositionError, report.maxNormalError, report.maxTangentError, report.maxUVError);
+    }
+}
+
+/**************************************************************
+ * printMeshletReport()
+ * -------------------
+ * Builds 64 vertex / 124 triangle meshlets and culls them
+ * from eight cameras around the mesh at two distances, on a
+ * 1920x1080 viewport, reporting the share of triangles still
+ * submitted.
+ *************************************************************/
+void printMeshletReport(const Mesh& mesh)
+{
+    MeshletMesh meshlets;
+    buildMeshlets(mesh, 64, 124, meshlets);
+
+    size_t vertices = 0;
+    for(size_t i = 0; i < meshlets.meshlets.size(); ++i)
+        vertices += meshlets.meshlets[i].vertexCount;
+    std::printf("%u meshlets, %.1f vertices and %.1f triangles on average\n", (unsigned)meshlets.meshlets.size(),
+                (double)vertices / meshlets.meshlets.size(), (double)mesh.indices.size() / 3 / meshlets.meshlets.size());
+
+    glm::vec3 center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+    float radius = glm::length(mesh.boundsMax - mesh.boundsMin) * 0.5f;
+    static const float Distances[] = { 2.0f, 50.0f };
+
+    MeshletCullSettings settings;
+    settings.model = glm::mat4(1.0f);
+    settings.viewportSize = glm::vec2(1920.0f, 1080.0f);
+    settings.frustum = settings.backface = settings.smallPrimitives = true;
+    settings.projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, radius * 0.01f, radius * 200.0f);
+
+    std::printf("distance   submitted  frustum  backface  small  ranges\n");
+    for(int d = 0; d < 2; ++d)
+    {
+        MeshletCullStats total = MeshletCullStats();
+        for(int view = 0; view < 8; ++view)
+        {
+            float angle = view * glm::radians(45.0f);
+            glm::vec3 eye = center + glm::vec3(std::cos(angle), 0.3f, std::sin(angle)) * radius * Distances[d];
+            settings.view = glm::lookAt(eye, center, glm::vec3(0.0f, 1.0f, 0.0f));
+
+            std::vector<IndexRange> ranges;
+            MeshletCullStats stats;
+            cullMeshlets(meshlets, settings, ranges, &stats);
+            total.trianglesTotal += stats.trianglesTotal;
+            total.trianglesSubmitted += stats.trianglesSubmitted;
+            total.frustumCulled += stats.frustumCulled;
+            total.backfaceCulled += stats.backfaceCulled;
+            total.smallCulled += stats.smallCulled;
+            total.ranges += stats.ranges;
+        }
+        std::printf("%5.0fr     %8.1f%%  %7u  %8u  %5u  %6u\n", Distances[d],
+                    100.0 * total.trianglesSubmitted / total.trianglesTotal, (unsigned)total.frustumCulled / 8,
+                    (unsigned)total.backfaceCulled / 8, (unsigned)total.smallCulled / 8, (unsigned)total.ranges / 8);
+    }
+}
+
+/**************************************************************
+ * printLodReport()
+ * ---------------
+ * Builds up to eight LODs halving the triangle count each
+ * time, then picks one at growing distances for a 60 degree,
+ * 1080 pixel high view with one pixel of allowed error.
+ *************************************************************/
+void printLodReport(const Mesh& mesh)
+{
+    LodChain chain;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    buildLodChain(mesh, 8, 0.5f, chain);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("lod  triangles  error (built in %.3fs)\n", seconds);
+    for(size_t i = 0; i < chain.lods.size(); ++i)
+        std::printf("%3u  %9u  %g\n", (unsigned)i, chain.lods[i].indexCount / 3, chain.lods[i].error);
+
+    float radius = glm::length(mesh.boundsMax - mesh.boundsMin) * 0.5f;
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+    std::printf("distance  lod  triangles\n");
+    for(float distance = 2.0f; distance <= 256.0f; distance *= 2.0f)
+    {
+        size_t lod = selectLod(chain, 1.0f, distance * radius, projection, 1080.0f, 1.0f);
+        std::printf("%7.0fr  %3u  %9u\n", distance, (unsigned)lod, chain.lods[lod].indexCount / 3);
+    }
+}
+
+/**************************************************************
+ * saveObj()
+ * --------
+ * Writes positions, normals and uvs with shared indices.
+ *************************************************************/
+bool saveObj(const std::string& path, const Mesh& mesh)
+{
+    std::ofstream file(path.c_str());
+    if(!file)
+        return false;
+
+    for(size_t i = 0; i < mesh.vertices.size(); ++i)
+    {
+        const MeshVertex& v = mesh.vertices[i];
+        file << "v " << v.position.x << " " << v.position.y << " " << v.position.z << "\n"
+             << "vn " << v.normal.x << " " << v.normal.y << " " << v.normal.z << "\n"
+             << "vt " << v.uv.x << " " << v.uv.y << "\n";
+    }
+    for(size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        file << "f";
+        for(int c = 0; c < 3; ++c)
+        {
+            uint32_t index = mesh.indices[i + c] + 1;
+            file << " " << index << "/" << index << "/" << index;
+        }
+        file << "\n";
+    }
+    return file.good();
+}